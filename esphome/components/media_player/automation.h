@@ -34,7 +34,15 @@ MEDIA_PLAYER_SIMPLE_COMMAND_ACTION(VolumeDownAction, VOLUME_DOWN)
 
 template<typename... Ts> class PlayMediaAction : public Action<Ts...>, public Parented<MediaPlayer> {
   TEMPLATABLE_VALUE(std::string, media_url)
-  void play(Ts... x) override { this->parent_->make_call().set_media_url(this->media_url_.value(x...)).perform(); }
+  TEMPLATABLE_VALUE(bool, enqueue)
+  void play(Ts... x) override {
+    auto call = this->parent_->make_call();
+    call.set_media_url(this->media_url_.value(x...));
+    if (this->enqueue_.value(x...)) {
+      call.set_command(MEDIA_PLAYER_COMMAND_ENQUEUE);
+    }
+    call.perform();
+  }
 };
 
 template<typename... Ts> class VolumeSetAction : public Action<Ts...>, public Parented<MediaPlayer> {
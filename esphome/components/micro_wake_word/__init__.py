@@ -51,6 +51,14 @@ CONF_SLIDING_WINDOW_AVERAGE_SIZE = "sliding_window_average_size"
 CONF_SLIDING_WINDOW_SIZE = "sliding_window_size"
 CONF_TENSOR_ARENA_SIZE = "tensor_arena_size"
 CONF_VAD = "vad"
+CONF_PREPROCESSOR_TASK = "preprocessor_task"
+CONF_INFERENCE_TASK = "inference_task"
+CONF_CORE = "core"
+CONF_PRIORITY = "priority"
+
+CORE_ANY = "any"
+# Chips with a second core; elsewhere every task runs on the only core
+DUAL_CORE_VARIANTS = [esp32.const.VARIANT_ESP32, esp32.const.VARIANT_ESP32S3]
 
 TYPE_HTTP = "http"
 
@@ -358,6 +366,25 @@ def _maybe_empty_vad_schema(value):
     return VAD_MODEL_SCHEMA(value)
 
 
+def _task_schema(core, priority):
+    return cv.Schema(
+        {
+            cv.Optional(CONF_CORE, default=core): cv.Any(
+                cv.one_of(CORE_ANY, lower=True), cv.int_range(min=0, max=1)
+            ),
+            cv.Optional(CONF_PRIORITY, default=priority): cv.int_range(min=1, max=24),
+        }
+    )
+
+
+def _task_core(task_config):
+    core = task_config[CONF_CORE]
+    if core == CORE_ANY or esp32.get_esp32_variant() not in DUAL_CORE_VARIANTS:
+        return cg.RawExpression("tskNO_AFFINITY")
+    return core
+
+
+# By default both tasks share core 1 with the microphone, away from Wi-Fi and audio decoding on core 0
 CONFIG_SCHEMA = cv.All(
     cv.Schema(
         {
@@ -370,6 +397,8 @@ CONFIG_SCHEMA = cv.All(
                 single=True
             ),
             cv.Optional(CONF_VAD): _maybe_empty_vad_schema,
+            cv.Optional(CONF_PREPROCESSOR_TASK, default={}): _task_schema(1, 3),
+            cv.Optional(CONF_INFERENCE_TASK, default={}): _task_schema(1, 3),
             cv.Optional(CONF_MODEL): cv.invalid(
                 f"The {CONF_MODEL} parameter has moved to be a list element under the {CONF_MODELS} parameter."
             ),
@@ -448,6 +477,20 @@ async def to_code(config):
     mic = await cg.get_variable(config[CONF_MICROPHONE])
     cg.add(var.set_microphone(mic))
 
+    preprocessor_task_config = config[CONF_PREPROCESSOR_TASK]
+    cg.add(
+        var.set_preprocessor_task(
+            preprocessor_task_config[CONF_PRIORITY],
+            _task_core(preprocessor_task_config),
+        )
+    )
+    inference_task_config = config[CONF_INFERENCE_TASK]
+    cg.add(
+        var.set_inference_task(
+            inference_task_config[CONF_PRIORITY], _task_core(inference_task_config)
+        )
+    )
+
     cg.add_define("USE_MICRO_WAKE_WORD")
     cg.add_define("USE_OTA_STATE_CALLBACK")
 
@@ -36,9 +36,6 @@ static const size_t STOPPING_TIMEOUT_MS = 200;
 static const uint32_t PREPROCESSOR_TASK_STACK_SIZE = 3072;
 static const uint32_t INFERENCE_TASK_STACK_SIZE = 3072;
 
-static const UBaseType_t PREPROCESSOR_TASK_PRIORITY = 3;
-static const UBaseType_t INFERENCE_TASK_PRIORITY = 3;
-
 enum EventGroupBits : uint32_t {
   COMMAND_STOP = (1 << 0),  // Stops all activity in the mWW tasks
 
@@ -379,15 +376,17 @@ void MicroWakeWord::start() {
   ESP_LOGD(TAG, "Starting wake word detection");
 
   if (this->preprocessor_task_handle_ == nullptr) {
-    this->preprocessor_task_handle_ = xTaskCreateStatic(
+    this->preprocessor_task_handle_ = xTaskCreateStaticPinnedToCore(
         MicroWakeWord::preprocessor_task_, "preprocessor", PREPROCESSOR_TASK_STACK_SIZE, (void *) this,
-        PREPROCESSOR_TASK_PRIORITY, this->preprocessor_task_stack_buffer_, &this->preprocessor_task_stack_);
+        this->preprocessor_task_priority_, this->preprocessor_task_stack_buffer_, &this->preprocessor_task_stack_,
+        this->preprocessor_task_core_);
   }
 
   if (this->inference_task_handle_ == nullptr) {
-    this->inference_task_handle_ =
-        xTaskCreateStatic(MicroWakeWord::inference_task_, "inference", INFERENCE_TASK_STACK_SIZE, (void *) this,
-                          INFERENCE_TASK_PRIORITY, this->inference_task_stack_buffer_, &this->inference_task_stack_);
+    this->inference_task_handle_ = xTaskCreateStaticPinnedToCore(
+        MicroWakeWord::inference_task_, "inference", INFERENCE_TASK_STACK_SIZE, (void *) this,
+        this->inference_task_priority_, this->inference_task_stack_buffer_, &this->inference_task_stack_,
+        this->inference_task_core_);
   }
 
   xEventGroupSetBits(this->event_group_, PREPROCESSOR_COMMAND_START);
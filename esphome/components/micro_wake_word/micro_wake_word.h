@@ -41,6 +41,21 @@ class MicroWakeWord : public Component {
 
   void set_microphone(microphone::Microphone *microphone) { this->microphone_ = microphone; }
 
+  /// @brief Sets where the preprocessor task runs
+  /// @param priority FreeRTOS task priority
+  /// @param core core to pin the task to, or tskNO_AFFINITY
+  void set_preprocessor_task(UBaseType_t priority, BaseType_t core) {
+    this->preprocessor_task_priority_ = priority;
+    this->preprocessor_task_core_ = core;
+  }
+  /// @brief Sets where the inference task runs
+  /// @param priority FreeRTOS task priority
+  /// @param core core to pin the task to, or tskNO_AFFINITY
+  void set_inference_task(UBaseType_t priority, BaseType_t core) {
+    this->inference_task_priority_ = priority;
+    this->inference_task_core_ = core;
+  }
+
   Trigger<std::string> *get_wake_word_detected_trigger() const { return this->wake_word_detected_trigger_; }
 
   void add_wake_word_model(WakeWordModel *model);
@@ -108,11 +123,15 @@ class MicroWakeWord : public Component {
   TaskHandle_t preprocessor_task_handle_{nullptr};
   StaticTask_t preprocessor_task_stack_;
   StackType_t *preprocessor_task_stack_buffer_{nullptr};
+  UBaseType_t preprocessor_task_priority_{3};
+  BaseType_t preprocessor_task_core_{tskNO_AFFINITY};
 
   static void inference_task_(void *params);
   TaskHandle_t inference_task_handle_{nullptr};
   StaticTask_t inference_task_stack_;
   StackType_t *inference_task_stack_buffer_{nullptr};
+  UBaseType_t inference_task_priority_{3};
+  BaseType_t inference_task_core_{tskNO_AFFINITY};
 };
 
 template<typename... Ts> class StartAction : public Action<Ts...>, public Parented<MicroWakeWord> {
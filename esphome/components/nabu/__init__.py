@@ -0,0 +1,30 @@
+import esphome.codegen as cg
+from esphome.components import esp32
+import esphome.config_validation as cv
+
+CONF_CORE = "core"
+CONF_PRIORITY = "priority"
+
+CORE_ANY = "any"
+# Chips with a second core; elsewhere every task runs on the only core
+DUAL_CORE_VARIANTS = [esp32.const.VARIANT_ESP32, esp32.const.VARIANT_ESP32S3]
+
+
+def task_schema(core, priority):
+    """Schema of a task's ``core`` (0, 1, or any) and ``priority``, with defaults."""
+    return cv.Schema(
+        {
+            cv.Optional(CONF_CORE, default=core): cv.Any(
+                cv.one_of(CORE_ANY, lower=True), cv.int_range(min=0, max=1)
+            ),
+            cv.Optional(CONF_PRIORITY, default=priority): cv.int_range(min=1, max=24),
+        }
+    )
+
+
+def task_core(task_config):
+    """The core to pin a task to; tskNO_AFFINITY for any core or single core chips."""
+    core = task_config[CONF_CORE]
+    if core == CORE_ANY or esp32.get_esp32_variant() not in DUAL_CORE_VARIANTS:
+        return cg.RawExpression("tskNO_AFFINITY")
+    return core
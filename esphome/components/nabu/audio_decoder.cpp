@@ -4,26 +4,199 @@
 
 #include "mp3_decoder.h"
 
-#include "esphome/core/ring_buffer.h"
+#include "esphome/core/helpers.h"
+
+#include <strings.h>
+
+#include <cstdlib>
+#include <cstring>
 
 namespace esphome {
 namespace nabu {
 
 static const size_t READ_WRITE_TIMEOUT_MS = 20;
 
-AudioDecoder::AudioDecoder(RingBuffer *input_ring_buffer, RingBuffer *output_ring_buffer, size_t internal_buffer_size) {
+// Minimum contiguous input peeked from the ring buffer for MP3 and WAV files; fits the largest MP3 frame (1441 bytes)
+static const size_t MIN_INPUT_BYTES = 2048;
+
+static const size_t MP3_HEADER_BYTES = 4;
+// Largest MP3 frame output: 1152 samples per channel, 2 channels
+static const size_t MP3_MAX_OUTPUT_BYTES = 1152 * 2 * sizeof(int16_t);
+// FLAC streams don't state their bitrate; typical music compresses to about this share of the PCM bitrate
+static const uint32_t FLAC_ESTIMATED_COMPRESSION_PERCENT = 60;
+// Avoids many tiny copies when the output ring buffer is nearly full
+static const size_t WAV_MIN_OUTPUT_BYTES = 1024;
+
+// Loudness that ReplayGain and R128 track gains bring a track to
+static const float REPLAYGAIN_REFERENCE_LUFS = -18.0f;
+static const float R128_REFERENCE_LUFS = -23.0f;
+
+static const uint8_t FLAC_VORBIS_COMMENT_BLOCK = 4;
+static const size_t FLAC_BLOCK_HEADER_BYTES = 4;
+static const size_t ID3_HEADER_BYTES = 10;
+static const size_t ID3_FRAME_HEADER_BYTES = 10;
+
+static uint32_t read_le32(const uint8_t *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static uint32_t read_be32(const uint8_t *data) {
+  return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+// ID3v2 sizes have 7 bits per byte, so they never contain a false MP3 sync word
+static uint32_t read_syncsafe32(const uint8_t *data) {
+  return ((data[0] & 0x7F) << 21) | ((data[1] & 0x7F) << 14) | ((data[2] & 0x7F) << 7) | (data[3] & 0x7F);
+}
+
+static bool key_equals(const char *key, size_t key_length, const char *name) {
+  return (key_length == std::strlen(name)) && (strncasecmp(key, name, key_length) == 0);
+}
+
+// Converts a track gain tag to the loudness it implies. ReplayGain values are in dB, like "-7.25 dB"; R128 values are
+// Q7.8 fixed point integers.
+static optional<float> parse_loudness_tag(const char *key, size_t key_length, const char *value, size_t value_length) {
+  bool replaygain = key_equals(key, key_length, "REPLAYGAIN_TRACK_GAIN");
+  if (!replaygain && !key_equals(key, key_length, "R128_TRACK_GAIN")) {
+    return {};
+  }
+
+  char text[16];
+  size_t text_length = std::min(value_length, sizeof(text) - 1);
+  std::memcpy(text, value, text_length);
+  text[text_length] = '\0';
+
+  char *end = nullptr;
+  float gain = strtof(text, &end);
+  if (end == text) {
+    return {};
+  }
+
+  if (replaygain) {
+    return REPLAYGAIN_REFERENCE_LUFS - gain;
+  }
+  return R128_REFERENCE_LUFS - gain / 256.0f;
+}
+
+// Looks for a loudness tag in the KEY=value comments of a FLAC VORBIS_COMMENT block
+static optional<float> find_vorbis_comment_loudness(const uint8_t *data, size_t length) {
+  if ((length < 4) || (read_le32(data) > length - 8)) {
+    return {};
+  }
+
+  // Skip the vendor string
+  size_t position = 4 + read_le32(data);
+  uint32_t comment_count = read_le32(data + position);
+  position += 4;
+
+  for (uint32_t i = 0; (i < comment_count) && (position + 4 <= length); ++i) {
+    size_t comment_length = read_le32(data + position);
+    position += 4;
+    if (comment_length > length - position) {
+      break;
+    }
+
+    const char *comment = reinterpret_cast<const char *>(data + position);
+    const char *separator = static_cast<const char *>(std::memchr(comment, '=', comment_length));
+    if (separator != nullptr) {
+      optional<float> loudness =
+          parse_loudness_tag(comment, separator - comment, separator + 1, comment + comment_length - separator - 1);
+      if (loudness.has_value()) {
+        return loudness;
+      }
+    }
+
+    position += comment_length;
+  }
+
+  return {};
+}
+
+// Looks for a loudness tag in the metadata blocks that start a FLAC file
+static optional<float> find_flac_track_loudness(const uint8_t *data, size_t length) {
+  if ((length < 4) || (std::memcmp(data, "fLaC", 4) != 0)) {
+    return {};
+  }
+
+  size_t position = 4;
+  while (position + FLAC_BLOCK_HEADER_BYTES <= length) {
+    bool last_block = data[position] & 0x80;
+    uint8_t block_type = data[position] & 0x7F;
+    size_t block_length = (data[position + 1] << 16) | (data[position + 2] << 8) | data[position + 3];
+    position += FLAC_BLOCK_HEADER_BYTES;
+
+    if (block_length > length - position) {
+      break;
+    }
+    if (block_type == FLAC_VORBIS_COMMENT_BLOCK) {
+      return find_vorbis_comment_loudness(data + position, block_length);
+    }
+    if (last_block) {
+      break;
+    }
+
+    position += block_length;
+  }
+
+  return {};
+}
+
+// Looks for a loudness tag in the TXXX frames of an ID3v2.3 or ID3v2.4 tag, as far as it is in the data
+static optional<float> find_id3_track_loudness(const uint8_t *data, size_t length) {
+  uint8_t version = data[3];
+  uint8_t flags = data[5];
+  if (((version != 3) && (version != 4)) || (flags & 0xC0)) {
+    // Unsynchronised tags and extended headers aren't worth supporting for this
+    return {};
+  }
+
+  length = std::min<size_t>(length, ID3_HEADER_BYTES + read_syncsafe32(data + 6));
+
+  size_t position = ID3_HEADER_BYTES;
+  // Frame IDs never start with a zero byte, so one marks the padding after the last frame
+  while ((position + ID3_FRAME_HEADER_BYTES <= length) && (data[position] != 0)) {
+    const uint8_t *frame = data + position;
+    size_t frame_length = (version == 4) ? read_syncsafe32(frame + 4) : read_be32(frame + 4);
+    position += ID3_FRAME_HEADER_BYTES;
+
+    if (frame_length > length - position) {
+      break;
+    }
+
+    // A TXXX frame is a text encoding byte, a description, a null, and the value. Only single byte encodings
+    // (ISO-8859-1 and UTF-8) are searched.
+    const uint8_t encoding = frame[ID3_FRAME_HEADER_BYTES];
+    if ((std::memcmp(frame, "TXXX", 4) == 0) && (frame_length > 1) && ((encoding == 0) || (encoding == 3))) {
+      const char *text = reinterpret_cast<const char *>(frame + ID3_FRAME_HEADER_BYTES + 1);
+      size_t text_length = frame_length - 1;
+      const char *separator = static_cast<const char *>(std::memchr(text, '\0', text_length));
+      if (separator != nullptr) {
+        optional<float> loudness =
+            parse_loudness_tag(text, separator - text, separator + 1, text + text_length - separator - 1);
+        if (loudness.has_value()) {
+          return loudness;
+        }
+      }
+    }
+
+    position += frame_length;
+  }
+
+  return {};
+}
+
+AudioDecoder::AudioDecoder(AudioRingBuffer *input_ring_buffer, AudioRingBuffer *output_ring_buffer,
+                           size_t internal_buffer_size) {
   this->input_ring_buffer_ = input_ring_buffer;
   this->output_ring_buffer_ = output_ring_buffer;
   this->internal_buffer_size_ = internal_buffer_size;
+  this->ticks_to_wait_ = pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS);
 }
 
 AudioDecoder::~AudioDecoder() {
   ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
-  if (this->input_buffer_ != nullptr) {
-    allocator.deallocate(this->input_buffer_, this->internal_buffer_size_);
-  }
-  if (this->output_buffer_ != nullptr) {
-    allocator.deallocate(this->output_buffer_, this->internal_buffer_size_);
+  if (this->flac_input_buffer_ != nullptr) {
+    allocator.deallocate(this->flac_input_buffer_, this->internal_buffer_size_);
   }
 
   if (this->flac_decoder_ != nullptr) {
@@ -43,25 +216,29 @@ AudioDecoder::~AudioDecoder() {
 }
 
 esp_err_t AudioDecoder::start(media_player::MediaFileType media_file_type) {
+  this->media_file_type_ = media_file_type;
+
   esp_err_t err = this->allocate_buffers_();
 
   if (err != ESP_OK) {
     return err;
   }
 
-  this->media_file_type_ = media_file_type;
-
+  this->input_buffer_ = this->flac_input_buffer_;
   this->input_buffer_current_ = this->input_buffer_;
   this->input_buffer_length_ = 0;
-  this->output_buffer_current_ = this->output_buffer_;
   this->output_buffer_length_ = 0;
 
   this->potentially_failed_count_ = 0;
   this->end_of_file_ = false;
+  this->first_output_pending_ = true;
+
+  this->track_loudness_.reset();
+  this->id3_tag_checked_ = false;
 
   switch (this->media_file_type_) {
     case media_player::MediaFileType::FLAC:
-      this->flac_decoder_ = make_unique<flac::FLACDecoder>(this->input_buffer_);
+      this->flac_decoder_ = make_unique<flac::FLACDecoder>(this->flac_input_buffer_);
       break;
     case media_player::MediaFileType::MP3:
       this->mp3_decoder_ = MP3InitDecoder();
@@ -79,16 +256,16 @@ esp_err_t AudioDecoder::start(media_player::MediaFileType media_file_type) {
 }
 
 AudioDecoderState AudioDecoder::decode(bool stop_gracefully) {
+  this->bytes_moved_ = 0;
+
   if (stop_gracefully) {
-    if (this->output_buffer_length_ == 0) {
-      // If the file decoder believes it the end of file
-      if (this->end_of_file_) {
-        return AudioDecoderState::FINISHED;
-      }
-      // If all the internal buffers are empty, the decoding is done
-      if ((this->input_ring_buffer_->available() == 0) && (this->input_buffer_length_ == 0)) {
-        return AudioDecoderState::FINISHED;
-      }
+    // If the file decoder believes it the end of file
+    if (this->end_of_file_) {
+      return AudioDecoderState::FINISHED;
+    }
+    // If all the internal buffers are empty, the decoding is done
+    if ((this->input_ring_buffer_->available() == 0) && (this->input_buffer_length_ == 0)) {
+      return AudioDecoderState::FINISHED;
     }
   }
 
@@ -99,69 +276,52 @@ AudioDecoderState AudioDecoder::decode(bool stop_gracefully) {
   FileDecoderState state = FileDecoderState::MORE_TO_PROCESS;
 
   while (state == FileDecoderState::MORE_TO_PROCESS) {
-    if (this->output_buffer_length_ > 0) {
-      // Have decoded data, write it to the output ring buffer
-
-      size_t bytes_to_write = this->output_buffer_length_;
-
-      if (bytes_to_write > 0) {
-        size_t bytes_written = this->output_ring_buffer_->write_without_replacement(
-            (void *) this->output_buffer_current_, bytes_to_write, pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
+    // Reserve room for a whole decoded frame before consuming any input, so the file decoders write in place
+    size_t output_bytes_needed = this->output_bytes_needed_();
+    this->output_buffer_size_ =
+        this->output_ring_buffer_->reserve(&this->output_buffer_, output_bytes_needed, this->ticks_to_wait_);
+    if (this->output_buffer_size_ < output_bytes_needed) {
+      // Output ring buffer doesn't have room yet
+      return AudioDecoderState::DECODING;
+    }
 
-        this->output_buffer_length_ -= bytes_written;
-        this->output_buffer_current_ += bytes_written;
-      }
+    bool input_full = false;
+    size_t bytes_read = this->refill_input_(input_full);
 
-      if (this->output_buffer_length_ > 0) {
-        // Output buffer still has decoded audio to write
-        return AudioDecoderState::DECODING;
+    if ((this->input_buffer_length_ == 0) || ((this->potentially_failed_count_ > 0) && (bytes_read == 0))) {
+      if ((this->input_buffer_length_ && stop_gracefully) || input_full) {
+        // data in buffer won't change, don't try again
+        state = FileDecoderState::FAILED;
+      } else {
+        state = FileDecoderState::IDLE;
       }
     } else {
-      // Decode more data
-
-      // Shift unread data in input buffer to start
-      if (this->input_buffer_length_ > 0) {
-        memmove(this->input_buffer_, this->input_buffer_current_, this->input_buffer_length_);
+      switch (this->media_file_type_) {
+        case media_player::MediaFileType::FLAC:
+          state = this->decode_flac_();
+          break;
+        case media_player::MediaFileType::MP3:
+          state = this->decode_mp3_();
+          break;
+        case media_player::MediaFileType::WAV:
+          state = this->decode_wav_();
+          break;
+        case media_player::MediaFileType::NONE:
+          state = FileDecoderState::IDLE;
+          break;
       }
-      this->input_buffer_current_ = this->input_buffer_;
-
-      // read in new ring buffer data to fill the remaining input buffer
-      size_t bytes_read = 0;
-
-      size_t bytes_to_read = this->internal_buffer_size_ - this->input_buffer_length_;
-
-      if (bytes_to_read > 0) {
-        uint8_t *new_audio_data = this->input_buffer_ + this->input_buffer_length_;
-        bytes_read = this->input_ring_buffer_->read((void *) new_audio_data, bytes_to_read,
-                                                    pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
+    }
 
-        this->input_buffer_length_ += bytes_read;
-      }
+    this->release_input_();
 
-      if ((this->input_buffer_length_ == 0) || ((this->potentially_failed_count_ > 0) && (bytes_read == 0))) {
-        if ((this->input_buffer_length_ && stop_gracefully) || bytes_to_read == 0) {
-          // data in buffer won't change, don't try again
-          state = FileDecoderState::FAILED;
-        } else {
-          state = FileDecoderState::IDLE;
-        }
-      } else {
-        switch (this->media_file_type_) {
-          case media_player::MediaFileType::FLAC:
-            state = this->decode_flac_();
-            break;
-          case media_player::MediaFileType::MP3:
-            state = this->decode_mp3_();
-            break;
-          case media_player::MediaFileType::WAV:
-            state = this->decode_wav_();
-            break;
-          case media_player::MediaFileType::NONE:
-            state = FileDecoderState::IDLE;
-            break;
-        }
-      }
+    // Make the audio the file decoder wrote into the reserved region available to the next stage
+    this->output_ring_buffer_->commit(this->output_buffer_length_);
+    this->bytes_moved_ += this->output_buffer_length_;
+    if (this->output_buffer_length_ > 0) {
+      this->first_output_pending_ = false;
     }
+    this->output_buffer_length_ = 0;
+
     if (state == FileDecoderState::POTENTIALLY_FAILED) {
       ++this->potentially_failed_count_;
     } else if (state == FileDecoderState::END_OF_FILE) {
@@ -175,22 +335,148 @@ AudioDecoderState AudioDecoder::decode(bool stop_gracefully) {
   return AudioDecoderState::DECODING;
 }
 
+uint32_t AudioDecoder::get_bitrate() const {
+  if (!this->audio_stream_info_.has_value()) {
+    return 0;
+  }
+
+  const audio::AudioStreamInfo &stream_info = this->audio_stream_info_.value();
+  uint32_t pcm_bitrate = stream_info.sample_rate * stream_info.channels * stream_info.bits_per_sample;
+
+  switch (this->media_file_type_) {
+    case media_player::MediaFileType::FLAC:
+      return pcm_bitrate / 100 * FLAC_ESTIMATED_COMPRESSION_PERCENT;
+    case media_player::MediaFileType::MP3:
+      return this->mp3_bitrate_;
+    case media_player::MediaFileType::WAV:
+      return pcm_bitrate;
+    default:
+      return 0;
+  }
+}
+
+size_t AudioDecoder::resync(size_t byte_offset) {
+  // Drop any pointers into the reset input ring buffer and anything staged from it
+  this->input_buffer_ = this->flac_input_buffer_;
+  this->input_buffer_current_ = this->input_buffer_;
+  this->input_buffer_length_ = 0;
+
+  this->potentially_failed_count_ = 0;
+  this->end_of_file_ = false;
+
+  if (this->media_file_type_ == media_player::MediaFileType::MP3) {
+    // Every MP3 frame has its own header
+    this->resyncing_ = true;
+    return byte_offset;
+  }
+
+  if (!this->audio_stream_info_.has_value()) {
+    // The header hasn't been read yet, so read the file from the start again
+    if (this->wav_decoder_ != nullptr) {
+      this->wav_decoder_->reset();
+    }
+    return 0;
+  }
+
+  if (this->media_file_type_ == media_player::MediaFileType::WAV) {
+    const audio::AudioStreamInfo &stream_info = this->audio_stream_info_.value();
+    size_t frame_bytes = stream_info.channels * (stream_info.bits_per_sample / 8);
+
+    size_t data_offset = 0;
+    if (byte_offset > this->wav_data_start_) {
+      data_offset = std::min(byte_offset - this->wav_data_start_, this->wav_data_size_);
+      data_offset -= data_offset % frame_bytes;
+    }
+    this->wav_bytes_left_ = this->wav_data_size_ - data_offset;
+
+    return this->wav_data_start_ + data_offset;
+  }
+
+  this->resyncing_ = true;
+  return byte_offset;
+}
+
 esp_err_t AudioDecoder::allocate_buffers_() {
-  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  if (this->media_file_type_ != media_player::MediaFileType::FLAC) {
+    // Other file types are decoded directly from the input ring buffer
+    return ESP_OK;
+  }
 
-  if (this->input_buffer_ == nullptr)
-    this->input_buffer_ = allocator.allocate(this->internal_buffer_size_);
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
 
-  if (this->output_buffer_ == nullptr)
-    this->output_buffer_ = allocator.allocate(this->internal_buffer_size_);
+  if (this->flac_input_buffer_ == nullptr)
+    this->flac_input_buffer_ = allocator.allocate(this->internal_buffer_size_);
 
-  if ((this->input_buffer_ == nullptr) || (this->output_buffer_ == nullptr)) {
+  if (this->flac_input_buffer_ == nullptr) {
     return ESP_ERR_NO_MEM;
   }
 
   return ESP_OK;
 }
 
+size_t AudioDecoder::refill_input_(bool &input_full) {
+  size_t previous_length = this->input_buffer_length_;
+
+  if (this->flac_input_buffer_ != nullptr) {
+    // Shift unread data in the staging buffer to start
+    if (this->input_buffer_length_ > 0) {
+      memmove(this->flac_input_buffer_, this->input_buffer_current_, this->input_buffer_length_);
+    }
+    this->input_buffer_ = this->flac_input_buffer_;
+    this->input_buffer_current_ = this->input_buffer_;
+
+    // read in new ring buffer data to fill the remaining staging buffer
+    size_t bytes_to_read = this->internal_buffer_size_ - this->input_buffer_length_;
+    input_full = (bytes_to_read == 0);
+
+    if (bytes_to_read > 0) {
+      uint8_t *new_audio_data = this->input_buffer_ + this->input_buffer_length_;
+      size_t bytes_read = this->input_ring_buffer_->read((void *) new_audio_data, bytes_to_read, this->ticks_to_wait_);
+      this->input_buffer_length_ += bytes_read;
+      this->bytes_moved_ += bytes_read;
+    }
+  } else {
+    size_t min_input_bytes = MIN_INPUT_BYTES;
+    if (this->low_latency_start_ && this->first_output_pending_) {
+      // Only wait for one more byte than last time, so the first frame is decoded as soon as all of it is there
+      min_input_bytes = std::min(previous_length + 1, MIN_INPUT_BYTES);
+    }
+
+    // The window starts at the unconsumed data, so it only ever grows between calls
+    this->input_buffer_length_ =
+        this->input_ring_buffer_->peek(&this->input_buffer_, min_input_bytes, this->ticks_to_wait_);
+    this->input_buffer_current_ = this->input_buffer_;
+    input_full = (this->input_ring_buffer_->free() == 0);
+  }
+
+  return this->input_buffer_length_ - previous_length;
+}
+
+void AudioDecoder::release_input_() {
+  if (this->flac_input_buffer_ == nullptr) {
+    size_t bytes_consumed = this->input_buffer_current_ - this->input_buffer_;
+    this->input_ring_buffer_->release(bytes_consumed);
+    this->bytes_moved_ += bytes_consumed;
+    this->input_buffer_ = this->input_buffer_current_;
+  }
+}
+
+size_t AudioDecoder::output_bytes_needed_() {
+  switch (this->media_file_type_) {
+    case media_player::MediaFileType::FLAC:
+      if (this->audio_stream_info_.has_value()) {
+        return this->flac_decoder_->get_output_buffer_size() * sizeof(int16_t);
+      }
+      return 0;  // Reading the header doesn't output any audio
+    case media_player::MediaFileType::MP3:
+      return MP3_MAX_OUTPUT_BYTES;
+    case media_player::MediaFileType::WAV:
+      return WAV_MIN_OUTPUT_BYTES;
+    default:
+      return 0;
+  }
+}
+
 FileDecoderState AudioDecoder::decode_flac_() {
   if (!this->audio_stream_info_.has_value()) {
     // Header hasn't been read
@@ -206,12 +492,13 @@ FileDecoderState AudioDecoder::decode_flac_() {
     }
 
     size_t bytes_consumed = this->flac_decoder_->get_bytes_index();
+    this->track_loudness_ = find_flac_track_loudness(this->input_buffer_current_, bytes_consumed);
     this->input_buffer_current_ += bytes_consumed;
     this->input_buffer_length_ = this->flac_decoder_->get_bytes_left();
 
     size_t flac_decoder_output_buffer_min_size = flac_decoder_->get_output_buffer_size();
-    if (this->internal_buffer_size_ < flac_decoder_output_buffer_min_size * sizeof(int16_t)) {
-      // Output buffer is not big enough
+    if (this->output_ring_buffer_->guard_size() < flac_decoder_output_buffer_min_size * sizeof(int16_t)) {
+      // A decoded frame may not fit contiguously in the output ring buffer
       return FileDecoderState::FAILED;
     }
 
@@ -225,6 +512,26 @@ FileDecoderState AudioDecoder::decode_flac_() {
     return FileDecoderState::MORE_TO_PROCESS;
   }
 
+  if (this->resyncing_) {
+    // Skip to the next frame sync code: 14 set bits, a reserved 0 bit, and the blocking strategy bit
+    size_t offset = 0;
+    while ((offset + 1 < this->input_buffer_length_) && !((this->input_buffer_current_[offset] == 0xFF) &&
+                                                         ((this->input_buffer_current_[offset + 1] & 0xFE) == 0xF8))) {
+      ++offset;
+    }
+    this->input_buffer_current_ += offset;
+    this->input_buffer_length_ -= offset;
+
+    if (this->input_buffer_length_ < 2) {
+      // We may find it once we have more data
+      return FileDecoderState::POTENTIALLY_FAILED;
+    }
+    if (offset > 0) {
+      // The FLAC decoder reads from the start of the staging buffer, so let the candidate frame be shifted there first
+      return FileDecoderState::MORE_TO_PROCESS;
+    }
+  }
+
   uint32_t output_samples = 0;
   auto result =
       this->flac_decoder_->decode_frame(this->input_buffer_length_, (int16_t *) this->output_buffer_, &output_samples);
@@ -232,6 +539,11 @@ FileDecoderState AudioDecoder::decode_flac_() {
   if (result == flac::FLAC_DECODER_ERROR_OUT_OF_DATA) {
     // Not an issue, just needs more data that we'll get next time.
     return FileDecoderState::POTENTIALLY_FAILED;
+  } else if ((result > flac::FLAC_DECODER_ERROR_OUT_OF_DATA) && this->resyncing_) {
+    // The sync code was part of the audio data; look for the next one
+    ++this->input_buffer_current_;
+    --this->input_buffer_length_;
+    return FileDecoderState::MORE_TO_PROCESS;
   } else if (result > flac::FLAC_DECODER_ERROR_OUT_OF_DATA) {
     // Corrupted frame, don't retry with current buffer content, wait for new sync
     size_t bytes_consumed = this->flac_decoder_->get_bytes_index();
@@ -242,11 +554,11 @@ FileDecoderState AudioDecoder::decode_flac_() {
   }
 
   // We have successfully decoded some input data and have new output data
+  this->resyncing_ = false;
   size_t bytes_consumed = this->flac_decoder_->get_bytes_index();
   this->input_buffer_current_ += bytes_consumed;
   this->input_buffer_length_ = this->flac_decoder_->get_bytes_left();
 
-  this->output_buffer_current_ = this->output_buffer_;
   this->output_buffer_length_ = output_samples * sizeof(int16_t);
 
   if (result == flac::FLAC_DECODER_NO_MORE_FRAMES) {
@@ -257,6 +569,21 @@ FileDecoderState AudioDecoder::decode_flac_() {
 }
 
 FileDecoderState AudioDecoder::decode_mp3_() {
+  if (!this->id3_tag_checked_ && (this->input_buffer_length_ >= ID3_HEADER_BYTES)) {
+    // An ID3v2 tag precedes the first frame. Look for a loudness tag in it once all of it or a full input window is
+    // available, or once decoding stalls on it.
+    if (std::memcmp(this->input_buffer_current_, "ID3", 3) != 0) {
+      this->id3_tag_checked_ = true;
+    } else {
+      size_t tag_bytes = ID3_HEADER_BYTES + read_syncsafe32(this->input_buffer_current_ + 6);
+      bool tag_available = this->input_buffer_length_ >= std::min(tag_bytes, MIN_INPUT_BYTES);
+      if (tag_available || (this->potentially_failed_count_ > 0)) {
+        this->track_loudness_ = find_id3_track_loudness(this->input_buffer_current_, this->input_buffer_length_);
+        this->id3_tag_checked_ = true;
+      }
+    }
+  }
+
   // Look for the next sync word
   int32_t offset = MP3FindSyncWord(this->input_buffer_current_, this->input_buffer_length_);
   if (offset < 0) {
@@ -268,6 +595,25 @@ FileDecoderState AudioDecoder::decode_mp3_() {
   this->input_buffer_current_ += offset;
   this->input_buffer_length_ -= offset;
 
+  if (this->resyncing_ && this->audio_stream_info_.has_value()) {
+    // After a seek the sync word may be part of the audio data, so check the header matches the stream first
+    if (this->input_buffer_length_ < MP3_HEADER_BYTES) {
+      return FileDecoderState::POTENTIALLY_FAILED;
+    }
+    MP3FrameInfo next_frame_info;
+    int err = MP3GetNextFrameInfo(this->mp3_decoder_, &next_frame_info, this->input_buffer_current_);
+    if (err || (static_cast<uint32_t>(next_frame_info.samprate) != this->audio_stream_info_.value().sample_rate) ||
+        (next_frame_info.nChans != this->audio_stream_info_.value().channels)) {
+      ++this->input_buffer_current_;
+      --this->input_buffer_length_;
+      return FileDecoderState::MORE_TO_PROCESS;
+    }
+  }
+
+  // MP3Decode advances past the frame header and side info even if the rest of the frame isn't available yet
+  uint8_t *frame_start = this->input_buffer_current_;
+  size_t frame_bytes_left = this->input_buffer_length_;
+
   int err = MP3Decode(this->mp3_decoder_, &this->input_buffer_current_, (int *) &this->input_buffer_length_,
                       (int16_t *) this->output_buffer_, 0);
   if (err) {
@@ -276,17 +622,36 @@ FileDecoderState AudioDecoder::decode_mp3_() {
         // Not a problem. Next call to decode will provide more data.
         return FileDecoderState::POTENTIALLY_FAILED;
         break;
+      case ERR_MP3_INDATA_UNDERFLOW:
+        // The frame continues past the end of the peeked input; retry the whole frame once more data is available
+        this->input_buffer_current_ = frame_start;
+        this->input_buffer_length_ = frame_bytes_left;
+        if (this->low_latency_start_ && this->first_output_pending_) {
+          // Expected while the first frame trickles in, as decoding doesn't wait for a full window of input
+          return FileDecoderState::IDLE;
+        }
+        return FileDecoderState::POTENTIALLY_FAILED;
+        break;
       default:
+        if (this->resyncing_) {
+          // Not a real frame; look for the next sync word
+          this->input_buffer_current_ = frame_start + 1;
+          this->input_buffer_length_ = frame_bytes_left - 1;
+          return FileDecoderState::MORE_TO_PROCESS;
+        }
         return FileDecoderState::FAILED;
         break;
     }
   } else {
+    this->resyncing_ = false;
+
     MP3FrameInfo mp3_frame_info;
     MP3GetLastFrameInfo(this->mp3_decoder_, &mp3_frame_info);
     if (mp3_frame_info.outputSamps > 0) {
+      this->mp3_bitrate_ = mp3_frame_info.bitrate;
+
       int bytes_per_sample = (mp3_frame_info.bitsPerSample / 8);
       this->output_buffer_length_ = mp3_frame_info.outputSamps * bytes_per_sample;
-      this->output_buffer_current_ = this->output_buffer_;
 
       audio::AudioStreamInfo stream_info;
       stream_info.channels = mp3_frame_info.nChans;
@@ -330,6 +695,8 @@ FileDecoderState AudioDecoder::decode_wav_() {
           audio_stream_info.bits_per_sample = this->wav_decoder_->bits_per_sample();
           this->audio_stream_info_ = audio_stream_info;
           this->wav_bytes_left_ = this->wav_decoder_->chunk_bytes_left();
+          this->wav_data_start_ = original_buffer_length - this->input_buffer_length_;
+          this->wav_data_size_ = this->wav_bytes_left_;
           header_finished = true;
         } else if (result == wav_decoder::WAV_DECODER_SUCCESS_NEXT) {
           // Continue parsing header
@@ -351,12 +718,11 @@ FileDecoderState AudioDecoder::decode_wav_() {
 
   if (this->wav_bytes_left_ > 0) {
     size_t bytes_to_write = std::min(this->wav_bytes_left_, this->input_buffer_length_);
-    bytes_to_write = std::min(bytes_to_write, this->internal_buffer_size_);
+    bytes_to_write = std::min(bytes_to_write, this->output_buffer_size_);
     if (bytes_to_write > 0) {
       std::memcpy(this->output_buffer_, this->input_buffer_current_, bytes_to_write);
       this->input_buffer_current_ += bytes_to_write;
       this->input_buffer_length_ -= bytes_to_write;
-      this->output_buffer_current_ = this->output_buffer_;
       this->output_buffer_length_ = bytes_to_write;
       this->wav_bytes_left_ -= bytes_to_write;
     }
@@ -6,11 +6,11 @@
 #include <wav_decoder.h>
 #include <mp3_decoder.h>
 
+#include "audio_ring_buffer.h"
+
 #include "esphome/components/audio/audio.h"
 #include "esphome/components/media_player/media_player.h"
 
-#include "esphome/core/ring_buffer.h"
-
 namespace esphome {
 namespace nabu {
 
@@ -32,47 +32,113 @@ enum class FileDecoderState : uint8_t {
 
 class AudioDecoder {
  public:
-  AudioDecoder(esphome::RingBuffer *input_ring_buffer, esphome::RingBuffer *output_ring_buffer,
-               size_t internal_buffer_size);
+  /// @brief Decodes directly from the input ring buffer's memory into the output ring buffer's memory. FLAC is the
+  /// exception on the input side, as the FLAC decoder is bound to a fixed buffer; it is staged in an internal buffer.
+  /// @param input_ring_buffer ring buffer with the encoded file
+  /// @param output_ring_buffer ring buffer for the decoded PCM audio. Its guard size must fit one decoded frame.
+  /// @param internal_buffer_size size of the FLAC input staging buffer
+  AudioDecoder(AudioRingBuffer *input_ring_buffer, AudioRingBuffer *output_ring_buffer, size_t internal_buffer_size);
   ~AudioDecoder();
 
+  /// @brief Sets how long ring buffer operations wait for data or space. Defaults to 20 ms; the cooperative pipeline
+  /// sets 0 so the stage returns immediately when it can't make progress.
+  void set_ticks_to_wait(TickType_t ticks_to_wait) { this->ticks_to_wait_ = ticks_to_wait; }
+
+  /// @brief Decodes the first frame as soon as its bytes arrive, instead of waiting for a full window of MP3 or WAV
+  /// input. Only applies until the first audio is output.
+  void set_low_latency_start(bool low_latency_start) { this->low_latency_start_ = low_latency_start; }
+
   esp_err_t start(media_player::MediaFileType media_file_type);
 
   AudioDecoderState decode(bool stop_gracefully);
 
+  /// @brief Bytes the last ``decode`` call took from the input ring buffer plus the bytes it committed to the output
+  /// ring buffer. Zero means it made no progress.
+  size_t get_bytes_moved() const { return this->bytes_moved_; }
+
+  /// @brief Prepares the decoder for the reader seeking to a new position. Must only be called after the input ring
+  /// buffer is reset. Keeps the stream information from the header; the next MP3 or FLAC frame is found by scanning
+  /// for its sync code, and WAV positions are aligned to whole frames of the data chunk.
+  /// @param byte_offset requested offset from the start of the file
+  /// @return the offset the reader should seek to
+  size_t resync(size_t byte_offset);
+
   const optional<audio::AudioStreamInfo> &get_audio_stream_info() const { return this->audio_stream_info_; }
 
+  /// @brief Gets the encoded stream's bitrate once the stream information is known. MP3 uses the first frame's
+  /// bitrate, WAV is exact, and FLAC is an estimate based on a typical compression ratio.
+  /// @return bits per second, or 0 if unknown
+  uint32_t get_bitrate() const;
+
+  /// @brief Gets the track's integrated loudness from its ReplayGain or R128 track gain tag. Tags are read from FLAC
+  /// Vorbis comments and MP3 ID3v2 TXXX frames that fit in the first input window. Known once the stream information
+  /// is.
+  /// @return loudness in LUFS, or no value if the file has no such tag
+  const optional<float> &get_track_loudness() const { return this->track_loudness_; }
+
  protected:
   esp_err_t allocate_buffers_();
 
+  /// @brief Points the input buffer at new data, either peeked from the input ring buffer or read into the FLAC
+  /// staging buffer
+  /// @param input_full (output) true if the input buffer can't grow any further
+  /// @return number of new bytes available since the last call
+  size_t refill_input_(bool &input_full);
+
+  /// @brief Releases the input bytes consumed by the file decoder back to the input ring buffer
+  void release_input_();
+
+  /// @brief Minimum contiguous space needed in the output ring buffer to decode the next frame
+  size_t output_bytes_needed_();
+
   FileDecoderState decode_flac_();
   FileDecoderState decode_mp3_();
   FileDecoderState decode_wav_();
 
-  esphome::RingBuffer *input_ring_buffer_;
-  esphome::RingBuffer *output_ring_buffer_;
+  AudioRingBuffer *input_ring_buffer_;
+  AudioRingBuffer *output_ring_buffer_;
   size_t internal_buffer_size_;
+  TickType_t ticks_to_wait_;
 
+  // Start of the current input data; a region of the input ring buffer or the FLAC staging buffer
   uint8_t *input_buffer_{nullptr};
   uint8_t *input_buffer_current_{nullptr};
   size_t input_buffer_length_;
 
+  // Only allocated for FLAC files
+  uint8_t *flac_input_buffer_{nullptr};
+
+  // Region reserved in the output ring buffer that the file decoders write into
   uint8_t *output_buffer_{nullptr};
-  uint8_t *output_buffer_current_{nullptr};
+  size_t output_buffer_size_;
   size_t output_buffer_length_;
 
+  size_t bytes_moved_{0};
+
   std::unique_ptr<flac::FLACDecoder> flac_decoder_;
 
   HMP3Decoder mp3_decoder_;
+  uint32_t mp3_bitrate_{0};
 
   std::unique_ptr<wav_decoder::WAVDecoder> wav_decoder_;
   size_t wav_bytes_left_;
+  // Position and length of the WAV data chunk in the file
+  size_t wav_data_start_{0};
+  size_t wav_data_size_{0};
 
   media_player::MediaFileType media_file_type_{media_player::MediaFileType::NONE};
   optional<audio::AudioStreamInfo> audio_stream_info_{};
 
+  optional<float> track_loudness_{};
+  bool id3_tag_checked_{false};
+
   size_t potentially_failed_count_{0};
   bool end_of_file_{false};
+  // Set after a seek until a frame decodes successfully; decoding errors skip ahead to the next sync code instead
+  bool resyncing_{false};
+
+  bool low_latency_start_{false};
+  bool first_output_pending_{true};
 };
 }  // namespace nabu
 }  // namespace esphome
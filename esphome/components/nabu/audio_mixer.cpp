@@ -2,42 +2,149 @@
 
 #include "audio_mixer.h"
 
-#include <dsp.h>
-
 #include "esphome/core/hal.h"
 #include "esphome/core/helpers.h"
 
 namespace esphome {
 namespace nabu {
 
-static const size_t INPUT_RING_BUFFER_SAMPLES = 24000;
-static const size_t OUTPUT_BUFFER_SAMPLES = 8192;
+// The ring buffers hold the same duration of audio whether the mixer is mono or stereo
+static const size_t INPUT_RING_BUFFER_FRAMES = 12000;
+// Fits the resampler's minimum output block
+static const size_t INPUT_RING_BUFFER_GUARD_BYTES = 2048;
+static const size_t OUTPUT_BUFFER_FRAMES = 4096;
+// The speaker's staging buffer fits a block of stereo frames, in case a mono mix is duplicated
+static const size_t OUTPUT_STAGING_BYTES = OUTPUT_BUFFER_FRAMES * 2 * sizeof(int16_t);
 static const size_t QUEUE_COUNT = 20;
 
 static const uint32_t TASK_STACK_SIZE = 3072;
 static const size_t TASK_DELAY_MS = 25;
 
 static const int16_t MAX_AUDIO_SAMPLE_VALUE = INT16_MAX;
-static const int16_t MIN_AUDIO_SAMPLE_VALUE = INT16_MIN;
 
-esp_err_t AudioMixer::start(speaker::Speaker *speaker, const std::string &task_name, UBaseType_t priority) {
+static const uint32_t LIMITER_LOOKAHEAD_MS = 2;
+static const uint32_t LIMITER_RELEASE_MS = 100;
+
+// Gain changes are always ramped over at least this many frames, so even immediate changes don't click
+static const size_t MIN_GAIN_RAMP_FRAMES = 256;
+
+// How long release_input and set_input_channels wait for the task to handle their commands
+static const uint32_t INPUT_COMMAND_TIMEOUT_MS = 200;
+// How long the destructor waits for a running task to stop before deleting it
+static const uint32_t DESTRUCTOR_STOP_TIMEOUT_MS = 200;
+
+// State of one input; only used by the mixer task
+struct InputState {
+  // nullptr while an on demand input isn't attached
+  AudioRingBuffer *ring_buffer{nullptr};
+
+  // PCM that replaces the input's ring buffer while it has audio left
+  const int16_t *pcm_current{nullptr};
+  size_t pcm_bytes_left{0};
+  bool playing_pcm{false};
+
+  // Channels in each of the input's frames; fewer than the mixer's channels if it is upmixed
+  uint8_t channels{2};
+  size_t frame_bytes{2 * sizeof(int16_t)};
+
+  bool paused{false};
+  // The input's gain times its ducking group's scale factor and its fade, ramped whenever any of them changes
+  int16_t gain{MAX_AUDIO_SAMPLE_VALUE};
+  int16_t fade{MAX_AUDIO_SAMPLE_VALUE};
+  GainRamp ramp;
+
+  // Each input waits until its ring buffer reaches the start threshold; see the class description
+  size_t start_threshold{0};
+  bool waiting{true};
+  bool flush{false};
+
+  // Audio available to mix in this block
+  uint8_t *data{nullptr};
+  size_t available{0};
+};
+
+// Scales a Q15 gain by another. Unity is exact, so an input nothing turns down keeps its gain.
+static int32_t scale_gain(int32_t gain, int16_t scale) {
+  return (scale == INT16_MAX) ? gain : ((gain * scale) >> 15);
+}
+
+// The gain an input ramps towards, combining its own gain with its ducking group's reduction, its fade, and the volume
+static int16_t target_gain(int16_t gain, int8_t db_reduction, int16_t fade, int16_t volume) {
+  // Ensure we only point to valid index in the Q15 scaling factor table
+  uint8_t safe_db_reduction_index = clamp<uint8_t>(db_reduction, 0, decibel_reduction_table.size() - 1);
+  int32_t ducked = scale_gain(gain, decibel_reduction_table[safe_db_reduction_index]);
+  return static_cast<int16_t>(scale_gain(scale_gain(ducked, fade), volume));
+}
+
+// Duplicates mono samples into stereo frames in place. Works backwards, so every sample is read before it is
+// overwritten.
+static void upmix_in_place(int16_t *samples, size_t frames) {
+  for (size_t i = frames; i > 0; --i) {
+    int16_t sample = samples[i - 1];
+    samples[2 * i - 2] = sample;
+    samples[2 * i - 1] = sample;
+  }
+}
+
+AudioMixer::~AudioMixer() {
+  if (this->task_handle_ != nullptr) {
+    // Let the task finish its block and hand back its inputs before it is deleted
+    CommandEvent command_event;
+    command_event.command = CommandEventType::STOP;
+    this->send_command(&command_event, pdMS_TO_TICKS(DESTRUCTOR_STOP_TIMEOUT_MS));
+
+    TaskEvent event;
+    const TickType_t start_ticks = xTaskGetTickCount();
+    while ((xTaskGetTickCount() - start_ticks) < pdMS_TO_TICKS(DESTRUCTOR_STOP_TIMEOUT_MS)) {
+      if (this->read_event(&event, 1) && (event.type == EventType::STOPPED)) {
+        break;
+      }
+    }
+    this->stop();
+  }
+
+  if (this->event_queue_ != nullptr) {
+    vQueueDelete(this->event_queue_);
+  }
+  if (this->command_queue_ != nullptr) {
+    vQueueDelete(this->command_queue_);
+  }
+  free(this->stack_buffer_);
+}
+
+esp_err_t AudioMixer::start(speaker::Speaker *speaker, const std::string &task_name, UBaseType_t priority,
+                            BaseType_t core) {
+  if (this->speaker_sink_ == nullptr) {
+    this->speaker_sink_ = SpeakerOutputSink::create(speaker, OUTPUT_STAGING_BYTES);
+    if (this->speaker_sink_ == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  return this->start(this->speaker_sink_.get(), task_name, priority, core);
+}
+
+esp_err_t AudioMixer::start(AudioOutputSink *sink, const std::string &task_name, UBaseType_t priority,
+                            BaseType_t core) {
   esp_err_t err = this->allocate_buffers_();
 
   if (err != ESP_OK) {
     return err;
   }
 
+  // Set before the task is created, as the task uses it right away
+  this->output_sink_ = sink;
+
   if (this->task_handle_ == nullptr) {
-    this->task_handle_ = xTaskCreateStatic(AudioMixer::audio_mixer_task_, task_name.c_str(), TASK_STACK_SIZE,
-                                           (void *) this, priority, this->stack_buffer_, &this->task_stack_);
+    this->task_handle_ =
+        xTaskCreateStaticPinnedToCore(AudioMixer::audio_mixer_task_, task_name.c_str(), TASK_STACK_SIZE, (void *) this,
+                                      priority, this->stack_buffer_, &this->task_stack_, core);
   }
 
   if (this->task_handle_ == nullptr) {
     return ESP_FAIL;
   }
 
-  this->speaker_ = speaker;
-
   return ESP_OK;
 }
 
@@ -49,6 +156,187 @@ void AudioMixer::stop() {
   xQueueReset(this->command_queue_);
 }
 
+esp_err_t AudioMixer::add_input(const MixerInputSettings &settings, uint8_t &input) {
+  if (this->task_handle_ != nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (this->input_count_ >= MAX_MIXER_INPUTS) {
+    return ESP_ERR_NO_MEM;
+  }
+  if ((settings.ducking_group > MAX_DUCKING_GROUPS) || (settings.channels > this->channels_)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  MixerInput &mixer_input = this->inputs_[this->input_count_];
+  mixer_input.settings = settings;
+  if (settings.channels == 0) {
+    mixer_input.settings.channels = this->channels_;
+  }
+  mixer_input.channels.store(mixer_input.settings.channels);
+
+  if (!settings.on_demand) {
+    mixer_input.ring_buffer = AudioRingBuffer::create(this->input_ring_buffer_size_(mixer_input.settings.channels),
+                                                      INPUT_RING_BUFFER_GUARD_BYTES);
+    if (mixer_input.ring_buffer == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  input = this->input_count_++;
+  return ESP_OK;
+}
+
+esp_err_t AudioMixer::reserve_input(uint8_t input) {
+  if ((input >= this->input_count_) || !this->inputs_[input].settings.on_demand) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  MixerInput &mixer_input = this->inputs_[input];
+  if (mixer_input.ring_buffer != nullptr) {
+    return ESP_OK;
+  }
+
+  mixer_input.ring_buffer = AudioRingBuffer::create(this->input_ring_buffer_size_(mixer_input.settings.channels),
+                                                    INPUT_RING_BUFFER_GUARD_BYTES);
+  if (mixer_input.ring_buffer == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  mixer_input.attached.store(true);
+  if (this->task_handle_ == nullptr) {
+    // The task attaches it when it starts
+    return ESP_OK;
+  }
+  mixer_input.ring_buffer->set_consumer_task(this->task_handle_);
+
+  // The queue orders the allocation before the task's first use of the ring buffer
+  CommandEvent command_event;
+  command_event.command = CommandEventType::ATTACH;
+  command_event.input = input;
+  this->send_command(&command_event);
+
+  return ESP_OK;
+}
+
+esp_err_t AudioMixer::release_input(uint8_t input) {
+  if ((input >= this->input_count_) || !this->inputs_[input].settings.on_demand) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  MixerInput &mixer_input = this->inputs_[input];
+  if (mixer_input.ring_buffer == nullptr) {
+    return ESP_OK;
+  }
+
+  if (mixer_input.attached.load()) {
+    CommandEvent command_event;
+    command_event.command = CommandEventType::DETACH;
+    command_event.input = input;
+    this->send_command(&command_event);
+
+    const TickType_t start_ticks = xTaskGetTickCount();
+    while (mixer_input.attached.load()) {
+      if ((xTaskGetTickCount() - start_ticks) > pdMS_TO_TICKS(INPUT_COMMAND_TIMEOUT_MS)) {
+        return ESP_ERR_TIMEOUT;
+      }
+      vTaskDelay(1);
+    }
+  }
+
+  mixer_input.ring_buffer.reset();
+  return ESP_OK;
+}
+
+esp_err_t AudioMixer::set_input_channels(uint8_t input, uint8_t channels) {
+  if ((input >= this->input_count_) || (channels > this->inputs_[input].settings.channels)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  MixerInput &mixer_input = this->inputs_[input];
+  if (channels == 0) {
+    channels = mixer_input.settings.channels;
+  }
+  if (mixer_input.channels.load() == channels) {
+    return ESP_OK;
+  }
+
+  if (this->task_handle_ == nullptr) {
+    // The task picks it up when it starts
+    mixer_input.channels.store(channels);
+    return ESP_OK;
+  }
+
+  // The queue orders both before the task reads them
+  mixer_input.channels_waiter = xTaskGetCurrentTaskHandle();
+  mixer_input.requested_channels.store(channels);
+  CommandEvent command_event;
+  command_event.command = CommandEventType::SET_CHANNELS;
+  command_event.input = input;
+  if (this->send_command(&command_event, pdMS_TO_TICKS(INPUT_COMMAND_TIMEOUT_MS)) != pdTRUE) {
+    mixer_input.requested_channels.store(0);
+    return ESP_FAIL;
+  }
+
+  const TickType_t start_ticks = xTaskGetTickCount();
+  const TickType_t timeout_ticks = pdMS_TO_TICKS(INPUT_COMMAND_TIMEOUT_MS);
+  while (mixer_input.channels.load() != channels) {
+    const TickType_t waited_ticks = xTaskGetTickCount() - start_ticks;
+    if (waited_ticks < timeout_ticks) {
+      ulTaskNotifyTake(pdTRUE, timeout_ticks - waited_ticks);
+    } else if (mixer_input.requested_channels.exchange(0) != 0) {
+      // Canceled before the task claimed it, so the task ignores the command
+      return ESP_ERR_TIMEOUT;
+    } else {
+      // The task claimed it and notifies as soon as it has switched
+      ulTaskNotifyTake(pdTRUE, 1);
+    }
+  }
+  return ESP_OK;
+}
+
+BaseType_t AudioMixer::send_command(CommandEvent *command, TickType_t ticks_to_wait) {
+  BaseType_t result = xQueueSend(this->command_queue_, command, ticks_to_wait);
+  if ((result == pdTRUE) && (this->task_handle_ != nullptr)) {
+    xTaskNotifyGive(this->task_handle_);
+  }
+  return result;
+}
+
+BaseType_t AudioMixer::play_pcm(uint8_t input, const int16_t *data, size_t length) {
+  if (input >= this->input_count_) {
+    return pdFALSE;
+  }
+
+  // Set before sending, so callers never see the flag cleared before the task receives the command
+  this->inputs_[input].pcm_playing.store(true);
+
+  CommandEvent command_event;
+  command_event.command = CommandEventType::PLAY_PCM;
+  command_event.input = input;
+  command_event.pcm_data = data;
+  command_event.pcm_length = length - length % (this->inputs_[input].channels.load() * sizeof(int16_t));
+
+  BaseType_t result = this->send_command(&command_event);
+  if (result != pdTRUE) {
+    this->inputs_[input].pcm_playing.store(false);
+  }
+  return result;
+}
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+void AudioMixer::get_stats(AudioStageStats &stats) {
+  stats = this->output_stats_;
+
+  // The task never blocks on its inputs, so there is no input wait time
+  for (uint8_t i = 0; i < this->input_count_; ++i) {
+    // Only the underruns of on demand inputs that are reserved now are counted
+    if (this->inputs_[i].ring_buffer != nullptr) {
+      stats.underruns += this->inputs_[i].ring_buffer->get_stats().underruns;
+    }
+  }
+}
+#endif
+
 void AudioMixer::suspend_task() {
   if (this->task_handle_ != nullptr) {
     vTaskSuspend(this->task_handle_);
@@ -67,204 +355,359 @@ void AudioMixer::audio_mixer_task_(void *params) {
   TaskEvent event;
   CommandEvent command_event;
 
-  ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
-  int16_t *media_buffer = allocator.allocate(OUTPUT_BUFFER_SAMPLES);
-  int16_t *announcement_buffer = allocator.allocate(OUTPUT_BUFFER_SAMPLES);
-  int16_t *combination_buffer = allocator.allocate(OUTPUT_BUFFER_SAMPLES);
+  AudioOutputSink *sink = this_mixer->output_sink_;
 
-  int16_t *combination_buffer_current = combination_buffer;
-  size_t combination_buffer_length = 0;
+  const uint8_t channels = this_mixer->channels_;
+  const size_t frame_bytes = channels * sizeof(int16_t);
+  sink->set_duplicate_channels((channels == 1) && this_mixer->stereo_output_);
 
-  if ((media_buffer == nullptr) || (announcement_buffer == nullptr)) {
-    event.type = EventType::WARNING;
-    event.err = ESP_ERR_NO_MEM;
-    xQueueSend(this_mixer->event_queue_, &event, portMAX_DELAY);
+  // Audio from a single playing input waiting to be copied to the output sink. It points directly into that input's
+  // ring buffer or PCM; a ring buffer region is released once all of it is sent. Mixes are written straight into the
+  // sink, so they never wait here.
+  int16_t *output_current = nullptr;
+  size_t output_length = 0;
+  AudioRingBuffer *output_source = nullptr;
+  size_t output_source_bytes = 0;
+  // Index of the input the waiting audio points into; -1 if there is none
+  int8_t output_input = -1;
 
-    event.type = EventType::STOPPED;
-    event.err = ESP_OK;
-    xQueueSend(this_mixer->event_queue_, &event, portMAX_DELAY);
+  this_mixer->limiter_.configure(this_mixer->sample_rate_, LIMITER_LOOKAHEAD_MS, LIMITER_RELEASE_MS, channels);
 
-    while (true) {
-      delay(TASK_DELAY_MS);
-    }
+  this_mixer->output_processor_.configure(this_mixer->output_processing_settings_, this_mixer->sample_rate_,
+                                          channels);
+  bool process_output = this_mixer->output_processing_enabled_ && this_mixer->output_processor_.is_active();
 
-    return;
+  if (this_mixer->reference_tap_ != nullptr) {
+    this_mixer->reference_tap_->reset();
   }
 
-  // Handles media stream pausing
-  bool transfer_media = true;
-
-  // Parameters to control the ducking dB reduction and its transitions
-  // There is a built in negative sign; e.g., reducing by 5 dB is changing the gain by -5 dB
-  int8_t target_ducking_db_reduction = 0;
-  int8_t current_ducking_db_reduction = 0;
+  const uint8_t input_count = this_mixer->input_count_;
+  int16_t volume = this_mixer->volume_;
+  InputState inputs[MAX_MIXER_INPUTS];
+  for (uint8_t i = 0; i < input_count; ++i) {
+    const MixerInputSettings &settings = this_mixer->inputs_[i].settings;
+    inputs[i].gain = settings.gain;
+    inputs[i].ramp.set(target_gain(settings.gain, 0, inputs[i].fade, volume));
+    inputs[i].channels = this_mixer->inputs_[i].channels.load();
+    inputs[i].frame_bytes = inputs[i].channels * sizeof(int16_t);
+    inputs[i].start_threshold = this_mixer->input_start_threshold_(i, inputs[i].channels);
+    // On demand inputs start detached unless they were reserved before the task started; otherwise reserve_input sends
+    // an ATTACH command for them
+    if (!settings.on_demand || this_mixer->inputs_[i].attached.load()) {
+      inputs[i].ring_buffer = this_mixer->inputs_[i].ring_buffer.get();
+      inputs[i].ring_buffer->set_consumer_task(xTaskGetCurrentTaskHandle());
+    }
+  }
 
-  // Each step represents a change in 1 dB. Positive 1 means the dB reduction is increasing. Negative 1 means the dB
-  // reduction is decreasing.
-  int8_t db_change_per_ducking_step = 1;
+  // Each group's dB reduction. There is a built in negative sign; e.g., reducing by 5 dB is changing the gain by -5 dB.
+  // Index 0 is unused, as ducking group 0 never ducks.
+  int8_t ducking_db_reductions[MAX_DUCKING_GROUPS + 1] = {};
 
-  size_t ducking_transition_samples_remaining = 0;
-  size_t samples_per_ducking_step = 0;
+  MixSource sources[MAX_MIXER_INPUTS];
+  uint8_t source_inputs[MAX_MIXER_INPUTS];
 
   event.type = EventType::STARTED;
   xQueueSend(this_mixer->event_queue_, &event, portMAX_DELAY);
 
   while (true) {
-    if (xQueueReceive(this_mixer->command_queue_, &command_event, 0) == pdTRUE) {
+    // Every command comes with a notification, but one wakeup may cover several of them, so handle all that are queued
+    bool stop = false;
+    while (!stop && (xQueueReceive(this_mixer->command_queue_, &command_event, 0) == pdTRUE)) {
       if (command_event.command == CommandEventType::STOP) {
-        break;
+        stop = true;
       } else if (command_event.command == CommandEventType::DUCK) {
-        if (target_ducking_db_reduction != command_event.decibel_reduction) {
-          current_ducking_db_reduction = target_ducking_db_reduction;
-
-          target_ducking_db_reduction = command_event.decibel_reduction;
-
-          uint8_t total_ducking_steps = 0;
-          if (target_ducking_db_reduction > current_ducking_db_reduction) {
-            // The dB reduction level is increasing (which results in quieter audio)
-            total_ducking_steps = target_ducking_db_reduction - current_ducking_db_reduction - 1;
-            db_change_per_ducking_step = 1;
-          } else {
-            // The dB reduction level is decreasing (which results in louder audio)
-            total_ducking_steps = current_ducking_db_reduction - target_ducking_db_reduction - 1;
-            db_change_per_ducking_step = -1;
+        if ((command_event.ducking_group > 0) && (command_event.ducking_group <= MAX_DUCKING_GROUPS)) {
+          ducking_db_reductions[command_event.ducking_group] = command_event.decibel_reduction;
+
+          // Each input in the group ramps from its current gain, even if a transition is already in progress. Equal dB
+          // steps match how ducking is specified.
+          size_t ramp_frames = std::max(command_event.transition_samples / channels, MIN_GAIN_RAMP_FRAMES);
+          for (uint8_t i = 0; i < input_count; ++i) {
+            if (this_mixer->inputs_[i].settings.ducking_group == command_event.ducking_group) {
+              inputs[i].ramp.ramp_to(
+                  target_gain(inputs[i].gain, command_event.decibel_reduction, inputs[i].fade, volume), ramp_frames,
+                  GainRampShape::EXPONENTIAL);
+            }
           }
-          if (total_ducking_steps > 0) {
-            ducking_transition_samples_remaining = command_event.transition_samples;
+        }
+      } else if (command_event.command == CommandEventType::SET_OUTPUT_PROCESSING) {
+        bool enable = command_event.enabled && this_mixer->output_processor_.is_active();
+        if (enable && !process_output) {
+          // Don't carry over filter state from before it was bypassed
+          this_mixer->output_processor_.reset();
+        }
+        process_output = enable;
+      } else if (command_event.command == CommandEventType::SET_STEREO_OUTPUT) {
+        // Audio the sink already staged keeps its layout; only new audio is affected
+        sink->set_duplicate_channels((channels == 1) && command_event.enabled);
+      } else if (command_event.command == CommandEventType::SET_VOLUME) {
+        volume = command_event.gain;
+        // Each input ramps from its current gain, even if a transition is already in progress
+        size_t ramp_frames = std::max(command_event.transition_samples / channels, MIN_GAIN_RAMP_FRAMES);
+        for (uint8_t i = 0; i < input_count; ++i) {
+          const int8_t db_reduction = ducking_db_reductions[this_mixer->inputs_[i].settings.ducking_group];
+          inputs[i].ramp.ramp_to(target_gain(inputs[i].gain, db_reduction, inputs[i].fade, volume), ramp_frames,
+                                 command_event.ramp_shape);
+        }
+      } else if (command_event.input < input_count) {
+        const uint8_t index = command_event.input;
+        InputState &input = inputs[index];
+        AudioRingBuffer *ring_buffer = input.ring_buffer;
+        const int8_t db_reduction = ducking_db_reductions[this_mixer->inputs_[index].settings.ducking_group];
+
+        uint8_t new_channels = 0;
+        if (command_event.command == CommandEventType::SET_CHANNELS) {
+          // Only a switch set_input_channels is still waiting for is applied; it cancels one it gave up on
+          new_channels = this_mixer->inputs_[index].requested_channels.exchange(0);
+          if (new_channels == 0) {
+            continue;
+          }
+        }
 
-            samples_per_ducking_step = ducking_transition_samples_remaining / total_ducking_steps;
+        if (command_event.command == CommandEventType::PAUSE) {
+          input.paused = true;
+        } else if (command_event.command == CommandEventType::RESUME) {
+          input.paused = false;
+        } else if ((command_event.command == CommandEventType::CLEAR) ||
+                   (command_event.command == CommandEventType::DETACH) ||
+                   (command_event.command == CommandEventType::SET_CHANNELS)) {
+          if (output_input == index) {
+            // Drop the pending audio that points into the ring buffer or the PCM
+            output_length = 0;
+            output_source = nullptr;
+            output_input = -1;
+          }
+          if (command_event.command == CommandEventType::DETACH) {
+            input.ring_buffer = nullptr;
+            this_mixer->inputs_[index].attached.store(false);
+          } else if (ring_buffer != nullptr) {
+            ring_buffer->reset();
+          }
+          input.pcm_bytes_left = 0;
+          input.waiting = true;
+          input.flush = false;
+          if (command_event.command == CommandEventType::SET_CHANNELS) {
+            // Only the buffered audio had the old channels; the fade and gain carry over, e.g., into a crossfade
+            input.channels = new_channels;
+            input.frame_bytes = input.channels * sizeof(int16_t);
+            input.start_threshold = this_mixer->input_start_threshold_(index, input.channels);
+            this_mixer->inputs_[index].channels.store(input.channels);
+            xTaskNotifyGive(this_mixer->inputs_[index].channels_waiter);
+          }
+        } else if (command_event.command == CommandEventType::ATTACH) {
+          input.ring_buffer = this_mixer->inputs_[index].ring_buffer.get();
+          input.waiting = true;
+          input.flush = false;
+          // Each stream on the input starts unfaded
+          input.fade = MAX_AUDIO_SAMPLE_VALUE;
+          input.ramp.set(target_gain(input.gain, db_reduction, input.fade, volume));
+        } else if (command_event.command == CommandEventType::PLAY_PCM) {
+          input.pcm_current = command_event.pcm_data;
+          input.pcm_bytes_left = command_event.pcm_length;
+          input.playing_pcm = true;
+          // Already complete in memory, so it never waits for a start threshold
+          this_mixer->inputs_[index].output_started_ms.store(millis());
+        } else if (command_event.command == CommandEventType::FLUSH) {
+          // Only matters if the rest of the stream is still waiting. Ignored if the stream had no audio at all, so it
+          // doesn't carry over to the next stream.
+          input.flush = input.waiting && (ring_buffer != nullptr) && (ring_buffer->available() > 0);
+        } else if (command_event.command == CommandEventType::SET_GAIN) {
+          input.gain = command_event.gain;
+          input.ramp.ramp_to(target_gain(input.gain, db_reduction, input.fade, volume),
+                             std::max(command_event.transition_samples / channels, MIN_GAIN_RAMP_FRAMES),
+                             command_event.ramp_shape);
+        } else if (command_event.command == CommandEventType::FADE) {
+          input.fade = command_event.gain;
+          if (input.waiting && (input.pcm_bytes_left == 0)) {
+            // None of the input's audio is playing, so it starts at the new level
+            input.ramp.set(target_gain(input.gain, db_reduction, input.fade, volume));
           } else {
-            ducking_transition_samples_remaining = 0;
+            input.ramp.ramp_to(target_gain(input.gain, db_reduction, input.fade, volume),
+                               std::max(command_event.transition_samples / channels, MIN_GAIN_RAMP_FRAMES),
+                               command_event.ramp_shape);
           }
         }
-      } else if (command_event.command == CommandEventType::PAUSE_MEDIA) {
-        transfer_media = false;
-      } else if (command_event.command == CommandEventType::RESUME_MEDIA) {
-        transfer_media = true;
-      } else if (command_event.command == CommandEventType::CLEAR_MEDIA) {
-        this_mixer->media_ring_buffer_->reset();
-      } else if (command_event.command == CommandEventType::CLEAR_ANNOUNCEMENT) {
-        this_mixer->announcement_ring_buffer_->reset();
       }
     }
+    if (stop) {
+      break;
+    }
+
+    if (output_length > 0) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+      const uint32_t start_us = micros();
+#endif
+      size_t output_bytes_written = sink->write(output_current, output_length, pdMS_TO_TICKS(TASK_DELAY_MS));
+#ifdef USE_AUDIO_PIPELINE_STATS
+      this_mixer->output_stats_.output_wait_us += micros() - start_us;
+      this_mixer->output_stats_.bytes_processed += output_bytes_written;
+#endif
+      if (this_mixer->reference_tap_ != nullptr) {
+        this_mixer->reference_tap_->write(output_current, output_bytes_written);
+      }
+      output_length -= output_bytes_written;
+      output_current = (int16_t *) ((uint8_t *) output_current + output_bytes_written);
 
-    if (combination_buffer_length > 0) {
-      size_t output_bytes_written = this_mixer->speaker_->play((uint8_t *) combination_buffer,
-                                                               combination_buffer_length, pdMS_TO_TICKS(TASK_DELAY_MS));
-      combination_buffer_length -= output_bytes_written;
-      if ((combination_buffer_length > 0) && (output_bytes_written > 0)) {
-        memmove(combination_buffer, combination_buffer + output_bytes_written / sizeof(int16_t),
-                combination_buffer_length);
+      if ((output_length == 0) && (output_source != nullptr)) {
+        // Only release whole regions so the ring buffer's read position stays sample aligned
+        output_source->release(output_source_bytes);
+        output_source = nullptr;
       }
     } else {
-      size_t media_available = this_mixer->media_ring_buffer_->available();
-      size_t announcement_available = this_mixer->announcement_ring_buffer_->available();
+      output_input = -1;
 
-      if (media_available * transfer_media + announcement_available > 0) {
-        size_t bytes_to_read = OUTPUT_BUFFER_SAMPLES * sizeof(int16_t);
+      size_t frames_to_read = OUTPUT_BUFFER_FRAMES;
+      size_t source_count = 0;
 
-        if (media_available * transfer_media > 0) {
-          bytes_to_read = std::min(bytes_to_read, media_available);
-        }
+      for (uint8_t i = 0; i < input_count; ++i) {
+        InputState &input = inputs[i];
+        AudioRingBuffer *ring_buffer = input.ring_buffer;
 
-        if (announcement_available > 0) {
-          bytes_to_read = std::min(bytes_to_read, announcement_available);
+        if (input.playing_pcm && (input.pcm_bytes_left == 0)) {
+          // Everything from the PCM has been sent to the speaker
+          input.playing_pcm = false;
+          this_mixer->inputs_[i].pcm_playing.store(false);
         }
 
-        if (bytes_to_read > 0) {
-          size_t media_bytes_read = 0;
-          if (media_available * transfer_media > 0) {
-            media_bytes_read = this_mixer->media_ring_buffer_->read((void *) media_buffer, bytes_to_read, 0);
-            if (media_bytes_read > 0) {
-              size_t samples_read = media_bytes_read / sizeof(int16_t);
-              if (ducking_transition_samples_remaining > 0) {
-                // Ducking level is still transitioning
-
-                size_t samples_left = ducking_transition_samples_remaining;
-
-                // There may be more than one step worth of samples to duck in the buffers, so manage positions
-                int16_t *current_media_buffer = media_buffer;
-
-                size_t samples_left_in_step = samples_left % samples_per_ducking_step;
-                if (samples_left_in_step == 0) {
-                  // Start of a new ducking step
-
-                  current_ducking_db_reduction += db_change_per_ducking_step;
-                  samples_left_in_step = samples_per_ducking_step;
-                }
-                size_t samples_left_to_duck = std::min(samples_left_in_step, samples_read);
+        input.data = nullptr;
+        input.available = 0;
 
-                size_t total_samples_ducked = 0;
-
-                while (samples_left_to_duck > 0) {
-                  // Ensure we only point to valid index in the Q15 scaling factor table
-                  uint8_t safe_db_reduction_index =
-                      clamp<uint8_t>(current_ducking_db_reduction, 0, decibel_reduction_table.size() - 1);
-
-                  int16_t q15_scale_factor = decibel_reduction_table[safe_db_reduction_index];
-                  this_mixer->scale_audio_samples_(current_media_buffer, current_media_buffer, q15_scale_factor,
-                                                   samples_left_to_duck);
-
-                  current_media_buffer += samples_left_to_duck;
-
-                  samples_read -= samples_left_to_duck;
-                  samples_left -= samples_left_to_duck;
-
-                  total_samples_ducked += samples_left_to_duck;
-
-                  samples_left_in_step = samples_left % samples_per_ducking_step;
-                  if (samples_left_in_step == 0) {
-                    // Start of a new step
-
-                    current_ducking_db_reduction += db_change_per_ducking_step;
-                    samples_left_in_step = samples_per_ducking_step;
-                  }
-                  samples_left_to_duck = std::min(samples_left_in_step, samples_read);
-                }
-              } else if (target_ducking_db_reduction > 0) {
-                // We still need to apply a ducking scaling, but we are done transitioning
-
-                uint8_t safe_db_reduction_index =
-                    clamp<uint8_t>(target_ducking_db_reduction, 0, decibel_reduction_table.size() - 1);
+        if (input.paused) {
+          continue;
+        }
 
-                int16_t q15_scale_factor = decibel_reduction_table[safe_db_reduction_index];
-                this_mixer->scale_audio_samples_(media_buffer, media_buffer, q15_scale_factor, samples_read);
-              }
-            }
+        if (input.pcm_bytes_left > 0) {
+          // The mixer never modifies PCM samples, so reading straight from the PCM data is safe
+          input.data = (uint8_t *) input.pcm_current;
+          input.available = input.pcm_bytes_left;
+        } else if (ring_buffer != nullptr) {
+          size_t buffered = ring_buffer->available();
+          if (input.waiting && (buffered > 0) && ((buffered >= input.start_threshold) || input.flush)) {
+            input.waiting = false;
+            input.flush = false;
+            this_mixer->inputs_[i].output_started_ms.store(millis());
+          } else if (!input.waiting && (buffered == 0)) {
+            input.waiting = true;
           }
 
-          size_t announcement_bytes_read = 0;
-          if (announcement_available > 0) {
-            announcement_bytes_read =
-                this_mixer->announcement_ring_buffer_->read((void *) announcement_buffer, bytes_to_read, 0);
+          if (!input.waiting) {
+            input.available = ring_buffer->peek(&input.data, input.frame_bytes, 0);
+            input.available -= input.available % input.frame_bytes;
           }
+        }
 
-          if ((media_bytes_read > 0) && (announcement_bytes_read > 0)) {
-            // We have both a media and an announcement stream, so mix them together
-
-            size_t samples_read = bytes_to_read / sizeof(int16_t);
+        if (input.available > 0) {
+          frames_to_read = std::min(frames_to_read, input.available / input.frame_bytes);
 
-            this_mixer->mix_audio_samples_without_clipping_(media_buffer, announcement_buffer, combination_buffer,
-                                                            samples_read);
+          sources[source_count].samples = (const int16_t *) input.data;
+          sources[source_count].ramp = &input.ramp;
+          sources[source_count].priority = this_mixer->inputs_[i].settings.priority;
+          sources[source_count].channels = input.channels;
+          source_inputs[source_count] = i;
+          ++source_count;
+        }
+      }
 
-            combination_buffer_length = samples_read * sizeof(int16_t);
-          } else if (media_bytes_read > 0) {
-            memcpy(combination_buffer, media_buffer, media_bytes_read);
-            combination_buffer_length = media_bytes_read;
-          } else if (announcement_bytes_read > 0) {
-            memcpy(combination_buffer, announcement_buffer, announcement_bytes_read);
-            combination_buffer_length = announcement_bytes_read;
+      if ((source_count <= 1) && (this_mixer->limiter_.get_delayed_frames() > 0)) {
+        // Send the end of the last mix that is still delayed in the limiter first, so no audio is skipped or repeated
+        int16_t *region = nullptr;
+        if (this_mixer->acquire_output_(&region, this_mixer->limiter_.get_delayed_frames() * frame_bytes) > 0) {
+          size_t frames_drained = this_mixer->limiter_.drain(region);
+          if (process_output) {
+            this_mixer->process_output_(region, frames_drained);
           }
+          this_mixer->commit_output_(region, frames_drained * frame_bytes);
 
-          size_t samples_written = combination_buffer_length / sizeof(int16_t);
-          if (ducking_transition_samples_remaining > 0) {
-            ducking_transition_samples_remaining -= std::min(samples_written, ducking_transition_samples_remaining);
+          // The drained frames play for as long as mixed ones, so every input's ramp moves on by as many frames
+          for (uint8_t i = 0; i < input_count; ++i) {
+            inputs[i].ramp.advance(frames_drained);
+          }
+        }
+      } else if (source_count > 0) {
+        size_t frames_read = frames_to_read;
+        const uint8_t first_index = source_inputs[0];
+
+        // A single input with the mixer's channels is sent without a copy, unless it is PCM that needs its gain
+        // applied or processing
+        bool zero_copy = (source_count == 1) && (inputs[first_index].channels == channels) &&
+                         ((inputs[first_index].pcm_bytes_left == 0) ||
+                          (inputs[first_index].ramp.is_unity() && !process_output));
+
+        if (zero_copy) {
+          InputState &input = inputs[first_index];
+          int16_t *samples = (int16_t *) input.data;
+          const size_t bytes_to_read = frames_read * frame_bytes;
+
+          output_input = first_index;
+          if (input.pcm_bytes_left > 0) {
+            output_source = nullptr;
+            // The PCM data stays valid, so it is consumed right away
+            input.pcm_current = (const int16_t *) ((const uint8_t *) input.pcm_current + bytes_to_read);
+            input.pcm_bytes_left -= bytes_to_read;
+          } else {
+            if (!input.ramp.is_unity()) {
+              // Apply the gain in place in the ring buffer
+              input.ramp.apply(samples, samples, frames_read, channels);
+            }
+            if (process_output) {
+              this_mixer->process_output_(samples, frames_read);
+            }
+            output_source = input.ring_buffer;
+          }
+          output_current = samples;
+          output_length = bytes_to_read;
+          output_source_bytes = bytes_to_read;
+        } else {
+          // Mixes, upmixed inputs, and PCM that needs its gain applied or processing, are written straight into the
+          // output sink. PCM may live in flash or be replayed later, so it is never modified in place.
+          int16_t *region = nullptr;
+          size_t region_bytes = this_mixer->acquire_output_(&region, frame_bytes);
+          frames_read = std::min(frames_read, region_bytes / frame_bytes);
+
+          if (frames_read > 0) {
+            size_t frames_output = frames_read;
+            if (source_count == 1) {
+              InputState &input = inputs[first_index];
+              input.ramp.apply(sources[0].samples, region, frames_read, input.channels);
+              if (input.channels < channels) {
+                upmix_in_place(region, frames_read);
+              }
+            } else {
+              // The limiter delays the mix, so fewer frames may come out than went in while its delay line fills
+              frames_output = this_mixer->mix_audio_samples_(sources, source_count, region, frames_read);
+            }
+            if (process_output) {
+              this_mixer->process_output_(region, frames_output);
+            }
+            this_mixer->commit_output_(region, frames_output * frame_bytes);
+
+            // Every input has been written to the output sink, so release them now
+            for (size_t i = 0; i < source_count; ++i) {
+              InputState &input = inputs[source_inputs[i]];
+              const size_t bytes_to_read = frames_read * input.frame_bytes;
+              if (input.pcm_bytes_left > 0) {
+                input.pcm_current = (const int16_t *) ((const uint8_t *) input.pcm_current + bytes_to_read);
+                input.pcm_bytes_left -= bytes_to_read;
+              } else {
+                input.ring_buffer->release(bytes_to_read);
+              }
+            }
           }
         }
-      } else {
-        // No audio data available in either buffer
 
-        delay(TASK_DELAY_MS);
+        // Keeps the ramps of inputs that weren't mixed in this block on time
+        for (uint8_t i = 0; i < input_count; ++i) {
+          if (inputs[i].available == 0) {
+            inputs[i].ramp.advance(frames_read);
+          }
+        }
+      } else if (sink->flush(pdMS_TO_TICKS(TASK_DELAY_MS))) {
+        // No audio data available in any input, and the sink isn't holding any back. Sleep until a command arrives or
+        // a pipeline commits audio to an input's ring buffer; both notify the task.
+#ifdef USE_AUDIO_PIPELINE_STATS
+        ++this_mixer->idle_wakeups_;
+#endif
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
       }
     }
   }
@@ -272,10 +715,15 @@ void AudioMixer::audio_mixer_task_(void *params) {
   event.type = EventType::STOPPING;
   xQueueSend(this_mixer->event_queue_, &event, portMAX_DELAY);
 
-  this_mixer->reset_ring_buffers_();
-  allocator.deallocate(media_buffer, OUTPUT_BUFFER_SAMPLES);
-  allocator.deallocate(announcement_buffer, OUTPUT_BUFFER_SAMPLES);
-  allocator.deallocate(combination_buffer, OUTPUT_BUFFER_SAMPLES);
+  for (uint8_t i = 0; i < input_count; ++i) {
+    this_mixer->inputs_[i].pcm_playing.store(false);
+    if (inputs[i].ring_buffer != nullptr) {
+      inputs[i].ring_buffer->reset();
+      inputs[i].ring_buffer->set_consumer_task(nullptr);
+    }
+    // The task no longer uses any ring buffer, so on demand inputs can be released
+    this_mixer->inputs_[i].attached.store(false);
+  }
 
   event.type = EventType::STOPPED;
   xQueueSend(this_mixer->event_queue_, &event, portMAX_DELAY);
@@ -286,16 +734,7 @@ void AudioMixer::audio_mixer_task_(void *params) {
 }
 
 esp_err_t AudioMixer::allocate_buffers_() {
-  if (this->media_ring_buffer_ == nullptr)
-    this->media_ring_buffer_ = RingBuffer::create(INPUT_RING_BUFFER_SAMPLES * sizeof(int16_t));
-
-  if (this->announcement_ring_buffer_ == nullptr)
-    this->announcement_ring_buffer_ = RingBuffer::create(INPUT_RING_BUFFER_SAMPLES * sizeof(int16_t));
-
-  if ((this->announcement_ring_buffer_ == nullptr) || (this->media_ring_buffer_ == nullptr)) {
-    return ESP_ERR_NO_MEM;
-  }
-
+  // The input ring buffers are allocated by add_input
   if (this->stack_buffer_ == nullptr)
     this->stack_buffer_ = (StackType_t *) malloc(TASK_STACK_SIZE);
 
@@ -316,65 +755,101 @@ esp_err_t AudioMixer::allocate_buffers_() {
   return ESP_OK;
 }
 
-void AudioMixer::reset_ring_buffers_() {
-  this->media_ring_buffer_->reset();
-  this->announcement_ring_buffer_->reset();
+size_t AudioMixer::input_ring_buffer_size_(uint8_t channels) const {
+  return INPUT_RING_BUFFER_FRAMES * channels * sizeof(int16_t);
 }
 
-void AudioMixer::mix_audio_samples_without_clipping_(int16_t *media_buffer, int16_t *announcement_buffer,
-                                                     int16_t *combination_buffer, size_t samples_to_mix) {
-  // We first test adding the two clips samples together and check for any clipping
-  // We want the announcement volume to be consistent, regardless if media is playing or not
-  // If there is clipping, we determine what factor we need to multiply that media sample by to avoid it
-  // We take the smallest factor necessary for all the samples so the media volume is consistent on this batch
-  // of samples
-  // Note: This may not be the best approach. Adding 2 audio samples together makes both sound louder, even if
-  // we are not clipping. As a result, the mixed announcement will sound louder (by around 3dB if the audio
-  // streams are independent?) than if it were by itself.
-
-  int16_t q15_scaling_factor = MAX_AUDIO_SAMPLE_VALUE;
-
-  for (int i = 0; i < samples_to_mix; ++i) {
-    int32_t added_sample = static_cast<int32_t>(media_buffer[i]) + static_cast<int32_t>(announcement_buffer[i]);
-
-    if ((added_sample > MAX_AUDIO_SAMPLE_VALUE) || (added_sample < MIN_AUDIO_SAMPLE_VALUE)) {
-      // The largest magnitude the media sample can be to avoid clipping (converted to Q30 fixed point)
-      int32_t q30_media_sample_safe_max =
-          static_cast<int32_t>(std::abs(MIN_AUDIO_SAMPLE_VALUE) - std::abs(announcement_buffer[i])) << 15;
-
-      // Actual media sample value (Q15 number stored in an int32 for future division)
-      int32_t media_sample_value = abs(media_buffer[i]);
-
-      // Calculation to perform the Q15 division for media_sample_safe_max/media_sample_value
-      // Reference: https://sestevenson.wordpress.com/2010/09/20/fixed-point-division-2/ (accessed August 15,
-      // 2024)
-      int16_t necessary_q15_factor = static_cast<int16_t>(q30_media_sample_safe_max / media_sample_value);
-      // Take the minimum scaling factor (the smaller the factor, the more it needs to be scaled down)
-      q15_scaling_factor = std::min(necessary_q15_factor, q15_scaling_factor);
-    } else {
-      // Store the combined samples in the combination buffer. If we do not need to scale, then the samples are already
-      // mixed.
-      combination_buffer[i] = added_sample;
-    }
-  }
+size_t AudioMixer::input_start_threshold_(uint8_t input, uint8_t channels) const {
+  // The same duration as the settings' threshold, which is in frames of the input's most channels
+  const MixerInputSettings &settings = this->inputs_[input].settings;
+  const size_t threshold = std::min(settings.start_threshold, this->input_ring_buffer_size_(settings.channels) / 2);
+  return threshold / settings.channels * channels;
+}
 
-  if (q15_scaling_factor < MAX_AUDIO_SAMPLE_VALUE) {
-    // Need to scale to avoid clipping
+size_t AudioMixer::acquire_output_(int16_t **region, size_t min_bytes) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+  const uint32_t start_us = micros();
+#endif
+  size_t region_bytes = this->output_sink_->acquire(region, min_bytes, pdMS_TO_TICKS(TASK_DELAY_MS));
+#ifdef USE_AUDIO_PIPELINE_STATS
+  this->output_stats_.output_wait_us += micros() - start_us;
+#endif
+  return region_bytes;
+}
 
-    this->scale_audio_samples_(media_buffer, media_buffer, q15_scaling_factor, samples_to_mix);
+void AudioMixer::commit_output_(const int16_t *region, size_t bytes) {
+  if (this->reference_tap_ != nullptr) {
+    this->reference_tap_->write(region, bytes);
+  }
+  this->output_sink_->commit(bytes);
+#ifdef USE_AUDIO_PIPELINE_STATS
+  this->output_stats_.bytes_processed += bytes;
+#endif
+}
 
-    // Mix both stream by adding them together with no bitshift
-    // The dsps_add functions have the following inputs:
-    // (buffer 1, buffer 2, output buffer, number of samples, buffer 1 step, buffer 2 step, output, buffer step,
-    // bitshift)
-    dsps_add_s16(media_buffer, announcement_buffer, combination_buffer, samples_to_mix, 1, 1, 1, 0);
+void AudioMixer::process_output_(int16_t *samples, size_t frames) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+  const uint32_t start_us = micros();
+#endif
+  this->output_processor_.process(samples, frames);
+#ifdef USE_AUDIO_PIPELINE_STATS
+  this->output_processing_us_ += micros() - start_us;
+  this->output_processed_frames_ += frames;
+#endif
+}
+
+size_t AudioMixer::mix_audio_samples_(const MixSource *sources, size_t source_count, int16_t *output_buffer,
+                                      size_t frames_to_mix) {
+  // Each frame is split into the sum of the highest priority sources and the sum of the rest (the background). We
+  // want the highest priority sources' volume to be consistent, regardless of what else is playing, so the limiter
+  // only turns down the background. If every source has the same priority, they all count as background.
+  // Each gain scaled sample fits in 16 bits, so the 32 bit sums have plenty of headroom for MAX_MIXER_INPUTS sources.
+
+  uint8_t highest_priority = 0;
+  uint8_t lowest_priority = UINT8_MAX;
+  for (size_t s = 0; s < source_count; ++s) {
+    highest_priority = std::max(highest_priority, sources[s].priority);
+    lowest_priority = std::min(lowest_priority, sources[s].priority);
+  }
+  // Priority that protects a source from the limiter; above every source if they all have the same priority
+  const uint16_t protected_priority =
+      (highest_priority > lowest_priority) ? highest_priority : static_cast<uint16_t>(highest_priority) + 1;
+
+  const uint8_t channels = this->channels_;
+  int32_t protected_sums[2];
+  int32_t background_sums[2];
+  size_t frames_output = 0;
+
+  for (size_t i = 0; i < frames_to_mix; ++i) {
+    this->sum_frame_(sources, source_count, protected_priority, i, channels, protected_sums, background_sums);
+    if (this->limiter_.process_frame(protected_sums, background_sums, output_buffer + channels * frames_output)) {
+      ++frames_output;
+    }
   }
+
+  return frames_output;
 }
 
-void AudioMixer::scale_audio_samples_(int16_t *audio_samples, int16_t *output_buffer, int16_t scale_factor,
-                                      size_t samples_to_scale) {
-  // Scale the audio samples and store them in the output buffer
-  dsps_mulc_s16(audio_samples, output_buffer, samples_to_scale, scale_factor, 1, 1);
+void AudioMixer::sum_frame_(const MixSource *sources, size_t source_count, uint16_t protected_priority, size_t frame,
+                            uint8_t channels, int32_t *protected_sums, int32_t *background_sums) {
+  protected_sums[0] = protected_sums[1] = 0;
+  background_sums[0] = background_sums[1] = 0;
+
+  for (size_t s = 0; s < source_count; ++s) {
+    int32_t gain = sources[s].ramp->next_gain();
+    int32_t *sums = (sources[s].priority >= protected_priority) ? protected_sums : background_sums;
+    const int16_t *samples = sources[s].samples + frame * sources[s].channels;
+    if (sources[s].channels < channels) {
+      // A mono source is upmixed as it is accumulated
+      int32_t sample = (static_cast<int32_t>(samples[0]) * gain) >> 15;
+      sums[0] += sample;
+      sums[1] += sample;
+    } else {
+      for (uint8_t channel = 0; channel < channels; ++channel) {
+        sums[channel] += (static_cast<int32_t>(samples[channel]) * gain) >> 15;
+      }
+    }
+  }
 }
 
 }  // namespace nabu
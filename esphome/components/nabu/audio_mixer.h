@@ -2,36 +2,82 @@
 
 #ifdef USE_ESP_IDF
 
+#include "audio_output_sink.h"
+#include "audio_reference_tap.h"
+#include "audio_ring_buffer.h"
+#include "gain_ramp.h"
+#include "output_processor.h"
+#include "peak_limiter.h"
+
 #include "esphome/components/media_player/media_player.h"
 #include "esphome/components/speaker/speaker.h"
 
 #include "esphome/core/hal.h"
 #include "esphome/core/helpers.h"
-#include "esphome/core/ring_buffer.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 
+#include <atomic>
+
 namespace esphome {
 namespace nabu {
 
-// Mixes two incoming audio streams together
-//  - The media stream intended for music playback
-//    - Able to duck (made quieter)
-//    - Able to pause
-//  - The announcement stream is intended for TTS reponses or various beeps/sound effects
-//    - Unable to duck
-//    - Unable to pause
-//  - Each stream has a corresponding input ring buffer. Retrieved via the `get_media_ring_buffer` and
-//    `get_announcement_ring_buffer` functions
-//  - The mixed audio is sent to the configured speaker component.
+// Mixes any number of incoming audio streams together, up to MAX_MIXER_INPUTS
+//  - Each input is added with ``add_input`` before the task starts. Its settings give it
+//    - A gain, changeable at runtime with the SET_GAIN command
+//    - A ducking group. DUCK commands make every input in the group quieter; group 0 is never ducked.
+//    - Every gain change, including ducking, ramps per sample with a ``GainRamp``. An input's ramp targets its gain
+//      times its ducking group's reduction and the mixer's volume.
+//  - A volume scales every input, e.g., for software volume control. It is set with ``set_volume`` before the task
+//    starts and changed with the SET_VOLUME command, which ramps every input like ducking does.
+//    - A priority. Mixes of several inputs go through a look-ahead peak limiter, so no mix clips. It only turns down
+//      the inputs below the highest playing priority, so the highest priority inputs keep their level. If every playing
+//      input has the same priority, it turns them all down.
+//    - A start threshold. An input only starts playing once its ring buffer holds that much audio, or once its
+//      pipeline sends a FLUSH command because the stream ended. An input that runs dry waits for the threshold again.
+//  - Each input has a corresponding ring buffer. Retrieved via the `get_input_ring_buffer` function
+//    - An on demand input only has a ring buffer between ``reserve_input`` and ``release_input``, e.g., for a second
+//      stream that only plays during a crossfade. The task only uses it after an ATTACH command and hands it back with
+//      a DETACH command, so it is never freed while the task reads it.
+//    - An input can instead play from PCM already in memory (see `play_pcm`), which skips its ring buffer and the
+//      pipeline that would otherwise fill it
+//    - Any input can be paused and resumed
+//    - Any input can be faded in or out with the FADE command. The fade scales the input's gain like its ducking group
+//      does, so a fade and the input's own gain changes don't override each other.
+//    - A single playing input is sent to the speaker straight from its ring buffer, with its gain applied in place.
+//      Mixing several inputs accumulates their gain scaled samples in 32 bits in a single pass over the output block,
+//      stepping each input's gain ramp per frame. The limiter delays the mix by a few milliseconds; once only one input
+//      is left, the delayed end of the mix is sent before that input's audio.
+//  - The mix is stereo by default. A mono mixer (see ``set_channels``) runs its inputs, mixing, ducking, limiting, and
+//    output processing on one channel, halving the input ring buffers and the work per frame. Its output sink
+//    duplicates the channel only when the output needs stereo (see ``set_stereo_output``).
+//  - Each input has its own number of channels. A mono input of a stereo mixer, e.g., for speech, is upmixed while it
+//    is mixed, so its ring buffer and the pipeline feeding it carry half the bytes. Such an input is never sent
+//    without a copy; its gain is applied into the output sink and the samples are then duplicated in place.
+//    - The settings give the most channels an input carries, which sizes its ring buffer. ``set_input_channels``
+//      switches it to fewer for a stream that has fewer, e.g., a mono stream on a stereo media input. The ring buffer
+//      then holds longer, and the start threshold is scaled to the same duration.
+//  - An optional OutputProcessor equalizes and compresses everything sent to the output, after mixing and limiting.
+//    It is configured before the task starts and can be switched on and off with the SET_OUTPUT_PROCESSING command,
+//    e.g., to only use it for a built in speaker.
+//  - An optional AudioReferenceTap gets a copy of everything handed to the output sink, e.g., as an echo canceller's
+//    reference
+//  - The mixed audio is sent to an AudioOutputSink, by default one wrapping the configured speaker component
+//    - Mixes, the limiter's delayed audio, and scaled PCM are written straight into a region of the sink's memory
+//    - A single input's audio is copied into the sink from its ring buffer
 //  - The mixer runs as a FreeRTOS task
+//    - When no input has audio, the task sleeps on its task notification. Commands and commits to the input ring
+//      buffers notify it, so it starts mixing as soon as audio arrives without polling.
 //    - The task reports its state using the TaskEvent queue. Regularly call the  `read_event` function to obtain the
 //      current state
 //    - Commands are sent to the task using a the CommandEvent queue. Use the `send_command` function to do so.
 //    - Use the `start` function to initiate. The `stop` function deletes the task, but be sure to send a STOP command
 //      first to avoid memory leaks.
 
+static const uint8_t MAX_MIXER_INPUTS = 4;
+static const uint8_t MAX_DUCKING_GROUPS = 4;  // Groups 1 to MAX_DUCKING_GROUPS; 0 means the input never ducks
+
 enum class EventType : uint8_t {
   STARTING = 0,
   STARTED,
@@ -49,19 +95,46 @@ struct TaskEvent {
 };
 
 enum class CommandEventType : uint8_t {
-  STOP,                // Stop mixing to prepare for stopping the mixing task
-  DUCK,                // Duck the media audio
-  PAUSE_MEDIA,         // Pauses the media stream
-  RESUME_MEDIA,        // Resumes the media stream
-  CLEAR_MEDIA,         // Resets the media ring buffer
-  CLEAR_ANNOUNCEMENT,  // Resets the announcement ring buffer
+  STOP,                   // Stop mixing to prepare for stopping the mixing task
+  DUCK,                   // Duck the inputs in a ducking group
+  PAUSE,                  // Pauses an input
+  RESUME,                 // Resumes an input
+  CLEAR,                  // Resets an input's ring buffer and drops any PCM it is playing
+  PLAY_PCM,               // Plays an input from PCM in memory instead of its ring buffer
+  FLUSH,                  // Starts an input even if it is below its start threshold
+  SET_GAIN,               // Changes an input's gain
+  SET_OUTPUT_PROCESSING,  // Switches the output processing on or off
+  FADE,                   // Fades an input to a level
+  ATTACH,                 // Starts using an on demand input's newly allocated ring buffer; sent by reserve_input
+  DETACH,                 // Stops using an on demand input's ring buffer so it can be freed; sent by release_input
+  SET_STEREO_OUTPUT,      // Switches a mono mixer's output between mono and duplicated stereo
+  SET_CHANNELS,           // Drops an input's audio and switches its channels; sent by set_input_channels
+  SET_VOLUME,             // Changes the volume of every input
 };
 
 // Used to send commands to the mixer task
 struct CommandEvent {
   CommandEventType command;
+  uint8_t input = 0;  // Every command but STOP, DUCK, SET_OUTPUT_PROCESSING, SET_STEREO_OUTPUT, and SET_VOLUME
+  uint8_t ducking_group = 1;  // DUCK
   uint8_t decibel_reduction;
-  size_t transition_samples = 0;
+  size_t transition_samples = 0;      // DUCK, SET_GAIN, FADE, and SET_VOLUME; counts every channel's samples
+  int16_t gain = INT16_MAX;           // SET_GAIN, FADE, and SET_VOLUME; Q15 fixed point
+  GainRampShape ramp_shape = GainRampShape::EXPONENTIAL;  // SET_GAIN, FADE, and SET_VOLUME
+  const int16_t *pcm_data = nullptr;  // The input's channels, 16 bits per sample, at the speaker's sample rate
+  size_t pcm_length = 0;              // in bytes
+  bool enabled = true;                // SET_OUTPUT_PROCESSING and SET_STEREO_OUTPUT
+};
+
+// Configures one of the mixer's inputs; see the AudioMixer description
+struct MixerInputSettings {
+  int16_t gain{INT16_MAX};  // Q15 fixed point
+  uint8_t ducking_group{0};
+  uint8_t priority{0};
+  size_t start_threshold{0};  // in bytes of the input's most channels; limited to half the ring buffer, so it is
+                              // reachable
+  bool on_demand{false};      // The ring buffer is only allocated between reserve_input and release_input
+  uint8_t channels{0};        // The most the input carries; 1 or 2, up to the mixer's channels; 0 uses the mixer's
 };
 
 // Gives the Q15 fixed point scaling factor to reduce by 0 dB, 1dB, ..., 50 dB
@@ -74,39 +147,157 @@ static const std::vector<int16_t> decibel_reduction_table = {
 
 class AudioMixer {
  public:
-  /// @brief Sends a CommandEvent to the command queue
+  /// @brief Stops the task if it is running and frees the mixer's buffers
+  ~AudioMixer();
+
+  /// @brief Sends a CommandEvent to the command queue and wakes the task to handle it
   /// @param command Pointer to CommandEvent object to be sent
-  /// @param ticks_to_wait The number of FreeRTOS ticks to wait for an event to appear on the queue. Defaults to 0.
-  /// @return pdTRUE if successful, pdFALSE otherwises
-  BaseType_t send_command(CommandEvent *command, TickType_t ticks_to_wait = portMAX_DELAY) {
-    return xQueueSend(this->command_queue_, command, ticks_to_wait);
-  }
+  /// @param ticks_to_wait The number of FreeRTOS ticks to wait for room in the queue if it is full. Defaults to
+  /// portMAX_DELAY, which waits until the task takes a command.
+  /// @return pdTRUE if successful, pdFALSE otherwise
+  BaseType_t send_command(CommandEvent *command, TickType_t ticks_to_wait = portMAX_DELAY);
 
   /// @brief Reads a TaskEvent from the event queue indicating its current status
   /// @param event Pointer to TaskEvent object to store the event in
-  /// @param ticks_to_wait The number of FreeRTOS ticks to wait for an event to appear on the queue. Defaults to 0.
+  /// @param ticks_to_wait The number of FreeRTOS ticks to wait for an event to appear on the queue. Defaults to 0,
+  /// which returns right away if there is none.
   /// @return pdTRUE if successful, pdFALSE otherwise
   BaseType_t read_event(TaskEvent *event, TickType_t ticks_to_wait = 0) {
     return xQueueReceive(this->event_queue_, event, ticks_to_wait);
   }
 
-  /// @brief Starts the mixer task
+  /// @brief Starts the mixer task, sending its audio to a speaker through a SpeakerOutputSink
   /// @param speaker Pointer to Speaker component
   /// @param task_name FreeRTOS task name
   /// @param priority FreeRTOS task priority. Defaults to 1
+  /// @param core core to pin the task to. Defaults to tskNO_AFFINITY, which lets it run on either
+  /// @return ESP_OK if successful, and error otherwise
+  esp_err_t start(speaker::Speaker *speaker, const std::string &task_name, UBaseType_t priority = 1,
+                  BaseType_t core = tskNO_AFFINITY);
+
+  /// @brief Starts the mixer task
+  /// @param sink where the mixer sends its audio; must outlive the task
+  /// @param task_name FreeRTOS task name
+  /// @param priority FreeRTOS task priority. Defaults to 1
+  /// @param core core to pin the task to. Defaults to tskNO_AFFINITY, which lets it run on either
   /// @return ESP_OK if successful, and error otherwise
-  esp_err_t start(speaker::Speaker *speaker, const std::string &task_name, UBaseType_t priority = 1);
+  esp_err_t start(AudioOutputSink *sink, const std::string &task_name, UBaseType_t priority = 1,
+                  BaseType_t core = tskNO_AFFINITY);
 
   /// @brief Stops the mixer task and clears the queues
   void stop();
 
-  /// @brief Retrieves the media stream's ring buffer pointer
-  /// @return pointer to media ring buffer
-  RingBuffer *get_media_ring_buffer() { return this->media_ring_buffer_.get(); }
+  /// @brief Sets the sample rate of the audio sent to the speaker, which times the limiter. Call before ``start``.
+  void set_sample_rate(uint32_t sample_rate) { this->sample_rate_ = sample_rate; }
+
+  /// @brief Sets the number of channels the inputs and the mix have; 1 or 2. Defaults to 2. Call before ``add_input``,
+  /// as it sizes the input ring buffers.
+  void set_channels(uint8_t channels) { this->channels_ = channels; }
+  /// @brief Number of channels the inputs and the mix have
+  uint8_t get_channels() const { return this->channels_; }
+
+  /// @brief Sets whether a mono mixer's output sink duplicates the mix into stereo. Call before ``start``; the
+  /// SET_STEREO_OUTPUT command switches it afterwards. Ignored by a stereo mixer.
+  void set_stereo_output(bool stereo_output) { this->stereo_output_ = stereo_output; }
+
+  /// @brief Sets the volume every input is scaled by, in Q15 fixed point. Defaults to unity. Call before ``start``;
+  /// the SET_VOLUME command ramps it afterwards.
+  void set_volume(int16_t volume) { this->volume_ = volume; }
+
+  /// @brief Sets the equalizer and compressor applied to the output. Call before ``start``.
+  /// @param settings the equalizer bands and compressor
+  /// @param enabled whether the processing starts switched on
+  void set_output_processing(const OutputProcessorSettings &settings, bool enabled) {
+    this->output_processing_settings_ = settings;
+    this->output_processing_enabled_ = enabled;
+  }
+
+  /// @brief Sets a tap that gets a copy of the output. Call before ``start``.
+  /// @param tap reference tap created for the mixer's sample rate; must outlive the task. nullptr for none.
+  void set_reference_tap(AudioReferenceTap *tap) { this->reference_tap_ = tap; }
 
-  /// @brief Retrieves the announcement stream's ring buffer pointer
-  /// @return pointer to announcement ring buffer
-  RingBuffer *get_announcement_ring_buffer() { return this->announcement_ring_buffer_.get(); }
+  /// @brief Adds an input stream and allocates its ring buffer. Call before ``start``.
+  /// @param settings the input's gain, ducking group, priority, start threshold, and channels
+  /// @param input (output) index of the new input, used by the input functions and commands
+  /// @return ESP_OK if successful, ESP_ERR_INVALID_STATE if the task has started, ESP_ERR_INVALID_ARG if the ducking
+  /// group is above MAX_DUCKING_GROUPS or the input has more channels than the mixer, or ESP_ERR_NO_MEM if there are
+  /// already MAX_MIXER_INPUTS inputs or the ring buffer couldn't be allocated
+  esp_err_t add_input(const MixerInputSettings &settings, uint8_t &input);
+
+  /// @brief Allocates an on demand input's ring buffer and has the task start using it. Before ``start``, the task
+  /// uses it from the start, like an input that isn't on demand.
+  /// @param input index of the input
+  /// @return ESP_OK if successful, ESP_ERR_INVALID_ARG if the input isn't on demand, or ESP_ERR_NO_MEM if the ring
+  /// buffer couldn't be allocated
+  esp_err_t reserve_input(uint8_t input);
+
+  /// @brief Has the task stop using an on demand input's ring buffer, then frees it. Stop the input's producer first.
+  /// Waits for the task to handle the command, which takes at most one block.
+  /// @param input index of the input
+  /// @return ESP_OK if the ring buffer is freed or wasn't reserved, ESP_ERR_INVALID_ARG if the input isn't on demand,
+  /// or ESP_ERR_TIMEOUT if the task didn't let go of the ring buffer in time; it is kept, so try again later
+  esp_err_t release_input(uint8_t input);
+
+  /// @brief Retrieves an input's ring buffer pointer
+  /// @return pointer to the input's ring buffer, or nullptr if there is no such input or it is an on demand input
+  /// that isn't reserved
+  AudioRingBuffer *get_input_ring_buffer(uint8_t input) {
+    return (input < this->input_count_) ? this->inputs_[input].ring_buffer.get() : nullptr;
+  }
+
+  /// @brief Switches the number of channels in each frame of an input's ring buffer and PCM. Drops the audio the
+  /// input has buffered or is playing from memory, so stop its producer or let it drain first. Waits for the task to
+  /// handle the command, which takes at most one block.
+  /// @param input index of the input
+  /// @param channels 1 or 2, up to the input's most channels (see MixerInputSettings); 0 uses its most channels
+  /// @return ESP_OK if the input has the channels, ESP_ERR_INVALID_ARG if there is no such input or it can't carry
+  /// that many channels, ESP_FAIL if the command couldn't be sent, or ESP_ERR_TIMEOUT if the task didn't handle the
+  /// command in time. A switch that timed out is canceled, so the input keeps its channels and audio.
+  esp_err_t set_input_channels(uint8_t input, uint8_t channels);
+
+  /// @brief Number of channels in each frame of an input's ring buffer and PCM
+  uint8_t get_input_channels(uint8_t input) const {
+    return (input < this->input_count_) ? this->inputs_[input].channels.load() : this->channels_;
+  }
+
+  /// @brief The most channels an input carries, from its settings
+  uint8_t get_input_max_channels(uint8_t input) const {
+    return (input < this->input_count_) ? this->inputs_[input].settings.channels : this->channels_;
+  }
+
+  /// @brief Plays an input straight from memory. Replaces any PCM already playing on the input.
+  /// @param input index of the input
+  /// @param data 16 bit samples with the input's channels at the speaker's sample rate; must stay valid until playback
+  /// finishes
+  /// @param length length of the data in bytes
+  /// @return pdTRUE if the command was sent, pdFALSE otherwise
+  BaseType_t play_pcm(uint8_t input, const int16_t *data, size_t length);
+
+  /// @brief Whether the mixer is still playing an input from memory
+  bool is_playing_pcm(uint8_t input) const {
+    return (input < this->input_count_) && this->inputs_[input].pcm_playing.load();
+  }
+
+  /// @brief The millis() timestamp of when the input last started sending audio to the speaker
+  uint32_t get_output_started_ms(uint8_t input) const {
+    return (input < this->input_count_) ? this->inputs_[input].output_started_ms.load() : 0;
+  }
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  /// @brief Collects the mixer's counters. The output side is the speaker; underruns are counted by the input ring
+  /// buffers.
+  /// @param stats (output) cumulative counters since the mixer started
+  void get_stats(AudioStageStats &stats);
+
+  /// @brief Number of times the task found no audio to mix and went to sleep. Each is a wakeup that did no mixing,
+  /// apart from the first.
+  uint32_t get_idle_wakeups() const { return this->idle_wakeups_; }
+
+  /// @brief Time spent in the output processing, in microseconds. Compare it to the duration of the processed frames.
+  uint32_t get_output_processing_us() const { return this->output_processing_us_; }
+  /// @brief Number of frames the output processing has processed
+  uint32_t get_output_processed_frames() const { return this->output_processed_frames_; }
+#endif
 
   /// @brief Suspends the mixer task
   void suspend_task();
@@ -118,24 +309,55 @@ class AudioMixer {
   /// @return ESP_OK if successful or an error otherwise
   esp_err_t allocate_buffers_();
 
-  /// @brief Resets the media and anouncement ring buffers
-  void reset_ring_buffers_();
-
-  /// @brief Mixes the media and announcement samples. If the resulting audio clips, the media samples are first scaled.
-  /// @param media_buffer buffer for media samples
-  /// @param announcement_buffer buffer for announcement samples
-  /// @param combination_buffer buffer for the mixed samples
-  /// @param samples_to_mix number of samples in the media and annoucnement buffers to mix together
-  void mix_audio_samples_without_clipping_(int16_t *media_buffer, int16_t *announcement_buffer,
-                                           int16_t *combination_buffer, size_t samples_to_mix);
-
-  /// @brief Scales audio samples. Scales in place when audio_samples == output_buffer.
-  /// @param audio_samples PCM int16 audio samples
-  /// @param output_buffer Buffer to store the scaled samples
-  /// @param scale_factor Q15 fixed point scaling factor
-  /// @param samples_to_scale Number of samples to scale
-  void scale_audio_samples_(int16_t *audio_samples, int16_t *output_buffer, int16_t scale_factor,
-                            size_t samples_to_scale);
+  /// @brief Size of an input's ring buffer in bytes
+  /// @param channels the input's channels
+  size_t input_ring_buffer_size_(uint8_t channels) const;
+
+  /// @brief An input's start threshold in bytes, for frames of some number of channels
+  /// @param input index of the input
+  /// @param channels the channels the input carries now
+  size_t input_start_threshold_(uint8_t input, uint8_t channels) const;
+
+  /// @brief Gets a region of the output sink to write into, waiting at most TASK_DELAY_MS
+  /// @param region (output) pointer to the start of the writable region
+  /// @param min_bytes the minimum length wanted
+  /// @return length of the region in bytes; 0 if the sink had no space in time
+  size_t acquire_output_(int16_t **region, size_t min_bytes);
+
+  /// @brief Outputs bytes written into the region from ``acquire_output_``
+  /// @param region start of the region from ``acquire_output_``
+  /// @param bytes number of bytes written
+  void commit_output_(const int16_t *region, size_t bytes);
+
+  /// @brief Runs the output processing on samples in place
+  void process_output_(int16_t *samples, size_t frames);
+
+  // An input's samples and the gain ramp to mix them with
+  struct MixSource {
+    const int16_t *samples;
+    GainRamp *ramp;
+    uint8_t priority;
+    uint8_t channels;  // Fewer than the mixer's channels for a mono input that is upmixed
+  };
+
+  /// @brief Mixes the sources in a single pass, accumulating the gain scaled samples in 32 bits, and feeds the sums
+  /// through the limiter. Each source's gain ramp steps once per frame.
+  /// @param sources the sources to mix
+  /// @param source_count number of sources; at most MAX_MIXER_INPUTS
+  /// @param output_buffer buffer for the limited samples
+  /// @param frames_to_mix number of frames from each source to mix together
+  /// @return number of frames output by the limiter; fewer than frames_to_mix while its delay line fills
+  size_t mix_audio_samples_(const MixSource *sources, size_t source_count, int16_t *output_buffer,
+                            size_t frames_to_mix);
+
+  /// @brief Sums one frame of the sources, split into the protected sources and the background. Mono sources are
+  /// added to both channels of a stereo mix.
+  /// @param frame index of the frame in every source
+  /// @param channels channels in the mix; 1 or 2
+  /// @param protected_sums (output) each channel's sum of the sources at or above protected_priority
+  /// @param background_sums (output) each channel's sum of the other sources
+  static inline void sum_frame_(const MixSource *sources, size_t source_count, uint16_t protected_priority,
+                                size_t frame, uint8_t channels, int32_t *protected_sums, int32_t *background_sums);
 
   static void audio_mixer_task_(void *params);
   TaskHandle_t task_handle_{nullptr};
@@ -143,15 +365,56 @@ class AudioMixer {
   StackType_t *stack_buffer_{nullptr};
 
   // Reports events from the mixer task
-  QueueHandle_t event_queue_;
+  QueueHandle_t event_queue_{nullptr};
 
   // Stores commands to send the mixer task
-  QueueHandle_t command_queue_;
+  QueueHandle_t command_queue_{nullptr};
 
-  speaker::Speaker *speaker_{nullptr};
+  AudioOutputSink *output_sink_{nullptr};
+  // Owns the sink when the mixer is started with a speaker
+  std::unique_ptr<SpeakerOutputSink> speaker_sink_;
 
-  std::unique_ptr<RingBuffer> media_ring_buffer_;
-  std::unique_ptr<RingBuffer> announcement_ring_buffer_;
+  struct MixerInput {
+    MixerInputSettings settings;
+    std::unique_ptr<AudioRingBuffer> ring_buffer;
+    // Set by reserve_input and cleared by the mixer task once it no longer uses an on demand input's ring buffer
+    std::atomic<bool> attached{false};
+    // Channels in the input's frames. Written by add_input, then by set_input_channels before the task starts and by
+    // the task once it switches.
+    std::atomic<uint8_t> channels{2};
+    // The channels a SET_CHANNELS command switches to; 0 once the task claims it or set_input_channels cancels it
+    std::atomic<uint8_t> requested_channels{0};
+    // Notified by the task once it switches to the requested channels
+    TaskHandle_t channels_waiter{nullptr};
+    // Set when PCM is sent and cleared by the mixer task once it is played or dropped
+    std::atomic<bool> pcm_playing{false};
+    // Written by the mixer task whenever the input leaves its start threshold wait
+    std::atomic<uint32_t> output_started_ms{0};
+  };
+  MixerInput inputs_[MAX_MIXER_INPUTS];
+  uint8_t input_count_{0};
+
+  uint32_t sample_rate_{16000};
+  uint8_t channels_{2};
+  bool stereo_output_{true};
+  int16_t volume_{INT16_MAX};
+
+  OutputProcessorSettings output_processing_settings_;
+  bool output_processing_enabled_{false};
+
+  AudioReferenceTap *reference_tap_{nullptr};
+
+  // Only used by the mixer task
+  PeakLimiter limiter_;
+  OutputProcessor output_processor_;
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  // Only the output side; written by the mixer task
+  AudioStageStats output_stats_;
+  uint32_t idle_wakeups_{0};
+  uint32_t output_processing_us_{0};
+  uint32_t output_processed_frames_{0};
+#endif
 };
 }  // namespace nabu
 }  // namespace esphome
@@ -0,0 +1,111 @@
+#ifdef USE_ESP_IDF
+
+#include "audio_output_sink.h"
+
+#include "esphome/core/helpers.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+size_t AudioOutputSink::write(const int16_t *data, size_t bytes, TickType_t ticks_to_wait) {
+  int16_t *region = nullptr;
+  size_t region_bytes = this->acquire(&region, std::min<size_t>(bytes, 1), ticks_to_wait);
+
+  size_t bytes_to_write = std::min(bytes, region_bytes);
+  if (bytes_to_write > 0) {
+    std::memcpy(region, data, bytes_to_write);
+    this->commit(bytes_to_write);
+  }
+
+  return bytes_to_write;
+}
+
+SpeakerOutputSink::~SpeakerOutputSink() {
+  if (this->staging_buffer_ != nullptr) {
+    ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+    allocator.deallocate(this->staging_buffer_, this->staging_bytes_);
+  }
+}
+
+std::unique_ptr<SpeakerOutputSink> SpeakerOutputSink::create(speaker::Speaker *speaker, size_t staging_bytes) {
+  std::unique_ptr<SpeakerOutputSink> sink(new SpeakerOutputSink(speaker, staging_bytes));
+
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  sink->staging_buffer_ = allocator.allocate(staging_bytes);
+  if (sink->staging_buffer_ == nullptr) {
+    return nullptr;
+  }
+
+  return sink;
+}
+
+size_t SpeakerOutputSink::acquire(int16_t **region, size_t min_bytes, TickType_t ticks_to_wait) {
+  // Duplicated audio doubles in size when it is committed
+  size_t region_bytes = this->duplicate_channels_ ? this->staging_bytes_ / 2 : this->staging_bytes_;
+  if ((min_bytes > region_bytes) || !this->flush(ticks_to_wait)) {
+    return 0;
+  }
+
+  *region = reinterpret_cast<int16_t *>(this->staging_buffer_);
+  return region_bytes;
+}
+
+void SpeakerOutputSink::commit(size_t bytes) {
+  if (this->duplicate_channels_) {
+    // Expand from the end, so no sample is overwritten before it is copied
+    int16_t *samples = reinterpret_cast<int16_t *>(this->staging_buffer_);
+    for (size_t i = bytes / sizeof(int16_t); i-- > 0;) {
+      samples[2 * i] = samples[i];
+      samples[2 * i + 1] = samples[i];
+    }
+    bytes *= 2;
+  }
+
+  this->pending_current_ = this->staging_buffer_;
+  this->pending_length_ = bytes;
+
+  // Hand over as much as the speaker takes right away; the rest is sent by the next flush
+  this->flush(0);
+}
+
+size_t SpeakerOutputSink::write(const int16_t *data, size_t bytes, TickType_t ticks_to_wait) {
+  if (this->duplicate_channels_) {
+    return AudioOutputSink::write(data, bytes, ticks_to_wait);
+  }
+
+  // Staged audio was committed earlier, so it has to reach the speaker first
+  if (!this->flush(ticks_to_wait)) {
+    return 0;
+  }
+
+  return this->speaker_->play(reinterpret_cast<const uint8_t *>(data), bytes, ticks_to_wait);
+}
+
+bool SpeakerOutputSink::flush(TickType_t ticks_to_wait) {
+  if (this->pending_length_ > 0) {
+    size_t bytes_written = this->speaker_->play(this->pending_current_, this->pending_length_, ticks_to_wait);
+    this->pending_current_ += bytes_written;
+    this->pending_length_ -= bytes_written;
+  }
+
+  return this->pending_length_ == 0;
+}
+
+size_t RingBufferOutputSink::acquire(int16_t **region, size_t min_bytes, TickType_t ticks_to_wait) {
+  uint8_t *data = nullptr;
+  size_t region_bytes = this->ring_buffer_->reserve(&data, min_bytes, ticks_to_wait);
+  if ((region_bytes == 0) || (region_bytes < min_bytes)) {
+    return 0;
+  }
+
+  *region = reinterpret_cast<int16_t *>(data);
+  return region_bytes;
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include "audio_ring_buffer.h"
+
+#include "esphome/components/speaker/speaker.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace esphome {
+namespace nabu {
+
+// Where the mixer sends its audio. All functions are only called by the mixer task.
+//  - Audio the mixer produces itself, like a mix, is written straight into the sink's memory: ``acquire`` gets a
+//    writable region, the mixer fills it in place, and ``commit`` hands it to the output
+//  - Audio that already exists elsewhere, like a single input's ring buffer, is copied in with ``write``
+//  - A sink may hold committed audio back, e.g., while its output is busy. ``flush`` sends it on, and the mixer calls
+//    it before going idle.
+//  - The audio has the mixer's channels. A sink may duplicate a mono mix into stereo on its way out (see
+//    ``set_duplicate_channels``); all lengths the mixer sees are still in mono bytes.
+class AudioOutputSink {
+ public:
+  virtual ~AudioOutputSink() = default;
+
+  /// @brief Gets a contiguous writable region for the mixer's 16 bit samples. Nothing is output until ``commit`` is
+  /// called.
+  /// @param region (output) pointer to the start of the writable region
+  /// @param min_bytes the minimum length wanted; waits until that much space is free
+  /// @param ticks_to_wait FreeRTOS ticks to wait for min_bytes of space
+  /// @return length of the writable region in bytes; 0 if it timed out
+  virtual size_t acquire(int16_t **region, size_t min_bytes, TickType_t ticks_to_wait) = 0;
+
+  /// @brief Outputs bytes written into the region from ``acquire``
+  /// @param bytes number of bytes written; must not exceed the length returned by ``acquire``
+  virtual void commit(size_t bytes) = 0;
+
+  /// @brief Copies audio into the sink. The default acquires a region, copies into it, and commits it.
+  /// @param data 16 bit samples with the mixer's channels
+  /// @param bytes length of the data in bytes
+  /// @param ticks_to_wait FreeRTOS ticks to wait for space
+  /// @return number of bytes written; may be less than bytes (or 0) if it timed out
+  virtual size_t write(const int16_t *data, size_t bytes, TickType_t ticks_to_wait);
+
+  /// @brief Sends on any committed audio the sink is holding back
+  /// @param ticks_to_wait FreeRTOS ticks to wait for the output
+  /// @return true if no audio is held back anymore
+  virtual bool flush(TickType_t /*ticks_to_wait*/) { return true; }
+
+  /// @brief Sets whether mono audio is duplicated into both channels of a stereo output. Only affects audio acquired
+  /// or written afterwards. Sinks that can't convert ignore it, so their consumer gets the mixer's channels.
+  virtual void set_duplicate_channels(bool /*duplicate*/) {}
+};
+
+// Sends audio to a speaker component
+//  - A speaker only accepts copies through ``play``, so the regions from ``acquire`` are in a staging buffer owned by
+//    the sink. Audio from ``write`` goes straight to the speaker without being staged.
+//  - When the speaker accepts only part of the staged audio, the rest stays where it is and is sent from there. A new
+//    region is only handed out once all of it has been sent, so staged audio is never moved.
+//  - While duplicating mono audio, regions are the first half of the staging buffer and ``commit`` expands them to
+//    stereo in place. Audio from ``write`` is staged too, as the speaker needs the expanded copy.
+class SpeakerOutputSink : public AudioOutputSink {
+ public:
+  ~SpeakerOutputSink() override;
+
+  /// @brief Allocates a sink with its staging buffer, preferring external RAM
+  /// @param speaker speaker to send the audio to
+  /// @param staging_bytes size of the staging buffer; the largest region ``acquire`` can hand out
+  /// @return unique_ptr to the sink, or nullptr if the staging buffer couldn't be allocated
+  static std::unique_ptr<SpeakerOutputSink> create(speaker::Speaker *speaker, size_t staging_bytes);
+
+  size_t acquire(int16_t **region, size_t min_bytes, TickType_t ticks_to_wait) override;
+  void commit(size_t bytes) override;
+  size_t write(const int16_t *data, size_t bytes, TickType_t ticks_to_wait) override;
+  bool flush(TickType_t ticks_to_wait) override;
+  void set_duplicate_channels(bool duplicate) override { this->duplicate_channels_ = duplicate; }
+
+ protected:
+  SpeakerOutputSink(speaker::Speaker *speaker, size_t staging_bytes)
+      : speaker_(speaker), staging_bytes_(staging_bytes) {}
+
+  speaker::Speaker *speaker_;
+
+  uint8_t *staging_buffer_{nullptr};
+  const size_t staging_bytes_;
+  bool duplicate_channels_{false};
+
+  // Staged audio the speaker hasn't accepted yet
+  const uint8_t *pending_current_{nullptr};
+  size_t pending_length_{0};
+};
+
+// Writes audio into a ring buffer, so its consumer (e.g., a task feeding I2S DMA) can read the mix in place. Regions
+// from ``acquire`` are in the ring buffer itself, so mixes are written without any copy.
+class RingBufferOutputSink : public AudioOutputSink {
+ public:
+  /// @param ring_buffer ring buffer to write into; the sink is its producer. ``acquire``'s min_bytes must not exceed
+  /// its guard size.
+  explicit RingBufferOutputSink(AudioRingBuffer *ring_buffer) : ring_buffer_(ring_buffer) {}
+
+  size_t acquire(int16_t **region, size_t min_bytes, TickType_t ticks_to_wait) override;
+  void commit(size_t bytes) override { this->ring_buffer_->commit(bytes); }
+
+ protected:
+  AudioRingBuffer *ring_buffer_;
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -5,20 +5,61 @@
 #include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 
+#include <cmath>
+
 namespace esphome {
 namespace nabu {
 
 static const size_t FILE_BUFFER_SIZE = 32 * 1024;
 static const size_t FILE_RING_BUFFER_SIZE = 64 * 1024;
+// Fits the minimum contiguous input the decoder peeks for MP3 and WAV files
+static const size_t FILE_RING_BUFFER_GUARD_SIZE = 4 * 1024;
 static const size_t BUFFER_SIZE_SAMPLES = 32768;
 static const size_t BUFFER_SIZE_BYTES = BUFFER_SIZE_SAMPLES * sizeof(int16_t);
+// Fits the largest decoded FLAC frame (4608 stereo samples), which the decoder writes in place
+static const size_t BUFFER_GUARD_SIZE = 4608 * 2 * sizeof(int16_t);
+
+// Once a track's stream information is known, the ring buffers are resized to hold this much audio
+static const uint32_t FILE_RING_BUFFER_TARGET_MS = 4000;  // Rides out Wi-Fi hiccups
+static const size_t FILE_RING_BUFFER_MIN_SIZE = 16 * 1024;
+static const size_t FILE_RING_BUFFER_MAX_SIZE = 512 * 1024;
+static const uint32_t BUFFER_TARGET_MS = 500;
+static const size_t BUFFER_MIN_SIZE_BYTES = 2 * BUFFER_GUARD_SIZE;
+static const size_t BUFFER_MAX_SIZE_BYTES = 256 * 1024;
+// Sizes are rounded up to a multiple of this, so tracks with similar bitrates don't reallocate
+static const size_t BUFFER_SIZE_GRANULARITY = 4 * 1024;
 
 static const uint32_t READER_TASK_STACK_SIZE = 5 * 1024;
 static const uint32_t DECODER_TASK_STACK_SIZE = 3 * 1024;
 static const uint32_t RESAMPLER_TASK_STACK_SIZE = 3 * 1024;
 
+// The cooperative task only needs to hold a few blocks between stages, as each stage runs right after the previous
+static const size_t COOPERATIVE_FILE_BUFFER_SIZE = 16 * 1024;
+static const size_t COOPERATIVE_FILE_RING_BUFFER_SIZE = 16 * 1024;
+static const size_t COOPERATIVE_TRANSFER_SIZE = 2 * 1024;  // Bounds how long an HTTP read blocks the other stages
+static const size_t COOPERATIVE_BUFFER_SIZE_SAMPLES = 12 * 1024;  // Still fits one decoded FLAC frame
+static const size_t COOPERATIVE_BUFFER_SIZE_BYTES = COOPERATIVE_BUFFER_SIZE_SAMPLES * sizeof(int16_t);
+static const size_t COOPERATIVE_RESAMPLER_BUFFER_SAMPLES = 4096;
+static const uint32_t COOPERATIVE_TASK_STACK_SIZE = 8 * 1024;
+// How long the cooperative task sleeps when no stage could make progress for lack of input
+static const uint32_t COOPERATIVE_IDLE_DELAY_MS = 5;
+
+// How often the reader and decoder tasks check whether they were resumed while paused
+static const uint32_t PAUSED_POLL_DELAY_MS = 10;
+
 static const size_t INFO_ERROR_QUEUE_COUNT = 5;
 
+// How long a stream waits for the previous one's audio to leave the mixer input before switching its channels. The
+// input holds 250 ms of its most channels, so up to 500 ms of fewer; the rest allows for a speaker that takes audio in
+// bursts.
+static const uint32_t MIXER_INPUT_DRAIN_TIMEOUT_MS = 1000;
+
+// Loudness normalization. A new estimate of an untagged track's loudness completes every 100 ms.
+static const uint32_t NORMALIZATION_FIRST_ESTIMATE_BLOCKS = 10;  // About 1 s of audio, so short sounds are covered
+static const uint32_t NORMALIZATION_UPDATE_BLOCKS = 10;          // Checks the estimate about once a second
+static const float NORMALIZATION_STEP_DB = 0.5f;  // Smaller changes aren't audible, so they aren't sent to the mixer
+static const uint32_t NORMALIZATION_RAMP_MS = 1000;
+
 static const char *const TAG = "nabu_media_player.pipeline";
 
 enum EventGroupBits : uint32_t {
@@ -27,6 +68,13 @@ enum EventGroupBits : uint32_t {
 
   // Stops all activity in the pipeline elements and set by stop() or by each task
   PIPELINE_COMMAND_STOP = (1 << 0),
+  // Seek to seek_byte_offset_; set by seek() and cleared by reader task
+  PIPELINE_COMMAND_SEEK = (1 << 1),
+  // Reader and decoder idle while set, leaving the buffered data in place; set and cleared by set_paused()
+  PIPELINE_COMMAND_PAUSE = (1 << 2),
+
+  // Reader is waiting for the decoder to resize the raw file ring buffer; cleared by reader task
+  READER_MESSAGE_PAUSED = (1 << 3),
 
   // Read audio from an HTTP source; cleared by reader task and set by start(uri,...)
   READER_COMMAND_INIT_HTTP = (1 << 4),
@@ -39,6 +87,11 @@ enum EventGroupBits : uint32_t {
   READER_MESSAGE_FINISHED = (1 << 7),
   // Error reading the file; cleared by get_state()
   READER_MESSAGE_ERROR = (1 << 8),
+  // The current track is completely read and the next track is being read into the next raw file ring buffer; cleared
+  // by the decoder task when it switches to the next track
+  READER_MESSAGE_NEXT_TRACK = (1 << 9),
+  // Reader is waiting to seek until the buffered data is discarded; cleared by the decoder task once it has resynced
+  READER_MESSAGE_SEEKING = (1 << 10),
 
   // Decoder has determined the stream information; cleared by resampler
   DECODER_MESSAGE_LOADED_STREAM_INFO = (1 << 11),
@@ -46,11 +99,21 @@ enum EventGroupBits : uint32_t {
   DECODER_MESSAGE_FINISHED = (1 << 12),
   // Error decoding the file; cleared by get_state() by decoder task
   DECODER_MESSAGE_ERROR = (1 << 13),
+  // Decoder finished the current track and waits to start the next; cleared by resampler task
+  DECODER_MESSAGE_NEXT_TRACK = (1 << 14),
+  // Decoder is waiting for the decoded audio to be discarded before a seek; cleared by resampler task
+  DECODER_MESSAGE_SEEKING = (1 << 15),
+  // Decoder wants to resize the raw file ring buffer once the reader pauses; cleared by decoder task
+  DECODER_MESSAGE_RESIZING = (1 << 16),
 
   // Resampler is done (either through a failure or the end of the stream); cleared by resampler task
   RESAMPLER_MESSAGE_FINISHED = (1 << 17),
   // Error resampling the file; cleared by get_state()
   RESAMPLER_MESSAGE_ERROR = (1 << 18),
+  // Resampler has processed all of the current track's audio; cleared by decoder task
+  RESAMPLER_MESSAGE_NEXT_TRACK_READY = (1 << 19),
+  // Resampler has discarded the decoded audio for a seek; cleared by decoder task
+  RESAMPLER_MESSAGE_SEEK_READY = (1 << 20),
 
   // Cleared by respective tasks
   FINISHED_BITS = READER_MESSAGE_FINISHED | DECODER_MESSAGE_FINISHED | RESAMPLER_MESSAGE_FINISHED,
@@ -58,17 +121,47 @@ enum EventGroupBits : uint32_t {
                                                     // bits of uint32 are not set; cleared by stop()
 };
 
-AudioPipeline::AudioPipeline(AudioMixer *mixer, AudioPipelineType pipeline_type) {
+AudioPipeline::AudioPipeline(AudioMixer *mixer, uint8_t mixer_input, bool cooperative) {
   this->mixer_ = mixer;
-  this->pipeline_type_ = pipeline_type;
+  this->mixer_input_ = mixer_input;
+  this->cooperative_ = cooperative;
+}
+
+AudioPipeline::~AudioPipeline() {
+  // Stopped tasks only wait on the event group for their next stream, so they hold nothing that needs cleaning up
+  TaskHandle_t *task_handles[] = {&this->read_task_handle_, &this->decode_task_handle_, &this->resample_task_handle_,
+                                  &this->cooperative_task_handle_};
+  for (TaskHandle_t *task_handle : task_handles) {
+    if (*task_handle != nullptr) {
+      vTaskDelete(*task_handle);
+      *task_handle = nullptr;
+    }
+  }
+
+  // The tasks were created statically, so their stacks are freed here rather than by FreeRTOS
+  free(this->read_task_stack_buffer_);
+  free(this->decode_task_stack_buffer_);
+  free(this->resample_task_stack_buffer_);
+  free(this->cooperative_task_stack_buffer_);
+
+  if (this->event_group_ != nullptr) {
+    vEventGroupDelete(this->event_group_);
+  }
+  if (this->info_error_queue_ != nullptr) {
+    vQueueDelete(this->info_error_queue_);
+  }
 }
 
 esp_err_t AudioPipeline::start(const std::string &uri, uint32_t target_sample_rate, const std::string &task_name,
-                               UBaseType_t priority) {
-  esp_err_t err = this->common_start_(target_sample_rate, task_name, priority);
+                               UBaseType_t priority, BaseType_t core) {
+  esp_err_t err = this->common_start_(target_sample_rate, task_name, priority, core);
 
   if (err == ESP_OK) {
     this->current_uri_ = uri;
+    this->current_media_file_ = nullptr;
+    if (!this->cooperative_) {
+      this->next_track_state_.store(NEXT_TRACK_NONE);
+    }
     xEventGroupSetBits(this->event_group_, READER_COMMAND_INIT_HTTP);
   }
 
@@ -76,40 +169,149 @@ esp_err_t AudioPipeline::start(const std::string &uri, uint32_t target_sample_ra
 }
 
 esp_err_t AudioPipeline::start(media_player::MediaFile *media_file, uint32_t target_sample_rate,
-                               const std::string &task_name, UBaseType_t priority) {
-  esp_err_t err = this->common_start_(target_sample_rate, task_name, priority);
+                               const std::string &task_name, UBaseType_t priority, BaseType_t core) {
+  esp_err_t err = this->common_start_(target_sample_rate, task_name, priority, core);
 
   if (err == ESP_OK) {
     this->current_media_file_ = media_file;
+    if (!this->cooperative_) {
+      this->next_track_state_.store(NEXT_TRACK_NONE);
+    }
     xEventGroupSetBits(this->event_group_, READER_COMMAND_INIT_FILE);
   }
 
   return err;
 }
 
+esp_err_t AudioPipeline::enqueue(const std::string &uri) {
+  if (this->cooperative_) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (this->next_track_state_.load() != NEXT_TRACK_NONE) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // Safe to modify, as the reader task only reads these once the state is pending
+  this->next_uri_ = uri;
+  this->next_media_file_ = nullptr;
+
+  return this->enqueue_();
+}
+
+esp_err_t AudioPipeline::enqueue(media_player::MediaFile *media_file) {
+  if (this->cooperative_) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (this->next_track_state_.load() != NEXT_TRACK_NONE) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // Safe to modify, as the reader task only reads these once the state is pending
+  this->next_uri_.clear();
+  this->next_media_file_ = media_file;
+
+  return this->enqueue_();
+}
+
+esp_err_t AudioPipeline::seek(size_t byte_offset) {
+  if (this->cooperative_) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (this->event_group_ == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  EventBits_t event_bits = xEventGroupGetBits(this->event_group_);
+  if (event_bits & (PIPELINE_COMMAND_STOP | PIPELINE_COMMAND_SEEK | READER_MESSAGE_SEEKING | READER_MESSAGE_FINISHED |
+                    READER_MESSAGE_NEXT_TRACK)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // Safe to modify, as the reader task only reads it once the command bit is set
+  this->seek_byte_offset_ = byte_offset;
+  xEventGroupSetBits(this->event_group_, EventGroupBits::PIPELINE_COMMAND_SEEK);
+
+  return ESP_OK;
+}
+
+esp_err_t AudioPipeline::enqueue_() {
+  if (this->next_raw_file_ring_buffer_ == nullptr)
+    this->next_raw_file_ring_buffer_ = AudioRingBuffer::create(FILE_RING_BUFFER_SIZE, FILE_RING_BUFFER_GUARD_SIZE);
+
+  if (this->next_raw_file_ring_buffer_ == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  uint8_t expected_state = NEXT_TRACK_NONE;
+  if (!this->next_track_state_.compare_exchange_strong(expected_state, NEXT_TRACK_PENDING)) {
+    // The reader finished reading its last track in the meantime
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  return ESP_OK;
+}
+
+bool AudioPipeline::take_next_track_() {
+  uint8_t state = NEXT_TRACK_NONE;
+  if (this->next_track_state_.compare_exchange_strong(state, NEXT_TRACK_CLOSED)) {
+    // Nothing is queued, so this was the last track
+    return false;
+  }
+
+  if (state != NEXT_TRACK_PENDING) {
+    // The pipeline is stopping
+    return false;
+  }
+
+  this->current_uri_ = this->next_uri_;
+  this->current_media_file_ = this->next_media_file_;
+
+  // Accept another track, unless the pipeline was stopped in the meantime
+  state = NEXT_TRACK_PENDING;
+  this->next_track_state_.compare_exchange_strong(state, NEXT_TRACK_NONE);
+
+  return true;
+}
+
 esp_err_t AudioPipeline::allocate_buffers_() {
+  size_t file_ring_buffer_size = FILE_RING_BUFFER_SIZE;
+  size_t buffer_size_bytes = BUFFER_SIZE_BYTES;
+  if (this->cooperative_) {
+    file_ring_buffer_size = COOPERATIVE_FILE_RING_BUFFER_SIZE;
+    buffer_size_bytes = COOPERATIVE_BUFFER_SIZE_BYTES;
+  }
+
   if (this->raw_file_ring_buffer_ == nullptr)
-    this->raw_file_ring_buffer_ = RingBuffer::create(FILE_RING_BUFFER_SIZE);
+    this->raw_file_ring_buffer_ = AudioRingBuffer::create(file_ring_buffer_size, FILE_RING_BUFFER_GUARD_SIZE);
 
   if (this->decoded_ring_buffer_ == nullptr)
-    this->decoded_ring_buffer_ = RingBuffer::create(BUFFER_SIZE_BYTES);
+    this->decoded_ring_buffer_ = AudioRingBuffer::create(buffer_size_bytes, BUFFER_GUARD_SIZE);
 
   if ((this->raw_file_ring_buffer_ == nullptr) || (this->decoded_ring_buffer_ == nullptr)) {
     return ESP_ERR_NO_MEM;
   }
 
-  if (this->read_task_stack_buffer_ == nullptr)
-    this->read_task_stack_buffer_ = (StackType_t *) malloc(READER_TASK_STACK_SIZE);
+  if (this->cooperative_) {
+    if (this->cooperative_task_stack_buffer_ == nullptr)
+      this->cooperative_task_stack_buffer_ = (StackType_t *) malloc(COOPERATIVE_TASK_STACK_SIZE);
 
-  if (this->decode_task_stack_buffer_ == nullptr)
-    this->decode_task_stack_buffer_ = (StackType_t *) malloc(DECODER_TASK_STACK_SIZE);
+    if (this->cooperative_task_stack_buffer_ == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+  } else {
+    if (this->read_task_stack_buffer_ == nullptr)
+      this->read_task_stack_buffer_ = (StackType_t *) malloc(READER_TASK_STACK_SIZE);
 
-  if (this->resample_task_stack_buffer_ == nullptr)
-    this->resample_task_stack_buffer_ = (StackType_t *) malloc(RESAMPLER_TASK_STACK_SIZE);
+    if (this->decode_task_stack_buffer_ == nullptr)
+      this->decode_task_stack_buffer_ = (StackType_t *) malloc(DECODER_TASK_STACK_SIZE);
 
-  if ((this->read_task_stack_buffer_ == nullptr) || (this->decode_task_stack_buffer_ == nullptr) ||
-      (this->resample_task_stack_buffer_ == nullptr)) {
-    return ESP_ERR_NO_MEM;
+    if (this->resample_task_stack_buffer_ == nullptr)
+      this->resample_task_stack_buffer_ = (StackType_t *) malloc(RESAMPLER_TASK_STACK_SIZE);
+
+    if ((this->read_task_stack_buffer_ == nullptr) || (this->decode_task_stack_buffer_ == nullptr) ||
+        (this->resample_task_stack_buffer_ == nullptr)) {
+      return ESP_ERR_NO_MEM;
+    }
   }
 
   if (this->event_group_ == nullptr)
@@ -129,36 +331,53 @@ esp_err_t AudioPipeline::allocate_buffers_() {
 }
 
 esp_err_t AudioPipeline::common_start_(uint32_t target_sample_rate, const std::string &task_name,
-                                       UBaseType_t priority) {
+                                       UBaseType_t priority, BaseType_t core) {
   esp_err_t err = this->allocate_buffers_();
   if (err != ESP_OK) {
     return err;
   }
 
-  if (this->read_task_handle_ == nullptr) {
-    this->read_task_handle_ =
-        xTaskCreateStatic(AudioPipeline::read_task_, (task_name + "_read").c_str(), READER_TASK_STACK_SIZE,
-                          (void *) this, priority, this->read_task_stack_buffer_, &this->read_task_stack_);
-  }
-  if (this->decode_task_handle_ == nullptr) {
-    this->decode_task_handle_ =
-        xTaskCreateStatic(AudioPipeline::decode_task_, (task_name + "_decode").c_str(), DECODER_TASK_STACK_SIZE,
-                          (void *) this, priority, this->decode_task_stack_buffer_, &this->decode_task_stack_);
-  }
-  if (this->resample_task_handle_ == nullptr) {
-    this->resample_task_handle_ =
-        xTaskCreateStatic(AudioPipeline::resample_task_, (task_name + "_resample").c_str(), RESAMPLER_TASK_STACK_SIZE,
-                          (void *) this, priority, this->resample_task_stack_buffer_, &this->resample_task_stack_);
-  }
+  if (this->cooperative_) {
+    if (this->cooperative_task_handle_ == nullptr) {
+      this->cooperative_task_handle_ = xTaskCreateStaticPinnedToCore(
+          AudioPipeline::cooperative_task_, (task_name + "_pipeline").c_str(), COOPERATIVE_TASK_STACK_SIZE,
+          (void *) this, priority, this->cooperative_task_stack_buffer_, &this->cooperative_task_stack_, core);
+    }
+
+    if (this->cooperative_task_handle_ == nullptr) {
+      return ESP_FAIL;
+    }
+  } else {
+    if (this->read_task_handle_ == nullptr) {
+      this->read_task_handle_ = xTaskCreateStaticPinnedToCore(
+          AudioPipeline::read_task_, (task_name + "_read").c_str(), READER_TASK_STACK_SIZE, (void *) this, priority,
+          this->read_task_stack_buffer_, &this->read_task_stack_, core);
+    }
+    if (this->decode_task_handle_ == nullptr) {
+      this->decode_task_handle_ = xTaskCreateStaticPinnedToCore(
+          AudioPipeline::decode_task_, (task_name + "_decode").c_str(), DECODER_TASK_STACK_SIZE, (void *) this,
+          priority, this->decode_task_stack_buffer_, &this->decode_task_stack_, core);
+    }
+    if (this->resample_task_handle_ == nullptr) {
+      this->resample_task_handle_ = xTaskCreateStaticPinnedToCore(
+          AudioPipeline::resample_task_, (task_name + "_resample").c_str(), RESAMPLER_TASK_STACK_SIZE, (void *) this,
+          priority, this->resample_task_stack_buffer_, &this->resample_task_stack_, core);
+    }
 
-  if ((this->read_task_handle_ == nullptr) || (this->decode_task_handle_ == nullptr) ||
-      (this->resample_task_handle_ == nullptr)) {
-    return ESP_FAIL;
+    if ((this->read_task_handle_ == nullptr) || (this->decode_task_handle_ == nullptr) ||
+        (this->resample_task_handle_ == nullptr)) {
+      return ESP_FAIL;
+    }
   }
 
   this->target_sample_rate_ = target_sample_rate;
 
-  return this->stop();
+  err = this->stop();
+  if (err == ESP_OK) {
+    // Reports the pipeline as playing as soon as it is started, rather than once the tasks wake up for the new stream
+    xEventGroupClearBits(this->event_group_, FINISHED_BITS);
+  }
+  return err;
 }
 
 AudioPipelineState AudioPipeline::get_state() {
@@ -210,6 +429,9 @@ AudioPipelineState AudioPipeline::get_state() {
             if (event.resample_info.value().mono_to_stereo) {
               ESP_LOGD(TAG, "Converting mono channel audio to stereo channel audio");
             }
+            if (event.resample_info.value().stereo_to_mono) {
+              ESP_LOGD(TAG, "Downmixing stereo channel audio to mono channel audio");
+            }
           }
           break;
       }
@@ -217,7 +439,8 @@ AudioPipelineState AudioPipeline::get_state() {
   }
 
   EventBits_t event_bits = xEventGroupGetBits(this->event_group_);
-  if (!this->read_task_handle_ && !this->decode_task_handle_ && !this->resample_task_handle_) {
+  if (!this->read_task_handle_ && !this->decode_task_handle_ && !this->resample_task_handle_ &&
+      !this->cooperative_task_handle_) {
     return AudioPipelineState::STOPPED;
   }
 
@@ -244,8 +467,143 @@ AudioPipelineState AudioPipeline::get_state() {
   return AudioPipelineState::PLAYING;
 }
 
+void AudioPipeline::start_loudness_normalization_(AudioResampler *resampler, bool gapless) {
+  if (!this->loudness_normalization_) {
+    return;
+  }
+
+  uint32_t ramp_ms = NORMALIZATION_RAMP_MS;
+  if (!gapless) {
+    // The mixer input is empty at the start of a stream, so the gain changes right away. Someone else may have set the
+    // input's gain since the last stream (e.g., for cached announcements), so it is always sent.
+    ramp_ms = 0;
+    this->normalization_gain_db_ = NAN;
+  }
+
+  if (this->track_loudness_.has_value()) {
+    resampler->set_loudness_meter(nullptr);
+    this->set_normalization_gain_(normalization_gain_db(this->track_loudness_, this->target_loudness_), ramp_ms);
+    return;
+  }
+
+  this->loudness_meter_.configure(this->target_sample_rate_, this->mixer_->get_input_channels(this->mixer_input_));
+  this->normalization_blocks_ = 0;
+  resampler->set_loudness_meter(&this->loudness_meter_);
+
+  if (!gapless) {
+    // Nothing is known about the new stream yet. A gapless track keeps the previous track's gain until its own
+    // estimate is ready, as tracks on the same album are usually mastered alike.
+    this->set_normalization_gain_(0.0f, ramp_ms);
+  }
+}
+
+void AudioPipeline::update_loudness_normalization_() {
+  if (!this->loudness_normalization_ || this->track_loudness_.has_value()) {
+    return;
+  }
+
+  uint32_t blocks = this->loudness_meter_.get_block_count();
+  if ((blocks < NORMALIZATION_FIRST_ESTIMATE_BLOCKS) ||
+      (blocks - this->normalization_blocks_ < NORMALIZATION_UPDATE_BLOCKS)) {
+    return;
+  }
+  this->normalization_blocks_ = blocks;
+
+  optional<float> loudness = this->loudness_meter_.get_integrated_loudness();
+  if (loudness.has_value()) {
+    this->set_normalization_gain_(normalization_gain_db(loudness, this->target_loudness_), NORMALIZATION_RAMP_MS);
+  }
+}
+
+void AudioPipeline::set_normalization_gain_(float gain_db, uint32_t ramp_ms) {
+  if (std::fabs(gain_db - this->normalization_gain_db_) < NORMALIZATION_STEP_DB) {
+    return;
+  }
+  this->normalization_gain_db_ = gain_db;
+
+  CommandEvent command_event;
+  command_event.command = CommandEventType::SET_GAIN;
+  command_event.input = this->mixer_input_;
+  command_event.gain = db_to_q15_gain(gain_db);
+  command_event.transition_samples = this->mixer_->get_channels() * (this->target_sample_rate_ / 1000) * ramp_ms;
+  command_event.ramp_shape = GainRampShape::EXPONENTIAL;
+  this->mixer_->send_command(&command_event);
+}
+
+void AudioPipeline::notify_resampler_task_() {
+  if (this->cooperative_task_handle_ != nullptr) {
+    xTaskNotifyGive(this->cooperative_task_handle_);
+  }
+  if (this->resample_task_handle_ != nullptr) {
+    xTaskNotifyGive(this->resample_task_handle_);
+  }
+}
+
+void AudioPipeline::set_mixer_input_channels_(uint8_t stream_channels) {
+  const uint8_t channels = std::min(stream_channels, this->mixer_->get_input_max_channels(this->mixer_input_));
+  if (this->mixer_->get_input_channels(this->mixer_input_) == channels) {
+    return;
+  }
+
+  AudioRingBuffer *ring_buffer = this->mixer_->get_input_ring_buffer(this->mixer_input_);
+  if ((ring_buffer != nullptr) && (ring_buffer->available() > 0)) {
+    // The previous stream has ended, so its end plays even if the input is waiting for its start threshold
+    this->flush_mixer_();
+
+    // Sleep until the mixer's releases, or a stop, wake the task. The cooperative task is already the producer task.
+    ring_buffer->set_producer_task(xTaskGetCurrentTaskHandle());
+    const TickType_t start_ticks = xTaskGetTickCount();
+    const TickType_t timeout_ticks = pdMS_TO_TICKS(MIXER_INPUT_DRAIN_TIMEOUT_MS);
+    TickType_t waited_ticks = 0;
+    while ((ring_buffer->available() > 0) && !(xEventGroupGetBits(this->event_group_) & PIPELINE_COMMAND_STOP) &&
+           (waited_ticks < timeout_ticks)) {
+      ulTaskNotifyTake(pdTRUE, timeout_ticks - waited_ticks);
+      waited_ticks = xTaskGetTickCount() - start_ticks;
+    }
+    if (!this->cooperative_) {
+      ring_buffer->set_producer_task(nullptr);
+    }
+
+    if (ring_buffer->available() > 0) {
+      // The mixer isn't taking the audio, e.g., while the input is paused, so the stream is converted to the channels
+      // the input has rather than dropping it
+      return;
+    }
+  }
+
+  // Fails only if the mixer doesn't handle the command in time; the switch is then canceled, and the stream is
+  // converted to the channels the input has
+  this->mixer_->set_input_channels(this->mixer_input_, channels);
+}
+
+void AudioPipeline::flush_mixer_() {
+  CommandEvent command_event;
+  command_event.command = CommandEventType::FLUSH;
+  command_event.input = this->mixer_input_;
+  this->mixer_->send_command(&command_event);
+}
+
+void AudioPipeline::set_paused(bool paused) {
+  if (this->event_group_ == nullptr) {
+    return;
+  }
+
+  if (paused) {
+    xEventGroupSetBits(this->event_group_, PIPELINE_COMMAND_PAUSE);
+  } else {
+    xEventGroupClearBits(this->event_group_, PIPELINE_COMMAND_PAUSE);
+  }
+  this->notify_resampler_task_();
+}
+
+bool AudioPipeline::is_paused() {
+  return (this->event_group_ != nullptr) && (xEventGroupGetBits(this->event_group_) & PIPELINE_COMMAND_PAUSE);
+}
+
 esp_err_t AudioPipeline::stop() {
+  this->next_track_state_.store(NEXT_TRACK_CLOSED);
   xEventGroupSetBits(this->event_group_, PIPELINE_COMMAND_STOP);
+  this->notify_resampler_task_();
 
   uint32_t event_group_bits = xEventGroupWaitBits(this->event_group_,
                                                   FINISHED_BITS,        // Bit message to read
@@ -273,11 +631,8 @@ esp_err_t AudioPipeline::stop() {
 
   // Clear the ring buffer in the mixer; avoids playing incorrect audio when starting a new file while paused
   CommandEvent command_event;
-  if (this->pipeline_type_ == AudioPipelineType::MEDIA) {
-    command_event.command = CommandEventType::CLEAR_MEDIA;
-  } else {
-    command_event.command = CommandEventType::CLEAR_ANNOUNCEMENT;
-  }
+  command_event.command = CommandEventType::CLEAR;
+  command_event.input = this->mixer_input_;
   this->mixer_->send_command(&command_event);
 
   xEventGroupClearBits(this->event_group_, UNFINISHED_BITS);
@@ -289,7 +644,84 @@ esp_err_t AudioPipeline::stop() {
 void AudioPipeline::reset_ring_buffers() {
   this->raw_file_ring_buffer_->reset();
   this->decoded_ring_buffer_->reset();
+  if (this->next_raw_file_ring_buffer_ != nullptr) {
+    this->next_raw_file_ring_buffer_->reset();
+  }
+}
+
+static size_t buffer_size_for_duration(uint32_t bytes_per_second, uint32_t duration_ms, size_t min_size,
+                                       size_t max_size) {
+  size_t size = static_cast<uint64_t>(bytes_per_second) * duration_ms / 1000;
+  size = (size + BUFFER_SIZE_GRANULARITY - 1) / BUFFER_SIZE_GRANULARITY * BUFFER_SIZE_GRANULARITY;
+  return clamp<size_t>(size, min_size, max_size);
+}
+
+void AudioPipeline::size_buffers_for_stream_(uint32_t bitrate) {
+  this->current_bitrate_ = bitrate;
+
+  const audio::AudioStreamInfo &stream_info = this->current_audio_stream_info_;
+  uint32_t decoded_bytes_per_second = stream_info.sample_rate * stream_info.channels * sizeof(int16_t);
+
+  // The resampler is waiting for the stream information, so nothing else uses the decoded ring buffer. If the new size
+  // can't be allocated, the current one is kept.
+  this->decoded_ring_buffer_->resize(buffer_size_for_duration(decoded_bytes_per_second, BUFFER_TARGET_MS,
+                                                              BUFFER_MIN_SIZE_BYTES, BUFFER_MAX_SIZE_BYTES));
+
+  if (bitrate > 0) {
+    size_t file_ring_buffer_size = buffer_size_for_duration(bitrate / 8, FILE_RING_BUFFER_TARGET_MS,
+                                                            FILE_RING_BUFFER_MIN_SIZE, FILE_RING_BUFFER_MAX_SIZE);
+    if (file_ring_buffer_size != this->raw_file_ring_buffer_->capacity()) {
+      // The reader is still writing into it, so resize once the reader pauses
+      this->raw_file_ring_buffer_target_size_ = file_ring_buffer_size;
+      xEventGroupSetBits(this->event_group_, EventGroupBits::DECODER_MESSAGE_RESIZING);
+    }
+  }
+}
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+void AudioPipeline::get_stats(AudioPipelineStats &stats) {
+  stats = AudioPipelineStats();
+  if ((this->raw_file_ring_buffer_ == nullptr) || (this->decoded_ring_buffer_ == nullptr)) {
+    return;
+  }
+
+  AudioRingBufferStats raw_file_stats = this->raw_file_ring_buffer_->get_stats();
+  if (this->next_raw_file_ring_buffer_ != nullptr) {
+    // The two raw file ring buffers swap roles on every gapless track change, so combine them
+    const AudioRingBufferStats &next_stats = this->next_raw_file_ring_buffer_->get_stats();
+    raw_file_stats.bytes_committed += next_stats.bytes_committed;
+    raw_file_stats.producer_wait_us += next_stats.producer_wait_us;
+    raw_file_stats.consumer_wait_us += next_stats.consumer_wait_us;
+    raw_file_stats.underruns += next_stats.underruns;
+    for (size_t i = 0; i < FILL_HISTOGRAM_BUCKETS; ++i) {
+      raw_file_stats.fill_histogram[i] += next_stats.fill_histogram[i];
+    }
+  }
+  const AudioRingBufferStats &decoded_stats = this->decoded_ring_buffer_->get_stats();
+
+  AudioRingBuffer *output_ring_buffer = this->mixer_->get_input_ring_buffer(this->mixer_input_);
+
+  stats.reader.bytes_processed = raw_file_stats.bytes_committed;
+  stats.reader.input_wait_us = this->reader_stats_.input_wait_us;
+  stats.reader.output_wait_us = raw_file_stats.producer_wait_us;
+  stats.reader.underruns = this->reader_stats_.underruns;
+
+  stats.decoder.bytes_processed = decoded_stats.bytes_committed;
+  stats.decoder.input_wait_us = raw_file_stats.consumer_wait_us;
+  stats.decoder.output_wait_us = decoded_stats.producer_wait_us;
+  stats.decoder.underruns = raw_file_stats.underruns;
+
+  stats.resampler.input_wait_us = decoded_stats.consumer_wait_us;
+  stats.resampler.underruns = decoded_stats.underruns;
+  if (output_ring_buffer != nullptr) {
+    stats.resampler.bytes_processed = output_ring_buffer->get_stats().bytes_committed;
+    stats.resampler.output_wait_us = output_ring_buffer->get_stats().producer_wait_us;
+  }
+
+  std::memcpy(stats.raw_file_fill_histogram, raw_file_stats.fill_histogram, sizeof(stats.raw_file_fill_histogram));
+  std::memcpy(stats.decoded_fill_histogram, decoded_stats.fill_histogram, sizeof(stats.decoded_fill_histogram));
 }
+#endif
 
 void AudioPipeline::suspend_tasks() {
   if (this->read_task_handle_ != nullptr) {
@@ -301,6 +733,9 @@ void AudioPipeline::suspend_tasks() {
   if (this->resample_task_handle_ != nullptr) {
     vTaskSuspend(this->resample_task_handle_);
   }
+  if (this->cooperative_task_handle_ != nullptr) {
+    vTaskSuspend(this->cooperative_task_handle_);
+  }
 }
 
 void AudioPipeline::resume_tasks() {
@@ -313,6 +748,35 @@ void AudioPipeline::resume_tasks() {
   if (this->resample_task_handle_ != nullptr) {
     vTaskResume(this->resample_task_handle_);
   }
+  if (this->cooperative_task_handle_ != nullptr) {
+    vTaskResume(this->cooperative_task_handle_);
+  }
+}
+
+bool AudioPipeline::set_stream_info_(const audio::AudioStreamInfo &audio_stream_info, InfoErrorEvent &event) {
+  this->current_audio_stream_info_ = audio_stream_info;
+
+  // Send the stream information to the pipeline
+  event.audio_stream_info = this->current_audio_stream_info_;
+
+  bool supported = false;
+  if (this->current_audio_stream_info_.bits_per_sample != 16) {
+    // Error state, incompatible bits per sample
+    event.decoding_err = DecodingError::INCOMPATIBLE_BITS_PER_SAMPLE;
+    xEventGroupSetBits(this->event_group_,
+                       EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+  } else if ((this->current_audio_stream_info_.channels > 2)) {
+    // Error state, incompatible number of channels
+    event.decoding_err = DecodingError::INCOMPATIBLE_CHANNELS;
+    xEventGroupSetBits(this->event_group_,
+                       EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+  } else {
+    supported = true;
+  }
+
+  xQueueSend(this->info_error_queue_, &event, portMAX_DELAY);
+
+  return supported;
 }
 
 void AudioPipeline::read_task_(void *params) {
@@ -336,12 +800,17 @@ void AudioPipeline::read_task_(void *params) {
       event.source = InfoErrorSource::READER;
       esp_err_t err = ESP_OK;
 
-      AudioReader reader = AudioReader(this_pipeline->raw_file_ring_buffer_.get(), FILE_BUFFER_SIZE);
+      std::unique_ptr<AudioReader> reader =
+          make_unique<AudioReader>(this_pipeline->raw_file_ring_buffer_.get(), FILE_BUFFER_SIZE);
+      reader->set_low_latency_start(this_pipeline->low_latency_);
+#ifdef USE_AUDIO_PIPELINE_STATS
+      reader->set_stats(&this_pipeline->reader_stats_);
+#endif
 
       if (event_bits & READER_COMMAND_INIT_FILE) {
-        err = reader.start(this_pipeline->current_media_file_, this_pipeline->current_media_file_type_);
+        err = reader->start(this_pipeline->current_media_file_, this_pipeline->current_media_file_type_);
       } else {
-        err = reader.start(this_pipeline->current_uri_, this_pipeline->current_media_file_type_);
+        err = reader->start(this_pipeline->current_uri_, this_pipeline->current_media_file_type_);
       }
       if (err != ESP_OK) {
         // Send specific error message
@@ -367,10 +836,89 @@ void AudioPipeline::read_task_(void *params) {
           break;
         }
 
-        AudioReaderState reader_state = reader.read();
+        if (event_bits & PIPELINE_COMMAND_PAUSE) {
+          // A dropped HTTP connection is reopened from the last byte read once the reader resumes
+          delay(PAUSED_POLL_DELAY_MS);
+          continue;
+        }
+
+        if (event_bits & DECODER_MESSAGE_RESIZING) {
+          // Stop writing so the decoder can reallocate the raw file ring buffer
+          xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_PAUSED);
+          while (((event_bits = xEventGroupGetBits(this_pipeline->event_group_)) & DECODER_MESSAGE_RESIZING) &&
+                 !(event_bits & PIPELINE_COMMAND_STOP)) {
+            delay(10);
+          }
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_PAUSED);
+          continue;
+        }
+
+        if (event_bits & PIPELINE_COMMAND_SEEK) {
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::PIPELINE_COMMAND_SEEK);
+
+          // Ignore a seek that arrived after the reader moved on to the next track
+          if (!(event_bits & READER_MESSAGE_NEXT_TRACK)) {
+            // Wait until the decoder has discarded the buffered data and resynced
+            xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_SEEKING);
+            while (((event_bits = xEventGroupGetBits(this_pipeline->event_group_)) & READER_MESSAGE_SEEKING) &&
+                   !(event_bits & PIPELINE_COMMAND_STOP)) {
+              delay(10);
+            }
+            if (event_bits & PIPELINE_COMMAND_STOP) {
+              break;
+            }
+
+            err = reader->seek(this_pipeline->seek_byte_offset_);
+            if (err != ESP_OK) {
+              event.err = err;
+              xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+
+              xEventGroupSetBits(this_pipeline->event_group_,
+                                 EventGroupBits::READER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+              break;
+            }
+          }
+          continue;
+        }
+
+        AudioReaderState reader_state = reader->read();
 
         if (reader_state == AudioReaderState::FINISHED) {
-          break;
+          if (!this_pipeline->take_next_track_()) {
+            break;
+          }
+
+          // Wait until the decoder has switched to the previously read track, which frees the next ring buffer
+          while (((event_bits = xEventGroupGetBits(this_pipeline->event_group_)) & READER_MESSAGE_NEXT_TRACK) &&
+                 !(event_bits & PIPELINE_COMMAND_STOP)) {
+            delay(10);
+          }
+          if (event_bits & PIPELINE_COMMAND_STOP) {
+            break;
+          }
+
+          reader = make_unique<AudioReader>(this_pipeline->next_raw_file_ring_buffer_.get(), FILE_BUFFER_SIZE);
+#ifdef USE_AUDIO_PIPELINE_STATS
+          reader->set_stats(&this_pipeline->reader_stats_);
+#endif
+          if (this_pipeline->current_media_file_ != nullptr) {
+            err = reader->start(this_pipeline->current_media_file_, this_pipeline->next_media_file_type_);
+          } else {
+            err = reader->start(this_pipeline->current_uri_, this_pipeline->next_media_file_type_);
+          }
+
+          if (err != ESP_OK) {
+            // Only the next track failed; let the current track finish playing
+            event.err = err;
+            xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+            break;
+          }
+
+          event.file_type = this_pipeline->next_media_file_type_;
+          xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+
+          // Inform the decoder it can switch to the next track once it finishes the current one
+          xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_NEXT_TRACK);
         } else if (reader_state == AudioReaderState::FAILED) {
           xEventGroupSetBits(this_pipeline->event_group_,
                              EventGroupBits::READER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
@@ -402,6 +950,7 @@ void AudioPipeline::decode_task_(void *params) {
 
       std::unique_ptr<AudioDecoder> decoder = make_unique<AudioDecoder>(
           this_pipeline->raw_file_ring_buffer_.get(), this_pipeline->decoded_ring_buffer_.get(), FILE_BUFFER_SIZE);
+      decoder->set_low_latency_start(this_pipeline->low_latency_);
       esp_err_t err = decoder->start(this_pipeline->current_media_file_type_);
 
       if (err != ESP_OK) {
@@ -423,11 +972,90 @@ void AudioPipeline::decode_task_(void *params) {
           break;
         }
 
-        // Stop gracefully if the reader has finished
-        AudioDecoderState decoder_state = decoder->decode(event_bits & READER_MESSAGE_FINISHED);
+        if (event_bits & PIPELINE_COMMAND_PAUSE) {
+          delay(PAUSED_POLL_DELAY_MS);
+          continue;
+        }
+
+        if ((event_bits & DECODER_MESSAGE_RESIZING) &&
+            (event_bits & (READER_MESSAGE_PAUSED | READER_MESSAGE_FINISHED))) {
+          // The reader isn't writing, so the raw file ring buffer can be reallocated. Its data is kept, so it can't
+          // shrink below what is still buffered.
+          this_pipeline->raw_file_ring_buffer_->resize(std::max(this_pipeline->raw_file_ring_buffer_target_size_,
+                                                                this_pipeline->raw_file_ring_buffer_->available()));
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_RESIZING);
+        }
+
+        if (event_bits & READER_MESSAGE_SEEKING) {
+          if (has_stream_info) {
+            // The resampler is running, so have it discard the decoded audio
+            xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_SEEKING);
+            event_bits =
+                xEventGroupWaitBits(this_pipeline->event_group_,
+                                    RESAMPLER_MESSAGE_SEEK_READY | PIPELINE_COMMAND_STOP,  // Bit message to read
+                                    pdFALSE,         // Clear the bit on exit
+                                    pdFALSE,         // Wait for all the bits,
+                                    portMAX_DELAY);  // Block indefinitely until bit is set
+            if (event_bits & PIPELINE_COMMAND_STOP) {
+              break;
+            }
+            xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::RESAMPLER_MESSAGE_SEEK_READY);
+          }
+
+          // The reader is waiting, so nothing writes to the raw file ring buffer while it is reset
+          this_pipeline->raw_file_ring_buffer_->reset();
+          this_pipeline->seek_byte_offset_ = decoder->resync(this_pipeline->seek_byte_offset_);
+
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_SEEKING);
+          continue;
+        }
+
+        // Stop gracefully if the reader has finished or moved on to the next track
+        AudioDecoderState decoder_state =
+            decoder->decode(event_bits & (READER_MESSAGE_FINISHED | READER_MESSAGE_NEXT_TRACK));
 
         if (decoder_state == AudioDecoderState::FINISHED) {
-          break;
+          if (!(event_bits & READER_MESSAGE_NEXT_TRACK)) {
+            break;
+          }
+
+          // Let the resampler process all of the current track's audio before the next track's audio follows it
+          xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_NEXT_TRACK);
+          event_bits =
+              xEventGroupWaitBits(this_pipeline->event_group_,
+                                  RESAMPLER_MESSAGE_NEXT_TRACK_READY | PIPELINE_COMMAND_STOP,  // Bit message to read
+                                  pdFALSE,         // Clear the bit on exit
+                                  pdFALSE,         // Wait for all the bits,
+                                  portMAX_DELAY);  // Block indefinitely until bit is set
+          if (event_bits & PIPELINE_COMMAND_STOP) {
+            break;
+          }
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::RESAMPLER_MESSAGE_NEXT_TRACK_READY);
+
+          // Switch to the ring buffer with the next track. Reset the old one, as the decoder may have stopped before
+          // any trailing data (e.g., ID3 tags)
+          std::swap(this_pipeline->raw_file_ring_buffer_, this_pipeline->next_raw_file_ring_buffer_);
+          this_pipeline->next_raw_file_ring_buffer_->reset();
+          this_pipeline->current_media_file_type_ = this_pipeline->next_media_file_type_;
+
+          // The reader may now read another track into the old ring buffer
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::READER_MESSAGE_NEXT_TRACK);
+
+          decoder.reset();
+          decoder = make_unique<AudioDecoder>(this_pipeline->raw_file_ring_buffer_.get(),
+                                              this_pipeline->decoded_ring_buffer_.get(), FILE_BUFFER_SIZE);
+          err = decoder->start(this_pipeline->current_media_file_type_);
+
+          if (err != ESP_OK) {
+            event.err = err;
+            xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+
+            xEventGroupSetBits(this_pipeline->event_group_,
+                               EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+            break;
+          }
+
+          has_stream_info = false;
         } else if (decoder_state == AudioDecoderState::FAILED) {
           if (!has_stream_info) {
             event.decoding_err = DecodingError::FAILED_HEADER;
@@ -441,27 +1069,13 @@ void AudioPipeline::decode_task_(void *params) {
         if (!has_stream_info && decoder->get_audio_stream_info().has_value()) {
           has_stream_info = true;
 
-          this_pipeline->current_audio_stream_info_ = decoder->get_audio_stream_info().value();
+          this_pipeline->track_loudness_ = decoder->get_track_loudness();
+          if (this_pipeline->set_stream_info_(decoder->get_audio_stream_info().value(), event)) {
+            this_pipeline->size_buffers_for_stream_(decoder->get_bitrate());
 
-          // Send the stream information to the pipeline
-          event.audio_stream_info = this_pipeline->current_audio_stream_info_;
-
-          if (this_pipeline->current_audio_stream_info_.bits_per_sample != 16) {
-            // Error state, incompatible bits per sample
-            event.decoding_err = DecodingError::INCOMPATIBLE_BITS_PER_SAMPLE;
-            xEventGroupSetBits(this_pipeline->event_group_,
-                               EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
-          } else if ((this_pipeline->current_audio_stream_info_.channels > 2)) {
-            // Error state, incompatible number of channels
-            event.decoding_err = DecodingError::INCOMPATIBLE_CHANNELS;
-            xEventGroupSetBits(this_pipeline->event_group_,
-                               EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
-          } else {
             // Inform the resampler that the stream information is available
             xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_LOADED_STREAM_INFO);
           }
-
-          xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
         }
       }
     }
@@ -487,19 +1101,19 @@ void AudioPipeline::resample_task_(void *params) {
       InfoErrorEvent event;
       event.source = InfoErrorSource::RESAMPLER;
 
-      RingBuffer *output_ring_buffer = nullptr;
-
-      if (this_pipeline->pipeline_type_ == AudioPipelineType::MEDIA) {
-        output_ring_buffer = this_pipeline->mixer_->get_media_ring_buffer();
-      } else {
-        output_ring_buffer = this_pipeline->mixer_->get_announcement_ring_buffer();
-      }
+      AudioRingBuffer *output_ring_buffer = this_pipeline->mixer_->get_input_ring_buffer(this_pipeline->mixer_input_);
 
-      AudioResampler resampler =
-          AudioResampler(this_pipeline->decoded_ring_buffer_.get(), output_ring_buffer, BUFFER_SIZE_SAMPLES);
+      std::unique_ptr<AudioResampler> resampler = make_unique<AudioResampler>(
+          this_pipeline->decoded_ring_buffer_.get(), output_ring_buffer, BUFFER_SIZE_SAMPLES);
+      resampler->set_quality(this_pipeline->resampler_quality_);
+      resampler->set_drift_compensation(this_pipeline->drift_compensation_);
+      resampler->set_upstream_buffer(this_pipeline->raw_file_ring_buffer_.get(), this_pipeline->current_bitrate_);
 
-      esp_err_t err = resampler.start(this_pipeline->current_audio_stream_info_, this_pipeline->target_sample_rate_,
-                                      this_pipeline->current_resample_info_);
+      audio::AudioStreamInfo stream_info = this_pipeline->current_audio_stream_info_;
+      this_pipeline->set_mixer_input_channels_(stream_info.channels);
+      esp_err_t err = resampler->start(stream_info, this_pipeline->target_sample_rate_,
+                                       this_pipeline->mixer_->get_input_channels(this_pipeline->mixer_input_),
+                                       this_pipeline->current_resample_info_);
 
       if (err != ESP_OK) {
         // Send specific error message
@@ -512,6 +1126,8 @@ void AudioPipeline::resample_task_(void *params) {
       } else {
         event.resample_info = this_pipeline->current_resample_info_;
         xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+
+        this_pipeline->start_loudness_normalization_(resampler.get(), false);
       }
 
       while (true) {
@@ -521,10 +1137,78 @@ void AudioPipeline::resample_task_(void *params) {
           break;
         }
 
+        if (event_bits & DECODER_MESSAGE_SEEKING) {
+          // The decoder is waiting, so nothing writes to the decoded ring buffer while its audio is discarded
+          this_pipeline->decoded_ring_buffer_->release(this_pipeline->decoded_ring_buffer_->available());
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_SEEKING);
+          xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::RESAMPLER_MESSAGE_SEEK_READY);
+          continue;
+        }
+
+        if ((event_bits & DECODER_MESSAGE_NEXT_TRACK) &&
+            (this_pipeline->decoded_ring_buffer_->available() < stream_info.channels * sizeof(int16_t))) {
+          // All of the current track's audio is resampled. Discard any partial frame so the next track's audio starts
+          // aligned, and let the decoder start on the next track.
+          this_pipeline->decoded_ring_buffer_->release(this_pipeline->decoded_ring_buffer_->available());
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_NEXT_TRACK);
+          xEventGroupSetBits(this_pipeline->event_group_, EventGroupBits::RESAMPLER_MESSAGE_NEXT_TRACK_READY);
+
+          event_bits =
+              xEventGroupWaitBits(this_pipeline->event_group_,
+                                  DECODER_MESSAGE_LOADED_STREAM_INFO | PIPELINE_COMMAND_STOP,  // Bit message to read
+                                  pdFALSE,         // Clear the bit on exit
+                                  pdFALSE,         // Wait for all the bits,
+                                  portMAX_DELAY);  // Block indefinitely until bit is set
+          if (event_bits & PIPELINE_COMMAND_STOP) {
+            break;
+          }
+          xEventGroupClearBits(this_pipeline->event_group_, EventGroupBits::DECODER_MESSAGE_LOADED_STREAM_INFO);
+
+          const audio::AudioStreamInfo &next_stream_info = this_pipeline->current_audio_stream_info_;
+          if ((next_stream_info.sample_rate != stream_info.sample_rate) ||
+              (next_stream_info.channels != stream_info.channels) ||
+              (next_stream_info.bits_per_sample != stream_info.bits_per_sample)) {
+            // The next track has a different format, so restart the resampler. Otherwise the resampler just continues,
+            // keeping its filter state across the track boundary.
+            stream_info = next_stream_info;
+            // A change of channels leaves a gap while the previous track plays out, but a stereo track isn't downmixed
+            // after a mono one
+            this_pipeline->set_mixer_input_channels_(stream_info.channels);
+
+            resampler.reset();
+            resampler = make_unique<AudioResampler>(this_pipeline->decoded_ring_buffer_.get(), output_ring_buffer,
+                                                    BUFFER_SIZE_SAMPLES);
+            resampler->set_quality(this_pipeline->resampler_quality_);
+            resampler->set_drift_compensation(this_pipeline->drift_compensation_);
+            err = resampler->start(stream_info, this_pipeline->target_sample_rate_,
+                                   this_pipeline->mixer_->get_input_channels(this_pipeline->mixer_input_),
+                                   this_pipeline->current_resample_info_);
+
+            if (err != ESP_OK) {
+              event.err = err;
+              xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+
+              xEventGroupSetBits(this_pipeline->event_group_,
+                                 EventGroupBits::RESAMPLER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+              break;
+            }
+
+            event.resample_info = this_pipeline->current_resample_info_;
+            xQueueSend(this_pipeline->info_error_queue_, &event, portMAX_DELAY);
+          }
+
+          // The raw file ring buffers swapped roles for the next track
+          resampler->set_upstream_buffer(this_pipeline->raw_file_ring_buffer_.get(), this_pipeline->current_bitrate_);
+          this_pipeline->start_loudness_normalization_(resampler.get(), true);
+          continue;
+        }
+
         // Stop gracefully if the decoder is done
-        AudioResamplerState resampler_state = resampler.resample(event_bits & DECODER_MESSAGE_FINISHED);
+        AudioResamplerState resampler_state = resampler->resample(event_bits & DECODER_MESSAGE_FINISHED);
+        this_pipeline->update_loudness_normalization_();
 
         if (resampler_state == AudioResamplerState::FINISHED) {
+          this_pipeline->flush_mixer_();
           break;
         } else if (resampler_state == AudioResamplerState::FAILED) {
           xEventGroupSetBits(this_pipeline->event_group_,
@@ -536,6 +1220,210 @@ void AudioPipeline::resample_task_(void *params) {
   }
 }
 
+void AudioPipeline::cooperative_task_(void *params) {
+  AudioPipeline *this_pipeline = (AudioPipeline *) params;
+
+  while (true) {
+    xEventGroupSetBits(this_pipeline->event_group_, FINISHED_BITS);
+
+    // Wait until the pipeline notifies us the source of the media file
+    EventBits_t event_bits =
+        xEventGroupWaitBits(this_pipeline->event_group_,
+                            READER_COMMAND_INIT_FILE | READER_COMMAND_INIT_HTTP,  // Bit message to read
+                            pdTRUE,                                               // Clear the bit on exit
+                            pdFALSE,                                              // Wait for all the bits,
+                            portMAX_DELAY);                                       // Block indefinitely until bit is set
+
+    xEventGroupClearBits(this_pipeline->event_group_, FINISHED_BITS);
+
+    {
+      InfoErrorEvent reader_event;
+      reader_event.source = InfoErrorSource::READER;
+      InfoErrorEvent decoder_event;
+      decoder_event.source = InfoErrorSource::DECODER;
+      InfoErrorEvent resampler_event;
+      resampler_event.source = InfoErrorSource::RESAMPLER;
+
+      AudioRingBuffer *raw_file_ring_buffer = this_pipeline->raw_file_ring_buffer_.get();
+      AudioRingBuffer *decoded_ring_buffer = this_pipeline->decoded_ring_buffer_.get();
+
+      AudioReader reader = AudioReader(raw_file_ring_buffer, COOPERATIVE_TRANSFER_SIZE);
+      reader.set_ticks_to_wait(0);
+      reader.set_low_latency_start(this_pipeline->low_latency_);
+#ifdef USE_AUDIO_PIPELINE_STATS
+      reader.set_stats(&this_pipeline->reader_stats_);
+#endif
+
+      esp_err_t err;
+      if (event_bits & READER_COMMAND_INIT_FILE) {
+        err = reader.start(this_pipeline->current_media_file_, this_pipeline->current_media_file_type_);
+      } else {
+        err = reader.start(this_pipeline->current_uri_, this_pipeline->current_media_file_type_);
+      }
+
+      if (err != ESP_OK) {
+        reader_event.err = err;
+        xQueueSend(this_pipeline->info_error_queue_, &reader_event, portMAX_DELAY);
+
+        // Setting up the reader failed, stop the pipeline
+        xEventGroupSetBits(this_pipeline->event_group_,
+                           EventGroupBits::READER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+      } else {
+        reader_event.file_type = this_pipeline->current_media_file_type_;
+        xQueueSend(this_pipeline->info_error_queue_, &reader_event, portMAX_DELAY);
+      }
+
+      std::unique_ptr<AudioDecoder> decoder =
+          make_unique<AudioDecoder>(raw_file_ring_buffer, decoded_ring_buffer, COOPERATIVE_FILE_BUFFER_SIZE);
+      decoder->set_ticks_to_wait(0);
+      decoder->set_low_latency_start(this_pipeline->low_latency_);
+
+      if (err == ESP_OK) {
+        err = decoder->start(this_pipeline->current_media_file_type_);
+
+        if (err != ESP_OK) {
+          decoder_event.err = err;
+          xQueueSend(this_pipeline->info_error_queue_, &decoder_event, portMAX_DELAY);
+
+          // Setting up the decoder failed, stop the pipeline
+          xEventGroupSetBits(this_pipeline->event_group_,
+                             EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+        }
+      }
+
+      // Only created once the decoder has determined the stream information
+      std::unique_ptr<AudioResampler> resampler;
+      AudioRingBuffer *mixer_input_ring_buffer = nullptr;
+
+      bool reader_finished = false;
+      bool decoder_finished = false;
+      bool has_stream_info = false;
+
+      while (true) {
+        event_bits = xEventGroupGetBits(this_pipeline->event_group_);
+
+        if (event_bits & PIPELINE_COMMAND_STOP) {
+          break;
+        }
+
+        // Every stage returns immediately if its input is empty or its output is full, so the stages are simply run in
+        // order. Each reports the bytes it moved, so the task only sleeps once none of them made progress.
+        size_t bytes_moved = 0;
+        const bool paused = event_bits & PIPELINE_COMMAND_PAUSE;
+
+        if (!reader_finished && !paused) {
+          AudioReaderState reader_state = reader.read();
+          bytes_moved += reader.get_bytes_moved();
+
+          if (reader_state == AudioReaderState::FINISHED) {
+            reader_finished = true;
+          } else if (reader_state == AudioReaderState::FAILED) {
+            xEventGroupSetBits(this_pipeline->event_group_,
+                               EventGroupBits::READER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+            break;
+          }
+        }
+
+        if (!decoder_finished && !paused) {
+          // Stop gracefully if the reader has finished
+          AudioDecoderState decoder_state = decoder->decode(reader_finished);
+          bytes_moved += decoder->get_bytes_moved();
+
+          if (decoder_state == AudioDecoderState::FINISHED) {
+            decoder_finished = true;
+          } else if (decoder_state == AudioDecoderState::FAILED) {
+            if (!has_stream_info) {
+              decoder_event.decoding_err = DecodingError::FAILED_HEADER;
+              xQueueSend(this_pipeline->info_error_queue_, &decoder_event, portMAX_DELAY);
+            }
+            xEventGroupSetBits(this_pipeline->event_group_,
+                               EventGroupBits::DECODER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+            break;
+          }
+
+          if (!has_stream_info && decoder->get_audio_stream_info().has_value()) {
+            has_stream_info = true;
+
+            this_pipeline->track_loudness_ = decoder->get_track_loudness();
+            if (!this_pipeline->set_stream_info_(decoder->get_audio_stream_info().value(), decoder_event)) {
+              break;
+            }
+
+            AudioRingBuffer *output_ring_buffer =
+                this_pipeline->mixer_->get_input_ring_buffer(this_pipeline->mixer_input_);
+
+            resampler = make_unique<AudioResampler>(decoded_ring_buffer, output_ring_buffer,
+                                                    COOPERATIVE_RESAMPLER_BUFFER_SAMPLES);
+            // The mixer's releases wake the task once it is waiting for room in the mixer input
+            mixer_input_ring_buffer = output_ring_buffer;
+            mixer_input_ring_buffer->set_producer_task(xTaskGetCurrentTaskHandle());
+            resampler->set_ticks_to_wait(0);
+            resampler->set_quality(this_pipeline->resampler_quality_);
+            resampler->set_drift_compensation(this_pipeline->drift_compensation_);
+            resampler->set_upstream_buffer(raw_file_ring_buffer, decoder->get_bitrate());
+
+            this_pipeline->set_mixer_input_channels_(this_pipeline->current_audio_stream_info_.channels);
+            err = resampler->start(this_pipeline->current_audio_stream_info_, this_pipeline->target_sample_rate_,
+                                   this_pipeline->mixer_->get_input_channels(this_pipeline->mixer_input_),
+                                   this_pipeline->current_resample_info_);
+
+            if (err != ESP_OK) {
+              resampler_event.err = err;
+              xQueueSend(this_pipeline->info_error_queue_, &resampler_event, portMAX_DELAY);
+
+              // Setting up the resampler failed, stop the pipeline
+              xEventGroupSetBits(this_pipeline->event_group_,
+                                 EventGroupBits::RESAMPLER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+              break;
+            }
+
+            resampler_event.resample_info = this_pipeline->current_resample_info_;
+            xQueueSend(this_pipeline->info_error_queue_, &resampler_event, portMAX_DELAY);
+
+            this_pipeline->start_loudness_normalization_(resampler.get(), false);
+          }
+        }
+
+        if (resampler != nullptr) {
+          // Stop gracefully if the decoder is done
+          AudioResamplerState resampler_state = resampler->resample(decoder_finished);
+          bytes_moved += resampler->get_bytes_moved();
+          this_pipeline->update_loudness_normalization_();
+
+          if (resampler_state == AudioResamplerState::FINISHED) {
+            this_pipeline->flush_mixer_();
+            break;
+          } else if (resampler_state == AudioResamplerState::FAILED) {
+            xEventGroupSetBits(this_pipeline->event_group_,
+                               EventGroupBits::RESAMPLER_MESSAGE_ERROR | EventGroupBits::PIPELINE_COMMAND_STOP);
+            break;
+          }
+        } else if (decoder_finished) {
+          // The decoder finished without ever producing audio
+          break;
+        }
+
+        if (bytes_moved == 0) {
+          const size_t input_frame_bytes = this_pipeline->current_audio_stream_info_.channels * sizeof(int16_t);
+          if ((resampler != nullptr) && (decoder_finished || (decoded_ring_buffer->available() >= input_frame_bytes))) {
+            // Decoded audio is waiting for room in the mixer input, or the stream ends once the mixer has taken the
+            // rest of it. Every release by the mixer, a stop, and a pause change notify the task; a release since the
+            // resampler's attempt has already left a notification.
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+          } else {
+            // Waiting for more HTTP data to arrive
+            delay(COOPERATIVE_IDLE_DELAY_MS);
+          }
+        }
+      }
+
+      if (mixer_input_ring_buffer != nullptr) {
+        mixer_input_ring_buffer->set_producer_task(nullptr);
+      }
+    }
+  }
+}
+
 }  // namespace nabu
 }  // namespace esphome
 #endif
@@ -6,18 +6,21 @@
 #include "audio_decoder.h"
 #include "audio_resampler.h"
 #include "audio_mixer.h"
+#include "audio_ring_buffer.h"
+#include "loudness_meter.h"
 
 #include "esphome/components/audio/audio.h"
 #include "esphome/components/media_player/media_player.h"
 
 #include "esphome/core/hal.h"
 #include "esphome/core/helpers.h"
-#include "esphome/core/ring_buffer.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
 
+#include <atomic>
+
 namespace esphome {
 namespace nabu {
 
@@ -56,27 +59,102 @@ struct InfoErrorEvent {
   optional<DecodingError> decoding_err;
 };
 
+#ifdef USE_AUDIO_PIPELINE_STATS
+struct AudioPipelineStats {
+  AudioStageStats reader;
+  AudioStageStats decoder;
+  AudioStageStats resampler;
+  uint32_t raw_file_fill_histogram[FILL_HISTOGRAM_BUCKETS];
+  uint32_t decoded_fill_histogram[FILL_HISTOGRAM_BUCKETS];
+};
+#endif
+
 class AudioPipeline {
  public:
-  AudioPipeline(AudioMixer *mixer, AudioPipelineType pipeline_type);
+  /// @param mixer the mixer the pipeline's audio is sent to
+  /// @param mixer_input index of the mixer input the pipeline feeds; see ``AudioMixer::add_input``
+  /// @param cooperative if true, a single task steps the reader, decoder, and resampler in turn with smaller
+  /// inter-stage buffers instead of running each in its own task. Suited to short announcements.
+  AudioPipeline(AudioMixer *mixer, uint8_t mixer_input, bool cooperative = false);
+
+  /// @brief Deletes the tasks and frees the buffers. Only destroy a pipeline once ``stop`` has succeeded, so no task is
+  /// in the middle of a stream.
+  ~AudioPipeline();
+
+  /// @brief Gets the first audio of each stream to the mixer as soon as possible. The reader reads the start of HTTP
+  /// streams in small chunks and the decoder decodes the first frame as soon as it arrives. Pair with a zero start
+  /// threshold in the mixer.
+  void set_low_latency(bool low_latency) { this->low_latency_ = low_latency; }
+
+  /// @brief Sets the resampler's filter profile. Takes effect when the next stream's resampler starts.
+  void set_resampler_quality(ResamplerQuality quality) { this->resampler_quality_ = quality; }
+
+  /// @brief Keeps the audio buffered between the reader and the mixer at half the buffers' capacity for live streams
+  /// whose clock drifts from the output's; see ``AudioResampler::set_drift_compensation``. Takes effect when the next
+  /// stream's resampler starts.
+  void set_drift_compensation(bool enabled) { this->drift_compensation_ = enabled; }
+
+  /// @brief Turns each track down to a target loudness with the pipeline's mixer input gain, so it costs no extra pass
+  /// over the samples. A track's ReplayGain or R128 tag sets the gain as soon as its stream information is known.
+  /// Untagged tracks are measured as they are resampled, and the gain follows the running estimate of their integrated
+  /// loudness. Tracks quieter than the target are left as they are, as the mixer's gains can't exceed unity. The
+  /// pipeline owns its mixer input's gain while enabled. Must be called before the pipeline is started.
+  /// @param enabled whether to normalize the loudness
+  /// @param target_lufs target integrated loudness in LUFS
+  void set_loudness_normalization(bool enabled, float target_lufs) {
+    this->loudness_normalization_ = enabled;
+    this->target_loudness_ = target_lufs;
+  }
 
   /// @brief Starts an audio pipeline given a media url
   /// @param uri media file url
   /// @param target_sample_rate the desired sample rate of the audio stream
   /// @param task_name FreeRTOS task name
   /// @param priority FreeRTOS task priority
+  /// @param core core to pin the tasks to, or tskNO_AFFINITY to let them run on either
   /// @return ESP_OK if successful or an appropriate error if not
   esp_err_t start(const std::string &uri, uint32_t target_sample_rate, const std::string &task_name,
-                  UBaseType_t priority = 1);
+                  UBaseType_t priority = 1, BaseType_t core = tskNO_AFFINITY);
 
   /// @brief Starts an audio pipeline given a MediaFile pointer
   /// @param media_file pointer to a MediaFile object
   /// @param target_sample_rate the desired sample rate of the audio stream
   /// @param task_name FreeRTOS task name
   /// @param priority FreeRTOS task priority
+  /// @param core core to pin the tasks to, or tskNO_AFFINITY to let them run on either
   /// @return ESP_OK if successful or an appropriate error if not
   esp_err_t start(media_player::MediaFile *media_file, uint32_t target_sample_rate, const std::string &task_name,
-                  UBaseType_t priority = 1);
+                  UBaseType_t priority = 1, BaseType_t core = tskNO_AFFINITY);
+
+  /// @brief Queues a media url to play right after the current track without a gap. The reader reads it into a second
+  /// ring buffer while the current track is still decoding, and the decoder switches to it once the current track ends.
+  /// @param uri media file url
+  /// @return ESP_OK if queued, ESP_ERR_INVALID_STATE if the pipeline has already read its last track or a track is
+  /// already queued, ESP_ERR_NOT_SUPPORTED for cooperative pipelines, or ESP_ERR_NO_MEM
+  esp_err_t enqueue(const std::string &uri);
+
+  /// @brief Queues a MediaFile to play right after the current track without a gap
+  /// @param media_file pointer to a MediaFile object
+  /// @return ESP_OK if queued or an appropriate error if not; see the url version
+  esp_err_t enqueue(media_player::MediaFile *media_file);
+
+  /// @brief Moves playback of the current track to a byte offset in its file. The reader reopens HTTP sources with a
+  /// range request, the buffered audio is discarded, and the decoder resyncs to the next frame at the new position.
+  /// Only possible while the reader is still reading the current track.
+  /// @param byte_offset offset from the start of the file
+  /// @return ESP_OK if the seek was requested, ESP_ERR_INVALID_STATE if the reader isn't reading the current track or
+  /// a seek is already in progress, or ESP_ERR_NOT_SUPPORTED for cooperative pipelines
+  esp_err_t seek(size_t byte_offset);
+
+  /// @brief Pauses the pipeline upstream of the mixer. The reader stops reading and the decoder stops decoding, so no
+  /// network or decode work is done while paused; the resampler only finishes the audio already decoded. Everything
+  /// buffered is kept, so the stream continues at the exact sample it left off once resumed. Pausing the pipeline's
+  /// mixer input is up to the caller. Stopping or starting the pipeline resumes it.
+  /// @param paused true to pause, false to resume
+  void set_paused(bool paused);
+
+  /// @brief Whether the pipeline is paused upstream; see ``set_paused``
+  bool is_paused();
 
   /// @brief Stops the pipeline. Sends a stop signal to each task (if running) and clears the ring buffers.
   /// @return ESP_OK if successful or ESP_ERR_TIMEOUT if the tasks did not indicate they stopped
@@ -89,6 +167,13 @@ class AudioPipeline {
   /// @brief Resets the ring buffers, discarding any existing data
   void reset_ring_buffers();
 
+#ifdef USE_AUDIO_PIPELINE_STATS
+  /// @brief Collects the counters of each stage. Each stage's input and output waits and underruns come from the ring
+  /// buffers on either side of it; the reader's input side is the HTTP connection.
+  /// @param stats (output) cumulative counters since the buffers were allocated
+  void get_stats(AudioPipelineStats &stats);
+#endif
+
   /// @brief Suspends any running tasks
   void suspend_tasks();
   /// @brief Resumes any running tasks
@@ -103,8 +188,54 @@ class AudioPipeline {
   /// @param target_sample_rate the desired sample rate of the audio stream
   /// @param task_name FreeRTOS task name
   /// @param priority FreeRTOS task priority
+  /// @param core core to pin the tasks to, or tskNO_AFFINITY
   /// @return ESP_OK if successful or an appropriate error if not
-  esp_err_t common_start_(uint32_t target_sample_rate, const std::string &task_name, UBaseType_t priority);
+  esp_err_t common_start_(uint32_t target_sample_rate, const std::string &task_name, UBaseType_t priority,
+                          BaseType_t core);
+
+  /// @brief Stores the decoded stream information and sends it to the pipeline. Stops the pipeline if the stream
+  /// isn't supported.
+  /// @param audio_stream_info the stream information from the decoder
+  /// @param event info event from the decoder, used to send the stream information and any decoding error
+  /// @return true if the stream is supported
+  bool set_stream_info_(const audio::AudioStreamInfo &audio_stream_info, InfoErrorEvent &event);
+
+  /// @brief Resizes the ring buffers to hold a target duration of the current track's audio. The decoded ring buffer
+  /// is resized right away; the raw file ring buffer is resized by the decoder task once the reader pauses. Only called
+  /// by the decoder task while the resampler waits for the stream information. Also records the bitrate, which the
+  /// resampler's drift compensation uses to count the raw file ring buffer's audio.
+  /// @param bitrate encoded bitrate in bits per second from the decoder; 0 keeps the raw file ring buffer's size
+  void size_buffers_for_stream_(uint32_t bitrate);
+
+  /// @brief Starts normalizing a new track once the resampler has its stream information. Only called by the task
+  /// running the resampler.
+  /// @param resampler the resampler to measure the track's loudness with if it has no loudness tag
+  /// @param gapless true if the track directly follows the previous one; false if the mixer input starts empty
+  void start_loudness_normalization_(AudioResampler *resampler, bool gapless);
+
+  /// @brief Updates the normalization gain from the measured loudness. Called after each resample.
+  void update_loudness_normalization_();
+
+  /// @brief Switches the mixer input to the stream's channels, up to the most it carries, so a mono stream isn't
+  /// upmixed before the mixer. Switching drops what the input holds, so the end of the previous stream plays out first,
+  /// for at most MIXER_INPUT_DRAIN_TIMEOUT_MS; if it doesn't, the input keeps its channels. Only called by the task
+  /// running the resampler, before it starts.
+  /// @param stream_channels the decoded stream's channels
+  void set_mixer_input_channels_(uint8_t stream_channels);
+
+  /// @brief Sends the mixer a new gain for the pipeline's input if it differs enough from the current one
+  /// @param gain_db gain in dB, at most 0
+  /// @param ramp_ms duration of the ramp to the new gain
+  void set_normalization_gain_(float gain_db, uint32_t ramp_ms);
+
+  /// @brief Common enqueue code; allocates the second ring buffer and marks the next track as pending
+  /// @return ESP_OK if queued or an appropriate error if not
+  esp_err_t enqueue_();
+
+  /// @brief Called by the reader task once it has read the whole current track. Moves a pending next track into
+  /// current_uri_/current_media_file_, or stops accepting new tracks if there isn't one.
+  /// @return true if there is a next track to read
+  bool take_next_track_();
 
   // Pointer to the media player's mixer object. The resample task feeds the appropriate ring buffer directly
   AudioMixer *mixer_;
@@ -114,13 +245,56 @@ class AudioPipeline {
 
   media_player::MediaFileType current_media_file_type_;
   audio::AudioStreamInfo current_audio_stream_info_;
+  uint32_t current_bitrate_{0};  // Encoded bits per second, or 0 if unknown; see size_buffers_for_stream_
   ResampleInfo current_resample_info_;
   uint32_t target_sample_rate_;
 
-  AudioPipelineType pipeline_type_;
-
-  std::unique_ptr<RingBuffer> raw_file_ring_buffer_;
-  std::unique_ptr<RingBuffer> decoded_ring_buffer_;
+  uint8_t mixer_input_;
+  bool cooperative_;
+  bool low_latency_{false};
+  ResamplerQuality resampler_quality_{ResamplerQuality::BALANCED};
+  bool drift_compensation_{false};
+
+  // Loudness normalization; only used by the task running the resampler, except track_loudness_, which the decoder
+  // sets before it sends the stream information
+  bool loudness_normalization_{false};
+  float target_loudness_{0.0f};  // in LUFS
+  optional<float> track_loudness_{};
+  LoudnessMeter loudness_meter_;
+  uint32_t normalization_blocks_{0};  // Meter blocks when the gain was last updated
+  float normalization_gain_db_{0.0f};
+
+  /// @brief Tells the mixer the stream has ended, so it plays the rest even if it is below its start threshold
+  void flush_mixer_();
+
+  /// @brief Wakes the task running the resampler if it is waiting on the mixer input, so it sees a new command
+  void notify_resampler_task_();
+
+  // Sized for the current track once its stream information is known; see size_buffers_for_stream_
+  std::unique_ptr<AudioRingBuffer> raw_file_ring_buffer_;
+  std::unique_ptr<AudioRingBuffer> decoded_ring_buffer_;
+  size_t raw_file_ring_buffer_target_size_{0};
+
+  // Gapless playback. The reader reads the next track into ``next_raw_file_ring_buffer_``; the decoder swaps it with
+  // ``raw_file_ring_buffer_`` when it switches tracks.
+  enum NextTrackState : uint8_t {
+    NEXT_TRACK_NONE = 0,  // Accepting a next track
+    NEXT_TRACK_PENDING,   // A next track is queued; only the reader task changes this state
+    NEXT_TRACK_CLOSED,    // Not accepting a next track; the reader has read its last track or the pipeline is stopped
+  };
+  std::atomic<uint8_t> next_track_state_{NEXT_TRACK_CLOSED};
+  std::string next_uri_{};
+  media_player::MediaFile *next_media_file_{nullptr};
+  media_player::MediaFileType next_media_file_type_;
+  std::unique_ptr<AudioRingBuffer> next_raw_file_ring_buffer_;
+
+  // Set by seek(); the decoder task may adjust it to a frame boundary before the reader task seeks to it
+  size_t seek_byte_offset_{0};
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  // Only the input side of the reader; everything else is counted by the ring buffers
+  AudioStageStats reader_stats_;
+#endif
 
   // Handles basic control/state of the three tasks
   EventGroupHandle_t event_group_{nullptr};
@@ -140,11 +314,18 @@ class AudioPipeline {
   StaticTask_t decode_task_stack_;
   StackType_t *decode_task_stack_buffer_{nullptr};
 
-  // Resamples the audio to match the specified target sample rate. Converts mono audio to stereo audio if necessary.
+  // Resamples the audio to match the specified target sample rate. Converts the audio to the mixer's number of channels
+  // if necessary.
   static void resample_task_(void *params);
   TaskHandle_t resample_task_handle_{nullptr};
   StaticTask_t resample_task_stack_;
   StackType_t *resample_task_stack_buffer_{nullptr};
+
+  // Runs the reader, decoder, and resampler in one task; replaces the three tasks above in cooperative mode
+  static void cooperative_task_(void *params);
+  TaskHandle_t cooperative_task_handle_{nullptr};
+  StaticTask_t cooperative_task_stack_;
+  StackType_t *cooperative_task_stack_buffer_{nullptr};
 };
 
 }  // namespace nabu
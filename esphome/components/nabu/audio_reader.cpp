@@ -2,7 +2,8 @@
 
 #include "audio_reader.h"
 
-#include "esphome/core/ring_buffer.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
 
 #if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
 #include "esp_crt_bundle.h"
@@ -16,43 +17,32 @@ static const size_t READ_WRITE_TIMEOUT_MS = 20;
 // The number of times the http read times out with no data before throwing an error
 static const size_t ERROR_COUNT_NO_DATA_READ_TIMEOUT = 10;
 
-AudioReader::AudioReader(esphome::RingBuffer *output_ring_buffer, size_t transfer_buffer_size) {
-  this->output_ring_buffer_ = output_ring_buffer;
-  this->transfer_buffer_size_ = transfer_buffer_size;
-}
-
-AudioReader::~AudioReader() {
-  if (this->transfer_buffer_ != nullptr) {
-    ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
-    allocator.deallocate(this->transfer_buffer_, this->transfer_buffer_size_);
-  }
+// The number of times a dropped connection is reopened from the last received byte before throwing an error
+static const size_t MAX_RECONNECT_ATTEMPTS = 5;
+// Delay before reopening a dropped connection; multiplied by the attempt number
+static const uint32_t RECONNECT_DELAY_MS = 50;
 
-  this->cleanup_connection_();
-}
-
-esp_err_t AudioReader::allocate_buffers_() {
-  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
-  if (this->transfer_buffer_ == nullptr)
-    this->transfer_buffer_ = allocator.allocate(this->transfer_buffer_size_);
+// With a low latency start, the first bytes of an HTTP stream are read in small chunks
+static const size_t LOW_LATENCY_START_BYTES = 4 * 1024;
+static const size_t LOW_LATENCY_TRANSFER_SIZE = 256;
 
-  if (this->transfer_buffer_ == nullptr)
-    return ESP_ERR_NO_MEM;
+static const int HTTP_STATUS_PARTIAL_CONTENT = 206;
+static const int HTTP_STATUS_RANGE_NOT_SATISFIABLE = 416;
 
-  return ESP_OK;
+AudioReader::AudioReader(AudioRingBuffer *output_ring_buffer, size_t transfer_buffer_size) {
+  this->output_ring_buffer_ = output_ring_buffer;
+  this->transfer_buffer_size_ = transfer_buffer_size;
+  this->ticks_to_wait_ = pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS);
 }
 
-esp_err_t AudioReader::start(media_player::MediaFile *media_file, media_player::MediaFileType &file_type) {
-  file_type = media_player::MediaFileType::NONE;
-
-  esp_err_t err = this->allocate_buffers_();
-  if (err != ESP_OK) {
-    return err;
-  }
+AudioReader::~AudioReader() { this->cleanup_connection_(); }
 
+esp_err_t AudioReader::start(media_player::MediaFile *media_file, media_player::MediaFileType &file_type) {
   this->current_media_file_ = media_file;
 
-  this->transfer_buffer_current_ = media_file->data;
-  this->transfer_buffer_length_ = media_file->length;
+  this->media_file_current_ = media_file->data;
+  this->media_file_bytes_left_ = media_file->length;
+  this->position_ = 0;
   file_type = media_file->file_type;
 
   return ESP_OK;
@@ -60,11 +50,7 @@ esp_err_t AudioReader::start(media_player::MediaFile *media_file, media_player::
 
 esp_err_t AudioReader::start(const std::string &uri, media_player::MediaFileType &file_type) {
   file_type = media_player::MediaFileType::NONE;
-
-  esp_err_t err = this->allocate_buffers_();
-  if (err != ESP_OK) {
-    return err;
-  }
+  esp_err_t err = ESP_OK;
 
   this->cleanup_connection_();
 
@@ -95,13 +81,11 @@ esp_err_t AudioReader::start(const std::string &uri, media_player::MediaFileType
     return ESP_FAIL;
   }
 
-  if ((err = esp_http_client_open(this->client_, 0)) != ESP_OK) {
+  if ((err = this->open_connection_(0)) != ESP_OK) {
     this->cleanup_connection_();
     return err;
   }
 
-  int content_length = esp_http_client_fetch_headers(this->client_);
-
   char url[500];
   err = esp_http_client_get_url(this->client_, url, 500);
   if (err != ESP_OK) {
@@ -123,14 +107,46 @@ esp_err_t AudioReader::start(const std::string &uri, media_player::MediaFileType
     return ESP_ERR_NOT_SUPPORTED;
   }
 
-  this->transfer_buffer_current_ = this->transfer_buffer_;
-  this->transfer_buffer_length_ = 0;
+  this->position_ = 0;
   this->no_data_read_count_ = 0;
+  this->reconnect_attempts_ = 0;
+  this->connection_dropped_ = false;
+
+  return ESP_OK;
+}
+
+esp_err_t AudioReader::seek(size_t byte_offset) {
+  if (this->client_ != nullptr) {
+    esp_http_client_close(this->client_);
+
+    esp_err_t err = this->open_connection_(byte_offset);
+    if (err != ESP_OK) {
+      this->cleanup_connection_();
+      return err;
+    }
+
+    this->no_data_read_count_ = 0;
+    this->reconnect_attempts_ = 0;
+    this->connection_dropped_ = false;
+  } else if (this->current_media_file_ != nullptr) {
+    if (byte_offset > this->current_media_file_->length) {
+      return ESP_ERR_INVALID_ARG;
+    }
+
+    this->media_file_current_ = this->current_media_file_->data + byte_offset;
+    this->media_file_bytes_left_ = this->current_media_file_->length - byte_offset;
+  } else {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  this->position_ = byte_offset;
 
   return ESP_OK;
 }
 
 AudioReaderState AudioReader::read() {
+  this->bytes_moved_ = 0;
+
   if (this->client_ != nullptr) {
     return this->http_read_();
   } else if (this->current_media_file_ != nullptr) {
@@ -141,11 +157,14 @@ AudioReaderState AudioReader::read() {
 }
 
 AudioReaderState AudioReader::file_read_() {
-  if (this->transfer_buffer_length_ > 0) {
-    size_t bytes_written = this->output_ring_buffer_->write_without_replacement(
-        (void *) this->transfer_buffer_current_, this->transfer_buffer_length_, pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
-    this->transfer_buffer_length_ -= bytes_written;
-    this->transfer_buffer_current_ += bytes_written;
+  if (this->media_file_bytes_left_ > 0) {
+    size_t bytes_to_write = std::min(this->media_file_bytes_left_, this->transfer_buffer_size_);
+    size_t bytes_written = this->output_ring_buffer_->write((void *) this->media_file_current_, bytes_to_write,
+                                                            this->ticks_to_wait_);
+    this->media_file_bytes_left_ -= bytes_written;
+    this->media_file_current_ += bytes_written;
+    this->position_ += bytes_written;
+    this->bytes_moved_ = bytes_written;
 
     return AudioReaderState::READING;
   }
@@ -153,41 +172,54 @@ AudioReaderState AudioReader::file_read_() {
 }
 
 AudioReaderState AudioReader::http_read_() {
-  if (this->transfer_buffer_length_ > 0) {
-    size_t bytes_written = this->output_ring_buffer_->write_without_replacement(
-        (void *) this->transfer_buffer_, this->transfer_buffer_length_, pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
-    this->transfer_buffer_length_ -= bytes_written;
-
-    // Shift remaining data to the start of the transfer buffer
-    memmove(this->transfer_buffer_, this->transfer_buffer_ + bytes_written, this->transfer_buffer_length_);
+  if (this->connection_dropped_) {
+    return this->reconnect_();
   }
 
   if (esp_http_client_is_complete_data_received(this->client_)) {
-    if (this->transfer_buffer_length_ == 0) {
-      this->cleanup_connection_();
-      return AudioReaderState::FINISHED;
+    this->cleanup_connection_();
+    return AudioReaderState::FINISHED;
+  }
+
+  // Receive directly into the ring buffer's memory
+  uint8_t *ring_buffer_data;
+  size_t bytes_to_read = this->output_ring_buffer_->reserve(&ring_buffer_data, 1, this->ticks_to_wait_);
+  bytes_to_read = std::min(bytes_to_read, this->transfer_buffer_size_);
+  if (this->low_latency_start_ && (this->position_ < LOW_LATENCY_START_BYTES)) {
+    bytes_to_read = std::min(bytes_to_read, LOW_LATENCY_TRANSFER_SIZE);
+  }
+
+  if (bytes_to_read > 0) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+    const uint32_t start_us = micros();
+#endif
+    int received_len = esp_http_client_read(this->client_, (char *) ring_buffer_data, bytes_to_read);
+#ifdef USE_AUDIO_PIPELINE_STATS
+    if (this->stats_ != nullptr) {
+      this->stats_->input_wait_us += micros() - start_us;
+      if ((received_len <= 0) && (this->no_data_read_count_ == 0)) {
+        // Count each stall once, rather than every read that times out during it
+        ++this->stats_->underruns;
+      }
     }
-  } else {
-    size_t bytes_to_read = this->transfer_buffer_size_ - this->transfer_buffer_length_;
-    int received_len = esp_http_client_read(
-        this->client_, (char *) this->transfer_buffer_ + this->transfer_buffer_length_, bytes_to_read);
+#endif
 
     if (received_len > 0) {
-      this->transfer_buffer_length_ += received_len;
+      this->output_ring_buffer_->commit(received_len);
+      this->position_ += received_len;
+      this->bytes_moved_ = received_len;
       this->no_data_read_count_ = 0;
+      this->reconnect_attempts_ = 0;
     } else if (received_len < 0) {
-      // HTTP read error
-      this->cleanup_connection_();
-      return AudioReaderState::FAILED;
+      // HTTP read error; most likely the connection dropped
+      this->connection_dropped_ = true;
+      return AudioReaderState::READING;
     } else {
-      if (bytes_to_read > 0) {
-        // Read timed out
-        ++this->no_data_read_count_;
-        if (this->no_data_read_count_ >= ERROR_COUNT_NO_DATA_READ_TIMEOUT) {
-          // Timed out with no data read too many times, so the http read has failed
-          this->cleanup_connection_();
-          return AudioReaderState::FAILED;
-        }
+      // Read timed out
+      ++this->no_data_read_count_;
+      if (this->no_data_read_count_ >= ERROR_COUNT_NO_DATA_READ_TIMEOUT) {
+        // Timed out with no data read too many times, so the connection is likely stalled
+        this->connection_dropped_ = true;
       }
     }
   }
@@ -195,6 +227,64 @@ AudioReaderState AudioReader::http_read_() {
   return AudioReaderState::READING;
 }
 
+AudioReaderState AudioReader::reconnect_() {
+  if (this->reconnect_attempts_ >= MAX_RECONNECT_ATTEMPTS) {
+    this->cleanup_connection_();
+    return AudioReaderState::FAILED;
+  }
+  ++this->reconnect_attempts_;
+
+  esp_http_client_close(this->client_);
+  delay(RECONNECT_DELAY_MS * this->reconnect_attempts_);
+
+  // Continue right after the last byte committed to the ring buffer, so the decoder never sees a discontinuity
+  esp_err_t err = this->open_connection_(this->position_);
+  if (err == ESP_ERR_NOT_SUPPORTED) {
+    // The server ignores range requests, so the stream can't be resumed
+    this->cleanup_connection_();
+    return AudioReaderState::FAILED;
+  } else if (err == ESP_ERR_INVALID_ARG) {
+    // The connection dropped right after the last byte of the file
+    this->cleanup_connection_();
+    return AudioReaderState::FINISHED;
+  }
+
+  // Try again on the next read if it didn't reopen; one attempt per call lets the pipeline stop the reader in between
+  this->connection_dropped_ = (err != ESP_OK);
+  this->no_data_read_count_ = 0;
+
+  return AudioReaderState::READING;
+}
+
+esp_err_t AudioReader::open_connection_(size_t byte_offset) {
+  if (byte_offset > 0) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%zu-", byte_offset);
+    esp_http_client_set_header(this->client_, "Range", range);
+  } else {
+    esp_http_client_delete_header(this->client_, "Range");
+  }
+
+  esp_err_t err = esp_http_client_open(this->client_, 0);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  esp_http_client_fetch_headers(this->client_);
+
+  if (byte_offset > 0) {
+    int status_code = esp_http_client_get_status_code(this->client_);
+    if (status_code == HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+      return ESP_ERR_INVALID_ARG;
+    } else if (status_code != HTTP_STATUS_PARTIAL_CONTENT) {
+      // The server sent the whole file (or an error) instead of the requested range
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+  }
+
+  return ESP_OK;
+}
+
 void AudioReader::cleanup_connection_() {
   if (this->client_ != nullptr) {
     esp_http_client_close(this->client_);
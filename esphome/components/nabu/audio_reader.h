@@ -2,8 +2,9 @@
 
 #ifdef USE_ESP_IDF
 
+#include "audio_ring_buffer.h"
+
 #include "esphome/components/media_player/media_player.h"
-#include "esphome/core/ring_buffer.h"
 
 #include <esp_http_client.h>
 
@@ -18,35 +19,83 @@ enum class AudioReaderState : uint8_t {
 
 class AudioReader {
  public:
-  AudioReader(esphome::RingBuffer *output_ring_buffer, size_t transfer_buffer_size);
+  /// @param output_ring_buffer ring buffer the file is read into; HTTP data is received directly into its memory
+  /// @param transfer_buffer_size maximum number of bytes transferred into the ring buffer per read call
+  AudioReader(AudioRingBuffer *output_ring_buffer, size_t transfer_buffer_size);
   ~AudioReader();
 
+  /// @brief Sets how long ring buffer operations wait for data or space. Defaults to 20 ms; the cooperative pipeline
+  /// sets 0 so the stage returns immediately when it can't make progress.
+  void set_ticks_to_wait(TickType_t ticks_to_wait) { this->ticks_to_wait_ = ticks_to_wait; }
+
+  /// @brief Reads the start of HTTP streams in small chunks, as each read blocks until its whole chunk arrives. The
+  /// decoder then gets the first frames as soon as the server sends them.
+  void set_low_latency_start(bool low_latency_start) { this->low_latency_start_ = low_latency_start; }
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  /// @brief Sets where the time spent waiting for HTTP data and the number of stalls are counted. The counters outlive
+  /// the reader, so they accumulate across tracks.
+  void set_stats(AudioStageStats *stats) { this->stats_ = stats; }
+#endif
+
   esp_err_t start(const std::string &uri, media_player::MediaFileType &file_type);
   esp_err_t start(media_player::MediaFile *media_file, media_player::MediaFileType &file_type);
 
+  /// @brief Moves the read position to a byte offset in the file. HTTP sources reopen the connection with a range
+  /// request. Data already in the ring buffer is left in place; the caller is responsible for discarding it.
+  /// @param byte_offset offset from the start of the file
+  /// @return ESP_OK if successful, ESP_ERR_INVALID_ARG if the offset is past the end of the file,
+  /// ESP_ERR_NOT_SUPPORTED if the server doesn't support range requests, or another error if the connection failed
+  esp_err_t seek(size_t byte_offset);
+
   AudioReaderState read();
 
- protected:
-  esp_err_t allocate_buffers_();
+  /// @brief Bytes the last ``read`` call committed to the output ring buffer. Zero means it made no progress, e.g.,
+  /// because the ring buffer is full or no HTTP data arrived.
+  size_t get_bytes_moved() const { return this->bytes_moved_; }
 
+ protected:
   AudioReaderState file_read_();
   AudioReaderState http_read_();
 
+  /// @brief Makes one attempt to reopen a dropped or stalled HTTP connection from the last byte committed to the ring
+  /// buffer. Gives up after a limited number of attempts without receiving data, backing off a bit more each attempt.
+  /// @return READING if the connection was reopened or will be retried, FAILED otherwise
+  AudioReaderState reconnect_();
+
+  /// @brief Opens the HTTP connection and reads the response headers. Sends a range request for nonzero offsets.
+  /// @param byte_offset offset from the start of the file to start receiving at
+  /// @return ESP_OK if successful, ESP_ERR_NOT_SUPPORTED if the server ignored the range request,
+  /// ESP_ERR_INVALID_ARG if the range is past the end of the file, or another error if the connection failed
+  esp_err_t open_connection_(size_t byte_offset);
+
   void cleanup_connection_();
 
-  esphome::RingBuffer *output_ring_buffer_;
+  AudioRingBuffer *output_ring_buffer_;
 
-  size_t transfer_buffer_length_;  // Amount of data currently stored in transfer buffer (in bytes)
-  size_t transfer_buffer_size_;    // Capacity of transfer buffer (in bytes)
+  size_t transfer_buffer_size_;  // Maximum bytes transferred per read call
+  TickType_t ticks_to_wait_;
 
-  ssize_t no_data_read_count_;
+  size_t no_data_read_count_;
+  size_t reconnect_attempts_{0};
+  bool connection_dropped_{false};
 
-  uint8_t *transfer_buffer_{nullptr};
-  const uint8_t *transfer_buffer_current_{nullptr};
+  // Offset from the start of the file of the next byte to be committed to the ring buffer
+  size_t position_{0};
+  size_t bytes_moved_{0};
+  bool low_latency_start_{false};
+
+  // Position and remaining length of the media file in flash
+  const uint8_t *media_file_current_{nullptr};
+  size_t media_file_bytes_left_;
 
   esp_http_client_handle_t client_{nullptr};
 
   media_player::MediaFile *current_media_file_{nullptr};
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  AudioStageStats *stats_{nullptr};
+#endif
 };
 }  // namespace nabu
 }  // namespace esphome
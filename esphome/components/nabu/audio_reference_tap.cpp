@@ -0,0 +1,196 @@
+#ifdef USE_ESP_IDF
+
+#include "audio_reference_tap.h"
+
+#include "esphome/core/hal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+static const float PI = 3.14159265358979f;
+// Leaves room for the filter's transition band below the reference's 8 kHz Nyquist frequency
+static const float REFERENCE_CUTOFF_HZ = 6500.0f;
+// Reference samples are collected here before they are copied into the ring buffer
+static const size_t REFERENCE_CHUNK_SAMPLES = 64;
+
+AudioReferenceTap::~AudioReferenceTap() {
+  if (this->timestamp_queue_ != nullptr) {
+    vQueueDelete(this->timestamp_queue_);
+  }
+}
+
+std::unique_ptr<AudioReferenceTap> AudioReferenceTap::create(uint32_t output_sample_rate, uint8_t output_channels,
+                                                             uint32_t buffer_ms) {
+  uint32_t decimation = output_sample_rate / REFERENCE_SAMPLE_RATE;
+  if ((output_sample_rate % REFERENCE_SAMPLE_RATE != 0) || (decimation == 0) ||
+      (decimation > MAX_REFERENCE_DECIMATION) || (output_channels == 0) || (output_channels > 2)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<AudioReferenceTap> tap(new AudioReferenceTap(decimation, output_channels));
+
+  tap->ring_buffer_ = AudioRingBuffer::create(REFERENCE_SAMPLE_RATE / 1000 * buffer_ms * sizeof(int16_t));
+  // A single slot that is overwritten, so it always holds the latest timestamp
+  tap->timestamp_queue_ = xQueueCreate(1, sizeof(ReferenceTimestamp));
+  if ((tap->ring_buffer_ == nullptr) || (tap->timestamp_queue_ == nullptr)) {
+    return nullptr;
+  }
+
+  tap->compute_filter_();
+  tap->reset();
+
+  return tap;
+}
+
+void AudioReferenceTap::compute_filter_() {
+  if (this->decimation_ == 1) {
+    // Already at the reference's sample rate
+    this->taps_ = 1;
+    this->coefficients_[0] = 1.0f;
+    return;
+  }
+
+  // An odd number of taps whose delay, (taps - 1) / 2, is a whole number of output frames
+  this->taps_ = 16 * this->decimation_ - 1;
+  const float cutoff = REFERENCE_CUTOFF_HZ / static_cast<float>(REFERENCE_SAMPLE_RATE * this->decimation_);
+  const float center = static_cast<float>(this->taps_ - 1) / 2.0f;
+
+  float sum = 0.0f;
+  for (size_t i = 0; i < this->taps_; ++i) {
+    float x = static_cast<float>(i) - center;
+    float sinc = (x == 0.0f) ? 2.0f * cutoff : std::sin(2.0f * PI * cutoff * x) / (PI * x);
+    // Blackman window
+    float w = 2.0f * PI * static_cast<float>(i) / static_cast<float>(this->taps_ - 1);
+    float window = 0.42f - 0.5f * std::cos(w) + 0.08f * std::cos(2.0f * w);
+    this->coefficients_[i] = sinc * window;
+    sum += this->coefficients_[i];
+  }
+
+  // Unity gain at DC
+  for (size_t i = 0; i < this->taps_; ++i) {
+    this->coefficients_[i] /= sum;
+  }
+}
+
+void AudioReferenceTap::reset() {
+  this->ring_buffer_->reset();
+  xQueueReset(this->timestamp_queue_);
+
+  std::memset(this->history_, 0, sizeof(this->history_));
+  this->history_index_ = 0;
+  this->phase_ = 0;
+  this->partial_frame_bytes_ = 0;
+
+  this->output_frames_ = 0;
+  this->reference_samples_ = 0;
+}
+
+void AudioReferenceTap::write(const int16_t *samples, size_t bytes) {
+  ReferenceTimestamp timestamp;
+  timestamp.committed_us = micros();
+  timestamp.output_frame = this->output_frames_;
+  timestamp.reference_sample = this->reference_samples_;
+  // The next reference sample is computed once the frame completing its phase is in, and is centered the filter's
+  // delay before that frame
+  timestamp.reference_frame = static_cast<int64_t>(this->output_frames_ + this->decimation_ - 1 - this->phase_) -
+                              static_cast<int64_t>((this->taps_ - 1) / 2);
+
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(samples);
+
+  size_t frames = (this->partial_frame_bytes_ + bytes) / this->frame_bytes_;
+  size_t reference_samples = (this->phase_ + frames) / this->decimation_;
+  bool keep = true;
+  if (this->ring_buffer_->free() < reference_samples * sizeof(int16_t)) {
+    // The consumer isn't keeping up. Drop the whole block, so the samples written in each block stay contiguous. The
+    // filter still runs, so the next block starts with the right history.
+    this->dropped_samples_ += reference_samples;
+    keep = false;
+  }
+
+  if (this->partial_frame_bytes_ > 0) {
+    // Complete the frame split across the previous write
+    size_t bytes_to_copy = std::min(bytes, this->frame_bytes_ - this->partial_frame_bytes_);
+    std::memcpy(this->partial_frame_ + this->partial_frame_bytes_, data, bytes_to_copy);
+    this->partial_frame_bytes_ += bytes_to_copy;
+    data += bytes_to_copy;
+    bytes -= bytes_to_copy;
+
+    if (this->partial_frame_bytes_ == this->frame_bytes_) {
+      int16_t frame[2];
+      std::memcpy(frame, this->partial_frame_, this->frame_bytes_);
+      this->process_frames_(frame, 1, keep);
+      this->partial_frame_bytes_ = 0;
+    }
+  }
+
+  size_t whole_frames = bytes / this->frame_bytes_;
+  this->process_frames_(reinterpret_cast<const int16_t *>(data), whole_frames, keep);
+
+  size_t tail_bytes = bytes - whole_frames * this->frame_bytes_;
+  if (tail_bytes > 0) {
+    std::memcpy(this->partial_frame_, data + whole_frames * this->frame_bytes_, tail_bytes);
+    this->partial_frame_bytes_ = tail_bytes;
+  }
+
+  if (keep && (reference_samples > 0)) {
+    xQueueOverwrite(this->timestamp_queue_, &timestamp);
+  }
+}
+
+void AudioReferenceTap::process_frames_(const int16_t *samples, size_t frames, bool keep) {
+  int16_t chunk[REFERENCE_CHUNK_SAMPLES];
+  size_t chunk_samples = 0;
+
+  for (size_t i = 0; i < frames; ++i) {
+    float mono;
+    if (this->channels_ == 1) {
+      mono = static_cast<float>(samples[i]);
+    } else {
+      // Average rather than sum, so the mono mix can't clip
+      mono = 0.5f * (static_cast<float>(samples[2 * i]) + static_cast<float>(samples[2 * i + 1]));
+    }
+    this->history_[this->history_index_] = mono;
+    this->history_[this->history_index_ + this->taps_] = mono;
+    this->history_index_ = (this->history_index_ + 1) % this->taps_;
+    ++this->output_frames_;
+
+    if (++this->phase_ < this->decimation_) {
+      continue;
+    }
+    this->phase_ = 0;
+
+    if (!keep) {
+      continue;
+    }
+
+    // The oldest sample is at history_index_, so the filter runs over the next taps_ samples. The filter is symmetric,
+    // so the order of the coefficients doesn't matter.
+    const float *window = this->history_ + this->history_index_;
+    float sum = 0.0f;
+    for (size_t t = 0; t < this->taps_; ++t) {
+      sum += this->coefficients_[t] * window[t];
+    }
+
+    int32_t rounded = static_cast<int32_t>(std::lrint(sum));
+    chunk[chunk_samples++] = static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(rounded, INT16_MIN), INT16_MAX));
+    if (chunk_samples == REFERENCE_CHUNK_SAMPLES) {
+      this->ring_buffer_->write(chunk, chunk_samples * sizeof(int16_t), 0);
+      this->reference_samples_ += chunk_samples;
+      chunk_samples = 0;
+    }
+  }
+
+  if (chunk_samples > 0) {
+    this->ring_buffer_->write(chunk, chunk_samples * sizeof(int16_t), 0);
+    this->reference_samples_ += chunk_samples;
+  }
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
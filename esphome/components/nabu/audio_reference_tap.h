@@ -0,0 +1,113 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include "audio_ring_buffer.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace esphome {
+namespace nabu {
+
+static const uint32_t REFERENCE_SAMPLE_RATE = 16000;
+// Output sample rates up to 48 kHz are supported
+static const uint32_t MAX_REFERENCE_DECIMATION = 3;
+static const size_t MAX_REFERENCE_FILTER_TAPS = 16 * MAX_REFERENCE_DECIMATION - 1;
+
+// Lines up the reference samples with the output. Published once per output block.
+//  - The time a reference sample k is handed to the output sink is
+//    committed_us + (reference_frame + (k - reference_sample) * decimation - output_frame) / output_sample_rate.
+//    Adding the output's own latency (e.g., its DMA buffers) gives when it is played.
+//  - Reference samples are only dropped when the ring buffer is full, a whole block at a time. That shows as a jump
+//    between the mappings of consecutive timestamps.
+struct ReferenceTimestamp {
+  uint64_t reference_sample;  // Index of the block's first reference sample in the ring buffer's sample stream
+  int64_t reference_frame;    // Output frame that reference sample is centered on; negative while the filter fills
+  uint64_t output_frame;      // Index of the block's first output frame
+  uint32_t committed_us;      // micros() when the block was handed to the output sink
+};
+
+// Keeps a reference of what the mixer outputs, e.g., for an echo canceller
+//  - The mixer writes every block it hands to its output sink, after limiting and output processing. Writes never
+//    block the mixer.
+//  - A stereo output is averaged to mono, and a mono output is used as is. It is decimated to 16 kHz mono 16 bit
+//    samples in a ring buffer. A linear phase FIR filter removes everything above the reference's band first. Its
+//    delay is a whole number of output frames, so every reference sample lines up exactly with an output frame.
+//  - Only output sample rates that are a multiple of 16 kHz, up to 48 kHz, can be decimated without resampling
+class AudioReferenceTap {
+ public:
+  ~AudioReferenceTap();
+
+  /// @brief Allocates a tap and its ring buffer, preferring external RAM
+  /// @param output_sample_rate sample rate of the mixer's output
+  /// @param output_channels number of channels in the mixer's output; 1 or 2
+  /// @param buffer_ms duration of reference audio the ring buffer holds
+  /// @return unique_ptr to the tap, or nullptr if the sample rate isn't supported or the memory couldn't be allocated
+  static std::unique_ptr<AudioReferenceTap> create(uint32_t output_sample_rate, uint8_t output_channels,
+                                                   uint32_t buffer_ms);
+
+  /// @brief Ring buffer with the 16 kHz mono 16 bit reference samples. The tap is its producer.
+  AudioRingBuffer *get_ring_buffer() { return this->ring_buffer_.get(); }
+
+  /// @brief Gets the latest timestamp without removing it
+  /// @param timestamp (output) the timestamp of the latest block written
+  /// @return true if a block has been written since the tap was reset
+  bool get_timestamp(ReferenceTimestamp &timestamp) { return xQueuePeek(this->timestamp_queue_, &timestamp, 0); }
+
+  /// @brief Output frames per reference sample
+  uint32_t get_decimation() const { return this->decimation_; }
+
+  /// @brief Number of reference samples dropped because the ring buffer was full
+  uint32_t get_dropped_samples() const { return this->dropped_samples_; }
+
+  /// @brief Discards the reference audio and filter state, and restarts the frame and sample counts. Only called by
+  /// the mixer task.
+  void reset();
+
+  /// @brief Adds audio handed to the output sink. Only called by the mixer task.
+  /// @param samples 16 bit samples with the output's number of channels
+  /// @param bytes length in bytes; a frame split across writes is completed by the next write
+  void write(const int16_t *samples, size_t bytes);
+
+ protected:
+  AudioReferenceTap(uint32_t decimation, uint8_t channels)
+      : decimation_(decimation), channels_(channels), frame_bytes_(channels * sizeof(int16_t)) {}
+
+  /// @brief Computes the windowed sinc low-pass filter for the decimation
+  void compute_filter_();
+
+  /// @brief Filters and decimates whole frames into the ring buffer
+  /// @param keep false to only update the filter state, dropping the reference samples
+  void process_frames_(const int16_t *samples, size_t frames, bool keep);
+
+  std::unique_ptr<AudioRingBuffer> ring_buffer_;
+  QueueHandle_t timestamp_queue_{nullptr};
+
+  const uint32_t decimation_;
+  const uint8_t channels_;
+  const size_t frame_bytes_;
+  size_t taps_{0};
+  float coefficients_[MAX_REFERENCE_FILTER_TAPS];
+  // Delay line of mono samples, stored twice so the newest taps_ samples are always contiguous
+  float history_[2 * MAX_REFERENCE_FILTER_TAPS];
+  size_t history_index_{0};
+  uint32_t phase_{0};  // Frames since the last reference sample
+
+  // First bytes of a frame split across writes
+  uint8_t partial_frame_[2 * sizeof(int16_t)];
+  size_t partial_frame_bytes_{0};
+
+  uint64_t output_frames_{0};
+  uint64_t reference_samples_{0};
+  uint32_t dropped_samples_{0};
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -2,105 +2,77 @@
 
 #include "audio_resampler.h"
 
-#include "esphome/core/ring_buffer.h"
 #include "esphome/core/helpers.h"
 
 namespace esphome {
 namespace nabu {
 
-static const size_t NUM_TAPS = 32;
-static const size_t NUM_FILTERS = 32;
-static const bool USE_PRE_POST_FILTER = true;
+// Indexed by ResamplerQuality
+static const ResamplerProfile RESAMPLER_PROFILES[] = {
+    {16, 0.8f, 16, 16, false},                                            // VOICE
+    {POLYPHASE_TAPS_PER_PHASE, POLYPHASE_CUTOFF_FRACTION, 32, 32, true},  // BALANCED
+    {48, 0.93f, 64, 64, true},                                            // HIFI
+};
 
-// These output parameters are currently hardcoded in the elements further down the pipeline (mixer and speaker)
-static const uint8_t OUTPUT_CHANNELS = 2;
+const ResamplerProfile &get_resampler_profile(ResamplerQuality quality) {
+  return RESAMPLER_PROFILES[static_cast<uint8_t>(quality)];
+}
+
+// The output's bits per sample are hardcoded in the elements further down the pipeline (mixer and speaker)
 static const uint8_t OUTPUT_BITS_PER_SAMPLE = 16;
 
 static const size_t READ_WRITE_TIMEOUT_MS = 20;
 
-AudioResampler::AudioResampler(RingBuffer *input_ring_buffer, RingBuffer *output_ring_buffer,
+// Avoids converting tiny blocks when the output ring buffer is nearly full or its free space wraps around
+static const size_t MIN_OUTPUT_BYTES = 1024;
+
+AudioResampler::AudioResampler(AudioRingBuffer *input_ring_buffer, AudioRingBuffer *output_ring_buffer,
                                size_t internal_buffer_samples) {
   this->input_ring_buffer_ = input_ring_buffer;
   this->output_ring_buffer_ = output_ring_buffer;
   this->internal_buffer_samples_ = internal_buffer_samples;
+  this->ticks_to_wait_ = pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS);
 }
 
 AudioResampler::~AudioResampler() {
-  ExternalRAMAllocator<int16_t> int16_allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
-  ExternalRAMAllocator<float> float_allocator(ExternalRAMAllocator<float>::ALLOW_FAILURE);
-
-  if (this->input_buffer_ != nullptr) {
-    int16_allocator.deallocate(this->input_buffer_, this->internal_buffer_samples_);
-  }
-  if (this->output_buffer_ != nullptr) {
-    int16_allocator.deallocate(this->output_buffer_, this->internal_buffer_samples_);
-  }
-  if (this->float_input_buffer_ != nullptr) {
-    float_allocator.deallocate(this->float_input_buffer_, this->internal_buffer_samples_);
-  }
-  if (this->float_output_buffer_ != nullptr) {
-    float_allocator.deallocate(this->float_output_buffer_, this->internal_buffer_samples_);
-  }
   if (this->resampler_ != nullptr) {
     resampleFree(this->resampler_);
     this->resampler_ = nullptr;
   }
 }
 
-esp_err_t AudioResampler::allocate_buffers_() {
-  ExternalRAMAllocator<int16_t> int16_allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
-  ExternalRAMAllocator<float> float_allocator(ExternalRAMAllocator<float>::ALLOW_FAILURE);
-
-  if (this->input_buffer_ == nullptr)
-    this->input_buffer_ = int16_allocator.allocate(this->internal_buffer_samples_);
-  if (this->output_buffer_ == nullptr)
-    this->output_buffer_ = int16_allocator.allocate(this->internal_buffer_samples_);
-
-  if (this->float_input_buffer_ == nullptr)
-    this->float_input_buffer_ = float_allocator.allocate(this->internal_buffer_samples_);
-
-  if (this->float_output_buffer_ == nullptr)
-    this->float_output_buffer_ = float_allocator.allocate(this->internal_buffer_samples_);
-
-  if ((this->input_buffer_ == nullptr) || (this->output_buffer_ == nullptr) || (this->float_input_buffer_ == nullptr) ||
-      (this->float_output_buffer_ == nullptr)) {
-    return ESP_ERR_NO_MEM;
-  }
-
-  return ESP_OK;
-}
-
 esp_err_t AudioResampler::start(audio::AudioStreamInfo &stream_info, uint32_t target_sample_rate,
-                                ResampleInfo &resample_info) {
-  esp_err_t err = this->allocate_buffers_();
-  if (err != ESP_OK) {
-    return err;
-  }
-
+                                uint8_t output_channels, ResampleInfo &resample_info) {
   this->stream_info_ = stream_info;
+  this->output_channels_ = output_channels;
 
-  this->input_buffer_current_ = this->input_buffer_;
-  this->input_buffer_length_ = 0;
-  this->float_input_buffer_current_ = this->float_input_buffer_;
-  this->float_input_buffer_length_ = 0;
-
-  this->output_buffer_current_ = this->output_buffer_;
-  this->output_buffer_length_ = 0;
-  this->float_output_buffer_current_ = this->float_output_buffer_;
-  this->float_output_buffer_length_ = 0;
-
-  resample_info.mono_to_stereo = (stream_info.channels != 2);
-
-  if ((stream_info.channels > OUTPUT_CHANNELS) || (stream_info_.bits_per_sample != OUTPUT_BITS_PER_SAMPLE)) {
+  if ((stream_info.channels == 0) || (stream_info.channels > 2) || (output_channels == 0) || (output_channels > 2) ||
+      (stream_info_.bits_per_sample != OUTPUT_BITS_PER_SAMPLE)) {
     return ESP_ERR_NOT_SUPPORTED;
   }
 
-  if (stream_info.channels > 0) {
-    this->channel_factor_ = 2 / stream_info.channels;
-  }
+  resample_info.mono_to_stereo = (stream_info.channels < output_channels);
+  resample_info.stereo_to_mono = (stream_info.channels > output_channels);
+  this->resample_channels_ = std::min(stream_info.channels, output_channels);
 
-  if (stream_info.sample_rate != target_sample_rate) {
+  const ResamplerProfile &profile = get_resampler_profile(this->quality_);
+
+  this->use_polyphase_ = (stream_info.sample_rate != target_sample_rate) && !this->drift_compensation_ &&
+                         (this->polyphase_.start(stream_info.sample_rate, target_sample_rate, stream_info.channels,
+                                                 output_channels, profile.polyphase_taps_per_phase,
+                                                 profile.polyphase_cutoff_fraction) == ESP_OK);
+
+  if (this->use_polyphase_) {
+    resample_info.resample = true;
+  } else if ((stream_info.sample_rate != target_sample_rate) || this->drift_compensation_) {
     int flags = 0;
+    if (this->drift_compensation_) {
+      // Interpolates between the filter phases, so the small ratio changes move the output smoothly
+      flags |= SUBSAMPLE_INTERPOLATE;
+
+      this->target_sample_rate_ = target_sample_rate;
+      this->drift_compensator_.start(target_sample_rate);
+    }
 
     resample_info.resample = true;
 
@@ -118,36 +90,36 @@ esp_err_t AudioResampler::start(audio::AudioStreamInfo &stream_info, uint32_t ta
         this->lowpass_ratio_ = this->sample_ratio_;
       }
     }
-    if (this->lowpass_ratio_ * this->sample_ratio_ < 0.98 && USE_PRE_POST_FILTER) {
+    if (this->lowpass_ratio_ * this->sample_ratio_ < 0.98 && profile.use_pre_post_filter) {
       float cutoff = this->lowpass_ratio_ * this->sample_ratio_ / 2.0;
       biquad_lowpass(&this->lowpass_coeff_, cutoff);
       this->pre_filter_ = true;
     }
 
-    if (this->lowpass_ratio_ / this->sample_ratio_ < 0.98 && USE_PRE_POST_FILTER && !this->pre_filter_) {
+    if (this->lowpass_ratio_ / this->sample_ratio_ < 0.98 && profile.use_pre_post_filter && !this->pre_filter_) {
       float cutoff = this->lowpass_ratio_ / this->sample_ratio_ / 2.0;
       biquad_lowpass(&this->lowpass_coeff_, cutoff);
       this->post_filter_ = true;
     }
 
     if (this->pre_filter_ || this->post_filter_) {
-      for (int i = 0; i < stream_info.channels; ++i) {
+      for (int i = 0; i < this->resample_channels_; ++i) {
         biquad_init(&this->lowpass_[i][0], &this->lowpass_coeff_, 1.0);
         biquad_init(&this->lowpass_[i][1], &this->lowpass_coeff_, 1.0);
       }
     }
 
     if (this->sample_ratio_ < 1.0) {
-      this->resampler_ = resampleInit(stream_info.channels, NUM_TAPS, NUM_FILTERS,
+      this->resampler_ = resampleInit(this->resample_channels_, profile.num_taps, profile.num_filters,
                                       this->sample_ratio_ * this->lowpass_ratio_, flags | INCLUDE_LOWPASS);
     } else if (this->lowpass_ratio_ < 1.0) {
-      this->resampler_ =
-          resampleInit(stream_info.channels, NUM_TAPS, NUM_FILTERS, this->lowpass_ratio_, flags | INCLUDE_LOWPASS);
+      this->resampler_ = resampleInit(this->resample_channels_, profile.num_taps, profile.num_filters,
+                                      this->lowpass_ratio_, flags | INCLUDE_LOWPASS);
     } else {
-      this->resampler_ = resampleInit(stream_info.channels, NUM_TAPS, NUM_FILTERS, 1.0, flags);
+      this->resampler_ = resampleInit(this->resample_channels_, profile.num_taps, profile.num_filters, 1.0, flags);
     }
 
-    resampleAdvancePosition(this->resampler_, NUM_TAPS / 2.0);
+    resampleAdvancePosition(this->resampler_, profile.num_taps / 2.0);
 
   } else {
     resample_info.resample = false;
@@ -158,159 +130,193 @@ esp_err_t AudioResampler::start(audio::AudioStreamInfo &stream_info, uint32_t ta
 }
 
 AudioResamplerState AudioResampler::resample(bool stop_gracefully) {
+  const size_t input_frame_bytes = this->stream_info_.channels * sizeof(int16_t);
+  const size_t output_frame_bytes = this->output_channels_ * sizeof(int16_t);
+  this->bytes_moved_ = 0;
+
   if (stop_gracefully) {
-    if ((this->input_ring_buffer_->available() == 0) && (this->output_ring_buffer_->available() == 0) &&
-        (this->input_buffer_length_ == 0) && (this->output_buffer_length_ == 0)) {
+    if ((this->input_ring_buffer_->available() < input_frame_bytes) && (this->output_ring_buffer_->available() == 0)) {
       return AudioResamplerState::FINISHED;
     }
   }
 
-  if (this->output_buffer_length_ > 0) {
-    size_t bytes_to_write = this->output_buffer_length_;
+  // Samples are indiviudal int16 values. Frames include 1 sample for mono and 2 samples for stereo
+  // Be careful converting between bytes, samples, and frames!
+  // 1 sample = 2 bytes = sizeof(int16_t)
+  // if mono:
+  //    1 frame = 1 sample
+  // if stereo:
+  //    1 frame = 2 samples (left and right)
+  // Only whole frames are ever committed to the output ring buffer, which keeps the samples aligned for the mixer.
 
-    if (bytes_to_write > 0) {
-      size_t bytes_written = this->output_ring_buffer_->write_without_replacement(
-          (void *) this->output_buffer_current_, bytes_to_write, pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
-
-      this->output_buffer_current_ += bytes_written / sizeof(int16_t);
-      this->output_buffer_length_ -= bytes_written;
-    }
+  uint8_t *output_data;
+  size_t output_bytes = this->output_ring_buffer_->reserve(&output_data, MIN_OUTPUT_BYTES, this->ticks_to_wait_);
+  size_t max_output_frames = output_bytes / output_frame_bytes;
 
+  if (max_output_frames == 0) {
     return AudioResamplerState::RESAMPLING;
   }
 
-  // Copy audio data directly to output_buffer if resampling isn't required
-  if (!this->resample_info_.resample && !this->resample_info_.mono_to_stereo) {
-    size_t bytes_read =
-        this->input_ring_buffer_->read((void *) this->output_buffer_, this->internal_buffer_samples_ * sizeof(int16_t),
-                                       pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
-
-    this->output_buffer_current_ = this->output_buffer_;
-    this->output_buffer_length_ += bytes_read;
+  uint8_t *input_data;
+  size_t input_bytes = this->input_ring_buffer_->peek(&input_data, input_frame_bytes, this->ticks_to_wait_);
+  size_t input_frames = input_bytes / input_frame_bytes;
 
+  if (input_frames == 0) {
     return AudioResamplerState::RESAMPLING;
   }
 
-  //////
-  // Refill input buffer
-  //////
-
-  // Depending on if we are converting mono to stereo or if we are upsampling, we may need to restrict how many input
-  // samples we transfer
-  size_t max_input_samples = this->internal_buffer_samples_;
-
-  // Mono to stereo -> cut in half
-  max_input_samples /= (2 / this->stream_info_.channels);
-
-  if (this->sample_ratio_ > 1.0) {
-    // Upsampling -> reduce by a factor of the ceiling of sample_ratio_
-    uint32_t upsampling_factor = std::ceil(this->sample_ratio_);
-    max_input_samples /= upsampling_factor;
-  }
-
-  // Move old data to the start of the buffer
-  if (this->input_buffer_length_ > 0) {
-    memmove((void *) this->input_buffer_, (void *) this->input_buffer_current_, this->input_buffer_length_);
-  }
-  this->input_buffer_current_ = this->input_buffer_;
-
-  // Copy new data to the end of the of the buffer
-  size_t bytes_to_read = max_input_samples * sizeof(int16_t) - this->input_buffer_length_;
-
-  if (bytes_to_read > 0) {
-    int16_t *new_input_buffer_data = this->input_buffer_ + this->input_buffer_length_ / sizeof(int16_t);
-    size_t bytes_read = this->input_ring_buffer_->read((void *) new_input_buffer_data, bytes_to_read,
-                                                       pdMS_TO_TICKS(READ_WRITE_TIMEOUT_MS));
-
-    this->input_buffer_length_ += bytes_read;
-  }
-
-  if (this->input_buffer_length_ == 0) {
-    return AudioResamplerState::RESAMPLING;
-  }
-
-  if (this->resample_info_.resample) {
-    if (this->input_buffer_length_ > 0) {
-      // Samples are indiviudal int16 values. Frames include 1 sample for mono and 2 samples for stereo
-      // Be careful converting between bytes, samples, and frames!
-      // 1 sample = 2 bytes = sizeof(int16_t)
-      // if mono:
-      //    1 frame = 1 sample
-      // if stereo:
-      //    1 frame = 2 samples (left and right)
-
-      size_t samples_read = this->input_buffer_length_ / sizeof(int16_t);
+  const int16_t *input_samples = (const int16_t *) input_data;
+  int16_t *output_samples = (int16_t *) output_data;
+
+  size_t frames_used = 0;
+  size_t frames_generated = 0;
+
+  if (!this->resample_info_.resample && !this->resample_info_.mono_to_stereo && !this->resample_info_.stereo_to_mono) {
+    // Copy audio data directly between the ring buffers if no conversion is required
+    frames_used = std::min(input_frames, max_output_frames);
+    std::memcpy((void *) output_samples, (void *) input_samples, frames_used * input_frame_bytes);
+    frames_generated = frames_used;
+  } else if (this->use_polyphase_) {
+    // Reads and writes the ring buffers' memory directly, converting the channels at the same time
+    frames_generated =
+        this->polyphase_.process(input_samples, input_frames, output_samples, max_output_frames, frames_used);
+  } else if (this->resample_info_.resample) {
+    // Bounds how much is converted per call, like the other paths' ring buffer reservations
+    max_output_frames = std::min(max_output_frames, this->internal_buffer_samples_ / this->resample_channels_);
+
+    double ratio = this->sample_ratio_;
+    if (this->drift_compensation_) {
+      ratio *= this->drift_compensator_.get_ratio_factor();
+    }
 
-      for (int i = 0; i < samples_read; ++i) {
-        this->float_input_buffer_[i] = static_cast<float>(this->input_buffer_[i]) / 32768.0f;
+    // Each block is converted, filtered, resampled, and converted back while it is in the scratch buffers, and only
+    // the ring buffers' memory is touched on either end
+    while ((frames_used < input_frames) && (frames_generated < max_output_frames)) {
+      size_t block_output_frames = std::min(RESAMPLER_FLOAT_BLOCK_FRAMES, max_output_frames - frames_generated);
+      // The input that fits the block's output. The resampler may still owe an output frame for earlier input, so one
+      // frame of each is held back.
+      double block_input_limit = (static_cast<double>(block_output_frames) - 1.0) / ratio - 1.0;
+      if (block_input_limit < 1.0) {
+        break;
+      }
+      size_t block_input_frames = std::min(std::min(input_frames - frames_used, RESAMPLER_FLOAT_BLOCK_FRAMES),
+                                           static_cast<size_t>(block_input_limit));
+
+      const int16_t *block_input = input_samples + frames_used * this->stream_info_.channels;
+      if (this->resample_info_.stereo_to_mono) {
+        // Downmix first, so only one channel is filtered and resampled
+        for (size_t i = 0; i < block_input_frames; ++i) {
+          this->float_input_block_[i] =
+              (static_cast<float>(block_input[2 * i]) + static_cast<float>(block_input[2 * i + 1])) / 65536.0f;
+        }
+      } else {
+        size_t block_input_samples = block_input_frames * this->resample_channels_;
+        for (size_t i = 0; i < block_input_samples; ++i) {
+          this->float_input_block_[i] = static_cast<float>(block_input[i]) / 32768.0f;
+        }
       }
-
-      size_t frames_read = samples_read / this->stream_info_.channels;
 
       if (this->pre_filter_) {
-        for (int i = 0; i < this->stream_info_.channels; ++i) {
-          biquad_apply_buffer(&this->lowpass_[i][0], this->float_input_buffer_ + i, frames_read,
-                              this->stream_info_.channels);
-          biquad_apply_buffer(&this->lowpass_[i][1], this->float_input_buffer_ + i, frames_read,
-                              this->stream_info_.channels);
+        for (int i = 0; i < this->resample_channels_; ++i) {
+          biquad_apply_buffer(&this->lowpass_[i][0], this->float_input_block_ + i, block_input_frames,
+                              this->resample_channels_);
+          biquad_apply_buffer(&this->lowpass_[i][1], this->float_input_block_ + i, block_input_frames,
+                              this->resample_channels_);
         }
       }
 
-      ResampleResult res;
-
-      res = resampleProcessInterleaved(this->resampler_, this->float_input_buffer_, frames_read,
-                                       this->float_output_buffer_,
-                                       this->internal_buffer_samples_ / this->channel_factor_, this->sample_ratio_);
-
-      size_t frames_used = res.input_used;
-      size_t samples_used = frames_used * this->stream_info_.channels;
+      ResampleResult res = resampleProcessInterleaved(this->resampler_, this->float_input_block_, block_input_frames,
+                                                      this->float_output_block_, block_output_frames, ratio);
 
-      size_t frames_generated = res.output_generated;
       if (this->post_filter_) {
-        for (int i = 0; i < this->stream_info_.channels; ++i) {
-          biquad_apply_buffer(&this->lowpass_[i][0], this->float_output_buffer_ + i, frames_generated,
-                              this->stream_info_.channels);
-          biquad_apply_buffer(&this->lowpass_[i][1], this->float_output_buffer_ + i, frames_generated,
-                              this->stream_info_.channels);
+        for (int i = 0; i < this->resample_channels_; ++i) {
+          biquad_apply_buffer(&this->lowpass_[i][0], this->float_output_block_ + i, res.output_generated,
+                              this->resample_channels_);
+          biquad_apply_buffer(&this->lowpass_[i][1], this->float_output_block_ + i, res.output_generated,
+                              this->resample_channels_);
         }
       }
 
-      size_t samples_generated = frames_generated * this->stream_info_.channels;
-
-      for (int i = 0; i < samples_generated; ++i) {
-        this->output_buffer_[i] = static_cast<int16_t>(this->float_output_buffer_[i] * 32767);
+      // Convert back to int16 directly in the output ring buffer, converting mono to stereo at the same time
+      int16_t *block_output = output_samples + frames_generated * this->output_channels_;
+      if (this->resample_info_.mono_to_stereo) {
+        for (size_t i = 0; i < res.output_generated; ++i) {
+          int16_t sample = static_cast<int16_t>(this->float_output_block_[i] * 32767);
+          block_output[2 * i] = sample;
+          block_output[2 * i + 1] = sample;
+        }
+      } else {
+        size_t block_output_samples = res.output_generated * this->resample_channels_;
+        for (size_t i = 0; i < block_output_samples; ++i) {
+          block_output[i] = static_cast<int16_t>(this->float_output_block_[i] * 32767);
+        }
       }
 
-      this->input_buffer_current_ += samples_used;
-      this->input_buffer_length_ -= samples_used * sizeof(int16_t);
+      frames_used += res.input_used;
+      frames_generated += res.output_generated;
 
-      this->output_buffer_current_ = this->output_buffer_;
-      this->output_buffer_length_ += samples_generated * sizeof(int16_t);
+      if (res.input_used < block_input_frames) {
+        // The resampler's output is full; it takes the rest of the input on the next call
+        break;
+      }
+    }
+  } else if (this->resample_info_.mono_to_stereo) {
+    // Convert mono to stereo directly in the output ring buffer
+    frames_used = std::min(input_frames, max_output_frames);
+    for (size_t i = 0; i < frames_used; ++i) {
+      output_samples[2 * i] = input_samples[i];
+      output_samples[2 * i + 1] = input_samples[i];
     }
+    frames_generated = frames_used;
   } else {
-    size_t bytes_to_transfer =
-        std::min(this->internal_buffer_samples_ / this->channel_factor_ * sizeof(int16_t), this->input_buffer_length_);
-    std::memcpy((void *) this->output_buffer_, (void *) this->input_buffer_current_, bytes_to_transfer);
-
-    this->input_buffer_current_ += bytes_to_transfer / sizeof(int16_t);
-    this->input_buffer_length_ -= bytes_to_transfer;
+    // Downmix stereo to mono directly in the output ring buffer
+    frames_used = std::min(input_frames, max_output_frames);
+    for (size_t i = 0; i < frames_used; ++i) {
+      output_samples[i] =
+          static_cast<int16_t>((static_cast<int32_t>(input_samples[2 * i]) + input_samples[2 * i + 1]) >> 1);
+    }
+    frames_generated = frames_used;
+  }
 
-    this->output_buffer_current_ = this->output_buffer_;
-    this->output_buffer_length_ += bytes_to_transfer;
+  if (this->loudness_meter_ != nullptr) {
+    this->loudness_meter_->measure(output_samples, frames_generated);
   }
 
-  if (this->resample_info_.mono_to_stereo) {
-    // Convert mono to stereo
-    for (int i = this->output_buffer_length_ / (sizeof(int16_t)) - 1; i >= 0; --i) {
-      this->output_buffer_[2 * i] = this->output_buffer_[i];
-      this->output_buffer_[2 * i + 1] = this->output_buffer_[i];
-    }
+  this->input_ring_buffer_->release(frames_used * input_frame_bytes);
+  this->output_ring_buffer_->commit(frames_generated * output_frame_bytes);
+  this->bytes_moved_ = frames_used * input_frame_bytes + frames_generated * output_frame_bytes;
 
-    this->output_buffer_length_ *= 2;  // double the bytes for stereo samples
+  if (this->drift_compensation_ && (frames_generated > 0)) {
+    this->update_drift_compensator_(frames_generated);
   }
+
   return AudioResamplerState::RESAMPLING;
 }
 
+void AudioResampler::update_drift_compensator_(size_t frames_generated) {
+  const size_t input_frame_bytes = this->stream_info_.channels * sizeof(int16_t);
+  const size_t output_frame_bytes = this->output_channels_ * sizeof(int16_t);
+
+  float buffered_frames = static_cast<float>(this->output_ring_buffer_->available() / output_frame_bytes);
+  float capacity_frames = static_cast<float>(this->output_ring_buffer_->capacity() / output_frame_bytes);
+
+  // Decoded frames become sample_ratio_ output frames each
+  const size_t input_frames = this->input_ring_buffer_->available() / input_frame_bytes;
+  buffered_frames += static_cast<float>(input_frames) * this->sample_ratio_;
+  capacity_frames += static_cast<float>(this->input_ring_buffer_->capacity() / input_frame_bytes) * this->sample_ratio_;
+
+  if ((this->upstream_ring_buffer_ != nullptr) && (this->upstream_bitrate_ > 0)) {
+    // Encoded bytes hold 8 / bitrate seconds each. For variable bitrates, the error only scales this part of the total.
+    const float output_frames_per_byte =
+        8.0f * static_cast<float>(this->target_sample_rate_) / static_cast<float>(this->upstream_bitrate_);
+    buffered_frames += static_cast<float>(this->upstream_ring_buffer_->available()) * output_frames_per_byte;
+    capacity_frames += static_cast<float>(this->upstream_ring_buffer_->capacity()) * output_frames_per_byte;
+  }
+
+  this->drift_compensator_.update(static_cast<size_t>(buffered_frames), static_cast<size_t>(capacity_frames),
+                                  frames_generated);
+}
+
 }  // namespace nabu
 }  // namespace esphome
 
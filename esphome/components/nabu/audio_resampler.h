@@ -2,15 +2,54 @@
 
 #ifdef USE_ESP_IDF
 
+#include "audio_ring_buffer.h"
+#include "drift_compensator.h"
+#include "loudness_meter.h"
+#include "polyphase_resampler.h"
+
 #include "biquad.h"
 #include "resampler.h"
 
 #include "esphome/components/audio/audio.h"
-#include "esphome/core/ring_buffer.h"
 
 namespace esphome {
 namespace nabu {
 
+// Frames the floating point path converts, filters, and resamples at a time, so each block stays in cache
+static const size_t RESAMPLER_FLOAT_BLOCK_FRAMES = 128;
+
+// Trades the resampler's CPU time for its passband. Measured converting 44.1 kHz to 48 kHz on a desktop with
+// tests/nabu/bench_resampler_quality, on the fixed point path and on the floating point fallback, which takes ratios
+// the fixed point path doesn't support and every stream with drift compensation. Costs are cycles per output sample;
+// the ESP32-S3 is far slower, but the profiles scale alike. Ripple is up to half the lower Nyquist frequency.
+//  - VOICE: 16 taps per phase. About 35 cycles on either path, half of BALANCED's fixed point cost. Ripple is 0.02 dB,
+//    it is flat to 0.1 dB up to 0.55 of Nyquist (4.4 kHz for 16 kHz audio), and -3 dB at 0.74. The fallback's 16 taps
+//    without biquads have 0.004 dB of ripple, are flat to 0.69, and -3 dB at 0.93. Enough for speech, e.g., TTS
+//    announcements.
+//  - BALANCED: 32 taps per phase. About 65 cycles; the fallback's 32 taps and filters with its biquads take about 100
+//    to 160. Ripple is 0.002 dB on either path, flat to 0.77 of Nyquist (17.1 kHz for 44.1 kHz audio) and -3 dB at
+//    0.87; the fallback is flat to 0.81 and -3 dB at 0.95.
+//  - HIFI: 48 taps per phase. About 175 cycles, nearly three times BALANCED's; the fallback's 64 taps and filters
+//    take about 200. Ripple is under 0.002 dB on either path, flat to 0.84 of Nyquist (18.6 kHz for 44.1 kHz audio)
+//    and -3 dB at 0.91; the fallback is flat to 0.82 and -3 dB at 0.97.
+enum class ResamplerQuality : uint8_t {
+  VOICE = 0,
+  BALANCED,
+  HIFI,
+};
+
+// The filter settings behind a ResamplerQuality
+struct ResamplerProfile {
+  size_t polyphase_taps_per_phase;
+  float polyphase_cutoff_fraction;
+  int num_taps;  // Floating point resampler
+  int num_filters;
+  bool use_pre_post_filter;
+};
+
+/// @brief The filter settings a quality profile uses on either path
+const ResamplerProfile &get_resampler_profile(ResamplerQuality quality);
+
 enum class AudioResamplerState : uint8_t {
   INITIALIZED = 0,
   RESAMPLING,
@@ -21,56 +60,104 @@ enum class AudioResamplerState : uint8_t {
 struct ResampleInfo {
   bool resample;
   bool mono_to_stereo;
+  bool stereo_to_mono;
 };
 
 class AudioResampler {
  public:
-  AudioResampler(esphome::RingBuffer *input_ring_buffer, esphome::RingBuffer *output_ring_buffer,
+  /// @brief Reads samples directly from the input ring buffer's memory and writes the converted samples directly into
+  /// the output ring buffer's memory
+  /// @param input_ring_buffer ring buffer with the decoded PCM audio
+  /// @param output_ring_buffer ring buffer for the converted audio
+  /// @param internal_buffer_samples maximum number of samples converted per call
+  AudioResampler(AudioRingBuffer *input_ring_buffer, AudioRingBuffer *output_ring_buffer,
                  size_t internal_buffer_samples);
   ~AudioResampler();
 
-  /// @brief Sets up the various bits necessary to resample
+  /// @brief Sets how long ring buffer operations wait for data or space. Defaults to 20 ms; the cooperative pipeline
+  /// sets 0 so the stage returns immediately when it can't make progress.
+  void set_ticks_to_wait(TickType_t ticks_to_wait) { this->ticks_to_wait_ = ticks_to_wait; }
+
+  /// @brief Sets the filter profile used by the next call to ``start``. Defaults to BALANCED.
+  void set_quality(ResamplerQuality quality) { this->quality_ = quality; }
+
+  /// @brief Adjusts the resampling ratio by a few ppm to hold the audio buffered for the output at half the buffers'
+  /// capacity, so a live source's clock drifting from the output's never fills or drains them; see
+  /// ``DriftCompensator``. The input and output ring buffers are counted, along with the upstream buffer from
+  /// ``set_upstream_buffer``. Every stream then uses the floating point resampler, even when its sample rate already
+  /// matches, as only it can vary the ratio. Must be set before ``start``.
+  void set_drift_compensation(bool enabled) { this->drift_compensation_ = enabled; }
+
+  /// @brief Sets the encoded audio buffered ahead of the decoder, which drift compensation counts toward the total
+  /// @param ring_buffer ring buffer the decoder reads from, or nullptr if there is none
+  /// @param bitrate encoded bitrate in bits per second; 0 if unknown, which leaves the ring buffer uncounted
+  void set_upstream_buffer(const AudioRingBuffer *ring_buffer, uint32_t bitrate) {
+    this->upstream_ring_buffer_ = ring_buffer;
+    this->upstream_bitrate_ = bitrate;
+  }
+
+  /// @brief Sets up the various bits necessary to resample. Ratios the fixed point ``PolyphaseResampler`` supports use
+  /// it unless drift compensation is on; any other ratio falls back to the floating point resampler.
   /// @param stream_info the incoming sample rate, bits per sample, and number of channels
   /// @param target_sample_rate the necessary sample rate to convert to
+  /// @param output_channels the number of channels to convert to; 1 or 2. Stereo streams converted to mono are
+  /// downmixed before resampling, so only one channel is resampled.
+  /// @param resample_info (output) the conversions the stream needs
   /// @return ESP_OK if it is able to convert the incoming stream or an error otherwise
-  esp_err_t start(audio::AudioStreamInfo &stream_info, uint32_t target_sample_rate, ResampleInfo &resample_info);
+  esp_err_t start(audio::AudioStreamInfo &stream_info, uint32_t target_sample_rate, uint8_t output_channels,
+                  ResampleInfo &resample_info);
+
+  /// @brief Measures the loudness of the converted audio while it is still in cache, before it is committed to
+  /// the output ring buffer
+  /// @param loudness_meter meter configured for the target sample rate, or nullptr to stop measuring
+  void set_loudness_meter(LoudnessMeter *loudness_meter) { this->loudness_meter_ = loudness_meter; }
 
   AudioResamplerState resample(bool stop_gracefully);
 
+  /// @brief Bytes the last ``resample`` call took from the input ring buffer plus the bytes it committed to the output
+  /// ring buffer. Zero means it made no progress.
+  size_t get_bytes_moved() const { return this->bytes_moved_; }
+
  protected:
-  esp_err_t allocate_buffers_();
+  /// @brief Feeds the drift compensator the total buffered, in output frames, after frames_generated were committed
+  void update_drift_compensator_(size_t frames_generated);
 
-  esphome::RingBuffer *input_ring_buffer_;
-  esphome::RingBuffer *output_ring_buffer_;
+  AudioRingBuffer *input_ring_buffer_;
+  AudioRingBuffer *output_ring_buffer_;
   size_t internal_buffer_samples_;
+  TickType_t ticks_to_wait_;
+  ResamplerQuality quality_{ResamplerQuality::BALANCED};
+  size_t bytes_moved_{0};
 
-  int16_t *input_buffer_{nullptr};
-  int16_t *input_buffer_current_{nullptr};
-  size_t input_buffer_length_;
+  DriftCompensator drift_compensator_;
+  bool drift_compensation_{false};
+  const AudioRingBuffer *upstream_ring_buffer_{nullptr};
+  uint32_t upstream_bitrate_{0};
+  uint32_t target_sample_rate_{0};
 
-  int16_t *output_buffer_{nullptr};
-  int16_t *output_buffer_current_{nullptr};
-  size_t output_buffer_length_;
+  // Converts the sample rate and channels in one pass for the ratios it supports
+  PolyphaseResampler polyphase_;
+  bool use_polyphase_{false};
 
-  float *float_input_buffer_{nullptr};
-  float *float_input_buffer_current_{nullptr};
-  size_t float_input_buffer_length_;
-
-  float *float_output_buffer_{nullptr};
-  float *float_output_buffer_current_{nullptr};
-  size_t float_output_buffer_length_;
+  // Scratch blocks of the floating point resampler. They are small enough to stay in cache and internal RAM.
+  float float_input_block_[RESAMPLER_FLOAT_BLOCK_FRAMES * 2];
+  float float_output_block_[RESAMPLER_FLOAT_BLOCK_FRAMES * 2];
 
   audio::AudioStreamInfo stream_info_;
   ResampleInfo resample_info_;
 
   Resample *resampler_{nullptr};
 
+  LoudnessMeter *loudness_meter_{nullptr};
+
   Biquad lowpass_[2][2];
   BiquadCoefficients lowpass_coeff_;
 
   float sample_ratio_{1.0};
   float lowpass_ratio_{1.0};
-  uint8_t channel_factor_{1};
+  uint8_t output_channels_{2};
+  // Channels that run through the filters and the resampler; a stereo stream is downmixed first when the output is mono
+  uint8_t resample_channels_{2};
 
   bool pre_filter_{false};
   bool post_filter_{false};
@@ -0,0 +1,259 @@
+#ifdef USE_ESP_IDF
+
+#include "audio_ring_buffer.h"
+
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+enum EventGroupBits : uint32_t {
+  DATA_COMMITTED = (1 << 0),  // Set by commit, cleared by a consumer waiting for data
+  SPACE_RELEASED = (1 << 1),  // Set by release, cleared by a producer waiting for space
+};
+
+AudioRingBuffer::~AudioRingBuffer() {
+  if (this->storage_ != nullptr) {
+    ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+    allocator.deallocate(this->storage_, this->size_ + this->guard_size_);
+  }
+  if (this->event_group_ != nullptr) {
+    vEventGroupDelete(this->event_group_);
+  }
+}
+
+std::unique_ptr<AudioRingBuffer> AudioRingBuffer::create(size_t size, size_t guard_size) {
+  std::unique_ptr<AudioRingBuffer> ring_buffer(new AudioRingBuffer(size, guard_size));
+
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  ring_buffer->storage_ = allocator.allocate(size + guard_size);
+  if (ring_buffer->storage_ == nullptr) {
+    return nullptr;
+  }
+
+  ring_buffer->event_group_ = xEventGroupCreate();
+  if (ring_buffer->event_group_ == nullptr) {
+    return nullptr;
+  }
+
+  return ring_buffer;
+}
+
+size_t AudioRingBuffer::reserve(uint8_t **data, size_t min_bytes, TickType_t ticks_to_wait) {
+  this->wait_for_(SPACE_RELEASED, std::max<size_t>(min_bytes, 1), ticks_to_wait);
+
+  size_t free_bytes = this->free();
+  size_t contiguous = std::min(free_bytes, this->size_ - this->write_index_);
+
+  *data = this->storage_ + this->write_index_;
+
+  if (contiguous < min_bytes) {
+    // Extend the region into the guard area; commit copies the part past the end back to the start of the storage
+    return std::min(free_bytes, contiguous + this->guard_size_);
+  }
+
+  return contiguous;
+}
+
+void AudioRingBuffer::commit(size_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+
+  size_t end = this->write_index_ + bytes;
+  if (end >= this->size_) {
+    end -= this->size_;
+    if (end > 0) {
+      // The producer wrote into the guard area
+      std::memcpy(this->storage_, this->storage_ + this->size_, end);
+    }
+  }
+  this->write_index_ = end;
+
+  this->available_.fetch_add(bytes, std::memory_order_release);
+  xEventGroupSetBits(this->event_group_, DATA_COMMITTED);
+  if (this->consumer_task_ != nullptr) {
+    xTaskNotifyGive(this->consumer_task_);
+  }
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  this->stats_.bytes_committed += bytes;
+#endif
+}
+
+size_t AudioRingBuffer::peek(uint8_t **data, size_t min_bytes, TickType_t ticks_to_wait) {
+  this->wait_for_(DATA_COMMITTED, std::max<size_t>(min_bytes, 1), ticks_to_wait);
+
+  size_t available_bytes = this->available();
+  size_t contiguous = std::min(available_bytes, this->size_ - this->read_index_);
+
+  *data = this->storage_ + this->read_index_;
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  ++this->stats_.fill_histogram[std::min(available_bytes * FILL_HISTOGRAM_BUCKETS / this->size_,
+                                         FILL_HISTOGRAM_BUCKETS - 1)];
+  if (available_bytes < std::max<size_t>(min_bytes, 1)) {
+    if (this->consumer_had_data_) {
+      ++this->stats_.underruns;
+    }
+    this->consumer_had_data_ = false;
+  } else {
+    this->consumer_had_data_ = true;
+  }
+#endif
+
+  if ((contiguous < min_bytes) && (available_bytes > contiguous)) {
+    // The data wraps around; mirror just enough of the start of the storage into the guard area
+    size_t wrapped_bytes = std::min(std::min(available_bytes, min_bytes) - contiguous, this->guard_size_);
+    std::memcpy(this->storage_ + this->size_, this->storage_, wrapped_bytes);
+    return contiguous + wrapped_bytes;
+  }
+
+  return contiguous;
+}
+
+void AudioRingBuffer::release(size_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+
+  size_t end = this->read_index_ + bytes;
+  if (end >= this->size_) {
+    end -= this->size_;
+  }
+  this->read_index_ = end;
+
+  this->available_.fetch_sub(bytes, std::memory_order_release);
+  xEventGroupSetBits(this->event_group_, SPACE_RELEASED);
+  if (this->producer_task_ != nullptr) {
+    xTaskNotifyGive(this->producer_task_);
+  }
+}
+
+size_t AudioRingBuffer::write(const void *data, size_t len, TickType_t ticks_to_wait) {
+  const uint8_t *source = (const uint8_t *) data;
+  size_t bytes_written = 0;
+
+  while (bytes_written < len) {
+    uint8_t *region;
+    // Only block for the first region; the second one (after wrapping) is either free now or not at all
+    size_t region_length = this->reserve(&region, 1, (bytes_written == 0) ? ticks_to_wait : 0);
+    if (region_length == 0) {
+      break;
+    }
+
+    size_t bytes_to_copy = std::min(region_length, len - bytes_written);
+    std::memcpy(region, source + bytes_written, bytes_to_copy);
+    this->commit(bytes_to_copy);
+
+    bytes_written += bytes_to_copy;
+  }
+
+  return bytes_written;
+}
+
+size_t AudioRingBuffer::read(void *data, size_t len, TickType_t ticks_to_wait) {
+  uint8_t *destination = (uint8_t *) data;
+  size_t bytes_read = 0;
+
+  while (bytes_read < len) {
+    uint8_t *region;
+    size_t region_length = this->peek(&region, 1, (bytes_read == 0) ? ticks_to_wait : 0);
+    if (region_length == 0) {
+      break;
+    }
+
+    size_t bytes_to_copy = std::min(region_length, len - bytes_read);
+    std::memcpy(destination + bytes_read, region, bytes_to_copy);
+    this->release(bytes_to_copy);
+
+    bytes_read += bytes_to_copy;
+  }
+
+  return bytes_read;
+}
+
+void AudioRingBuffer::reset() {
+  this->write_index_ = 0;
+  this->read_index_ = 0;
+  this->available_.store(0, std::memory_order_release);
+
+  xEventGroupClearBits(this->event_group_, DATA_COMMITTED);
+  xEventGroupSetBits(this->event_group_, SPACE_RELEASED);
+  if (this->producer_task_ != nullptr) {
+    xTaskNotifyGive(this->producer_task_);
+  }
+}
+
+bool AudioRingBuffer::resize(size_t size) {
+  size_t available_bytes = this->available();
+  if (size < available_bytes) {
+    return false;
+  }
+  if (size == this->size_) {
+    return true;
+  }
+
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  uint8_t *storage = allocator.allocate(size + this->guard_size_);
+  if (storage == nullptr) {
+    return false;
+  }
+
+  // Unwrap the data to the start of the new storage
+  size_t contiguous = std::min(available_bytes, this->size_ - this->read_index_);
+  std::memcpy(storage, this->storage_ + this->read_index_, contiguous);
+  std::memcpy(storage + contiguous, this->storage_, available_bytes - contiguous);
+
+  allocator.deallocate(this->storage_, this->size_ + this->guard_size_);
+  this->storage_ = storage;
+  this->size_ = size;
+
+  this->read_index_ = 0;
+  this->write_index_ = (available_bytes == size) ? 0 : available_bytes;
+
+  return true;
+}
+
+bool AudioRingBuffer::wait_for_(EventBits_t wake_bit, size_t needed, TickType_t ticks_to_wait) {
+  if (((wake_bit == DATA_COMMITTED) ? this->available() : this->free()) >= needed) {
+    // Most calls don't wait, so they skip the clocks
+    return true;
+  }
+
+  const TickType_t start_ticks = xTaskGetTickCount();
+#ifdef USE_AUDIO_PIPELINE_STATS
+  const uint32_t start_us = micros();
+  uint32_t *wait_us = (wake_bit == DATA_COMMITTED) ? &this->stats_.consumer_wait_us : &this->stats_.producer_wait_us;
+#endif
+
+  while (true) {
+    size_t current = (wake_bit == DATA_COMMITTED) ? this->available() : this->free();
+    if (current >= needed) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+      *wait_us += micros() - start_us;
+#endif
+      return true;
+    }
+
+    TickType_t elapsed_ticks = xTaskGetTickCount() - start_ticks;
+    if (elapsed_ticks >= ticks_to_wait) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+      *wait_us += micros() - start_us;
+#endif
+      return false;
+    }
+
+    // The bit is cleared on exit, so a commit/release that happened after the check above still wakes us immediately
+    xEventGroupWaitBits(this->event_group_, wake_bit, pdTRUE, pdFALSE, ticks_to_wait - elapsed_ticks);
+  }
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
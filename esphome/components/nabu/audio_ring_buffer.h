@@ -0,0 +1,159 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace esphome {
+namespace nabu {
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+static const size_t FILL_HISTOGRAM_BUCKETS = 8;
+
+// Each counter is only written by one side of the ring buffer, so they are read without locking. The counters wrap
+// around, so compare differences between two reads.
+struct AudioRingBufferStats {
+  uint32_t bytes_committed{0};
+  uint32_t producer_wait_us{0};  // Time the producer spent blocked waiting for free space
+  uint32_t consumer_wait_us{0};  // Time the consumer spent blocked waiting for data
+  uint32_t underruns{0};  // Times the consumer found less data than it asked for after previously finding enough
+  uint32_t fill_histogram[FILL_HISTOGRAM_BUCKETS]{};  // Fill level seen by each peek, in equally sized buckets
+};
+
+// Counters for one stage of the audio pipeline
+struct AudioStageStats {
+  uint32_t bytes_processed{0};  // Bytes the stage sent to its output
+  uint32_t input_wait_us{0};
+  uint32_t output_wait_us{0};
+  uint32_t underruns{0};
+};
+#endif
+
+// Single producer, single consumer byte ring buffer that lets both sides work directly on the ring's memory
+//  - The producer calls ``reserve`` to get a contiguous writable region, fills it in place, and then calls ``commit``
+//  - The consumer calls ``peek`` to get a contiguous readable region, processes it in place, and then calls
+//    ``release``
+//  - A guard area after the end of the storage lets either side ask for a minimum contiguous length even when the
+//    region wraps around. Only the bytes that straddle the wrap point are copied, and only when a minimum is requested
+//    that the region before the wrap point can't satisfy.
+//    - The producer and consumer share the guard area. The producer only extends into it when the free space wraps,
+//      and the consumer only when the stored data wraps, so they never use it at the same time.
+//  - ``write`` and ``read`` are copying convenience wrappers for sources/sinks that need their own memory anyway
+//  - ``reset`` and ``resize`` are only safe when neither side is between a reserve/commit or peek/release pair
+class AudioRingBuffer {
+ public:
+  ~AudioRingBuffer();
+
+  /// @brief Allocates a ring buffer, preferring external RAM
+  /// @param size capacity in bytes
+  /// @param guard_size the largest minimum contiguous length that ``reserve`` or ``peek`` may request
+  /// @return unique_ptr to the ring buffer, or nullptr if it couldn't be allocated
+  static std::unique_ptr<AudioRingBuffer> create(size_t size, size_t guard_size = 0);
+
+  /// @brief Gets a contiguous writable region at the write position. Nothing is visible to the consumer until
+  /// ``commit`` is called.
+  /// @param data (output) pointer to the start of the writable region
+  /// @param min_bytes the minimum length wanted; waits until that much space is free. Must not exceed the guard size.
+  /// @param ticks_to_wait FreeRTOS ticks to wait for min_bytes of space
+  /// @return length of the writable region in bytes; may be less than min_bytes (or 0) if it timed out
+  size_t reserve(uint8_t **data, size_t min_bytes, TickType_t ticks_to_wait);
+
+  /// @brief Makes bytes written into the region from ``reserve`` available to the consumer
+  /// @param bytes number of bytes written; must not exceed the length returned by ``reserve``
+  void commit(size_t bytes);
+
+  /// @brief Gets a contiguous readable region at the read position. The data stays in the ring buffer until
+  /// ``release`` is called, and the consumer may modify it in place.
+  /// @param data (output) pointer to the start of the readable region
+  /// @param min_bytes the minimum length wanted; waits until that much data is available. Must not exceed the guard
+  /// size.
+  /// @param ticks_to_wait FreeRTOS ticks to wait for min_bytes of data
+  /// @return length of the readable region in bytes; may be less than min_bytes (or 0) if it timed out
+  size_t peek(uint8_t **data, size_t min_bytes, TickType_t ticks_to_wait);
+
+  /// @brief Frees bytes at the read position for the producer
+  /// @param bytes number of bytes consumed; must not exceed the length returned by ``peek``
+  void release(size_t bytes);
+
+  /// @brief Copies data into the ring buffer
+  /// @return number of bytes written; may be less than len if it timed out
+  size_t write(const void *data, size_t len, TickType_t ticks_to_wait);
+
+  /// @brief Copies data out of the ring buffer
+  /// @return number of bytes read; may be less than len if it timed out
+  size_t read(void *data, size_t len, TickType_t ticks_to_wait);
+
+  /// @brief Number of committed bytes the consumer hasn't released
+  size_t available() const { return this->available_.load(std::memory_order_acquire); }
+  /// @brief Number of bytes the producer can still reserve
+  size_t free() const { return this->size_ - this->available(); }
+  size_t capacity() const { return this->size_; }
+  size_t guard_size() const { return this->guard_size_; }
+
+  /// @brief Discards all data
+  void reset();
+
+  /// @brief Sets a task to notify whenever data is committed, so a consumer that watches several ring buffers can sleep
+  /// on its task notification instead of polling them. Only change it while the producer isn't committing.
+  /// @param task task to notify, or nullptr to stop notifying
+  void set_consumer_task(TaskHandle_t task) { this->consumer_task_ = task; }
+
+  /// @brief Sets a task to notify whenever space is freed by ``release`` or ``reset``, so a producer that can't wait on
+  /// this ring buffer alone can sleep on its task notification until the consumer frees space. Only change it while the
+  /// consumer isn't releasing.
+  /// @param task task to notify, or nullptr to stop notifying
+  void set_producer_task(TaskHandle_t task) { this->producer_task_ = task; }
+
+  /// @brief Reallocates the storage with a new capacity, keeping the data. Pointers from earlier ``reserve`` or
+  /// ``peek`` calls are invalid afterwards.
+  /// @param size new capacity in bytes; must fit the available data
+  /// @return true if successful; if not, the ring buffer is unchanged
+  bool resize(size_t size);
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  /// @brief Counters are kept across resets
+  const AudioRingBufferStats &get_stats() const { return this->stats_; }
+#endif
+
+ protected:
+  AudioRingBuffer(size_t size, size_t guard_size) : size_(size), guard_size_(guard_size) {}
+
+  /// @brief Blocks until the wake_bit is set or ticks_to_wait elapse, whichever is first, as long as the condition
+  /// (free or available bytes, depending on the bit) is below the needed amount
+  /// @return true if the needed amount is present
+  bool wait_for_(EventBits_t wake_bit, size_t needed, TickType_t ticks_to_wait);
+
+  uint8_t *storage_{nullptr};
+  size_t size_;
+  const size_t guard_size_;
+
+  // Only modified by the producer
+  size_t write_index_{0};
+  // Only modified by the consumer
+  size_t read_index_{0};
+
+  std::atomic<size_t> available_{0};
+
+  EventGroupHandle_t event_group_{nullptr};
+  // Notified by commit; see set_consumer_task
+  TaskHandle_t consumer_task_{nullptr};
+  // Notified by release and reset; see set_producer_task
+  TaskHandle_t producer_task_{nullptr};
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  AudioRingBufferStats stats_;
+  bool consumer_had_data_{false};
+#endif
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,88 @@
+#ifdef USE_ESP_IDF
+
+#include "drift_compensator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace esphome {
+namespace nabu {
+
+static const uint32_t UPDATE_INTERVAL_MS = 100;
+// Weight of each interval's average fill in the smoothed fill; about a second of smoothing
+static const float FILL_SMOOTHING = 0.1f;
+// Settles at half full, leaving equal room for the source's bursts and stalls. Above seven eighths full, the source is
+// taken to be faster than real time.
+static const float TARGET_FILL_FRACTION = 0.5f;
+static const float HOLD_FILL_FRACTION = 0.875f;
+// A critically damped loop with a time constant of about a minute. It settles within a few minutes of a change in
+// the drift, while the bursts left after smoothing move the ratio by less than 10 ppm.
+static const float PROPORTIONAL_PPM_PER_MS = 33.3f;     // ppm per ms of fill error
+static const float INTEGRAL_PPM_PER_MS_SECOND = 0.28f;  // ppm per second per ms of fill error
+static const float INTEGRAL_PPM_PER_MS_UPDATE = INTEGRAL_PPM_PER_MS_SECOND * UPDATE_INTERVAL_MS / 1000.0f;
+
+void DriftCompensator::start(uint32_t sample_rate) {
+  this->capacity_frames_ = 0;
+  this->update_frames_ = sample_rate * UPDATE_INTERVAL_MS / 1000;
+  this->frames_per_ms_ = static_cast<float>(sample_rate) / 1000.0f;
+
+  this->interval_frames_ = 0;
+  this->interval_fill_sum_ = 0;
+  this->smoothed_ = false;
+  this->integral_ppm_ = 0.0f;
+  this->correction_ppm_ = 0.0f;
+}
+
+void DriftCompensator::update(size_t buffered_frames, size_t capacity_frames, size_t frames_written) {
+  if (this->update_frames_ == 0) {
+    return;
+  }
+
+  // The encoded data's ring buffer is resized once the stream's bitrate is known
+  this->capacity_frames_ = capacity_frames;
+
+  this->interval_frames_ += frames_written;
+  this->interval_fill_sum_ += static_cast<uint64_t>(buffered_frames) * frames_written;
+
+  if (this->interval_frames_ >= this->update_frames_) {
+    this->step_(static_cast<float>(this->interval_fill_sum_) / static_cast<float>(this->interval_frames_));
+    this->interval_frames_ = 0;
+    this->interval_fill_sum_ = 0;
+  }
+}
+
+void DriftCompensator::step_(float average_fill) {
+  if (this->smoothed_) {
+    this->smoothed_fill_ += FILL_SMOOTHING * (average_fill - this->smoothed_fill_);
+  } else {
+    this->smoothed_fill_ = average_fill;
+    this->smoothed_ = true;
+  }
+
+  const float capacity = static_cast<float>(this->capacity_frames_);
+  if (this->smoothed_fill_ >= HOLD_FILL_FRACTION * capacity) {
+    // The source is being held back by the buffer, so there is no drift to measure. Keeps only the clocks' offset
+    // learned so far.
+    this->correction_ppm_ = this->integral_ppm_;
+    return;
+  }
+
+  // Positive when the buffer is running dry, which needs more output frames per input frame
+  float error_ms = (TARGET_FILL_FRACTION * capacity - this->smoothed_fill_) / this->frames_per_ms_;
+
+  float proportional_ppm = PROPORTIONAL_PPM_PER_MS * error_ms;
+  float integral_ppm = this->integral_ppm_ + INTEGRAL_PPM_PER_MS_UPDATE * error_ms;
+
+  // Only integrates while the correction isn't saturated, so the integral can't wind up during a long outage
+  if (std::abs(proportional_ppm + integral_ppm) < DRIFT_MAX_CORRECTION_PPM) {
+    this->integral_ppm_ = integral_ppm;
+  }
+
+  float correction_ppm = proportional_ppm + this->integral_ppm_;
+  this->correction_ppm_ = std::min(std::max(correction_ppm, -DRIFT_MAX_CORRECTION_PPM), DRIFT_MAX_CORRECTION_PPM);
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
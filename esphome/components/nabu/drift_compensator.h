@@ -0,0 +1,66 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+// Largest correction, well beyond the drift between two crystal clocks
+static const float DRIFT_MAX_CORRECTION_PPM = 1000.0f;
+
+// Keeps the audio buffered for a live source at a target, despite the source's clock drifting from the output's
+//  - A live source (e.g., an internet radio stream) produces audio at its own clock's pace, while the output consumes
+//    it at the I2S clock's pace. Left alone, the difference slowly fills the buffers or runs them dry.
+//  - The fill is the total buffered between the source and the output, in output frames: encoded data, decoded audio,
+//    and converted audio. Each stage fills the next before its own input backs up, so the buffer furthest downstream
+//    is nearly always full, and only the total moves with the drift.
+//  - A PI controller turns the fill's error from half the capacity into a correction in parts per million of the
+//    resampling ratio. The integral settles on the clocks' offset, so the fill returns to the target and stays there.
+//  - The fill is averaged over each update interval and then smoothed, so the bursts of network packets, decoded
+//    frames, and the mixer's reads don't modulate the ratio
+//  - A source that is faster than real time, like a file, keeps every buffer full. The controller holds its correction
+//    while the fill is above a high-water mark, so such a source plays at the nominal ratio.
+//  - Time is counted in the frames written to the output, which match the output's frames in steady state
+class DriftCompensator {
+ public:
+  /// @brief Resets the correction
+  /// @param sample_rate output frames per second
+  void start(uint32_t sample_rate);
+
+  /// @brief Updates the controller after frames were written to the output's buffer
+  /// @param buffered_frames total buffered after the write, in output frames
+  /// @param capacity_frames total the buffers hold, in output frames; the fill settles at half of it
+  /// @param frames_written frames just written
+  void update(size_t buffered_frames, size_t capacity_frames, size_t frames_written);
+
+  /// @brief Correction in parts per million; positive outputs more frames per input frame
+  float get_correction_ppm() const { return this->correction_ppm_; }
+
+  /// @brief Factor to multiply the nominal resampling ratio by
+  double get_ratio_factor() const { return 1.0 + static_cast<double>(this->correction_ppm_) * 1e-6; }
+
+ protected:
+  /// @brief Runs the PI controller on the interval's average fill
+  void step_(float average_fill);
+
+  size_t capacity_frames_{0};  // As of the last update
+  size_t update_frames_{0};  // Frames written per controller update
+  float frames_per_ms_{1.0f};
+
+  // The current interval
+  size_t interval_frames_{0};
+  uint64_t interval_fill_sum_{0};  // Fill weighted by the frames written
+
+  float smoothed_fill_{0.0f};
+  bool smoothed_{false};
+  float integral_ppm_{0.0f};
+  float correction_ppm_{0.0f};
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
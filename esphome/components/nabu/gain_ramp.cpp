@@ -0,0 +1,104 @@
+#ifdef USE_ESP_IDF
+
+#include "gain_ramp.h"
+
+#include <dsp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+// Largest per frame multiplier an exponential ramp can use; Q30 holds values below 2
+static const double MAX_EXPONENTIAL_MULTIPLIER = 1.99;
+
+void GainRamp::set(int16_t gain) {
+  this->gain_ = static_cast<int32_t>(gain) << 16;
+  this->target_ = this->gain_;
+  this->frames_remaining_ = 0;
+}
+
+void GainRamp::ramp_to(int16_t target, size_t frames, GainRampShape shape) {
+  this->target_ = static_cast<int32_t>(target) << 16;
+  this->frames_remaining_ = frames;
+
+  if ((frames == 0) || (this->gain_ == this->target_)) {
+    this->gain_ = this->target_;
+    this->frames_remaining_ = 0;
+    return;
+  }
+
+  this->shape_ = GainRampShape::LINEAR;
+  if ((shape == GainRampShape::EXPONENTIAL) && (this->gain_ > 0) && (this->target_ > 0)) {
+    // Only computed when a ramp starts, so the floating point math stays out of the per frame loop. A float multiplier
+    // is only good to about 1e-7, which compounds over a long ramp into a visible jump onto the target at its end.
+    double ratio = static_cast<double>(this->target_) / static_cast<double>(this->gain_);
+    double multiplier = std::pow(ratio, 1.0 / static_cast<double>(frames));
+    if (multiplier < MAX_EXPONENTIAL_MULTIPLIER) {
+      // Rounded towards the starting gain, so any error leaves the ramp a little short of its target, and the last
+      // frame's snap onto the target continues in the ramp's direction instead of turning back
+      double scaled = multiplier * static_cast<double>(1 << 30);
+      this->multiplier_ = static_cast<int32_t>((ratio > 1.0) ? std::floor(scaled) : std::ceil(scaled));
+      this->shape_ = GainRampShape::EXPONENTIAL;
+    }
+  }
+  if (this->shape_ == GainRampShape::LINEAR) {
+    this->increment_ =
+        static_cast<int32_t>((static_cast<int64_t>(this->target_) - this->gain_) / static_cast<int64_t>(frames));
+  }
+}
+
+void GainRamp::apply(const int16_t *input, int16_t *output, size_t frames, uint8_t channels) {
+  size_t ramp_frames = std::min(frames, this->frames_remaining_);
+
+  if (channels == 1) {
+    for (size_t i = 0; i < ramp_frames; ++i) {
+      output[i] = static_cast<int16_t>((static_cast<int32_t>(input[i]) * this->next_gain()) >> 15);
+    }
+  } else {
+    for (size_t i = 0; i < ramp_frames; ++i) {
+      int32_t gain = this->next_gain();
+      output[2 * i] = static_cast<int16_t>((static_cast<int32_t>(input[2 * i]) * gain) >> 15);
+      output[2 * i + 1] = static_cast<int16_t>((static_cast<int32_t>(input[2 * i + 1]) * gain) >> 15);
+    }
+  }
+
+  size_t steady_samples = (frames - ramp_frames) * channels;
+  if (steady_samples > 0) {
+    input += ramp_frames * channels;
+    output += ramp_frames * channels;
+
+    if (this->get_gain() < INT16_MAX) {
+      // The dsps_mulc functions have the following inputs:
+      // (input buffer, output buffer, number of samples, constant, input step, output step)
+      dsps_mulc_s16(const_cast<int16_t *>(input), output, steady_samples, this->get_gain(), 1, 1);
+    } else if (input != output) {
+      std::memcpy(output, input, steady_samples * sizeof(int16_t));
+    }
+  }
+}
+
+void GainRamp::advance(size_t frames) {
+  if (frames >= this->frames_remaining_) {
+    this->gain_ = this->target_;
+    this->frames_remaining_ = 0;
+    return;
+  }
+
+  if (this->shape_ == GainRampShape::LINEAR) {
+    this->gain_ += this->increment_ * static_cast<int32_t>(frames);
+    this->frames_remaining_ -= frames;
+    return;
+  }
+
+  while (frames-- > 0) {
+    this->step_();
+  }
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+enum class GainRampShape : uint8_t {
+  LINEAR,       // Equal amplitude steps; suited to fades
+  EXPONENTIAL,  // Equal dB steps; suited to ducking and volume changes
+};
+
+// Moves a gain to a target one frame at a time, so gain changes never step audibly
+//  - The gain is held in Q31 fixed point, so even long ramps between close gains advance every frame
+//  - ``apply`` scales a block of samples while ramping; once the target is reached it scales with ``dsps_mulc_s16``
+//  - ``next_gain`` steps the ramp one frame at a time for callers that fold the gain into their own loop, like mixing
+//  - Exponential ramps can't start or end at silence, so they ramp linearly in that case
+class GainRamp {
+ public:
+  /// @brief Jumps straight to a gain, cancelling any ramp in progress
+  /// @param gain Q15 fixed point gain
+  void set(int16_t gain);
+
+  /// @brief Starts a ramp from the current gain. Replaces any ramp in progress.
+  /// @param target Q15 fixed point gain to end at
+  /// @param frames number of frames the ramp takes; 0 jumps straight to the target
+  /// @param shape how the gain moves between the current gain and the target
+  void ramp_to(int16_t target, size_t frames, GainRampShape shape);
+
+  /// @brief Whether the ramp has not reached its target yet
+  bool is_ramping() const { return this->frames_remaining_ > 0; }
+
+  /// @brief Whether the gain is at unity and not moving, so samples pass through unchanged
+  bool is_unity() const { return !this->is_ramping() && (this->get_gain() == INT16_MAX); }
+
+  /// @brief The current gain in Q15 fixed point
+  int16_t get_gain() const { return static_cast<int16_t>(this->gain_ >> 16); }
+
+  /// @brief The gain the ramp ends at in Q15 fixed point
+  int16_t get_target() const { return static_cast<int16_t>(this->target_ >> 16); }
+
+  /// @brief Gets the gain for the next frame and steps the ramp
+  /// @return Q15 fixed point gain
+  inline int32_t next_gain() {
+    int32_t gain = this->gain_ >> 16;
+    if (this->frames_remaining_ > 0) {
+      this->step_();
+    }
+    return gain;
+  }
+
+  /// @brief Scales interleaved samples while stepping the ramp once per frame. Scales in place when input == output.
+  /// @param input PCM int16 samples
+  /// @param output buffer to store the scaled samples
+  /// @param frames number of frames to scale
+  /// @param channels samples per frame; 1 or 2
+  void apply(const int16_t *input, int16_t *output, size_t frames, uint8_t channels);
+
+  /// @brief Steps the ramp without scaling any samples; keeps ramps on time while their input isn't playing
+  /// @param frames number of frames to step
+  void advance(size_t frames);
+
+ protected:
+  inline void step_() {
+    if (--this->frames_remaining_ == 0) {
+      // Ends exactly on the target, regardless of any rounding along the way
+      this->gain_ = this->target_;
+    } else if (this->shape_ == GainRampShape::EXPONENTIAL) {
+      // Rounded, as truncating every frame adds up to a steady drift downwards over a long ramp
+      this->gain_ = static_cast<int32_t>((static_cast<int64_t>(this->gain_) * this->multiplier_ + (1 << 29)) >> 30);
+    } else {
+      this->gain_ += this->increment_;
+    }
+  }
+
+  int32_t gain_{INT32_MAX};    // Q31
+  int32_t target_{INT32_MAX};  // Q31
+  int32_t increment_{0};       // Q31 per frame, for linear ramps
+  int32_t multiplier_{0};      // Q30 per frame, for exponential ramps
+  size_t frames_remaining_{0};
+  GainRampShape shape_{GainRampShape::LINEAR};
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,182 @@
+#ifdef USE_ESP_IDF
+
+#include "loudness_meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+static const float ABSOLUTE_GATE_LUFS = -70.0f;
+static const float RELATIVE_GATE_LU = -10.0f;
+static const float BINS_PER_LU = 2.0f;
+static const float LOUDNESS_OFFSET = -0.691f;  // Calibrates K-weighted energy to LUFS
+static const size_t STEPS_PER_BLOCK = 4;
+static const float NORMALIZATION_MIN_GAIN_DB = -20.0f;
+
+static float energy_to_loudness(float energy) { return LOUDNESS_OFFSET + 10.0f * std::log10(energy); }
+
+static size_t loudness_to_bin(float loudness) {
+  float bin = (loudness - ABSOLUTE_GATE_LUFS) * BINS_PER_LU;
+  return std::min(static_cast<size_t>(std::max(bin, 0.0f)), LOUDNESS_HISTOGRAM_BINS - 1);
+}
+
+void LoudnessMeter::configure(uint32_t sample_rate, uint8_t channels) {
+  this->channels_ = channels;
+
+  // The filters from BS.1770 are specified at 48 kHz. These are their analog prototypes, as derived for libebur128,
+  // so they can be recomputed for any sample rate.
+  const double rate = static_cast<double>(sample_rate);
+
+  double k = std::tan(M_PI * 1681.974450955533 / rate);
+  double q = 0.7071752369554196;
+  double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+  double vb = std::pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  this->shelf_[0] = static_cast<float>((vh + vb * k / q + k * k) / a0);
+  this->shelf_[1] = static_cast<float>(2.0 * (k * k - vh) / a0);
+  this->shelf_[2] = static_cast<float>((vh - vb * k / q + k * k) / a0);
+  this->shelf_[3] = static_cast<float>(2.0 * (k * k - 1.0) / a0);
+  this->shelf_[4] = static_cast<float>((1.0 - k / q + k * k) / a0);
+
+  k = std::tan(M_PI * 38.13547087602444 / rate);
+  q = 0.5003270373238773;
+  a0 = 1.0 + k / q + k * k;
+  this->high_pass_[0] = 1.0f;
+  this->high_pass_[1] = -2.0f;
+  this->high_pass_[2] = 1.0f;
+  this->high_pass_[3] = static_cast<float>(2.0 * (k * k - 1.0) / a0);
+  this->high_pass_[4] = static_cast<float>((1.0 - k / q + k * k) / a0);
+
+  this->step_frames_ = std::max<size_t>(sample_rate / 10, 1);
+
+  this->reset();
+}
+
+void LoudnessMeter::reset() {
+  std::memset(this->states_, 0, sizeof(this->states_));
+  std::memset(this->step_energies_, 0, sizeof(this->step_energies_));
+  std::memset(this->bin_energies_, 0, sizeof(this->bin_energies_));
+  std::memset(this->bin_counts_, 0, sizeof(this->bin_counts_));
+  this->frames_in_step_ = 0;
+  this->step_energy_ = 0.0f;
+  this->step_index_ = 0;
+  this->steps_ = 0;
+  this->block_count_ = 0;
+}
+
+void LoudnessMeter::measure(const int16_t *samples, size_t frames) {
+  if (this->step_frames_ == 0) {
+    return;  // Not configured
+  }
+
+  const float scale = 1.0f / 32768.0f;
+  const float *s = this->shelf_;
+  const float *h = this->high_pass_;
+
+  while (frames > 0) {
+    size_t frames_to_measure = std::min(frames, this->step_frames_ - this->frames_in_step_);
+
+    float energy = 0.0f;
+    for (size_t channel = 0; channel < this->channels_; ++channel) {
+      float *shelf_state = this->states_[channel][0];
+      float *high_pass_state = this->states_[channel][1];
+
+      for (size_t i = 0; i < frames_to_measure; ++i) {
+        float x = static_cast<float>(samples[this->channels_ * i + channel]) * scale;
+
+        float y = s[0] * x + shelf_state[0];
+        shelf_state[0] = s[1] * x - s[3] * y + shelf_state[1];
+        shelf_state[1] = s[2] * x - s[4] * y;
+
+        float z = h[0] * y + high_pass_state[0];
+        high_pass_state[0] = h[1] * y - h[3] * z + high_pass_state[1];
+        high_pass_state[1] = h[2] * y - h[4] * z;
+
+        energy += z * z;
+      }
+    }
+
+    // A mono channel stands in for both channels of a stereo output
+    this->step_energy_ += (this->channels_ == 1) ? 2.0f * energy : energy;
+    this->frames_in_step_ += frames_to_measure;
+    if (this->frames_in_step_ == this->step_frames_) {
+      this->end_step_();
+    }
+
+    samples += this->channels_ * frames_to_measure;
+    frames -= frames_to_measure;
+  }
+}
+
+void LoudnessMeter::end_step_() {
+  this->step_energies_[this->step_index_] = this->step_energy_ / static_cast<float>(this->step_frames_);
+  this->step_index_ = (this->step_index_ + 1) % STEPS_PER_BLOCK;
+  this->step_energy_ = 0.0f;
+  this->frames_in_step_ = 0;
+
+  if (++this->steps_ < STEPS_PER_BLOCK) {
+    return;
+  }
+
+  float block_energy = 0.0f;
+  for (size_t i = 0; i < STEPS_PER_BLOCK; ++i) {
+    block_energy += this->step_energies_[i];
+  }
+  block_energy /= static_cast<float>(STEPS_PER_BLOCK);
+  ++this->block_count_;
+
+  if ((block_energy <= 0.0f) || (energy_to_loudness(block_energy) < ABSOLUTE_GATE_LUFS)) {
+    return;
+  }
+
+  size_t bin = loudness_to_bin(energy_to_loudness(block_energy));
+  this->bin_energies_[bin] += block_energy;
+  ++this->bin_counts_[bin];
+}
+
+optional<float> LoudnessMeter::get_integrated_loudness() const {
+  float energy = 0.0f;
+  uint32_t count = 0;
+  for (size_t i = 0; i < LOUDNESS_HISTOGRAM_BINS; ++i) {
+    energy += this->bin_energies_[i];
+    count += this->bin_counts_[i];
+  }
+
+  if (count == 0) {
+    return {};
+  }
+
+  size_t first_bin = loudness_to_bin(energy_to_loudness(energy / static_cast<float>(count)) + RELATIVE_GATE_LU);
+
+  energy = 0.0f;
+  count = 0;
+  for (size_t i = first_bin; i < LOUDNESS_HISTOGRAM_BINS; ++i) {
+    energy += this->bin_energies_[i];
+    count += this->bin_counts_[i];
+  }
+
+  if (count == 0) {
+    return {};
+  }
+
+  return energy_to_loudness(energy / static_cast<float>(count));
+}
+
+float normalization_gain_db(const optional<float> &loudness, float target_lufs) {
+  if (!loudness.has_value()) {
+    return 0.0f;
+  }
+  return clamp(target_lufs - loudness.value(), NORMALIZATION_MIN_GAIN_DB, 0.0f);
+}
+
+int16_t db_to_q15_gain(float gain_db) {
+  return static_cast<int16_t>(INT16_MAX * std::pow(10.0f, std::min(gain_db, 0.0f) / 20.0f));
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include "esphome/core/helpers.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+// 0.5 LU bins from the absolute gate at -70 LUFS up to +5 LUFS
+static const size_t LOUDNESS_HISTOGRAM_BINS = 150;
+
+// Measures the integrated loudness of a mono or stereo stream as it plays, following ITU-R BS.1770 and EBU R128
+//  - Each channel is K-weighted by a high shelf and a high-pass biquad, and its mean square is taken over 400 ms blocks
+//    that overlap by 75%, so a new block completes every 100 ms
+//  - Blocks below -70 LUFS are dropped (the absolute gate). The integrated loudness averages the blocks that are no
+//    more than 10 LU below the average of all the others (the relative gate).
+//  - A mono stream counts its channel twice, as if it were duplicated into both channels of a stereo output, so a mono
+//    mix and the same audio mixed in stereo measure the same loudness
+//  - Instead of keeping every block, each block's energy is added to a histogram bin by its loudness, so memory and the
+//    cost of an update don't grow with the stream's length. The relative gate is applied with the bins' resolution.
+class LoudnessMeter {
+ public:
+  /// @brief Computes the K-weighting filters for a sample rate and clears the measurement
+  /// @param sample_rate sample rate of the audio
+  /// @param channels samples per frame; 1 or 2
+  void configure(uint32_t sample_rate, uint8_t channels);
+
+  /// @brief Clears the measurement, e.g., for a new track
+  void reset();
+
+  /// @brief Adds samples to the measurement
+  /// @param samples PCM int16 samples with the configured number of channels
+  /// @param frames number of frames
+  void measure(const int16_t *samples, size_t frames);
+
+  /// @brief Number of 400 ms blocks completed since the last reset, including gated ones
+  uint32_t get_block_count() const { return this->block_count_; }
+
+  /// @brief The gated integrated loudness of everything measured since the last reset
+  /// @return loudness in LUFS, or no value if no block has passed the absolute gate yet
+  optional<float> get_integrated_loudness() const;
+
+ protected:
+  /// @brief Finishes a 100 ms step and, once four are done, the 400 ms block ending with it
+  void end_step_();
+
+  // Coefficients of the two K-weighting stages: b0, b1, b2, a1, a2
+  float shelf_[5];
+  float high_pass_[5];
+  // Direct form II transposed state of each stage, for each channel
+  float states_[2][2][2];
+
+  uint8_t channels_{2};
+  size_t step_frames_{0};  // Frames in 100 ms
+  size_t frames_in_step_{0};
+  float step_energy_{0.0f};
+  float step_energies_[4];  // Mean square of the last four steps, oldest first from step_index_
+  size_t step_index_{0};
+  size_t steps_{0};
+  uint32_t block_count_{0};
+
+  float bin_energies_[LOUDNESS_HISTOGRAM_BINS];
+  uint32_t bin_counts_[LOUDNESS_HISTOGRAM_BINS];
+};
+
+/// @brief Gain that brings audio to a target loudness. Only turns audio down, as the mixer's gains can't exceed unity.
+/// @param loudness integrated loudness of the audio in LUFS, if known
+/// @param target_lufs target integrated loudness in LUFS
+/// @return gain in dB, between -20 and 0; 0 if the loudness is unknown
+float normalization_gain_db(const optional<float> &loudness, float target_lufs);
+
+/// @brief Converts a gain of at most 0 dB to the mixer's Q15 fixed point gains
+int16_t db_to_q15_gain(float gain_db);
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,209 @@
+#ifdef USE_ESP_IDF
+
+#include "media_file_cache.h"
+
+#include "audio_decoder.h"
+#include "audio_reader.h"
+#include "audio_resampler.h"
+#include "audio_ring_buffer.h"
+#include "loudness_meter.h"
+
+#include "esphome/core/helpers.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace nabu {
+
+// The stages run one after another in the same task, so the buffers between them only need to hold a few blocks
+static const size_t FILE_BUFFER_SIZE = 16 * 1024;
+static const size_t FILE_RING_BUFFER_SIZE = 16 * 1024;
+// Fits the minimum contiguous input the decoder peeks for MP3 and WAV files
+static const size_t FILE_RING_BUFFER_GUARD_SIZE = 4 * 1024;
+static const size_t TRANSFER_SIZE = 4 * 1024;
+static const size_t DECODED_RING_BUFFER_SIZE = 24 * 1024;
+// Fits the largest decoded FLAC frame (4608 stereo samples), which the decoder writes in place
+static const size_t DECODED_RING_BUFFER_GUARD_SIZE = 4608 * 2 * sizeof(int16_t);
+static const size_t OUTPUT_RING_BUFFER_SIZE = 16 * 1024;
+// Fits the resampler's minimum output block
+static const size_t OUTPUT_RING_BUFFER_GUARD_SIZE = 2 * 1024;
+static const size_t RESAMPLER_BUFFER_SAMPLES = 4096;
+
+// Initial allocation for the cached audio; doubled whenever it fills up
+static const size_t INITIAL_CACHE_SIZE = 32 * 1024;
+
+MediaFileCache::~MediaFileCache() {
+  ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
+  for (auto &entry : this->cache_) {
+    allocator.deallocate(entry.second.data, entry.second.length / sizeof(int16_t));
+  }
+}
+
+esp_err_t MediaFileCache::add(media_player::MediaFile *media_file, uint32_t target_sample_rate,
+                              uint8_t target_channels) {
+  if (this->find(media_file) != nullptr) {
+    return ESP_OK;
+  }
+
+  std::unique_ptr<AudioRingBuffer> raw_file_ring_buffer =
+      AudioRingBuffer::create(FILE_RING_BUFFER_SIZE, FILE_RING_BUFFER_GUARD_SIZE);
+  std::unique_ptr<AudioRingBuffer> decoded_ring_buffer =
+      AudioRingBuffer::create(DECODED_RING_BUFFER_SIZE, DECODED_RING_BUFFER_GUARD_SIZE);
+  std::unique_ptr<AudioRingBuffer> output_ring_buffer =
+      AudioRingBuffer::create(OUTPUT_RING_BUFFER_SIZE, OUTPUT_RING_BUFFER_GUARD_SIZE);
+
+  if ((raw_file_ring_buffer == nullptr) || (decoded_ring_buffer == nullptr) || (output_ring_buffer == nullptr)) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Every stage returns right away when it can't make progress, as the next stage runs right after it
+  AudioReader reader = AudioReader(raw_file_ring_buffer.get(), TRANSFER_SIZE);
+  reader.set_ticks_to_wait(0);
+  AudioDecoder decoder = AudioDecoder(raw_file_ring_buffer.get(), decoded_ring_buffer.get(), FILE_BUFFER_SIZE);
+  decoder.set_ticks_to_wait(0);
+  AudioResampler resampler =
+      AudioResampler(decoded_ring_buffer.get(), output_ring_buffer.get(), RESAMPLER_BUFFER_SAMPLES);
+  resampler.set_ticks_to_wait(0);
+  // Files are converted once, before they are ever played, so the extra CPU time costs no real time playback
+  resampler.set_quality(ResamplerQuality::HIFI);
+
+  media_player::MediaFileType file_type;
+  esp_err_t err = reader.start(media_file, file_type);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = decoder.start(file_type);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  CachedAudio audio;
+  size_t capacity = 0;
+
+  bool reader_finished = false;
+  bool resampler_started = false;
+
+  while (true) {
+    if (!reader_finished) {
+      AudioReaderState reader_state = reader.read();
+      if (reader_state == AudioReaderState::FINISHED) {
+        reader_finished = true;
+      } else if (reader_state == AudioReaderState::FAILED) {
+        err = ESP_FAIL;
+        break;
+      }
+    }
+
+    AudioDecoderState decoder_state = decoder.decode(reader_finished);
+    if (decoder_state == AudioDecoderState::FAILED) {
+      err = ESP_FAIL;
+      break;
+    }
+
+    if (!resampler_started) {
+      if (!decoder.get_audio_stream_info().has_value()) {
+        if (decoder_state == AudioDecoderState::FINISHED) {
+          // Never found the stream information
+          err = ESP_FAIL;
+          break;
+        }
+        continue;
+      }
+
+      audio::AudioStreamInfo stream_info = decoder.get_audio_stream_info().value();
+      audio.channels = std::min(stream_info.channels, target_channels);
+      ResampleInfo resample_info;
+      err = resampler.start(stream_info, target_sample_rate, audio.channels, resample_info);
+      if (err != ESP_OK) {
+        break;
+      }
+      resampler_started = true;
+    }
+
+    AudioResamplerState resampler_state = resampler.resample(decoder_state == AudioDecoderState::FINISHED);
+
+    // Move the resampled audio into the cache
+    size_t bytes_available = output_ring_buffer->available();
+    if (bytes_available > 0) {
+      if (!this->reserve_(audio, capacity, audio.length + bytes_available)) {
+        err = ESP_ERR_NO_MEM;
+        break;
+      }
+      audio.length +=
+          output_ring_buffer->read((uint8_t *) audio.data + audio.length, bytes_available, 0);
+    }
+
+    if (resampler_state == AudioResamplerState::FINISHED) {
+      break;
+    }
+  }
+
+  ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
+
+  if ((err != ESP_OK) || (audio.length == 0)) {
+    if (audio.data != nullptr) {
+      allocator.deallocate(audio.data, capacity / sizeof(int16_t));
+    }
+    return (err != ESP_OK) ? err : ESP_FAIL;
+  }
+
+  // Give back the unused part of the last doubling
+  int16_t *trimmed_data = allocator.allocate(audio.length / sizeof(int16_t));
+  if (trimmed_data != nullptr) {
+    std::memcpy(trimmed_data, audio.data, audio.length);
+    allocator.deallocate(audio.data, capacity / sizeof(int16_t));
+    audio.data = trimmed_data;
+  }
+
+  audio.loudness = decoder.get_track_loudness();
+  if (!audio.loudness.has_value()) {
+    std::unique_ptr<LoudnessMeter> loudness_meter = make_unique<LoudnessMeter>();
+    loudness_meter->configure(target_sample_rate, audio.channels);
+    loudness_meter->measure(audio.data, audio.length / (audio.channels * sizeof(int16_t)));
+    audio.loudness = loudness_meter->get_integrated_loudness();
+  }
+
+  this->cache_[media_file] = audio;
+
+  return ESP_OK;
+}
+
+const CachedAudio *MediaFileCache::find(media_player::MediaFile *media_file) const {
+  auto entry = this->cache_.find(media_file);
+  if (entry == this->cache_.end()) {
+    return nullptr;
+  }
+  return &entry->second;
+}
+
+bool MediaFileCache::reserve_(CachedAudio &audio, size_t &capacity, size_t min_length) {
+  if (min_length <= capacity) {
+    return true;
+  }
+
+  size_t new_capacity = std::max(capacity, INITIAL_CACHE_SIZE);
+  while (new_capacity < min_length) {
+    new_capacity *= 2;
+  }
+
+  ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
+  int16_t *new_data = allocator.allocate(new_capacity / sizeof(int16_t));
+  if (new_data == nullptr) {
+    return false;
+  }
+
+  if (audio.data != nullptr) {
+    std::memcpy(new_data, audio.data, audio.length);
+    allocator.deallocate(audio.data, capacity / sizeof(int16_t));
+  }
+
+  audio.data = new_data;
+  capacity = new_capacity;
+
+  return true;
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
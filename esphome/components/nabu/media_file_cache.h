@@ -0,0 +1,52 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include "esphome/components/media_player/media_player.h"
+
+#include "esphome/core/helpers.h"
+
+#include <map>
+
+namespace esphome {
+namespace nabu {
+
+// Audio ready to be sent to the mixer: 16 bits per sample, at the mixer's sample rate
+struct CachedAudio {
+  int16_t *data{nullptr};
+  size_t length{0};     // in bytes
+  uint8_t channels{0};  // The file's channels, up to the mixer input's most; switch the input to them before playing
+  optional<float> loudness{};  // Integrated loudness in LUFS, from a loudness tag or measured; unknown if too short
+};
+
+// Keeps decoded and resampled copies of MediaFiles in external RAM, so replaying them skips the pipeline entirely
+//  - ``add`` runs the reader, decoder, and resampler once in the calling task. It is meant for setup, where blocking
+//    briefly is fine. The audio's loudness is measured then too, so it can be normalized without measuring it again.
+//  - ``find`` looks up the cached audio for a MediaFile; the audio stays valid for the lifetime of the cache
+class MediaFileCache {
+ public:
+  ~MediaFileCache();
+
+  /// @brief Decodes and resamples a media file into the cache. Does nothing if it is already cached.
+  /// @param media_file pointer to a MediaFile object
+  /// @param target_sample_rate the sample rate of the mixer
+  /// @param target_channels the most channels of the mixer input that plays it; a file with fewer keeps its own
+  /// @return ESP_OK if successful, ESP_ERR_NO_MEM if the audio doesn't fit, or another error if decoding failed
+  esp_err_t add(media_player::MediaFile *media_file, uint32_t target_sample_rate, uint8_t target_channels);
+
+  /// @brief Looks up the cached audio for a media file
+  /// @return pointer to the cached audio, or nullptr if the media file isn't cached
+  const CachedAudio *find(media_player::MediaFile *media_file) const;
+
+ protected:
+  /// @brief Grows the audio's allocation to fit at least min_length bytes, keeping its contents
+  /// @return true if successful
+  bool reserve_(CachedAudio &audio, size_t &capacity, size_t min_length);
+
+  std::map<media_player::MediaFile *, CachedAudio> cache_;
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
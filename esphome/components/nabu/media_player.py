@@ -6,13 +6,15 @@ from pathlib import Path
 
 from esphome import automation, external_files
 import esphome.codegen as cg
-from esphome.components import audio_dac, media_player, speaker
+from esphome.components import audio_dac, esp32, media_player, speaker
 from esphome.components.media_player import MEDIA_FILE_TYPE_ENUM, MediaFile
 import esphome.config_validation as cv
 from esphome.const import (
     CONF_DURATION,
+    CONF_ENABLED,
     CONF_FILE,
     CONF_FILES,
+    CONF_FREQUENCY,
     CONF_ID,
     CONF_PATH,
     CONF_RAW_DATA_ID,
@@ -24,6 +26,8 @@ from esphome.const import (
 from esphome.core import CORE, HexInt
 from esphome.external_files import download_content
 
+from . import CONF_PRIORITY, task_core, task_schema
+
 _LOGGER = logging.getLogger(__name__)
 
 AUTO_LOAD = ["audio"]
@@ -43,6 +47,38 @@ CONF_MEDIA_FILE = "media_file"
 CONF_VOLUME_INCREMENT = "volume_increment"
 CONF_VOLUME_MIN = "volume_min"
 CONF_VOLUME_MAX = "volume_max"
+CONF_STATS_LOG_INTERVAL = "stats_log_interval"
+CONF_CACHE = "cache"
+CONF_MEDIA_START_THRESHOLD = "media_start_threshold"
+CONF_ANNOUNCEMENT_START_THRESHOLD = "announcement_start_threshold"
+CONF_ANNOUNCEMENT_LOW_LATENCY = "announcement_low_latency"
+CONF_ANNOUNCEMENT_PAUSES_MEDIA = "announcement_pauses_media"
+CONF_MIXER_TASK = "mixer_task"
+CONF_MEDIA_PIPELINE_TASK = "media_pipeline_task"
+CONF_ANNOUNCEMENT_PIPELINE_TASK = "announcement_pipeline_task"
+CONF_OUTPUT_PROCESSING = "output_processing"
+CONF_EQUALIZER = "equalizer"
+CONF_COMPRESSOR = "compressor"
+CONF_GAIN = "gain"
+CONF_Q = "q"
+CONF_CROSSOVER = "crossover"
+CONF_THRESHOLD = "threshold"
+CONF_RATIO = "ratio"
+CONF_ATTACK = "attack"
+CONF_RELEASE = "release"
+CONF_LOUDNESS_NORMALIZATION = "loudness_normalization"
+CONF_MEDIA_TARGET = "media_target"
+CONF_ANNOUNCEMENT_TARGET = "announcement_target"
+CONF_RESAMPLER_QUALITY = "resampler_quality"
+CONF_MEDIA_DRIFT_COMPENSATION = "media_drift_compensation"
+CONF_MEDIA = "media"
+CONF_REFERENCE_BUFFER = "reference_buffer"
+CONF_CROSSFADE = "crossfade"
+CONF_MONO = "mono"
+CONF_STEREO_OUTPUT = "stereo_output"
+CONF_MONO_ANNOUNCEMENTS = "mono_announcements"
+
+MAX_EQUALIZER_BANDS = 6
 
 CONF_ON_MUTE = "on_mute"
 CONF_ON_UNMUTE = "on_unmute"
@@ -57,6 +93,16 @@ NabuMediaPlayer = nabu_ns.class_(
     cg.Component,
 )
 
+OutputProcessingSetAction = nabu_ns.class_(
+    "OutputProcessingSetAction",
+    automation.Action,
+    cg.Parented.template(NabuMediaPlayer),
+)
+StereoOutputSetAction = nabu_ns.class_(
+    "StereoOutputSetAction",
+    automation.Action,
+    cg.Parented.template(NabuMediaPlayer),
+)
 DuckingSetAction = nabu_ns.class_(
     "DuckingSetAction", automation.Action, cg.Parented.template(NabuMediaPlayer)
 )
@@ -64,6 +110,22 @@ PlayLocalMediaAction = nabu_ns.class_(
     "PlayLocalMediaAction", automation.Action, cg.Parented.template(NabuMediaPlayer)
 )
 
+EqualizerFilterType = nabu_ns.enum("EqualizerFilterType", is_class=True)
+EQUALIZER_FILTER_TYPES = {
+    "low_shelf": EqualizerFilterType.LOW_SHELF,
+    "high_shelf": EqualizerFilterType.HIGH_SHELF,
+    "peaking": EqualizerFilterType.PEAKING,
+    "low_pass": EqualizerFilterType.LOW_PASS,
+    "high_pass": EqualizerFilterType.HIGH_PASS,
+}
+
+ResamplerQuality = nabu_ns.enum("ResamplerQuality", is_class=True)
+RESAMPLER_QUALITIES = {
+    "voice": ResamplerQuality.VOICE,
+    "balanced": ResamplerQuality.BALANCED,
+    "hifi": ResamplerQuality.HIFI,
+}
+
 
 def _compute_local_file_path(value: dict) -> Path:
     url = value[CONF_URL]
@@ -142,27 +204,172 @@ MEDIA_FILE_TYPE_SCHEMA = cv.Schema(
         cv.Required(CONF_ID): cv.declare_id(MediaFile),
         cv.Required(CONF_FILE): _file_schema,
         cv.GenerateID(CONF_RAW_DATA_ID): cv.declare_id(cg.uint8),
+        cv.Optional(CONF_CACHE, default=False): cv.boolean,
+    }
+)
+
+
+EQUALIZER_BAND_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_TYPE): cv.enum(EQUALIZER_FILTER_TYPES, lower=True),
+        cv.Required(CONF_FREQUENCY): cv.frequency,
+        cv.Optional(CONF_GAIN, default=0.0): cv.float_range(min=-24.0, max=24.0),
+        cv.Optional(CONF_Q, default=0.707): cv.float_range(min=0.1, max=20.0),
+    }
+)
+
+# Splits the output at the crossover and compresses the bass and the rest separately
+COMPRESSOR_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_CROSSOVER, default="200Hz"): cv.frequency,
+        cv.Optional(CONF_THRESHOLD, default=-12.0): cv.float_range(
+            min=-60.0, max=0.0
+        ),
+        cv.Optional(CONF_RATIO, default=4.0): cv.float_range(min=1.0, max=20.0),
+        cv.Optional(CONF_ATTACK, default="5ms"): cv.positive_time_period_milliseconds,
+        cv.Optional(
+            CONF_RELEASE, default="150ms"
+        ): cv.positive_time_period_milliseconds,
+    }
+)
+
+OUTPUT_PROCESSING_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_ENABLED, default=True): cv.boolean,
+        cv.Optional(CONF_EQUALIZER): cv.All(
+            cv.ensure_list(EQUALIZER_BAND_SCHEMA),
+            cv.Length(max=MAX_EQUALIZER_BANDS),
+        ),
+        cv.Optional(CONF_COMPRESSOR): COMPRESSOR_SCHEMA,
     }
 )
 
+# Target integrated loudness in LUFS for each pipeline. Tracks are only turned down.
+LOUDNESS_NORMALIZATION_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_MEDIA_TARGET, default=-18.0): cv.float_range(
+            min=-40.0, max=0.0
+        ),
+        cv.Optional(CONF_ANNOUNCEMENT_TARGET, default=-18.0): cv.float_range(
+            min=-40.0, max=0.0
+        ),
+    }
+)
 
-CONFIG_SCHEMA = media_player.MEDIA_PLAYER_SCHEMA.extend(
+# Resampler filter profile for each pipeline; higher quality costs more CPU. Each
+# profile's cost and passband are listed with ResamplerQuality in audio_resampler.h
+RESAMPLER_QUALITY_SCHEMA = cv.Schema(
     {
-        cv.GenerateID(): cv.declare_id(NabuMediaPlayer),
-        cv.Required(CONF_SPEAKER): cv.use_id(speaker.Speaker),
-        cv.Optional(CONF_AUDIO_DAC): cv.use_id(audio_dac.AudioDac),
-        cv.Optional(CONF_SAMPLE_RATE, default=16000): cv.int_range(min=1),
-        cv.Optional(CONF_VOLUME_INCREMENT, default=0.05): cv.percentage,
-        cv.Optional(CONF_VOLUME_MAX, default=1.0): cv.percentage,
-        cv.Optional(CONF_VOLUME_MIN, default=0.0): cv.percentage,
-        cv.Optional(CONF_FILES): cv.ensure_list(MEDIA_FILE_TYPE_SCHEMA),
-        cv.Optional(CONF_ON_MUTE): automation.validate_automation(single=True),
-        cv.Optional(CONF_ON_UNMUTE): automation.validate_automation(single=True),
-        cv.Optional(CONF_ON_VOLUME): automation.validate_automation(single=True),
+        cv.Optional(CONF_MEDIA, default="balanced"): cv.enum(
+            RESAMPLER_QUALITIES, lower=True
+        ),
+        cv.Optional(CONF_ANNOUNCEMENT, default="balanced"): cv.enum(
+            RESAMPLER_QUALITIES, lower=True
+        ),
     }
 )
 
 
+def _validate_announcement_start(config):
+    if config[CONF_ANNOUNCEMENT_LOW_LATENCY] and (
+        CONF_ANNOUNCEMENT_START_THRESHOLD in config
+    ):
+        raise cv.Invalid(
+            f"{CONF_ANNOUNCEMENT_START_THRESHOLD} can't be set with {CONF_ANNOUNCEMENT_LOW_LATENCY}, which always starts announcements right away"
+        )
+    return config
+
+
+def _validate_output_processing(config):
+    if output_processing := config.get(CONF_OUTPUT_PROCESSING):
+        nyquist = config[CONF_SAMPLE_RATE] / 2
+        frequencies = [
+            band[CONF_FREQUENCY] for band in output_processing.get(CONF_EQUALIZER, [])
+        ]
+        if compressor := output_processing.get(CONF_COMPRESSOR):
+            frequencies.append(compressor[CONF_CROSSOVER])
+        for frequency in frequencies:
+            if frequency >= nyquist:
+                raise cv.Invalid(
+                    f"{CONF_OUTPUT_PROCESSING} frequencies must be below half the sample rate ({nyquist} Hz)"
+                )
+    return config
+
+
+def _validate_reference_buffer(config):
+    if CONF_REFERENCE_BUFFER in config:
+        sample_rate = config[CONF_SAMPLE_RATE]
+        if sample_rate % 16000 != 0 or sample_rate > 48000:
+            raise cv.Invalid(
+                f"{CONF_REFERENCE_BUFFER} needs a {CONF_SAMPLE_RATE} of 16000, 32000, or 48000"
+            )
+    return config
+
+
+# Default layout: Wi-Fi and lwIP run on core 0, so the audio output tasks share it and leave core 1 to the
+# microphone and wake word tasks. The mixer outranks the pipelines since a late mixer is an audible dropout, while the
+# pipelines are buffered.
+CONFIG_SCHEMA = (
+    media_player.MEDIA_PLAYER_SCHEMA.extend(
+        {
+            cv.GenerateID(): cv.declare_id(NabuMediaPlayer),
+            cv.Required(CONF_SPEAKER): cv.use_id(speaker.Speaker),
+            cv.Optional(CONF_AUDIO_DAC): cv.use_id(audio_dac.AudioDac),
+            cv.Optional(CONF_SAMPLE_RATE, default=16000): cv.int_range(min=1),
+            cv.Optional(CONF_VOLUME_INCREMENT, default=0.05): cv.percentage,
+            cv.Optional(CONF_VOLUME_MAX, default=1.0): cv.percentage,
+            cv.Optional(CONF_VOLUME_MIN, default=0.0): cv.percentage,
+            cv.Optional(CONF_FILES): cv.ensure_list(MEDIA_FILE_TYPE_SCHEMA),
+            cv.Optional(CONF_MIXER_TASK, default={}): task_schema(0, 10),
+            cv.Optional(CONF_MEDIA_PIPELINE_TASK, default={}): task_schema(0, 1),
+            cv.Optional(
+                CONF_ANNOUNCEMENT_PIPELINE_TASK, default={}
+            ): task_schema(0, 1),
+            cv.Optional(
+                CONF_MEDIA_START_THRESHOLD, default="100ms"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_ANNOUNCEMENT_START_THRESHOLD
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_ANNOUNCEMENT_LOW_LATENCY, default=False): cv.boolean,
+            # Pauses playing media during announcements and resumes it where it left off,
+            # instead of mixing the announcement with ducked media
+            cv.Optional(CONF_ANNOUNCEMENT_PAUSES_MEDIA, default=False): cv.boolean,
+            cv.Optional(CONF_STATS_LOG_INTERVAL): cv.positive_time_period_milliseconds,
+            # Decodes, resamples, and mixes a single channel; it is only duplicated for
+            # the speaker while the stereo output is on
+            cv.Optional(CONF_MONO, default=False): cv.boolean,
+            cv.Optional(CONF_STEREO_OUTPUT, default=False): cv.boolean,
+            # Keeps announcements mono up to the mixer, which upmixes them while
+            # mixing; halves their buffers and cached audio. When off, each
+            # announcement still keeps its own channels.
+            cv.Optional(CONF_MONO_ANNOUNCEMENTS, default=True): cv.boolean,
+            cv.Optional(CONF_OUTPUT_PROCESSING): OUTPUT_PROCESSING_SCHEMA,
+            cv.Optional(CONF_LOUDNESS_NORMALIZATION): LOUDNESS_NORMALIZATION_SCHEMA,
+            cv.Optional(
+                CONF_RESAMPLER_QUALITY, default={}
+            ): RESAMPLER_QUALITY_SCHEMA,
+            # Adjusts the media resampling ratio by a few ppm to follow a live stream's
+            # clock, so the buffers never slowly fill up or run dry
+            cv.Optional(CONF_MEDIA_DRIFT_COMPENSATION, default=False): cv.boolean,
+            # Starting a new track while one plays fades between them for this long
+            cv.Optional(CONF_CROSSFADE): cv.positive_time_period_milliseconds,
+            # Keeps a 16 kHz mono copy of the output, e.g., for an echo canceller
+            cv.Optional(CONF_REFERENCE_BUFFER): cv.All(
+                cv.positive_time_period_milliseconds,
+                cv.Range(min=cv.TimePeriod(milliseconds=20)),
+            ),
+            cv.Optional(CONF_ON_MUTE): automation.validate_automation(single=True),
+            cv.Optional(CONF_ON_UNMUTE): automation.validate_automation(single=True),
+            cv.Optional(CONF_ON_VOLUME): automation.validate_automation(single=True),
+        }
+    )
+    .add_extra(_validate_announcement_start)
+    .add_extra(_validate_output_processing)
+    .add_extra(_validate_reference_buffer)
+)
+
+
 def _read_audio_file_and_type(file_config):
     conf_file = file_config[CONF_FILE]
     file_source = conf_file[CONF_TYPE]
@@ -223,11 +430,86 @@ async def to_code(config):
     cg.add_define("USE_OTA_STATE_CALLBACK")
 
     cg.add(var.set_sample_rate(config[CONF_SAMPLE_RATE]))
+    if config[CONF_MONO]:
+        cg.add(var.set_mono(True))
+        cg.add(var.set_stereo_output(config[CONF_STEREO_OUTPUT]))
+    cg.add(var.set_mono_announcements(config[CONF_MONO_ANNOUNCEMENTS]))
 
     cg.add(var.set_volume_increment(config[CONF_VOLUME_INCREMENT]))
     cg.add(var.set_volume_max(config[CONF_VOLUME_MAX]))
     cg.add(var.set_volume_min(config[CONF_VOLUME_MIN]))
 
+    cg.add(var.set_media_start_threshold(config[CONF_MEDIA_START_THRESHOLD]))
+    cg.add(
+        var.set_announcement_start_threshold(
+            config.get(CONF_ANNOUNCEMENT_START_THRESHOLD, 50)
+        )
+    )
+    cg.add(var.set_announcement_low_latency(config[CONF_ANNOUNCEMENT_LOW_LATENCY]))
+    cg.add(
+        var.set_announcement_pauses_media(config[CONF_ANNOUNCEMENT_PAUSES_MEDIA])
+    )
+
+    for conf_task, setter in (
+        (CONF_MIXER_TASK, var.set_mixer_task),
+        (CONF_MEDIA_PIPELINE_TASK, var.set_media_pipeline_task),
+        (CONF_ANNOUNCEMENT_PIPELINE_TASK, var.set_announcement_pipeline_task),
+    ):
+        task_config = config[conf_task]
+        cg.add(setter(task_config[CONF_PRIORITY], task_core(task_config)))
+
+    if output_processing := config.get(CONF_OUTPUT_PROCESSING):
+        for band in output_processing.get(CONF_EQUALIZER, []):
+            cg.add(
+                var.add_output_equalizer_band(
+                    band[CONF_TYPE], band[CONF_FREQUENCY], band[CONF_GAIN], band[CONF_Q]
+                )
+            )
+        if compressor := output_processing.get(CONF_COMPRESSOR):
+            cg.add(
+                var.set_output_compressor(
+                    compressor[CONF_CROSSOVER],
+                    compressor[CONF_THRESHOLD],
+                    compressor[CONF_RATIO],
+                    compressor[CONF_ATTACK],
+                    compressor[CONF_RELEASE],
+                )
+            )
+        cg.add(var.set_output_processing(output_processing[CONF_ENABLED]))
+
+    if loudness_normalization := config.get(CONF_LOUDNESS_NORMALIZATION):
+        cg.add(
+            var.set_media_target_loudness(loudness_normalization[CONF_MEDIA_TARGET])
+        )
+        cg.add(
+            var.set_announcement_target_loudness(
+                loudness_normalization[CONF_ANNOUNCEMENT_TARGET]
+            )
+        )
+
+    resampler_quality = config[CONF_RESAMPLER_QUALITY]
+    cg.add(var.set_media_resampler_quality(resampler_quality[CONF_MEDIA]))
+    cg.add(
+        var.set_announcement_resampler_quality(resampler_quality[CONF_ANNOUNCEMENT])
+    )
+    cg.add(var.set_media_drift_compensation(config[CONF_MEDIA_DRIFT_COMPENSATION]))
+
+    if crossfade := config.get(CONF_CROSSFADE):
+        cg.add(var.set_crossfade_duration(crossfade))
+
+    if reference_buffer := config.get(CONF_REFERENCE_BUFFER):
+        cg.add(var.set_reference_buffer_duration(reference_buffer))
+
+    if stats_log_interval := config.get(CONF_STATS_LOG_INTERVAL):
+        # Compiles in the per-stage counters; they cost nothing when this isn't configured
+        cg.add_define("USE_AUDIO_PIPELINE_STATS")
+        cg.add(var.set_stats_log_interval(stats_log_interval))
+
+        # Needed for the per-task CPU usage report
+        esp32.add_idf_sdkconfig_option("CONFIG_FREERTOS_USE_TRACE_FACILITY", True)
+        esp32.add_idf_sdkconfig_option("CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS", True)
+        esp32.add_idf_sdkconfig_option("CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID", True)
+
     spkr = await cg.get_variable(config[CONF_SPEAKER])
     cg.add(var.set_speaker(spkr))
 
@@ -277,11 +559,14 @@ async def to_code(config):
                 ),
             )
 
-            cg.new_Pvariable(
+            media_file = cg.new_Pvariable(
                 file_config[CONF_ID],
                 media_files_struct,
             )
 
+            if file_config[CONF_CACHE]:
+                cg.add(var.add_cached_media_file(media_file))
+
 
 DUCKING_SET_SCHEMA = cv.Schema(
     {
@@ -328,3 +613,41 @@ async def ducking_set_to_code(config, action_id, template_arg, args):
     duration = await cg.templatable(config[CONF_DURATION], args, cg.float_)
     cg.add(var.set_duration(duration))
     return var
+
+
+@automation.register_action(
+    "nabu.set_output_processing",
+    OutputProcessingSetAction,
+    cv.maybe_simple_value(
+        {
+            cv.GenerateID(): cv.use_id(NabuMediaPlayer),
+            cv.Required(CONF_ENABLED): cv.templatable(cv.boolean),
+        },
+        key=CONF_ENABLED,
+    ),
+)
+async def output_processing_set_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    enabled = await cg.templatable(config[CONF_ENABLED], args, bool)
+    cg.add(var.set_enabled(enabled))
+    return var
+
+
+@automation.register_action(
+    "nabu.set_stereo_output",
+    StereoOutputSetAction,
+    cv.maybe_simple_value(
+        {
+            cv.GenerateID(): cv.use_id(NabuMediaPlayer),
+            cv.Required(CONF_ENABLED): cv.templatable(cv.boolean),
+        },
+        key=CONF_ENABLED,
+    ),
+)
+async def stereo_output_set_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    enabled = await cg.templatable(config[CONF_ENABLED], args, bool)
+    cg.add(var.set_enabled(enabled))
+    return var
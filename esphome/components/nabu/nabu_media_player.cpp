@@ -7,6 +7,8 @@
 #include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 
+#include <algorithm>
+
 #ifdef USE_OTA
 #include "esphome/components/ota/ota_backend.h"
 #endif
@@ -17,7 +19,8 @@ namespace nabu {
 // Framework:
 //  - Media player that can handle two streams; one for media and one for announcements
 //    - If played together, they are mixed with the announcement stream staying at full volume
-//    - The media audio is scaled, if necessary, to avoid clipping when mixing an announcement stream
+//    - A look-ahead limiter turns the media audio down, if necessary, to avoid clipping when mixing an announcement
+//      stream
 //    - The media audio can be further ducked via the ``set_ducking_reduction`` function
 //  - Each stream is handled by an ``AudioPipeline`` object with three parts/tasks
 //    - ``AudioReader`` handles reading from an HTTP source or from a PROGMEM flash set at compile time
@@ -29,22 +32,42 @@ namespace nabu {
 //      to stereo
 //      - The quality is not good, and it is slow! Please use audio at the configured sample rate to avoid these issues
 //    - Each task will always run once started, but they will not doing anything until they are needed
+//    - The YAML configuration sets each task's core and priority. By default the pipeline and mixer tasks share core 0
+//      with Wi-Fi, leaving core 1 to the microphone and wake word tasks
+//    - The announcement pipeline instead runs all three parts in one cooperative task with smaller buffers
+//    - Enqueued media tracks play gaplessly. The reader reads the next track into a second ring buffer while the
+//      current one is still decoding, and the decoder switches to it once the resampler has processed the current track
+//    - Starting a new track while one plays crossfades between them if a crossfade duration is configured. A second
+//      media pipeline and mixer input are allocated for the new track, the mixer fades the tracks once the new one
+//      starts playing, and the outgoing pipeline and its mixer input's ring buffer are freed once it has faded out.
+//    - Dropped HTTP connections are reopened with a range request from the last byte read. Seeking uses the same
+//      mechanism; the buffered audio is discarded and the decoder resyncs to the next frame.
 //    - FreeRTOS Event Groups make up the inter-task communication
+//    - Media files marked for caching are decoded and resampled once during setup by a ``MediaFileCache``. Announcing
+//      one sends the PCM straight to the mixer without starting the announcement pipeline.
 //    - The ``AudioPipeline`` sets up an output ring buffer for the Reader and Decoder parts. The next part/task
 //      automatically pulls from the previous ring buffer
 //  - The streams are mixed together in the ``AudioMixer`` task
-//    - Each stream has a corresponding input buffer that the ``AudioResampler`` feeds directly
+//    - Each stream is one of the mixer's inputs. The announcement input has the higher priority and the media input
+//      is in the ducking group that ``set_ducking_reduction`` ducks. The mixer supports more inputs for future sources.
+//    - Each input has a corresponding input buffer that the ``AudioResampler`` feeds directly
 //    - Pausing the media stream is done here
 //    - Media stream ducking is done here
+//    - Each stream starts once its start threshold of audio is buffered. In low latency mode, announcements start with
+//      their first decoded samples; the time to first sample of each stream is logged.
 //    - The output ring buffer feeds the configured speaker the audio directly
 //  - Media player commands are received by the ``control`` function. The commands are added to the
 //    ``media_control_command_queue_`` to be processed in the component's loop
 //    - Starting a stream intializes the appropriate pipeline or stops it if it is already running
 //    - Volume and mute commands are achieved by the ``mute``, ``unmute``, ``set_volume`` functions. Volume changes use
-//      an ``audio_dac`` component if configured. If one isn't, software volume control is used.
+//      an ``audio_dac`` component if configured. If one isn't, the mixer's volume ramps to the new level over
+//      ``VOLUME_RAMP_MS``, so a volume change never clicks.
 //      - Volume commands are ignored if the media control queue is full to avoid crashing when the track wheel is spun
 //      fast
 //    - Pausing is sent to the ``AudioMixer`` task. It only effects the media stream.
+//    - If announcements pause media, an announcement pauses the playing media's mixer input and its pipeline's reader
+//      and decoder. The buffered audio is kept, so the media resumes at the exact sample once the announcement has
+//      played. A new track started in the meantime waits for the announcement too.
 //  - The components main loop performs housekeeping:
 //    - It reads the media control queue and processes it directly
 //    - It watches the state of speaker and mixer tasks
@@ -53,16 +76,19 @@ namespace nabu {
 
 static const size_t QUEUE_LENGTH = 20;
 
-static const uint8_t NUMBER_OF_CHANNELS = 2;  // Hard-coded expectation of stereo (2 channel) audio
-
-static const UBaseType_t MEDIA_PIPELINE_TASK_PRIORITY = 1;
-static const UBaseType_t ANNOUNCEMENT_PIPELINE_TASK_PRIORITY = 1;
-static const UBaseType_t MIXER_TASK_PRIORITY = 10;
-
 static const size_t TASK_DELAY_MS = 10;
 
+// Mixer input settings; the announcement input outranks the media input, so only media is scaled to avoid clipping
+static const uint8_t MEDIA_DUCKING_GROUP = 1;
+static const uint8_t MEDIA_PRIORITY = 0;
+static const uint8_t ANNOUNCEMENT_PRIORITY = 1;
+
 static const float FIRST_BOOT_DEFAULT_VOLUME = 0.5f;
 
+// Software volume spans this many dB below full scale; only 0 is silent
+static const float SOFTWARE_VOLUME_RANGE_DB = 50.0f;
+static const uint32_t VOLUME_RAMP_MS = 50;
+
 static const char *const TAG = "nabu_media_player";
 
 void NabuMediaPlayer::setup() {
@@ -81,6 +107,26 @@ void NabuMediaPlayer::setup() {
     this->set_mute_state_(false);
   }
 
+  this->output_channels_ = this->stereo_output_ ? 2 : this->channels_;
+
+  for (auto *media_file : this->cached_media_files_) {
+    esp_err_t err = this->media_file_cache_.add(media_file, this->sample_rate_, this->announcement_channels_());
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to cache a media file, it will be decoded when played: %s", esp_err_to_name(err));
+    }
+  }
+
+  if (this->reference_buffer_ms_ > 0) {
+    this->reference_tap_ = AudioReferenceTap::create(this->sample_rate_, this->channels_, this->reference_buffer_ms_);
+    if (this->reference_tap_ == nullptr) {
+      ESP_LOGE(TAG, "Failed to allocate the output reference");
+    }
+  }
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  this->set_interval("pipeline_stats", this->stats_log_interval_, [this]() { this->log_pipeline_stats_(); });
+#endif
+
 #ifdef USE_OTA
   ota::get_global_ota_callback()->add_on_state_callback(
       [this](ota::OTAState state, float progress, uint8_t error, ota::OTAComponent *comp) {
@@ -91,6 +137,9 @@ void NabuMediaPlayer::setup() {
           if (this->media_pipeline_ != nullptr) {
             this->media_pipeline_->suspend_tasks();
           }
+          if (this->fading_pipeline_ != nullptr) {
+            this->fading_pipeline_->suspend_tasks();
+          }
           if (this->announcement_pipeline_ != nullptr) {
             this->announcement_pipeline_->suspend_tasks();
           }
@@ -101,6 +150,9 @@ void NabuMediaPlayer::setup() {
           if (this->media_pipeline_ != nullptr) {
             this->media_pipeline_->resume_tasks();
           }
+          if (this->fading_pipeline_ != nullptr) {
+            this->fading_pipeline_->resume_tasks();
+          }
           if (this->announcement_pipeline_ != nullptr) {
             this->announcement_pipeline_->resume_tasks();
           }
@@ -115,8 +167,21 @@ esp_err_t NabuMediaPlayer::start_pipeline_(AudioPipelineType type, bool url) {
   esp_err_t err = ESP_OK;
 
   if (this->speaker_ != nullptr) {
+    uint8_t output_channels = this->stereo_output_ ? 2 : this->channels_;
+    if ((output_channels != this->output_channels_) && this->speaker_->is_stopped()) {
+      // The speaker only picks up a new channel count when it starts, so the mixer's output only switches while the
+      // speaker is stopped
+      this->output_channels_ = output_channels;
+      if (this->audio_mixer_ != nullptr) {
+        CommandEvent command_event;
+        command_event.command = CommandEventType::SET_STEREO_OUTPUT;
+        command_event.enabled = (output_channels == 2);
+        this->audio_mixer_->send_command(&command_event);
+      }
+    }
+
     audio::AudioStreamInfo audio_stream_info;
-    audio_stream_info.channels = 2;
+    audio_stream_info.channels = this->output_channels_;
     audio_stream_info.bits_per_sample = 16;
     audio_stream_info.sample_rate = this->sample_rate_;
 
@@ -124,59 +189,318 @@ esp_err_t NabuMediaPlayer::start_pipeline_(AudioPipelineType type, bool url) {
   }
 
   if (this->audio_mixer_ == nullptr) {
-    this->audio_mixer_ = make_unique<AudioMixer>();
-    err = this->audio_mixer_->start(this->speaker_, "mixer", MIXER_TASK_PRIORITY);
+    std::unique_ptr<AudioMixer> audio_mixer = make_unique<AudioMixer>();
+    audio_mixer->set_sample_rate(this->sample_rate_);
+    audio_mixer->set_channels(this->channels_);
+    audio_mixer->set_stereo_output(this->output_channels_ == 2);
+    audio_mixer->set_output_processing(this->output_processing_settings_, this->output_processing_enabled_);
+    audio_mixer->set_reference_tap(this->reference_tap_.get());
+    audio_mixer->set_volume(this->software_volume_);
+
+    MixerInputSettings media_settings;
+    media_settings.ducking_group = MEDIA_DUCKING_GROUP;
+    media_settings.priority = MEDIA_PRIORITY;
+    media_settings.start_threshold = this->ms_to_bytes_(this->media_start_threshold_ms_, this->channels_);
+    // Crossfades need a second media input, so only the one in use keeps its ring buffer between crossfades
+    media_settings.on_demand = (this->crossfade_duration_ms_ > 0);
+    err = audio_mixer->add_input(media_settings, this->media_mixer_input_);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (media_settings.on_demand) {
+      err = audio_mixer->add_input(media_settings, this->spare_media_mixer_input_);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+
+    // Announcements are never ducked and keep their level when mixed with media
+    MixerInputSettings announcement_settings;
+    announcement_settings.priority = ANNOUNCEMENT_PRIORITY;
+    announcement_settings.channels = this->announcement_channels_();
+    if (!this->announcement_low_latency_) {
+      announcement_settings.start_threshold =
+          this->ms_to_bytes_(this->announcement_start_threshold_ms_, announcement_settings.channels);
+    }
+    err = audio_mixer->add_input(announcement_settings, this->announcement_mixer_input_);
+    if (err != ESP_OK) {
+      return err;
+    }
+
+    // Reserved before the task starts, so a failure leaves no task running
+    if (media_settings.on_demand) {
+      err = audio_mixer->reserve_input(this->media_mixer_input_);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+    err = audio_mixer->start(this->speaker_, "mixer", this->mixer_task_priority_, this->mixer_task_core_);
     if (err != ESP_OK) {
       return err;
     }
+    this->audio_mixer_ = std::move(audio_mixer);
   }
 
   if (type == AudioPipelineType::MEDIA) {
+    this->media_start_ms_ = millis();
+    this->media_first_sample_pending_ = true;
+
+    if (this->crossfade_duration_ms_ > 0) {
+      if ((this->media_pipeline_ != nullptr) && (this->media_pipeline_state_ == AudioPipelineState::PLAYING) &&
+          !this->is_paused_ && !this->media_preempted_) {
+        err = this->start_crossfade_();
+        if (err != ESP_OK) {
+          ESP_LOGW(TAG, "Unable to crossfade, starting the track directly: %s", esp_err_to_name(err));
+        }
+      } else {
+        this->finish_crossfade_();
+      }
+    }
+
     if (this->media_pipeline_ == nullptr) {
-      this->media_pipeline_ = make_unique<AudioPipeline>(this->audio_mixer_.get(), type);
+      this->media_pipeline_ = make_unique<AudioPipeline>(this->audio_mixer_.get(), this->media_mixer_input_);
+      this->media_pipeline_->set_resampler_quality(this->media_resampler_quality_);
+      this->media_pipeline_->set_drift_compensation(this->media_drift_compensation_);
+      if (this->media_target_loudness_.has_value()) {
+        this->media_pipeline_->set_loudness_normalization(true, this->media_target_loudness_.value());
+      }
     }
 
     if (url) {
       err = this->media_pipeline_->start(this->media_url_.value(), this->sample_rate_, "media",
-                                         MEDIA_PIPELINE_TASK_PRIORITY);
+                                         this->media_pipeline_task_priority_, this->media_pipeline_task_core_);
     } else {
       err = this->media_pipeline_->start(this->media_file_.value(), this->sample_rate_, "media",
-                                         MEDIA_PIPELINE_TASK_PRIORITY);
+                                         this->media_pipeline_task_priority_, this->media_pipeline_task_core_);
     }
 
-    if (this->is_paused_) {
+    if (this->media_preempted_) {
+      // Starting the pipeline resumed it, and its mixer input stays paused until the announcement has played
+      this->media_pipeline_->set_paused(true);
+    } else if (this->is_paused_) {
       CommandEvent command_event;
-      command_event.command = CommandEventType::RESUME_MEDIA;
+      command_event.command = CommandEventType::RESUME;
+      command_event.input = this->media_mixer_input_;
       this->audio_mixer_->send_command(&command_event);
     }
     this->is_paused_ = false;
   } else if (type == AudioPipelineType::ANNOUNCEMENT) {
+    this->announcement_start_ms_ = millis();
+    this->announcement_first_sample_pending_ = true;
+
+    const CachedAudio *cached_audio = nullptr;
+    if (!url) {
+      cached_audio = this->media_file_cache_.find(this->announcement_file_.value());
+    }
+
+    if (cached_audio != nullptr) {
+      if (this->announcement_pipeline_ != nullptr) {
+        // Clears the announcement ring buffer in the mixer before the cached audio starts
+        this->announcement_pipeline_->stop();
+      }
+      if (this->announcement_target_loudness_.has_value()) {
+        // Cached audio skips the pipeline, so its loudness measured when it was cached sets the gain here
+        CommandEvent command_event;
+        command_event.command = CommandEventType::SET_GAIN;
+        command_event.input = this->announcement_mixer_input_;
+        command_event.gain = db_to_q15_gain(
+            normalization_gain_db(cached_audio->loudness, this->announcement_target_loudness_.value()));
+        this->audio_mixer_->send_command(&command_event);
+      }
+      err = this->audio_mixer_->set_input_channels(this->announcement_mixer_input_, cached_audio->channels);
+      if (err != ESP_OK) {
+        return err;
+      }
+      if (this->audio_mixer_->play_pcm(this->announcement_mixer_input_, cached_audio->data, cached_audio->length) !=
+          pdTRUE) {
+        err = ESP_FAIL;
+      } else {
+        this->preempt_media_();
+      }
+      return err;
+    }
+
     if (this->announcement_pipeline_ == nullptr) {
-      this->announcement_pipeline_ = make_unique<AudioPipeline>(this->audio_mixer_.get(), type);
+      // Announcements are short, so a single cooperative task saves memory and starts playing sooner
+      this->announcement_pipeline_ =
+          make_unique<AudioPipeline>(this->audio_mixer_.get(), this->announcement_mixer_input_, true);
+      this->announcement_pipeline_->set_low_latency(this->announcement_low_latency_);
+      this->announcement_pipeline_->set_resampler_quality(this->announcement_resampler_quality_);
+      if (this->announcement_target_loudness_.has_value()) {
+        this->announcement_pipeline_->set_loudness_normalization(true, this->announcement_target_loudness_.value());
+      }
     }
 
     if (url) {
       err = this->announcement_pipeline_->start(this->announcement_url_.value(), this->sample_rate_, "ann",
-                                                ANNOUNCEMENT_PIPELINE_TASK_PRIORITY);
+                                                this->announcement_pipeline_task_priority_,
+                                                this->announcement_pipeline_task_core_);
     } else {
       err = this->announcement_pipeline_->start(this->announcement_file_.value(), this->sample_rate_, "ann",
-                                                ANNOUNCEMENT_PIPELINE_TASK_PRIORITY);
+                                                this->announcement_pipeline_task_priority_,
+                                                this->announcement_pipeline_task_core_);
+    }
+
+    if (err == ESP_OK) {
+      this->preempt_media_();
     }
   }
 
   return err;
 }
 
+void NabuMediaPlayer::preempt_media_() {
+  if (!this->announcement_pauses_media_ || this->media_preempted_ || this->is_paused_ ||
+      (this->media_pipeline_ == nullptr) || (this->media_pipeline_state_ != AudioPipelineState::PLAYING)) {
+    return;
+  }
+
+  // Only the new track pauses, so the outgoing one is cut off
+  this->finish_crossfade_();
+
+  // The mixer keeps the media's buffered audio, so playback picks up where it left off
+  CommandEvent command_event;
+  command_event.command = CommandEventType::PAUSE;
+  command_event.input = this->media_mixer_input_;
+  this->audio_mixer_->send_command(&command_event);
+
+  // The resampler fills what's left of the mixer input's ring buffer, but nothing more is read or decoded
+  this->media_pipeline_->set_paused(true);
+  this->media_preempted_ = true;
+}
+
+void NabuMediaPlayer::watch_preempted_media_() {
+  if (!this->media_preempted_) {
+    return;
+  }
+
+  if ((this->announcement_pipeline_state_ != AudioPipelineState::STOPPED) ||
+      this->audio_mixer_->is_playing_pcm(this->announcement_mixer_input_)) {
+    return;
+  }
+
+  // The announcement pipeline stops once it has sent all of its audio to the mixer, so wait for the mixer to play it
+  AudioRingBuffer *ring_buffer = this->audio_mixer_->get_input_ring_buffer(this->announcement_mixer_input_);
+  if ((ring_buffer != nullptr) && (ring_buffer->available() > 0)) {
+    return;
+  }
+
+  if (this->media_pipeline_ != nullptr) {
+    this->media_pipeline_->set_paused(false);
+  }
+  // Stays paused if the user paused it while the announcement played
+  if (!this->is_paused_) {
+    CommandEvent command_event;
+    command_event.command = CommandEventType::RESUME;
+    command_event.input = this->media_mixer_input_;
+    this->audio_mixer_->send_command(&command_event);
+  }
+  this->media_preempted_ = false;
+}
+
+esp_err_t NabuMediaPlayer::start_crossfade_() {
+  this->finish_crossfade_();
+  if (this->fading_pipeline_ != nullptr) {
+    // The previous outgoing track hasn't stopped yet
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = this->audio_mixer_->reserve_input(this->spare_media_mixer_input_);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  // The new track is silent until it starts playing and fades in
+  CommandEvent command_event;
+  command_event.command = CommandEventType::FADE;
+  command_event.input = this->spare_media_mixer_input_;
+  command_event.gain = 0;
+  this->audio_mixer_->send_command(&command_event);
+
+  // start_pipeline_ creates a new media pipeline for the spare input
+  this->fading_pipeline_ = std::move(this->media_pipeline_);
+  std::swap(this->media_mixer_input_, this->spare_media_mixer_input_);
+  this->crossfade_state_ = CROSSFADE_WAITING;
+
+  return ESP_OK;
+}
+
+void NabuMediaPlayer::watch_crossfade_() {
+  if (this->fading_pipeline_ == nullptr) {
+    return;
+  }
+
+  // Keeps the outgoing pipeline's info and error queue from filling up
+  this->fading_pipeline_->get_state();
+
+  if (this->crossfade_state_ == CROSSFADE_WAITING) {
+    if (!this->media_first_sample_pending_) {
+      // The new track is playing. Linear fades keep the sum of the tracks' gains constant.
+      CommandEvent command_event;
+      command_event.command = CommandEventType::FADE;
+      command_event.transition_samples =
+          static_cast<size_t>(static_cast<uint64_t>(this->crossfade_duration_ms_) * this->sample_rate_ / 1000) *
+          this->channels_;
+      command_event.ramp_shape = GainRampShape::LINEAR;
+
+      command_event.input = this->spare_media_mixer_input_;
+      command_event.gain = 0;
+      this->audio_mixer_->send_command(&command_event);
+
+      command_event.input = this->media_mixer_input_;
+      command_event.gain = INT16_MAX;
+      this->audio_mixer_->send_command(&command_event);
+
+      this->crossfade_end_ms_ = millis() + this->crossfade_duration_ms_;
+      this->crossfade_state_ = CROSSFADE_FADING;
+    } else if (this->media_pipeline_state_ != AudioPipelineState::PLAYING) {
+      // The new track failed before it played anything
+      this->finish_crossfade_();
+    }
+  } else if (static_cast<int32_t>(millis() - this->crossfade_end_ms_) >= 0) {
+    this->finish_crossfade_();
+  }
+}
+
+void NabuMediaPlayer::finish_crossfade_() {
+  if (this->fading_pipeline_ == nullptr) {
+    return;
+  }
+
+  // Brings the new track to full level if the crossfade is cut short
+  CommandEvent command_event;
+  command_event.command = CommandEventType::FADE;
+  command_event.input = this->media_mixer_input_;
+  command_event.gain = INT16_MAX;
+  this->audio_mixer_->send_command(&command_event);
+
+  if ((this->fading_pipeline_->stop() != ESP_OK) ||
+      (this->audio_mixer_->release_input(this->spare_media_mixer_input_) != ESP_OK)) {
+    // Tried again on the next loop
+    this->crossfade_state_ = CROSSFADE_FADING;
+    this->crossfade_end_ms_ = millis();
+    return;
+  }
+  this->fading_pipeline_.reset();
+}
+
 void NabuMediaPlayer::watch_media_commands_() {
   MediaCallCommand media_command;
   CommandEvent command_event;
   esp_err_t err = ESP_OK;
 
   if (xQueueReceive(this->media_control_command_queue_, &media_command, 0) == pdTRUE) {
+    if (media_command.enqueue.has_value() && media_command.enqueue.value()) {
+      // Handled by watch_enqueued_media_ once the media pipeline can accept it
+      this->enqueue_pending_ = true;
+      return;
+    }
+
     if (media_command.new_url.has_value() && media_command.new_url.value()) {
       if (media_command.announce.has_value() && media_command.announce.value()) {
         err = this->start_pipeline_(AudioPipelineType::ANNOUNCEMENT, true);
       } else {
+        this->enqueue_pending_ = false;
         err = this->start_pipeline_(AudioPipelineType::MEDIA, true);
       }
     }
@@ -185,6 +509,7 @@ void NabuMediaPlayer::watch_media_commands_() {
       if (media_command.announce.has_value() && media_command.announce.value()) {
         err = this->start_pipeline_(AudioPipelineType::ANNOUNCEMENT, false);
       } else {
+        this->enqueue_pending_ = false;
         err = this->start_pipeline_(AudioPipelineType::MEDIA, false);
       }
     }
@@ -204,15 +529,20 @@ void NabuMediaPlayer::watch_media_commands_() {
     if (media_command.command.has_value()) {
       switch (media_command.command.value()) {
         case media_player::MEDIA_PLAYER_COMMAND_PLAY:
-          if ((this->audio_mixer_ != nullptr) && this->is_paused_) {
-            command_event.command = CommandEventType::RESUME_MEDIA;
+          // Preempted media resumes once the announcement has played
+          if ((this->audio_mixer_ != nullptr) && this->is_paused_ && !this->media_preempted_) {
+            command_event.command = CommandEventType::RESUME;
+            command_event.input = this->media_mixer_input_;
             this->audio_mixer_->send_command(&command_event);
           }
           this->is_paused_ = false;
           break;
         case media_player::MEDIA_PLAYER_COMMAND_PAUSE:
+          // Only the new track pauses, so the outgoing one is cut off
+          this->finish_crossfade_();
           if ((this->audio_mixer_ != nullptr) && !this->is_paused_) {
-            command_event.command = CommandEventType::PAUSE_MEDIA;
+            command_event.command = CommandEventType::PAUSE;
+            command_event.input = this->media_mixer_input_;
             this->audio_mixer_->send_command(&command_event);
           }
           this->is_paused_ = true;
@@ -222,8 +552,15 @@ void NabuMediaPlayer::watch_media_commands_() {
           if (media_command.announce.has_value() && media_command.announce.value()) {
             if (this->announcement_pipeline_ != nullptr) {
               this->announcement_pipeline_->stop();
+            } else if (this->audio_mixer_ != nullptr) {
+              // Stops a cached announcement
+              command_event.command = CommandEventType::CLEAR;
+              command_event.input = this->announcement_mixer_input_;
+              this->audio_mixer_->send_command(&command_event);
             }
           } else {
+            this->enqueue_pending_ = false;
+            this->finish_crossfade_();
             if (this->media_pipeline_ != nullptr) {
               this->media_pipeline_->stop();
             }
@@ -231,11 +568,16 @@ void NabuMediaPlayer::watch_media_commands_() {
           break;
         case media_player::MEDIA_PLAYER_COMMAND_TOGGLE:
           if ((this->audio_mixer_ != nullptr) && this->is_paused_) {
-            command_event.command = CommandEventType::RESUME_MEDIA;
-            this->audio_mixer_->send_command(&command_event);
+            if (!this->media_preempted_) {
+              command_event.command = CommandEventType::RESUME;
+              command_event.input = this->media_mixer_input_;
+              this->audio_mixer_->send_command(&command_event);
+            }
             this->is_paused_ = false;
           } else if (this->audio_mixer_ != nullptr) {
-            command_event.command = CommandEventType::PAUSE_MEDIA;
+            this->finish_crossfade_();
+            command_event.command = CommandEventType::PAUSE;
+            command_event.input = this->media_mixer_input_;
             this->audio_mixer_->send_command(&command_event);
             this->is_paused_ = true;
           }
@@ -265,6 +607,44 @@ void NabuMediaPlayer::watch_media_commands_() {
   }
 }
 
+void NabuMediaPlayer::watch_enqueued_media_() {
+  if (!this->enqueue_pending_) {
+    return;
+  }
+
+  if ((this->media_pipeline_ != nullptr) && (this->media_pipeline_state_ == AudioPipelineState::PLAYING)) {
+    esp_err_t err;
+    if (this->enqueued_media_url_.has_value()) {
+      err = this->media_pipeline_->enqueue(this->enqueued_media_url_.value());
+    } else {
+      err = this->media_pipeline_->enqueue(this->enqueued_media_file_.value());
+    }
+
+    if (err == ESP_OK) {
+      ESP_LOGD(TAG, "Queued the next track for gapless playback");
+      this->enqueue_pending_ = false;
+    }
+    // Otherwise, another track is still queued or the current track has already been read. Try again later.
+  } else if (this->media_pipeline_state_ == AudioPipelineState::STOPPED) {
+    // Nothing is playing, so start the track normally
+    this->enqueue_pending_ = false;
+
+    esp_err_t err;
+    if (this->enqueued_media_url_.has_value()) {
+      this->media_url_ = this->enqueued_media_url_;
+      err = this->start_pipeline_(AudioPipelineType::MEDIA, true);
+    } else {
+      this->media_file_ = this->enqueued_media_file_;
+      err = this->start_pipeline_(AudioPipelineType::MEDIA, false);
+    }
+
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Error starting the audio pipeline: %s", esp_err_to_name(err));
+      this->status_set_error();
+    }
+  }
+}
+
 void NabuMediaPlayer::watch_mixer_() {
   TaskEvent event;
   if (this->audio_mixer_ != nullptr) {
@@ -276,9 +656,40 @@ void NabuMediaPlayer::watch_mixer_() {
   }
 }
 
+size_t NabuMediaPlayer::ms_to_bytes_(uint32_t ms, uint8_t channels) const {
+  return static_cast<size_t>(static_cast<uint64_t>(ms) * this->sample_rate_ / 1000) * channels * sizeof(int16_t);
+}
+
+void NabuMediaPlayer::watch_first_samples_() {
+  if (this->audio_mixer_ == nullptr) {
+    return;
+  }
+
+  // The mixer's timestamps only count once they are newer than the request; compared as differences to handle
+  // millis() wrapping around
+  if (this->media_first_sample_pending_) {
+    uint32_t started_ms = this->audio_mixer_->get_output_started_ms(this->media_mixer_input_);
+    if (static_cast<int32_t>(started_ms - this->media_start_ms_) >= 0) {
+      this->media_first_sample_pending_ = false;
+      this->media_time_to_first_sample_ms_ = started_ms - this->media_start_ms_;
+      ESP_LOGD(TAG, "Media time to first sample: %" PRIu32 " ms", this->media_time_to_first_sample_ms_);
+    }
+  }
+  if (this->announcement_first_sample_pending_) {
+    uint32_t started_ms = this->audio_mixer_->get_output_started_ms(this->announcement_mixer_input_);
+    if (static_cast<int32_t>(started_ms - this->announcement_start_ms_) >= 0) {
+      this->announcement_first_sample_pending_ = false;
+      this->announcement_time_to_first_sample_ms_ = started_ms - this->announcement_start_ms_;
+      ESP_LOGD(TAG, "Announcement time to first sample: %" PRIu32 " ms",
+               this->announcement_time_to_first_sample_ms_);
+    }
+  }
+}
+
 void NabuMediaPlayer::loop() {
   this->watch_media_commands_();
   this->watch_mixer_();
+  this->watch_first_samples_();
 
   // Determine state of the media player
   media_player::MediaPlayerState old_state = this->state;
@@ -289,6 +700,9 @@ void NabuMediaPlayer::loop() {
   if (this->media_pipeline_ != nullptr)
     this->media_pipeline_state_ = this->media_pipeline_->get_state();
 
+  this->watch_crossfade_();
+  this->watch_preempted_media_();
+
   if (this->media_pipeline_state_ == AudioPipelineState::ERROR_READING) {
     ESP_LOGE(TAG, "The media pipeline's file reader encountered an error.");
   } else if (this->media_pipeline_state_ == AudioPipelineState::ERROR_DECODING) {
@@ -297,6 +711,8 @@ void NabuMediaPlayer::loop() {
     ESP_LOGE(TAG, "The media pipeline's audio resampler encountered an error.");
   }
 
+  this->watch_enqueued_media_();
+
   if (this->announcement_pipeline_state_ == AudioPipelineState::ERROR_READING) {
     ESP_LOGE(TAG, "The announcement pipeline's file reader encountered an error.");
   } else if (this->announcement_pipeline_state_ == AudioPipelineState::ERROR_DECODING) {
@@ -305,7 +721,11 @@ void NabuMediaPlayer::loop() {
     ESP_LOGE(TAG, "The announcement pipeline's audio resampler encountered an error.");
   }
 
-  if (this->announcement_pipeline_state_ != AudioPipelineState::STOPPED) {
+  bool playing_cached_announcement =
+      (this->audio_mixer_ != nullptr) && this->audio_mixer_->is_playing_pcm(this->announcement_mixer_input_);
+
+  if ((this->announcement_pipeline_state_ != AudioPipelineState::STOPPED) || playing_cached_announcement ||
+      this->media_preempted_) {
     this->state = media_player::MEDIA_PLAYER_STATE_ANNOUNCING;
   } else {
     if (this->media_pipeline_state_ == AudioPipelineState::STOPPED) {
@@ -326,14 +746,198 @@ void NabuMediaPlayer::set_ducking_reduction(uint8_t decibel_reduction, float dur
   if (this->audio_mixer_ != nullptr) {
     CommandEvent command_event;
     command_event.command = CommandEventType::DUCK;
+    command_event.ducking_group = MEDIA_DUCKING_GROUP;
     command_event.decibel_reduction = decibel_reduction;
 
     // Convert the duration in seconds to number of samples, accounting for the sample rate and number of channels
-    command_event.transition_samples = static_cast<size_t>(duration * this->sample_rate_ * NUMBER_OF_CHANNELS);
+    command_event.transition_samples = static_cast<size_t>(duration * this->sample_rate_ * this->channels_);
     this->audio_mixer_->send_command(&command_event);
   }
 }
 
+void NabuMediaPlayer::set_output_processing(bool enabled) {
+  // Remembered so a mixer started later picks it up
+  this->output_processing_enabled_ = enabled;
+
+  if (this->audio_mixer_ != nullptr) {
+    CommandEvent command_event;
+    command_event.command = CommandEventType::SET_OUTPUT_PROCESSING;
+    command_event.enabled = enabled;
+    this->audio_mixer_->send_command(&command_event);
+  }
+}
+
+void NabuMediaPlayer::set_stereo_output(bool stereo_output) {
+  // Applied when the next stream starts, once the speaker is stopped; see start_pipeline_
+  this->stereo_output_ = stereo_output;
+}
+
+esp_err_t NabuMediaPlayer::seek_media(size_t byte_offset) {
+  if (this->media_pipeline_ == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return this->media_pipeline_->seek(byte_offset);
+}
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+bool NabuMediaPlayer::get_media_pipeline_stats(AudioPipelineStats &stats) {
+  if (this->media_pipeline_ == nullptr) {
+    return false;
+  }
+  this->media_pipeline_->get_stats(stats);
+  return true;
+}
+
+bool NabuMediaPlayer::get_announcement_pipeline_stats(AudioPipelineStats &stats) {
+  if (this->announcement_pipeline_ == nullptr) {
+    return false;
+  }
+  this->announcement_pipeline_->get_stats(stats);
+  return true;
+}
+
+bool NabuMediaPlayer::get_mixer_stats(AudioStageStats &stats) {
+  if (this->audio_mixer_ == nullptr) {
+    return false;
+  }
+  this->audio_mixer_->get_stats(stats);
+  return true;
+}
+
+static void log_stage_stats(const char *name, const AudioStageStats &stats) {
+  ESP_LOGD(TAG, "  %-9s %10" PRIu32 " bytes, %8" PRIu32 " ms waiting for input, %8" PRIu32
+                " ms waiting for output, %4" PRIu32 " underruns",
+           name, stats.bytes_processed, stats.input_wait_us / 1000, stats.output_wait_us / 1000, stats.underruns);
+}
+
+static void log_fill_histogram(const char *name, const uint32_t *histogram) {
+  uint32_t total = 0;
+  for (size_t i = 0; i < FILL_HISTOGRAM_BUCKETS; ++i) {
+    total += histogram[i];
+  }
+  if (total == 0) {
+    return;
+  }
+
+  // Percentage of the time the buffer was at each fill level, from empty to full
+  char line[FILL_HISTOGRAM_BUCKETS * 5 + 1];
+  size_t length = 0;
+  for (size_t i = 0; i < FILL_HISTOGRAM_BUCKETS; ++i) {
+    length += snprintf(line + length, sizeof(line) - length, " %3" PRIu32 "%%",
+                       static_cast<uint32_t>(static_cast<uint64_t>(histogram[i]) * 100 / total));
+  }
+  ESP_LOGD(TAG, "  %s buffer fill:%s", name, line);
+}
+
+void NabuMediaPlayer::log_pipeline_stats_() {
+  AudioPipelineStats pipeline_stats;
+  if (this->get_media_pipeline_stats(pipeline_stats)) {
+    ESP_LOGD(TAG, "Media pipeline:");
+    log_stage_stats("Reader", pipeline_stats.reader);
+    log_stage_stats("Decoder", pipeline_stats.decoder);
+    log_stage_stats("Resampler", pipeline_stats.resampler);
+    log_fill_histogram("File", pipeline_stats.raw_file_fill_histogram);
+    log_fill_histogram("Decoded", pipeline_stats.decoded_fill_histogram);
+  }
+  if (this->get_announcement_pipeline_stats(pipeline_stats)) {
+    ESP_LOGD(TAG, "Announcement pipeline:");
+    log_stage_stats("Reader", pipeline_stats.reader);
+    log_stage_stats("Decoder", pipeline_stats.decoder);
+    log_stage_stats("Resampler", pipeline_stats.resampler);
+    log_fill_histogram("File", pipeline_stats.raw_file_fill_histogram);
+    log_fill_histogram("Decoded", pipeline_stats.decoded_fill_histogram);
+  }
+
+  AudioStageStats mixer_stats;
+  if (this->get_mixer_stats(mixer_stats)) {
+    ESP_LOGD(TAG, "Mixer:");
+    log_stage_stats("Mixer", mixer_stats);
+    ESP_LOGD(TAG, "  %" PRIu32 " idle wakeups", this->audio_mixer_->get_idle_wakeups());
+
+    // The counters wrap around, so only the differences since the last log are used
+    uint32_t processing_us = this->audio_mixer_->get_output_processing_us();
+    uint32_t processed_frames = this->audio_mixer_->get_output_processed_frames();
+    uint32_t new_processing_us = processing_us - this->last_output_processing_us_;
+    uint32_t new_processed_frames = processed_frames - this->last_output_processed_frames_;
+    this->last_output_processing_us_ = processing_us;
+    this->last_output_processed_frames_ = processed_frames;
+    if (new_processed_frames > 0) {
+      // Share of real time spent processing the output, in tenths of a percent
+      uint64_t audio_us = static_cast<uint64_t>(new_processed_frames) * 1000000 / this->sample_rate_;
+      uint32_t load = static_cast<uint32_t>(static_cast<uint64_t>(new_processing_us) * 1000 /
+                                            std::max<uint64_t>(audio_us, 1));
+      if (load > OUTPUT_PROCESSOR_BUDGET_PERMILLE) {
+        ESP_LOGW(TAG, "  Output processing used %" PRIu32 ".%" PRIu32 "%% of real time, over its %" PRIu32 "%% budget",
+                 load / 10, load % 10, OUTPUT_PROCESSOR_BUDGET_PERMILLE / 10);
+      } else {
+        ESP_LOGD(TAG, "  Output processing used %" PRIu32 ".%" PRIu32 "%% of real time", load / 10, load % 10);
+      }
+    }
+    log_fill_histogram(
+        "Media", this->audio_mixer_->get_input_ring_buffer(this->media_mixer_input_)->get_stats().fill_histogram);
+    log_fill_histogram(
+        "Announcement",
+        this->audio_mixer_->get_input_ring_buffer(this->announcement_mixer_input_)->get_stats().fill_histogram);
+  }
+
+  this->log_task_cpu_usage_();
+}
+
+void NabuMediaPlayer::log_task_cpu_usage_() {
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+  // Leaves room for tasks created between counting and reading them
+  std::vector<TaskStatus_t> task_statuses(uxTaskGetNumberOfTasks() + 4);
+  uint32_t total_run_time = 0;
+  task_statuses.resize(uxTaskGetSystemState(task_statuses.data(), task_statuses.size(), &total_run_time));
+
+  // Counters wrap around, so only their differences are meaningful
+  const uint32_t elapsed = total_run_time - this->total_run_time_;
+  this->total_run_time_ = total_run_time;
+
+  std::map<UBaseType_t, uint32_t> run_times;
+  std::vector<std::pair<uint32_t, const TaskStatus_t *>> usage;
+  for (const auto &status : task_statuses) {
+    const uint32_t run_time = static_cast<uint32_t>(status.ulRunTimeCounter);
+    run_times[status.xTaskNumber] = run_time;
+
+    // A task new since the last call counts from its creation
+    auto previous = this->task_run_times_.find(status.xTaskNumber);
+    const uint32_t previous_run_time = (previous != this->task_run_times_.end()) ? previous->second : 0;
+    usage.emplace_back(run_time - previous_run_time, &status);
+  }
+  this->task_run_times_ = std::move(run_times);
+
+  if (elapsed == 0) {
+    return;
+  }
+
+  std::sort(usage.begin(), usage.end(),
+            [](const std::pair<uint32_t, const TaskStatus_t *> &a, const std::pair<uint32_t, const TaskStatus_t *> &b) {
+              return a.first > b.first;
+            });
+
+  // Percentages are of one core, so a task that kept a core busy the whole interval shows 100%
+  ESP_LOGD(TAG, "Task CPU usage:");
+  for (const auto &entry : usage) {
+    const TaskStatus_t *status = entry.second;
+    const float percentage = static_cast<float>(entry.first) * 100.0f / static_cast<float>(elapsed);
+#ifdef CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+    if (status->xCoreID == tskNO_AFFINITY) {
+      ESP_LOGD(TAG, "  %-16s core any, priority %2u: %5.1f%%", status->pcTaskName,
+               static_cast<unsigned>(status->uxCurrentPriority), percentage);
+    } else {
+      ESP_LOGD(TAG, "  %-16s core %3d, priority %2u: %5.1f%%", status->pcTaskName, static_cast<int>(status->xCoreID),
+               static_cast<unsigned>(status->uxCurrentPriority), percentage);
+    }
+#else
+    ESP_LOGD(TAG, "  %-16s priority %2u: %5.1f%%", status->pcTaskName,
+             static_cast<unsigned>(status->uxCurrentPriority), percentage);
+#endif
+  }
+#endif
+}
+#endif
+
 void NabuMediaPlayer::control(const media_player::MediaPlayerCall &call) {
   MediaCallCommand media_command;
 
@@ -349,6 +953,11 @@ void NabuMediaPlayer::control(const media_player::MediaPlayerCall &call) {
     media_command.new_url = true;
     if (call.get_announcement().has_value() && call.get_announcement().value()) {
       this->announcement_url_ = new_uri;
+    } else if (call.get_command().has_value() &&
+               (call.get_command().value() == media_player::MEDIA_PLAYER_COMMAND_ENQUEUE)) {
+      this->enqueued_media_url_ = new_uri;
+      this->enqueued_media_file_.reset();
+      media_command.enqueue = true;
     } else {
       this->media_url_ = new_uri;
     }
@@ -359,6 +968,11 @@ void NabuMediaPlayer::control(const media_player::MediaPlayerCall &call) {
   if (call.get_local_media_file().has_value()) {
     if (call.get_announcement().has_value() && call.get_announcement().value()) {
       this->announcement_file_ = call.get_local_media_file().value();
+    } else if (call.get_command().has_value() &&
+               (call.get_command().value() == media_player::MEDIA_PLAYER_COMMAND_ENQUEUE)) {
+      this->enqueued_media_file_ = call.get_local_media_file().value();
+      this->enqueued_media_url_.reset();
+      media_command.enqueue = true;
     } else {
       this->media_file_ = call.get_local_media_file().value();
     }
@@ -423,8 +1037,8 @@ void NabuMediaPlayer::set_mute_state_(bool mute_state) {
 #endif
   {  // Fall back to software mute control if there is no audio_dac or if it isn't configured
     if (mute_state) {
-      this->speaker_->set_volume(0.0f);
-    } else if (this->speaker_->get_volume() == 0.0f) {
+      this->set_software_volume_(0.0f);
+    } else if (this->software_volume_ == 0) {
       this->set_volume_(this->volume, false);  // restore previous volume
     }
   }
@@ -443,6 +1057,23 @@ void NabuMediaPlayer::set_mute_state_(bool mute_state) {
   }
 }
 
+void NabuMediaPlayer::set_software_volume_(float volume) {
+  if (volume <= 0.0f) {
+    this->software_volume_ = 0;
+  } else {
+    this->software_volume_ = db_to_q15_gain((std::min(volume, 1.0f) - 1.0f) * SOFTWARE_VOLUME_RANGE_DB);
+  }
+
+  if (this->audio_mixer_ != nullptr) {
+    CommandEvent command_event;
+    command_event.command = CommandEventType::SET_VOLUME;
+    command_event.gain = this->software_volume_;
+    command_event.transition_samples =
+        static_cast<size_t>(static_cast<uint64_t>(VOLUME_RAMP_MS) * this->sample_rate_ / 1000) * this->channels_;
+    this->audio_mixer_->send_command(&command_event);
+  }
+}
+
 void NabuMediaPlayer::set_volume_(float volume, bool publish) {
   // Remap the volume to fit with in the configured limits
   float bounded_volume = remap<float, float>(volume, 0.0f, 1.0f, this->volume_min_, this->volume_max_);
@@ -453,7 +1084,7 @@ void NabuMediaPlayer::set_volume_(float volume, bool publish) {
   } else
 #endif
   {  // Fall back to the speaker's volume control if there is no audio_dac or if it isn't configured
-    this->speaker_->set_volume(bounded_volume);
+    this->set_software_volume_(bounded_volume);
   }
 
   if (publish) {
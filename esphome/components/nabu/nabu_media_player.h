@@ -4,6 +4,7 @@
 
 #include "audio_mixer.h"
 #include "audio_pipeline.h"
+#include "media_file_cache.h"
 
 #ifdef USE_AUDIO_DAC
 #include "esphome/components/audio_dac/audio_dac.h"
@@ -20,6 +21,9 @@
 
 #include <esp_http_client.h>
 
+#include <map>
+#include <vector>
+
 namespace esphome {
 namespace nabu {
 
@@ -29,6 +33,7 @@ struct MediaCallCommand {
   optional<bool> announce;
   optional<bool> new_url;
   optional<bool> new_file;
+  optional<bool> enqueue;
 };
 
 struct VolumeRestoreState {
@@ -51,8 +56,141 @@ class NabuMediaPlayer : public Component, public media_player::MediaPlayer {
   /// @param duration (float) The duration (in seconds) for transitioning to the new ducking level
   void set_ducking_reduction(uint8_t decibel_reduction, float duration);
 
+  /// @brief Switches the output equalizer and compressor on or off, e.g., to bypass them while headphones are plugged
+  /// in. Does nothing if neither is configured.
+  /// @param enabled (bool) whether the output is processed
+  void set_output_processing(bool enabled);
+
+  /// @brief Sets whether a mono player sends stereo to the speaker, e.g., while headphones are plugged in. The mono
+  /// mix is then duplicated into both channels on its way to the speaker. Takes effect when a stream starts while the
+  /// speaker is stopped, as that is when the speaker picks up a new channel count. Ignored by a stereo player.
+  /// @param stereo_output (bool) whether the speaker gets stereo
+  void set_stereo_output(bool stereo_output);
+
+  /// @brief Moves playback of the current media track to a byte offset in its file
+  /// @param byte_offset (size_t) offset from the start of the file
+  /// @return ESP_OK if the seek was requested or an appropriate error if not; see ``AudioPipeline::seek``
+  esp_err_t seek_media(size_t byte_offset);
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  void set_stats_log_interval(uint32_t stats_log_interval) { this->stats_log_interval_ = stats_log_interval; }
+
+  /// @brief Gets the media pipeline's per-stage counters and ring buffer fill histograms
+  /// @param stats (output) cumulative counters
+  /// @return false if the media pipeline hasn't been started yet
+  bool get_media_pipeline_stats(AudioPipelineStats &stats);
+  /// @brief Gets the announcement pipeline's per-stage counters and ring buffer fill histograms
+  /// @param stats (output) cumulative counters
+  /// @return false if the announcement pipeline hasn't been started yet
+  bool get_announcement_pipeline_stats(AudioPipelineStats &stats);
+  /// @brief Gets the mixer's counters
+  /// @param stats (output) cumulative counters
+  /// @return false if the mixer hasn't been started yet
+  bool get_mixer_stats(AudioStageStats &stats);
+#endif
+
   void set_sample_rate(uint32_t sample_rate) { this->sample_rate_ = sample_rate; }
 
+  /// @brief Decodes, resamples, mixes, and processes a single channel instead of two, halving the ring buffers and the
+  /// work per frame. Stereo sources are downmixed by the resamplers.
+  void set_mono(bool mono) { this->channels_ = mono ? 1 : 2; }
+
+  /// @brief Carries announcements as a single channel up to the mixer, which upmixes them while mixing. Halves the
+  /// announcement ring buffers, cached announcements, and the copies between them. Stereo announcements are downmixed
+  /// by the resampler. Defaults to true; otherwise each announcement keeps its own channels, up to the mixer's.
+  void set_mono_announcements(bool mono_announcements) { this->mono_announcements_ = mono_announcements; }
+
+  /// @brief Sets where the mixer task runs
+  /// @param priority (UBaseType_t) FreeRTOS task priority
+  /// @param core (BaseType_t) core to pin the task to, or tskNO_AFFINITY
+  void set_mixer_task(UBaseType_t priority, BaseType_t core) {
+    this->mixer_task_priority_ = priority;
+    this->mixer_task_core_ = core;
+  }
+  /// @brief Sets where the media pipeline's tasks run
+  /// @param priority (UBaseType_t) FreeRTOS task priority
+  /// @param core (BaseType_t) core to pin the tasks to, or tskNO_AFFINITY
+  void set_media_pipeline_task(UBaseType_t priority, BaseType_t core) {
+    this->media_pipeline_task_priority_ = priority;
+    this->media_pipeline_task_core_ = core;
+  }
+  /// @brief Sets where the announcement pipeline's task runs
+  /// @param priority (UBaseType_t) FreeRTOS task priority
+  /// @param core (BaseType_t) core to pin the task to, or tskNO_AFFINITY
+  void set_announcement_pipeline_task(UBaseType_t priority, BaseType_t core) {
+    this->announcement_pipeline_task_priority_ = priority;
+    this->announcement_pipeline_task_core_ = core;
+  }
+
+  /// @brief Sets how much media audio the mixer buffers before it starts playing a stream
+  void set_media_start_threshold(uint32_t start_threshold_ms) { this->media_start_threshold_ms_ = start_threshold_ms; }
+  /// @brief Sets how much announcement audio the mixer buffers before it starts playing a stream. Ignored in low
+  /// latency mode.
+  void set_announcement_start_threshold(uint32_t start_threshold_ms) {
+    this->announcement_start_threshold_ms_ = start_threshold_ms;
+  }
+  /// @brief Starts announcements as soon as their first audio is decoded; see ``AudioPipeline::set_low_latency``
+  void set_announcement_low_latency(bool low_latency) { this->announcement_low_latency_ = low_latency; }
+  /// @brief Pauses playing media for the length of each announcement instead of mixing the announcement with ducked
+  /// media. The media pipeline stops reading and decoding while paused, and the media resumes at the exact sample it
+  /// left off once the announcement has played.
+  void set_announcement_pauses_media(bool pauses_media) { this->announcement_pauses_media_ = pauses_media; }
+
+  /// @brief Sets the media pipeline's resampler profile; see ``ResamplerQuality``
+  void set_media_resampler_quality(ResamplerQuality quality) { this->media_resampler_quality_ = quality; }
+  /// @brief Sets the announcement pipeline's resampler profile; see ``ResamplerQuality``. Cached announcements are
+  /// always converted with the HIFI profile.
+  void set_announcement_resampler_quality(ResamplerQuality quality) {
+    this->announcement_resampler_quality_ = quality;
+  }
+  /// @brief Compensates for live media streams drifting from the output's clock; see
+  /// ``AudioPipeline::set_drift_compensation``
+  void set_media_drift_compensation(bool enabled) { this->media_drift_compensation_ = enabled; }
+
+  /// @brief Normalizes the loudness of media; see ``AudioPipeline::set_loudness_normalization``
+  void set_media_target_loudness(float target_lufs) { this->media_target_loudness_ = target_lufs; }
+  /// @brief Normalizes the loudness of announcements, including cached ones; see
+  /// ``AudioPipeline::set_loudness_normalization``
+  void set_announcement_target_loudness(float target_lufs) { this->announcement_target_loudness_ = target_lufs; }
+
+  /// @brief Crossfades from the playing track to a new one instead of cutting it off
+  /// @param duration_ms length of the crossfade; 0 disables crossfading
+  void set_crossfade_duration(uint32_t duration_ms) { this->crossfade_duration_ms_ = duration_ms; }
+
+  /// @brief Keeps a 16 kHz mono copy of the mixer's output, e.g., as an echo canceller's reference
+  /// @param buffer_ms duration of reference audio kept for the consumer
+  void set_reference_buffer_duration(uint32_t buffer_ms) { this->reference_buffer_ms_ = buffer_ms; }
+  /// @brief Tap with the reference audio and its timestamps
+  /// @return pointer to the tap, or nullptr if no reference is kept
+  AudioReferenceTap *get_reference_tap() { return this->reference_tap_.get(); }
+
+  /// @brief Time from the last media stream being requested to its first audio reaching the speaker
+  uint32_t get_media_time_to_first_sample() const { return this->media_time_to_first_sample_ms_; }
+  /// @brief Time from the last announcement being requested to its first audio reaching the speaker
+  uint32_t get_announcement_time_to_first_sample() const { return this->announcement_time_to_first_sample_ms_; }
+
+  /// @brief Adds a biquad to the output equalizer. Bands past MAX_EQUALIZER_BANDS are ignored.
+  /// @param type (EqualizerFilterType) filter shape
+  /// @param frequency (float) corner or center frequency in Hz
+  /// @param gain_db (float) gain in dB; only used by the shelves and peaking filters
+  /// @param q (float) quality factor
+  void add_output_equalizer_band(EqualizerFilterType type, float frequency, float gain_db, float q) {
+    if (this->output_processing_settings_.band_count < MAX_EQUALIZER_BANDS) {
+      this->output_processing_settings_.bands[this->output_processing_settings_.band_count++] = {type, frequency,
+                                                                                                 gain_db, q};
+    }
+  }
+  /// @brief Sets up the output's two band compressor; see ``CompressorSettings``
+  void set_output_compressor(float crossover_frequency, float threshold_db, float ratio, float attack_ms,
+                             float release_ms) {
+    this->output_processing_settings_.use_compressor = true;
+    this->output_processing_settings_.compressor = {crossover_frequency, threshold_db, ratio, attack_ms, release_ms};
+  }
+
+  /// @brief Decodes the media file into memory during setup, so announcing it skips the announcement pipeline
+  /// @param media_file (MediaFile *) pointer to the media file
+  void add_cached_media_file(media_player::MediaFile *media_file) { this->cached_media_files_.push_back(media_file); }
+
   // Percentage to increase or decrease the volume for volume up or volume down commands
   void set_volume_increment(float volume_increment) { this->volume_increment_ = volume_increment; }
 
@@ -85,36 +223,149 @@ class NabuMediaPlayer : public Component, public media_player::MediaPlayer {
   /// @brief Saves the current volume and mute state to the flash for restoration.
   void save_volume_restore_state_();
 
+  /// @brief Ramps the mixer's volume to a software volume, or keeps it for when the mixer starts
+  /// @param volume the volume within the configured limits; 0 mutes
+  void set_software_volume_(float volume);
+
   // Reads commands from media_control_command_queue_. Starts pipelines and mixer if necessary.
   void watch_media_commands_();
 
+  // Hands an enqueued track to the running media pipeline for gapless playback, or starts it normally once the media
+  // pipeline has stopped
+  void watch_enqueued_media_();
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+  // Logs each pipeline's and the mixer's counters; called every stats_log_interval_ milliseconds
+  void log_pipeline_stats_();
+  uint32_t stats_log_interval_;
+
+  // Logs every FreeRTOS task's share of a core since the last call, so the task layout can be checked
+  void log_task_cpu_usage_();
+  // Run time counters from the previous call, keyed by task number
+  std::map<UBaseType_t, uint32_t> task_run_times_;
+  uint32_t total_run_time_{0};
+
+  // Output processing counters from the previous call
+  uint32_t last_output_processing_us_{0};
+  uint32_t last_output_processed_frames_{0};
+#endif
+
   std::unique_ptr<AudioPipeline> media_pipeline_;
   std::unique_ptr<AudioPipeline> announcement_pipeline_;
   std::unique_ptr<AudioMixer> audio_mixer_;
+  uint8_t media_mixer_input_{0};
+  // With crossfading, the media pipelines alternate between two on demand mixer inputs. This one is only reserved while
+  // a crossfade is in progress, for the outgoing track.
+  uint8_t spare_media_mixer_input_{0};
+  uint8_t announcement_mixer_input_{0};
+
+  std::vector<media_player::MediaFile *> cached_media_files_;
+  MediaFileCache media_file_cache_;
 
   speaker::Speaker *speaker_{nullptr};
 
   // Monitors the mixer task
   void watch_mixer_();
 
+  // Records the time to first sample once the mixer reports a requested stream started
+  void watch_first_samples_();
+
+  // Converts a duration to a length of 16 bit audio with a number of channels
+  size_t ms_to_bytes_(uint32_t ms, uint8_t channels) const;
+
+  // The most channels of the announcement pipeline's audio and of cached announcements
+  uint8_t announcement_channels_() const { return this->mono_announcements_ ? 1 : this->channels_; }
+
   // Starts the ``type`` pipeline with a ``url`` or file. Starts the mixer, pipeline, and speaker tasks if necessary.
   // Unpauses if starting media in paused state
   esp_err_t start_pipeline_(AudioPipelineType type, bool url);
 
-  AudioPipelineState media_pipeline_state_{AudioPipelineState::STOPPED};
+  // Moves the playing media pipeline to fading_pipeline_ and reserves the spare media mixer input for the new track.
+  // Any crossfade still in progress is finished first.
+  esp_err_t start_crossfade_();
+
+  // Fades the tracks once the new one starts playing, and finishes the crossfade once the fade is done
+  void watch_crossfade_();
+
+  // Stops the fading pipeline, frees it and its mixer input's ring buffer, and brings the new track to full level.
+  // Tries again on the next loop if the pipeline doesn't stop in time.
+  void finish_crossfade_();
+
+  // Pauses the playing media and its pipeline for an announcement if announcement_pauses_media_ is set
+  void preempt_media_();
+
+  // Resumes the preempted media once the announcement has played
+  void watch_preempted_media_();
+
+    AudioPipelineState media_pipeline_state_{AudioPipelineState::STOPPED};
   AudioPipelineState announcement_pipeline_state_{AudioPipelineState::STOPPED};
 
   optional<std::string> media_url_{};                        // only modified by control function
   optional<std::string> announcement_url_{};                 // only modified by control function
   optional<media_player::MediaFile *> media_file_{};         // only modified by control fucntion
   optional<media_player::MediaFile *> announcement_file_{};  // only modified by control fucntion
+  optional<std::string> enqueued_media_url_{};               // only modified by control function
+  optional<media_player::MediaFile *> enqueued_media_file_{};  // only modified by control function
+
+  // An enqueued track is waiting to be handed to the media pipeline
+  bool enqueue_pending_{false};
 
   QueueHandle_t media_control_command_queue_;
 
   uint32_t sample_rate_;
 
+  uint32_t media_start_threshold_ms_{0};
+  uint32_t announcement_start_threshold_ms_{0};
+  bool announcement_low_latency_{false};
+  bool announcement_pauses_media_{false};
+  ResamplerQuality media_resampler_quality_{ResamplerQuality::BALANCED};
+  ResamplerQuality announcement_resampler_quality_{ResamplerQuality::BALANCED};
+  bool media_drift_compensation_{false};
+  // The media is paused for an announcement; a user pause in the meantime still sets is_paused_
+  bool media_preempted_{false};
+
+  // Target loudness in LUFS; no value if that pipeline's loudness isn't normalized
+  optional<float> media_target_loudness_{};
+  optional<float> announcement_target_loudness_{};
+
+  uint32_t crossfade_duration_ms_{0};  // 0 if crossfading is disabled
+  // The outgoing track during a crossfade; only exists until the crossfade finishes
+  std::unique_ptr<AudioPipeline> fading_pipeline_;
+  enum CrossfadeState : uint8_t {
+    CROSSFADE_WAITING,  // The new track hasn't started playing; the outgoing track plays at full level
+    CROSSFADE_FADING,   // Both tracks are fading until crossfade_end_ms_
+  };
+  CrossfadeState crossfade_state_{CROSSFADE_WAITING};
+  uint32_t crossfade_end_ms_{0};
+
+  uint32_t reference_buffer_ms_{0};  // 0 if no reference is kept
+  std::unique_ptr<AudioReferenceTap> reference_tap_;
+
+  uint32_t media_start_ms_{0};
+  uint32_t announcement_start_ms_{0};
+  bool media_first_sample_pending_{false};
+  bool announcement_first_sample_pending_{false};
+  uint32_t media_time_to_first_sample_ms_{0};
+  uint32_t announcement_time_to_first_sample_ms_{0};
+
+  UBaseType_t mixer_task_priority_;
+  BaseType_t mixer_task_core_;
+  UBaseType_t media_pipeline_task_priority_;
+  BaseType_t media_pipeline_task_core_;
+  UBaseType_t announcement_pipeline_task_priority_;
+  BaseType_t announcement_pipeline_task_core_;
+
+  OutputProcessorSettings output_processing_settings_;
+  bool output_processing_enabled_{true};
+
+  uint8_t channels_{2};         // Channels of the decoded, resampled, and mixed audio
+  bool stereo_output_{true};    // Requested; only matters if channels_ is 1
+  uint8_t output_channels_{2};  // Channels the speaker is currently configured for
+  bool mono_announcements_{true};
+
   bool is_paused_{false};
   bool is_muted_{false};
+  int16_t software_volume_{INT16_MAX};  // Q15 fixed point; the mixer's volume if there is no audio_dac
 
   // The amount to change the volume on volume up/down commands
   float volume_increment_;
@@ -142,6 +393,17 @@ template<typename... Ts> class DuckingSetAction : public Action<Ts...>, public P
   }
 };
 
+template<typename... Ts>
+class OutputProcessingSetAction : public Action<Ts...>, public Parented<NabuMediaPlayer> {
+  TEMPLATABLE_VALUE(bool, enabled)
+  void play(Ts... x) override { this->parent_->set_output_processing(this->enabled_.value(x...)); }
+};
+
+template<typename... Ts> class StereoOutputSetAction : public Action<Ts...>, public Parented<NabuMediaPlayer> {
+  TEMPLATABLE_VALUE(bool, enabled)
+  void play(Ts... x) override { this->parent_->set_stereo_output(this->enabled_.value(x...)); }
+};
+
 template<typename... Ts> class PlayLocalMediaAction : public Action<Ts...>, public Parented<NabuMediaPlayer> {
   TEMPLATABLE_VALUE(media_player::MediaFile *, media_file)
   TEMPLATABLE_VALUE(bool, announcement)
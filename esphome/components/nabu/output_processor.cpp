@@ -0,0 +1,221 @@
+#ifdef USE_ESP_IDF
+
+#include "output_processor.h"
+
+#include <dsp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+static const float PI = 3.14159265358979f;
+static const float BUTTERWORTH_Q = 0.70710678f;
+
+// Computes biquad coefficients with the formulas from Robert Bristow-Johnson's Audio EQ Cookbook
+static void compute_coefficients(EqualizerFilterType type, float frequency, float gain_db, float q,
+                                 uint32_t sample_rate, float *coefficients) {
+  float omega = 2.0f * PI * frequency / static_cast<float>(sample_rate);
+  float cos_omega = std::cos(omega);
+  float alpha = std::sin(omega) / (2.0f * q);
+  float amplitude = std::pow(10.0f, gain_db / 40.0f);
+  float shelf_alpha = 2.0f * std::sqrt(amplitude) * alpha;
+
+  float b0, b1, b2, a0, a1, a2;
+  switch (type) {
+    case EqualizerFilterType::LOW_SHELF:
+      b0 = amplitude * ((amplitude + 1.0f) - (amplitude - 1.0f) * cos_omega + shelf_alpha);
+      b1 = 2.0f * amplitude * ((amplitude - 1.0f) - (amplitude + 1.0f) * cos_omega);
+      b2 = amplitude * ((amplitude + 1.0f) - (amplitude - 1.0f) * cos_omega - shelf_alpha);
+      a0 = (amplitude + 1.0f) + (amplitude - 1.0f) * cos_omega + shelf_alpha;
+      a1 = -2.0f * ((amplitude - 1.0f) + (amplitude + 1.0f) * cos_omega);
+      a2 = (amplitude + 1.0f) + (amplitude - 1.0f) * cos_omega - shelf_alpha;
+      break;
+    case EqualizerFilterType::HIGH_SHELF:
+      b0 = amplitude * ((amplitude + 1.0f) + (amplitude - 1.0f) * cos_omega + shelf_alpha);
+      b1 = -2.0f * amplitude * ((amplitude - 1.0f) + (amplitude + 1.0f) * cos_omega);
+      b2 = amplitude * ((amplitude + 1.0f) + (amplitude - 1.0f) * cos_omega - shelf_alpha);
+      a0 = (amplitude + 1.0f) - (amplitude - 1.0f) * cos_omega + shelf_alpha;
+      a1 = 2.0f * ((amplitude - 1.0f) - (amplitude + 1.0f) * cos_omega);
+      a2 = (amplitude + 1.0f) - (amplitude - 1.0f) * cos_omega - shelf_alpha;
+      break;
+    case EqualizerFilterType::PEAKING:
+      b0 = 1.0f + alpha * amplitude;
+      b1 = -2.0f * cos_omega;
+      b2 = 1.0f - alpha * amplitude;
+      a0 = 1.0f + alpha / amplitude;
+      a1 = -2.0f * cos_omega;
+      a2 = 1.0f - alpha / amplitude;
+      break;
+    case EqualizerFilterType::LOW_PASS:
+      b0 = (1.0f - cos_omega) / 2.0f;
+      b1 = 1.0f - cos_omega;
+      b2 = (1.0f - cos_omega) / 2.0f;
+      a0 = 1.0f + alpha;
+      a1 = -2.0f * cos_omega;
+      a2 = 1.0f - alpha;
+      break;
+    case EqualizerFilterType::HIGH_PASS:
+    default:
+      b0 = (1.0f + cos_omega) / 2.0f;
+      b1 = -(1.0f + cos_omega);
+      b2 = (1.0f + cos_omega) / 2.0f;
+      a0 = 1.0f + alpha;
+      a1 = -2.0f * cos_omega;
+      a2 = 1.0f - alpha;
+      break;
+  }
+
+  coefficients[0] = b0 / a0;
+  coefficients[1] = b1 / a0;
+  coefficients[2] = b2 / a0;
+  coefficients[3] = a1 / a0;
+  coefficients[4] = a2 / a0;
+}
+
+static inline int16_t to_sample(float sample) {
+  int32_t rounded = static_cast<int32_t>(std::lrint(sample));
+  return static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(rounded, INT16_MIN), INT16_MAX));
+}
+
+// Fraction of the way an envelope moves towards its target per sub-block, for a time constant
+static float envelope_coefficient(float time_ms, uint32_t sample_rate) {
+  float time_frames = std::max(1.0f, time_ms * static_cast<float>(sample_rate) / 1000.0f);
+  return 1.0f - std::exp(-static_cast<float>(COMPRESSOR_SUB_BLOCK_FRAMES) / time_frames);
+}
+
+void OutputProcessor::configure(const OutputProcessorSettings &settings, uint32_t sample_rate, uint8_t channels) {
+  this->channels_ = channels;
+  this->band_count_ = std::min(settings.band_count, MAX_EQUALIZER_BANDS);
+  for (size_t i = 0; i < this->band_count_; ++i) {
+    const EqualizerBand &band = settings.bands[i];
+    compute_coefficients(band.type, band.frequency, band.gain_db, band.q, sample_rate, this->coefficients_[i]);
+  }
+
+  this->use_compressor_ = settings.use_compressor;
+  if (this->use_compressor_) {
+    const CompressorSettings &compressor = settings.compressor;
+    compute_coefficients(EqualizerFilterType::LOW_PASS, compressor.crossover_frequency, 0.0f, BUTTERWORTH_Q,
+                         sample_rate, this->crossover_coefficients_);
+    this->threshold_ = static_cast<float>(INT16_MAX) * std::pow(10.0f, compressor.threshold_db / 20.0f);
+    this->slope_ = 1.0f / std::max(compressor.ratio, 1.0f) - 1.0f;
+    this->attack_coefficient_ = envelope_coefficient(compressor.attack_ms, sample_rate);
+    this->release_coefficient_ = envelope_coefficient(compressor.release_ms, sample_rate);
+  }
+
+  this->reset();
+}
+
+void OutputProcessor::reset() {
+  std::memset(this->states_, 0, sizeof(this->states_));
+  std::memset(this->crossover_states_, 0, sizeof(this->crossover_states_));
+  this->envelopes_[0] = this->envelopes_[1] = 0.0f;
+  this->gains_[0] = this->gains_[1] = 1.0f;
+}
+
+void OutputProcessor::process(int16_t *samples, size_t frames) {
+  while (frames > 0) {
+    size_t chunk_frames = std::min(frames, OUTPUT_PROCESSOR_CHUNK_FRAMES);
+
+    if (this->channels_ == 1) {
+      for (size_t i = 0; i < chunk_frames; ++i) {
+        this->left_[i] = static_cast<float>(samples[i]);
+      }
+    } else {
+      for (size_t i = 0; i < chunk_frames; ++i) {
+        this->left_[i] = static_cast<float>(samples[2 * i]);
+        this->right_[i] = static_cast<float>(samples[2 * i + 1]);
+      }
+    }
+
+    this->process_chunk_(chunk_frames);
+
+    if (this->channels_ == 1) {
+      for (size_t i = 0; i < chunk_frames; ++i) {
+        samples[i] = to_sample(this->left_[i]);
+      }
+    } else {
+      for (size_t i = 0; i < chunk_frames; ++i) {
+        samples[2 * i] = to_sample(this->left_[i]);
+        samples[2 * i + 1] = to_sample(this->right_[i]);
+      }
+    }
+
+    samples += this->channels_ * chunk_frames;
+    frames -= chunk_frames;
+  }
+}
+
+void OutputProcessor::process_chunk_(size_t frames) {
+  for (size_t i = 0; i < this->band_count_; ++i) {
+    dsps_biquad_f32(this->left_, this->left_, frames, this->coefficients_[i], this->states_[i][0]);
+    if (this->channels_ == 2) {
+      dsps_biquad_f32(this->right_, this->right_, frames, this->coefficients_[i], this->states_[i][1]);
+    }
+  }
+
+  if (this->use_compressor_) {
+    this->compress_(frames);
+  }
+}
+
+void OutputProcessor::compress_(size_t frames) {
+  const bool stereo = (this->channels_ == 2);
+
+  dsps_biquad_f32(this->left_, this->bass_left_, frames, this->crossover_coefficients_, this->crossover_states_[0]);
+  if (stereo) {
+    dsps_biquad_f32(this->right_, this->bass_right_, frames, this->crossover_coefficients_,
+                    this->crossover_states_[1]);
+  }
+
+  for (size_t start = 0; start < frames; start += COMPRESSOR_SUB_BLOCK_FRAMES) {
+    size_t end = std::min(start + COMPRESSOR_SUB_BLOCK_FRAMES, frames);
+
+    // The rest of the audio is whatever the bass band doesn't contain, so the bands always add back up to the input
+    float peaks[2] = {0.0f, 0.0f};
+    for (size_t i = start; i < end; ++i) {
+      this->left_[i] -= this->bass_left_[i];
+      peaks[0] = std::max(peaks[0], std::fabs(this->bass_left_[i]));
+      peaks[1] = std::max(peaks[1], std::fabs(this->left_[i]));
+    }
+    if (stereo) {
+      for (size_t i = start; i < end; ++i) {
+        this->right_[i] -= this->bass_right_[i];
+        peaks[0] = std::max(peaks[0], std::fabs(this->bass_right_[i]));
+        peaks[1] = std::max(peaks[1], std::fabs(this->right_[i]));
+      }
+    }
+
+    float steps[2];
+    for (size_t band = 0; band < 2; ++band) {
+      float coefficient =
+          (peaks[band] > this->envelopes_[band]) ? this->attack_coefficient_ : this->release_coefficient_;
+      this->envelopes_[band] += coefficient * (peaks[band] - this->envelopes_[band]);
+      float target = this->compressor_gain_(this->envelopes_[band]);
+      steps[band] = (target - this->gains_[band]) / static_cast<float>(end - start);
+    }
+
+    for (size_t i = start; i < end; ++i) {
+      this->gains_[0] += steps[0];
+      this->gains_[1] += steps[1];
+      this->left_[i] = this->bass_left_[i] * this->gains_[0] + this->left_[i] * this->gains_[1];
+      if (stereo) {
+        this->right_[i] = this->bass_right_[i] * this->gains_[0] + this->right_[i] * this->gains_[1];
+      }
+    }
+  }
+}
+
+float OutputProcessor::compressor_gain_(float envelope) const {
+  if (envelope <= this->threshold_) {
+    return 1.0f;
+  }
+  return std::pow(envelope / this->threshold_, this->slope_);
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+static const size_t MAX_EQUALIZER_BANDS = 6;
+static const size_t OUTPUT_PROCESSOR_CHUNK_FRAMES = 128;
+static const size_t COMPRESSOR_SUB_BLOCK_FRAMES = 16;
+
+// Processing budget with every band and the compressor in use: 1 ms per 10 ms block at 48 kHz, or 10% of a core
+static const uint32_t OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE = 48000;
+static const size_t OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES = OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE / 100;
+static const uint32_t OUTPUT_PROCESSOR_BUDGET_BLOCK_US = 1000;
+// The same budget as a share of real time, in tenths of a percent
+static const uint32_t OUTPUT_PROCESSOR_BUDGET_PERMILLE =
+    OUTPUT_PROCESSOR_BUDGET_BLOCK_US * 1000 / (OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES * 1000000 /
+                                                OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE);
+
+enum class EqualizerFilterType : uint8_t {
+  LOW_SHELF,
+  HIGH_SHELF,
+  PEAKING,
+  LOW_PASS,
+  HIGH_PASS,
+};
+
+struct EqualizerBand {
+  EqualizerFilterType type;
+  float frequency;  // in Hz
+  float gain_db;    // Only used by the shelves and peaking filters
+  float q;
+};
+
+// A two band compressor: the audio is split at the crossover frequency, and each band is compressed on its own
+struct CompressorSettings {
+  float crossover_frequency;  // in Hz
+  float threshold_db;         // in dBFS
+  float ratio;
+  float attack_ms;
+  float release_ms;
+};
+
+struct OutputProcessorSettings {
+  EqualizerBand bands[MAX_EQUALIZER_BANDS];
+  size_t band_count{0};
+  bool use_compressor{false};
+  CompressorSettings compressor;
+};
+
+// Equalizes and compresses the mono or stereo output of the mixer, e.g., so a small speaker doesn't distort on bass
+// heavy audio
+//  - The equalizer is a cascade of biquads. Each channel runs through them with ``dsps_biquad_f32``, which esp-dsp
+//    optimizes for the ESP32 and ESP32-S3.
+//  - The compressor splits the audio into a bass band and the rest with a low-pass biquad and its complement, so the
+//    bands always add back up to the input. Each band has its own envelope, so loud bass is turned down without
+//    pumping the voice and treble, and vice versa.
+//    - Each band's gain is found once per COMPRESSOR_SUB_BLOCK_FRAMES frames and ramps linearly in between, so the
+//      only transcendental math is one ``powf`` per band per sub-block
+//  - Samples are processed in chunks of OUTPUT_PROCESSOR_CHUNK_FRAMES frames, converted to float in fixed size
+//    scratch buffers, so any block size can be processed in place without allocating
+//  - The cost per frame is fixed. It must stay within OUTPUT_PROCESSOR_BUDGET_BLOCK_US per block at 48 kHz, which
+//    tests/nabu/bench_output_processor.cpp checks on the host. On a device, the media player's stats log reports the
+//    measured share of real time and warns when it is over OUTPUT_PROCESSOR_BUDGET_PERMILLE.
+class OutputProcessor {
+ public:
+  /// @brief Computes the filter coefficients and clears all state
+  /// @param settings the equalizer bands and compressor to use
+  /// @param sample_rate sample rate of the audio
+  /// @param channels samples per frame; 1 or 2. Mono audio only runs through the left channel's filters.
+  void configure(const OutputProcessorSettings &settings, uint32_t sample_rate, uint8_t channels);
+
+  /// @brief Clears the filter and envelope state, e.g., when processing resumes after being bypassed
+  void reset();
+
+  /// @brief Whether there is anything to process
+  bool is_active() const { return (this->band_count_ > 0) || this->use_compressor_; }
+
+  /// @brief Processes samples in place
+  /// @param samples PCM int16 samples with the configured number of channels
+  /// @param frames number of frames
+  void process(int16_t *samples, size_t frames);
+
+ protected:
+  /// @brief Processes up to OUTPUT_PROCESSOR_CHUNK_FRAMES frames that are already in the scratch buffers
+  void process_chunk_(size_t frames);
+
+  /// @brief Compresses the scratch buffers in place
+  void compress_(size_t frames);
+
+  /// @brief Gain a band needs for its envelope
+  float compressor_gain_(float envelope) const;
+
+  // Coefficients in esp-dsp's order: b0, b1, b2, a1, a2
+  float coefficients_[MAX_EQUALIZER_BANDS][5];
+  // Direct form II state of each band for the left and right channels
+  float states_[MAX_EQUALIZER_BANDS][2][2];
+  size_t band_count_{0};
+  uint8_t channels_{2};
+
+  bool use_compressor_{false};
+  float crossover_coefficients_[5];
+  float crossover_states_[2][2];
+  float threshold_{0.0f};            // in sample units
+  float slope_{0.0f};                // 1 / ratio - 1
+  float attack_coefficient_{0.0f};   // Fraction of the way the envelope rises per sub-block
+  float release_coefficient_{0.0f};  // Fraction of the way the envelope falls per sub-block
+  // Bass band, then the rest
+  float envelopes_[2];
+  float gains_[2];
+
+  float left_[OUTPUT_PROCESSOR_CHUNK_FRAMES];
+  float right_[OUTPUT_PROCESSOR_CHUNK_FRAMES];
+  float bass_left_[OUTPUT_PROCESSOR_CHUNK_FRAMES];
+  float bass_right_[OUTPUT_PROCESSOR_CHUNK_FRAMES];
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
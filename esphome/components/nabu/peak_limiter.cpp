@@ -0,0 +1,143 @@
+#ifdef USE_ESP_IDF
+
+#include "peak_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace esphome {
+namespace nabu {
+
+// Mixes never go past full scale
+static const int32_t CEILING = INT16_MAX;
+
+void PeakLimiter::configure(uint32_t sample_rate, uint32_t lookahead_ms, uint32_t release_ms, uint8_t channels) {
+  this->channels_ = channels;
+
+  // The newest sub-block in the delay line starts being output (sub_blocks_ - 1) sub-blocks from now, which is how
+  // far ahead the limiter looks
+  size_t lookahead_frames = static_cast<size_t>(static_cast<uint64_t>(sample_rate) * lookahead_ms / 1000);
+  size_t lookahead_sub_blocks = (lookahead_frames + LIMITER_SUB_BLOCK_FRAMES - 1) / LIMITER_SUB_BLOCK_FRAMES;
+  this->sub_blocks_ = std::min(std::max<size_t>(lookahead_sub_blocks + 1, 2), LIMITER_MAX_SUB_BLOCKS);
+  this->delay_frames_ = this->sub_blocks_ * LIMITER_SUB_BLOCK_FRAMES;
+
+  for (size_t i = 1; i < this->sub_blocks_; ++i) {
+    this->deadline_reciprocals_[i] =
+        static_cast<int32_t>((static_cast<int64_t>(1) << 31) / (i * LIMITER_SUB_BLOCK_FRAMES));
+  }
+
+  float release_frames = std::max(1.0f, static_cast<float>(sample_rate) * static_cast<float>(release_ms) / 1000.0f);
+  float release_fraction = 1.0f - std::exp(-static_cast<float>(LIMITER_SUB_BLOCK_FRAMES) / release_frames);
+  this->release_coefficient_ = static_cast<int32_t>(release_fraction * 32767.0f);
+
+  this->gain_ = INT32_MAX;
+  this->gain_slope_ = 0;
+  this->reset_delay_line_();
+}
+
+size_t PeakLimiter::drain(int16_t *output) {
+  size_t frames = this->delayed_frames_;
+  if (frames == 0) {
+    return 0;
+  }
+
+  // The last sub-block may be incomplete, so the gain it needs hasn't been found yet. Jump straight to the lowest gain
+  // any remaining frame needs; that only happens if the very end of the mix clips.
+  int32_t lowest_needed_gain = this->needed_gain_();
+  for (size_t i = 0; i < this->sub_blocks_; ++i) {
+    lowest_needed_gain = std::min(lowest_needed_gain, this->needed_gains_[i]);
+  }
+  this->gain_ = std::min(this->gain_, lowest_needed_gain);
+  this->gain_slope_ = 0;
+
+  size_t index = (this->delay_index_ + this->delay_frames_ - frames) % this->delay_frames_;
+  for (size_t i = 0; i < frames; ++i) {
+    const int32_t *slot = &this->delay_[index * 4];
+    for (size_t channel = 0; channel < this->channels_; ++channel) {
+      output[this->channels_ * i + channel] = this->limit_sample_(slot[channel], slot[channel + 2]);
+    }
+    if (++index == this->delay_frames_) {
+      index = 0;
+    }
+  }
+
+  this->reset_delay_line_();
+
+  return frames;
+}
+
+void PeakLimiter::end_sub_block_() {
+  // The oldest sub-block was fully output during the last sub-block, so the new one takes its place
+  this->needed_gains_[this->needed_index_] = this->needed_gain_();
+  if (++this->needed_index_ == this->sub_blocks_) {
+    this->needed_index_ = 0;
+  }
+
+  this->protected_peak_ = 0;
+  this->background_peak_ = 0;
+  this->mix_peak_ = 0;
+  this->sub_block_frames_ = 0;
+
+  // The oldest sub-block starts being output now. The ramps towards it have already reached its gain, except for
+  // rounding.
+  int32_t oldest_needed_gain = this->needed_gains_[this->needed_index_];
+  this->gain_ = std::max(std::min(this->gain_, oldest_needed_gain), static_cast<int32_t>(0));
+
+  // Ramp towards whichever later sub-block needs the steepest drop to reach its gain in time
+  int32_t lowest_needed_gain = oldest_needed_gain;
+  int32_t attack_slope = 0;
+  size_t index = this->needed_index_;
+  for (size_t i = 1; i < this->sub_blocks_; ++i) {
+    if (++index == this->sub_blocks_) {
+      index = 0;
+    }
+    int32_t needed_gain = this->needed_gains_[index];
+    lowest_needed_gain = std::min(lowest_needed_gain, needed_gain);
+    if (needed_gain < this->gain_) {
+      int32_t slope = static_cast<int32_t>(
+          (static_cast<int64_t>(needed_gain - this->gain_) * this->deadline_reciprocals_[i]) >> 31);
+      attack_slope = std::min(attack_slope, slope);
+    }
+  }
+
+  if (attack_slope < 0) {
+    this->gain_slope_ = attack_slope;
+  } else {
+    // Recover part of the way to the lowest gain still needed, spread over the next sub-block
+    int64_t recovery = (static_cast<int64_t>(lowest_needed_gain - this->gain_) * this->release_coefficient_) >> 15;
+    this->gain_slope_ = static_cast<int32_t>(recovery / static_cast<int64_t>(LIMITER_SUB_BLOCK_FRAMES));
+  }
+}
+
+int32_t PeakLimiter::needed_gain_() const {
+  if (this->mix_peak_ <= CEILING) {
+    return INT32_MAX;
+  }
+
+  int32_t headroom = CEILING - this->protected_peak_;
+  if ((headroom <= 0) || (this->background_peak_ == 0)) {
+    // The protected bus clips by itself; silence the background and let the output saturate
+    return 0;
+  }
+  if (headroom >= this->background_peak_) {
+    return INT32_MAX;
+  }
+
+  return static_cast<int32_t>((static_cast<int64_t>(headroom) << 31) / this->background_peak_);
+}
+
+void PeakLimiter::reset_delay_line_() {
+  this->delayed_frames_ = 0;
+  this->delay_index_ = 0;
+  this->protected_peak_ = 0;
+  this->background_peak_ = 0;
+  this->mix_peak_ = 0;
+  this->sub_block_frames_ = 0;
+  std::fill_n(this->needed_gains_, LIMITER_MAX_SUB_BLOCKS, INT32_MAX);
+  this->needed_index_ = 0;
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
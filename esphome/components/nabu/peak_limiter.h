@@ -0,0 +1,140 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+static const size_t LIMITER_SUB_BLOCK_FRAMES = 16;
+static const size_t LIMITER_MAX_SUB_BLOCKS = 16;
+
+// Streaming look-ahead peak limiter for a mono or stereo mix that is split into two buses
+//  - The protected bus passes through unchanged; the limiter's gain only applies to the background bus. With nothing
+//    on the protected bus, it is an ordinary limiter.
+//  - The audio is delayed by a few milliseconds. The gain needed by each sub-block of LIMITER_SUB_BLOCK_FRAMES frames
+//    is found when the sub-block enters the delay line, and the gain ramps linearly so it is reached before the
+//    sub-block leaves it. Afterwards, the gain recovers exponentially over the release time.
+//    - The needed gain is conservative: it assumes the sub-block's protected and background peaks line up
+//    - There is one division per sub-block and a fixed amount of work per frame, so the cost per frame is bounded
+//  - The input is 32 bit sums of 16 bit samples, so mixes of several streams can be limited before they clip
+//  - The delay line fills before the first frame is output, and ``drain`` empties it. Between the two, every frame in
+//    produces one frame out, so switching between limited and unlimited audio doesn't skip or repeat any frames.
+class PeakLimiter {
+ public:
+  /// @brief Sets the timing and clears all state
+  /// @param sample_rate sample rate of the audio
+  /// @param lookahead_ms how far ahead the limiter looks; limited to LIMITER_MAX_SUB_BLOCKS - 1 sub-blocks
+  /// @param release_ms time constant for the gain to recover once no more limiting is needed
+  /// @param channels samples per frame; 1 or 2
+  void configure(uint32_t sample_rate, uint32_t lookahead_ms, uint32_t release_ms, uint8_t channels);
+
+  /// @brief Number of frames waiting in the delay line
+  size_t get_delayed_frames() const { return this->delayed_frames_; }
+
+  /// @brief Adds one frame to the delay line and outputs the frame leaving it, if the delay line is full
+  /// @param protected_frame the frame's samples that are never scaled
+  /// @param background_frame the frame's samples that the limiter's gain applies to
+  /// @param output (output) samples of the frame leaving the delay line
+  /// @return true if a frame was output
+  inline bool process_frame(const int32_t *protected_frame, const int32_t *background_frame, int16_t *output);
+
+  /// @brief Outputs the frames still in the delay line. Afterwards, the delay line fills again before any output.
+  /// @param output buffer for the frames; must fit LIMITER_MAX_SUB_BLOCKS * LIMITER_SUB_BLOCK_FRAMES frames
+  /// @return number of frames output
+  size_t drain(int16_t *output);
+
+ protected:
+  /// @brief Finds the gain the sub-block that just entered the delay line needs and sets the gain's slope for the
+  /// next sub-block
+  void end_sub_block_();
+
+  /// @brief Mixes a protected and a background sample with the current gain. Only rounding in the gain ramp can leave
+  /// the result past the ceiling, so it is saturated.
+  inline int16_t limit_sample_(int32_t protected_sample, int32_t background_sample) const {
+    // Rounded, so a gain of INT32_MAX passes the background through unchanged
+    int32_t sample = protected_sample + static_cast<int32_t>(
+                                            (static_cast<int64_t>(background_sample) * this->gain_ + (1 << 30)) >> 31);
+    return static_cast<int16_t>(sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample));
+  }
+
+  /// @brief Empties the delay line and forgets the sub-blocks in it
+  void reset_delay_line_();
+
+  /// @brief Gain the sub-block entering the delay line needs so its mix doesn't exceed the ceiling
+  /// @return Q31 fixed point gain
+  int32_t needed_gain_() const;
+
+  // Delay line of interleaved protected left, protected right, background left, and background right samples. Mono
+  // frames only use the left slots.
+  int32_t delay_[LIMITER_MAX_SUB_BLOCKS * LIMITER_SUB_BLOCK_FRAMES * 4];
+  size_t delay_frames_{0};    // Length of the delay line
+  size_t delayed_frames_{0};  // Frames currently in the delay line
+  size_t delay_index_{0};
+  uint8_t channels_{2};
+
+  // Peaks of the sub-block currently entering the delay line
+  int32_t protected_peak_{0};
+  int32_t background_peak_{0};
+  int32_t mix_peak_{0};
+  size_t sub_block_frames_{0};
+
+  // Needed Q31 gains of the sub-blocks in the delay line, oldest first starting at needed_index_
+  int32_t needed_gains_[LIMITER_MAX_SUB_BLOCKS];
+  size_t needed_index_{0};
+  size_t sub_blocks_{1};
+
+  // Q31 reciprocal of the number of frames until each sub-block in the delay line starts being output
+  int32_t deadline_reciprocals_[LIMITER_MAX_SUB_BLOCKS];
+
+  int32_t gain_{INT32_MAX};         // Q31
+  int32_t gain_slope_{0};           // Q31 per frame
+  int32_t release_coefficient_{0};  // Q15 fraction of the remaining gain recovered per sub-block
+};
+
+bool PeakLimiter::process_frame(const int32_t *protected_frame, const int32_t *background_frame, int16_t *output) {
+  int32_t *slot = &this->delay_[this->delay_index_ * 4];
+
+  bool output_frame = (this->delayed_frames_ == this->delay_frames_);
+  if (output_frame) {
+    for (size_t channel = 0; channel < this->channels_; ++channel) {
+      output[channel] = this->limit_sample_(slot[channel], slot[channel + 2]);
+    }
+  } else {
+    ++this->delayed_frames_;
+  }
+
+  for (size_t channel = 0; channel < this->channels_; ++channel) {
+    slot[channel] = protected_frame[channel];
+    slot[channel + 2] = background_frame[channel];
+
+    int32_t protected_magnitude = protected_frame[channel] < 0 ? -protected_frame[channel] : protected_frame[channel];
+    int32_t background_magnitude =
+        background_frame[channel] < 0 ? -background_frame[channel] : background_frame[channel];
+    int32_t mix = protected_frame[channel] + background_frame[channel];
+    int32_t mix_magnitude = mix < 0 ? -mix : mix;
+    this->protected_peak_ = protected_magnitude > this->protected_peak_ ? protected_magnitude : this->protected_peak_;
+    this->background_peak_ =
+        background_magnitude > this->background_peak_ ? background_magnitude : this->background_peak_;
+    this->mix_peak_ = mix_magnitude > this->mix_peak_ ? mix_magnitude : this->mix_peak_;
+  }
+
+  if (++this->delay_index_ == this->delay_frames_) {
+    this->delay_index_ = 0;
+  }
+
+  this->gain_ += this->gain_slope_;
+
+  if (++this->sub_block_frames_ == LIMITER_SUB_BLOCK_FRAMES) {
+    this->end_sub_block_();
+  }
+
+  return output_frame;
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,220 @@
+#ifdef USE_ESP_IDF
+
+#include "polyphase_resampler.h"
+
+#include "esphome/core/helpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace nabu {
+
+static const float PI = 3.14159265358979f;
+// Each phase's coefficients sum to this, so DC passes at unity
+static const int32_t UNITY_Q15 = 1 << 15;
+
+static uint32_t greatest_common_divisor(uint32_t a, uint32_t b) {
+  while (b != 0) {
+    uint32_t remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+  return a;
+}
+
+PolyphaseResampler::~PolyphaseResampler() { this->free_coefficients_(); }
+
+void PolyphaseResampler::free_coefficients_() {
+  if (this->coefficients_ != nullptr) {
+    ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
+    allocator.deallocate(this->coefficients_, this->coefficient_count_);
+    this->coefficients_ = nullptr;
+    this->coefficient_count_ = 0;
+  }
+}
+
+esp_err_t PolyphaseResampler::start(uint32_t input_sample_rate, uint32_t output_sample_rate, uint8_t input_channels,
+                                    uint8_t output_channels, size_t taps_per_phase, float cutoff_fraction) {
+  if ((input_sample_rate == 0) || (output_sample_rate == 0) || (input_sample_rate == output_sample_rate) ||
+      (input_channels == 0) || (input_channels > 2) || (output_channels == 0) || (output_channels > 2)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  uint32_t divisor = greatest_common_divisor(input_sample_rate, output_sample_rate);
+  uint32_t interpolation = output_sample_rate / divisor;
+  uint32_t decimation = input_sample_rate / divisor;
+
+  // Decimating narrows the passband relative to the upsampled rate, so the filter needs more taps for the same
+  // transition band
+  taps_per_phase *= (decimation + interpolation - 1) / interpolation;
+  if ((taps_per_phase == 0) || (taps_per_phase > POLYPHASE_MAX_TAPS_PER_PHASE) ||
+      (static_cast<uint64_t>(interpolation) * taps_per_phase > POLYPHASE_MAX_COEFFICIENTS)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  size_t coefficient_count = interpolation * taps_per_phase;
+  if (coefficient_count != this->coefficient_count_) {
+    this->free_coefficients_();
+    ExternalRAMAllocator<int16_t> allocator(ExternalRAMAllocator<int16_t>::ALLOW_FAILURE);
+    this->coefficients_ = allocator.allocate(coefficient_count);
+    if (this->coefficients_ == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+    this->coefficient_count_ = coefficient_count;
+  }
+
+  this->interpolation_ = interpolation;
+  this->decimation_ = decimation;
+  this->taps_per_phase_ = taps_per_phase;
+  this->input_channels_ = input_channels;
+  this->channels_ = std::min(input_channels, output_channels);
+  this->output_channels_ = output_channels;
+
+  // Cycles per upsampled sample; the upsampled rate is input_sample_rate * L = output_sample_rate * M
+  this->compute_filter_(cutoff_fraction * 0.5f / static_cast<float>(std::max(interpolation, decimation)));
+
+  std::memset(this->history_, 0, sizeof(this->history_));
+  this->history_index_ = 0;
+  // The first input frame is needed before the first output frame
+  this->phase_ = interpolation;
+  // The linear phase filter delays the upsampled signal by (taps - 1) / 2 samples; skip the output frames in it
+  this->skip_frames_ = (coefficient_count - 1 + decimation) / (2 * decimation);
+
+  return ESP_OK;
+}
+
+void PolyphaseResampler::compute_filter_(float cutoff) {
+  const size_t taps = this->coefficient_count_;
+  const float center = static_cast<float>(taps - 1) / 2.0f;
+
+  for (uint32_t phase = 0; phase < this->interpolation_; ++phase) {
+    int16_t *row = this->coefficients_ + phase * this->taps_per_phase_;
+
+    // The samples of the prototype filter that line up with the input for this phase, scaled so the phase passes DC
+    // at unity. The zeros the upsampling inserts would otherwise cost a factor of L.
+    float values[POLYPHASE_MAX_TAPS_PER_PHASE];
+    float sum = 0.0f;
+    for (size_t m = 0; m < this->taps_per_phase_; ++m) {
+      size_t k = phase + m * this->interpolation_;
+      float x = static_cast<float>(k) - center;
+      float sinc = (x == 0.0f) ? 2.0f * cutoff : std::sin(2.0f * PI * cutoff * x) / (PI * x);
+      float w = 2.0f * PI * static_cast<float>(k) / static_cast<float>(taps - 1);
+      float window = 0.42f - 0.5f * std::cos(w) + 0.08f * std::cos(2.0f * w);
+      values[m] = sinc * window;
+      sum += values[m];
+    }
+
+    // Reversed, so the oldest sample in the delay line meets the last tap
+    int32_t quantized_sum = 0;
+    size_t largest = 0;
+    int32_t largest_magnitude = -1;
+    for (size_t m = 0; m < this->taps_per_phase_; ++m) {
+      int32_t quantized = static_cast<int32_t>(std::lrint(values[m] / sum * static_cast<float>(UNITY_Q15)));
+      quantized = std::min<int32_t>(std::max<int32_t>(quantized, INT16_MIN), INT16_MAX);
+      size_t index = this->taps_per_phase_ - 1 - m;
+      row[index] = static_cast<int16_t>(quantized);
+      quantized_sum += quantized;
+      if (std::abs(quantized) > largest_magnitude) {
+        largest = index;
+        largest_magnitude = std::abs(quantized);
+      }
+    }
+
+    // The rounding error is a few LSBs; the largest tap absorbs it with the least relative change
+    int32_t corrected = row[largest] + (UNITY_Q15 - quantized_sum);
+    row[largest] = static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(corrected, INT16_MIN), INT16_MAX));
+  }
+}
+
+inline void PolyphaseResampler::push_frame_(const int16_t *frame) {
+  if (this->input_channels_ > this->channels_) {
+    int16_t sample = static_cast<int16_t>((static_cast<int32_t>(frame[0]) + frame[1]) >> 1);
+    this->history_[0][this->history_index_] = sample;
+    this->history_[0][this->history_index_ + this->taps_per_phase_] = sample;
+  } else {
+    for (size_t channel = 0; channel < this->channels_; ++channel) {
+      this->history_[channel][this->history_index_] = frame[channel];
+      this->history_[channel][this->history_index_ + this->taps_per_phase_] = frame[channel];
+    }
+  }
+
+  if (++this->history_index_ == this->taps_per_phase_) {
+    this->history_index_ = 0;
+  }
+}
+
+inline void PolyphaseResampler::output_frame_(uint32_t phase, int16_t *frame) const {
+  const int16_t *row = this->coefficients_ + phase * this->taps_per_phase_;
+
+  for (size_t channel = 0; channel < this->channels_; ++channel) {
+    // The oldest sample is at history_index_, so the newest taps_per_phase_ samples follow it
+    const int16_t *window = this->history_[channel] + this->history_index_;
+    int64_t sum = UNITY_Q15 / 2;  // Rounds to nearest
+    for (size_t t = 0; t < this->taps_per_phase_; ++t) {
+      sum += static_cast<int32_t>(row[t]) * window[t];
+    }
+    int64_t sample = sum >> 15;
+    frame[channel] = static_cast<int16_t>(sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample));
+  }
+
+  if (this->output_channels_ > this->channels_) {
+    frame[1] = frame[0];
+  }
+}
+
+size_t PolyphaseResampler::process(const int16_t *input, size_t input_frames, int16_t *output,
+                                   size_t max_output_frames, size_t &frames_used) {
+  size_t used = 0;
+  size_t generated = 0;
+
+  if ((this->decimation_ == 1) && (this->skip_frames_ == 0)) {
+    // Integer upsampling; every input frame is followed by an output frame for each phase
+    while (generated < max_output_frames) {
+      if (this->phase_ == this->interpolation_) {
+        if (used == input_frames) {
+          break;
+        }
+        this->push_frame_(input + used * this->input_channels_);
+        ++used;
+        this->phase_ = 0;
+      }
+
+      uint32_t phases = std::min<size_t>(this->interpolation_ - this->phase_, max_output_frames - generated);
+      for (uint32_t i = 0; i < phases; ++i) {
+        this->output_frame_(this->phase_++, output + generated * this->output_channels_);
+        ++generated;
+      }
+    }
+  } else {
+    while (generated < max_output_frames) {
+      if (this->phase_ >= this->interpolation_) {
+        // Decimating by more than the interpolation needs several input frames per output frame
+        if (used == input_frames) {
+          break;
+        }
+        this->push_frame_(input + used * this->input_channels_);
+        ++used;
+        this->phase_ -= this->interpolation_;
+        continue;
+      }
+
+      if (this->skip_frames_ > 0) {
+        --this->skip_frames_;
+      } else {
+        this->output_frame_(this->phase_, output + generated * this->output_channels_);
+        ++generated;
+      }
+      this->phase_ += this->decimation_;
+    }
+  }
+
+  frames_used = used;
+  return generated;
+}
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
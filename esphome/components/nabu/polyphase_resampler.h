@@ -0,0 +1,105 @@
+#pragma once
+
+#ifdef USE_ESP_IDF
+
+#include <esp_err.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace nabu {
+
+// Default taps per phase when upsampling; decimating by a larger ratio needs proportionally more
+static const size_t POLYPHASE_TAPS_PER_PHASE = 32;
+// Supports decimating by up to 6 with the default taps, e.g., 48 kHz to 8 kHz
+static const size_t POLYPHASE_MAX_TAPS_PER_PHASE = 6 * POLYPHASE_TAPS_PER_PHASE;
+// Default cutoff as a fraction of the lower of the two Nyquist frequencies
+static const float POLYPHASE_CUTOFF_FRACTION = 0.9f;
+// Bounds the coefficient table to 32 kB. Fits 44.1 kHz to 48 kHz (5120 coefficients) and most other ratios between
+// the common sample rates; the rest use the floating point resampler.
+static const size_t POLYPHASE_MAX_COEFFICIENTS = 16384;
+
+// Fixed point polyphase resampler for rational ratios
+//  - Converting by out/in = L/M upsamples by L, low-pass filters, and keeps every Mth sample. Only the filter phase
+//    lined up with the input samples is computed for each output frame, so a frame costs one short dot product per
+//    channel.
+//  - The Blackman windowed sinc filter is computed once in ``start`` and quantized to Q15. Each phase is corrected to
+//    pass DC at exactly unity, so the rounding doesn't modulate the signal at the phase rate. The Q15 by Q15 products
+//    are accumulated in 64 bits, so nothing saturates before the output.
+//  - Integer upsampling ratios (e.g., 16 kHz or 24 kHz to 48 kHz) output L frames per input frame without tracking
+//    the phase
+//  - Stereo input can be downmixed as it enters the delay line, and a mono result duplicated as it is written, so
+//    converting the channels costs no extra pass
+//  - The filter's delay is skipped at the start of a stream, so the output lines up with the input to within half an
+//    output frame
+class PolyphaseResampler {
+ public:
+  ~PolyphaseResampler();
+
+  /// @brief Computes the filter for the conversion and clears the state
+  /// @param input_sample_rate sample rate of the input
+  /// @param output_sample_rate sample rate to convert to; must differ from the input's
+  /// @param input_channels channels in each input frame; 1 or 2
+  /// @param output_channels channels in each output frame; 1 or 2. Stereo input is downmixed for a mono output, and
+  /// mono input is duplicated for a stereo output.
+  /// @param taps_per_phase taps per phase when upsampling. More taps narrow the transition band.
+  /// @param cutoff_fraction the filter's cutoff as a fraction of the lower of the two Nyquist frequencies. It must
+  /// leave room for the transition band, or content near the Nyquist frequency aliases.
+  /// @return ESP_OK, ESP_ERR_NOT_SUPPORTED if the ratio needs too many taps or coefficients, or ESP_ERR_NO_MEM
+  esp_err_t start(uint32_t input_sample_rate, uint32_t output_sample_rate, uint8_t input_channels,
+                  uint8_t output_channels, size_t taps_per_phase = POLYPHASE_TAPS_PER_PHASE,
+                  float cutoff_fraction = POLYPHASE_CUTOFF_FRACTION);
+
+  /// @brief Converts until the input runs out or the output is full
+  /// @param input interleaved input frames
+  /// @param input_frames number of input frames
+  /// @param output (output) interleaved output frames
+  /// @param max_output_frames number of frames that fit in the output
+  /// @param frames_used (output) number of input frames consumed
+  /// @return number of frames output
+  size_t process(const int16_t *input, size_t input_frames, int16_t *output, size_t max_output_frames,
+                 size_t &frames_used);
+
+  /// @brief Upsampling factor L of the reduced ratio
+  uint32_t get_interpolation() const { return this->interpolation_; }
+  /// @brief Decimation factor M of the reduced ratio
+  uint32_t get_decimation() const { return this->decimation_; }
+
+ protected:
+  /// @brief Computes the Q15 coefficients of every phase, each in reverse so it lines up with the delay line
+  void compute_filter_(float cutoff);
+
+  /// @brief Adds an input frame to the delay line, downmixing it if necessary
+  void push_frame_(const int16_t *frame);
+
+  /// @brief Filters the delay line with a phase and writes one output frame
+  void output_frame_(uint32_t phase, int16_t *frame) const;
+
+  void free_coefficients_();
+
+  int16_t *coefficients_{nullptr};  // taps_per_phase_ coefficients for each of the interpolation_ phases
+  size_t coefficient_count_{0};
+
+  uint32_t interpolation_{1};  // L
+  uint32_t decimation_{1};     // M
+  size_t taps_per_phase_{POLYPHASE_TAPS_PER_PHASE};
+
+  uint8_t input_channels_{2};
+  uint8_t channels_{2};  // Channels in the delay line
+  uint8_t output_channels_{2};
+
+  // Delay line of each channel, stored twice so the newest taps_per_phase_ samples are always contiguous
+  int16_t history_[2][2 * POLYPHASE_MAX_TAPS_PER_PHASE];
+  size_t history_index_{0};
+
+  // Phase of the next output frame; at least interpolation_ once the next input frame is needed
+  uint32_t phase_{0};
+  // Output frames still to skip while the filter's delay passes
+  size_t skip_frames_{0};
+};
+
+}  // namespace nabu
+}  // namespace esphome
+
+#endif
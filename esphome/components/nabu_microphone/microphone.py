@@ -30,6 +30,11 @@ CONF_USE_APLL = "use_apll"
 CONF_CHANNEL_0 = "channel_0"
 CONF_CHANNEL_1 = "channel_1"
 CONF_AMPLIFY_SHIFT = "amplify_shift"
+CONF_READ_TASK = "read_task"
+CONF_CORE = "core"
+CONF_PRIORITY = "priority"
+
+CORE_ANY = "any"
 
 nabu_microphone_ns = cg.esphome_ns.namespace("nabu_microphone")
 
@@ -46,6 +51,8 @@ CHANNELS = {
 
 INTERNAL_ADC_VARIANTS = [esp32.const.VARIANT_ESP32]
 PDM_VARIANTS = [esp32.const.VARIANT_ESP32, esp32.const.VARIANT_ESP32S3]
+# Chips with a second core; elsewhere every task runs on the only core
+DUAL_CORE_VARIANTS = [esp32.const.VARIANT_ESP32, esp32.const.VARIANT_ESP32S3]
 
 
 def validate_esp32_variant(config):
@@ -71,6 +78,24 @@ MICROPHONE_CHANNEL_SCHEMA = microphone.MICROPHONE_SCHEMA.extend(
             }
         )
 
+# By default the read task runs on core 1 with the wake word tasks, away from Wi-Fi and audio decoding on core 0. Its
+# high priority keeps the I2S DMA buffers from overflowing.
+READ_TASK_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_CORE, default=1): cv.Any(
+            cv.one_of(CORE_ANY, lower=True), cv.int_range(min=0, max=1)
+        ),
+        cv.Optional(CONF_PRIORITY, default=23): cv.int_range(min=1, max=24),
+    }
+)
+
+
+def _task_core(task_config):
+    core = task_config[CONF_CORE]
+    if core == CORE_ANY or esp32.get_esp32_variant() not in DUAL_CORE_VARIANTS:
+        return cg.RawExpression("tskNO_AFFINITY")
+    return core
+
 BASE_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(NabuMicrophone),
@@ -85,6 +110,7 @@ BASE_SCHEMA = cv.Schema(
         cv.Optional(CONF_USE_APLL, default=False): cv.boolean,
         cv.Optional(CONF_CHANNEL_0): MICROPHONE_CHANNEL_SCHEMA,
         cv.Optional(CONF_CHANNEL_1): MICROPHONE_CHANNEL_SCHEMA,
+        cv.Optional(CONF_READ_TASK, default={}): READ_TASK_SCHEMA,
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
@@ -145,4 +171,9 @@ async def to_code(config):
     cg.add(var.set_use_apll(config[CONF_USE_APLL]))
     cg.add(var.set_i2s_mode(config[CONF_I2S_MODE]))
 
+    read_task_config = config[CONF_READ_TASK]
+    cg.add(
+        var.set_read_task(read_task_config[CONF_PRIORITY], _task_core(read_task_config))
+    )
+
     cg.add_define("USE_OTA_STATE_CALLBACK")
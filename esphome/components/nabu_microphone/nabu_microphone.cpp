@@ -347,7 +347,8 @@ void NabuMicrophone::start() {
     return;
 
   if (this->read_task_handle_ == nullptr) {
-    xTaskCreate(NabuMicrophone::read_task_, "microphone_task", 3584, (void *) this, 23, &this->read_task_handle_);
+    xTaskCreatePinnedToCore(NabuMicrophone::read_task_, "microphone_task", 3584, (void *) this,
+                            this->read_task_priority_, &this->read_task_handle_, this->read_task_core_);
   }
 
   // TODO: Should we overwrite? If stop and start are called in quick succession, what behavior do we want
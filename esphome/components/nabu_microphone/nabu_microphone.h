@@ -63,6 +63,14 @@ class NabuMicrophone : public i2s_audio::I2SAudioIn, public Component {
   void set_din_pin(int8_t pin) { this->din_pin_ = pin; }
   void set_pdm(bool pdm) { this->pdm_ = pdm; }
 
+  /// @brief Sets where the read task runs
+  /// @param priority FreeRTOS task priority
+  /// @param core core to pin the task to, or tskNO_AFFINITY
+  void set_read_task(UBaseType_t priority, BaseType_t core) {
+    this->read_task_priority_ = priority;
+    this->read_task_core_ = core;
+  }
+
   bool is_running() { return this->state_ == microphone::STATE_RUNNING; }
   uint32_t get_sample_rate() { return this->sample_rate_; }
 
@@ -74,6 +82,8 @@ class NabuMicrophone : public i2s_audio::I2SAudioIn, public Component {
   static void read_task_(void *params);
 
   TaskHandle_t read_task_handle_{nullptr};
+  UBaseType_t read_task_priority_{23};
+  BaseType_t read_task_core_{tskNO_AFFINITY};
   QueueHandle_t event_queue_;
 
   NabuMicrophoneChannel *channel_0_{nullptr};
@@ -0,0 +1,115 @@
+// Cycles per sample of ducking a stereo stream by 20 dB over one second, before and after GainRamp
+//  - "before" is the mixer's old table-stepped loop: one gain per block, looked up in the dB table, applied with
+//    dsps_mulc_s16, and moved a whole dB at a time every few hundred samples
+//  - "after" is GainRamp::apply, which steps the gain every frame while ramping and falls back to dsps_mulc_s16 once
+//    the target is reached; the steady case is measured on its own
+//  - Each figure is the fastest of several runs over the same samples
+
+#include "harness.h"
+
+#include "audio_mixer.h"
+#include "gain_ramp.h"
+
+#include <dsp.h>
+
+#include <algorithm>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const size_t SAMPLE_RATE = 48000;
+static const size_t RAMP_FRAMES = SAMPLE_RATE;
+static const size_t BLOCK_FRAMES = 512;
+static const int8_t DUCK_DB = 20;
+static const int RUNS = 20;
+
+// The old mixer's ducking state and stepping, as they were
+struct DuckingState {
+  int8_t target_db_reduction{0};
+  int8_t current_db_reduction{0};
+  int8_t db_change_per_step{1};
+  size_t transition_samples_remaining{0};
+  size_t samples_per_step{0};
+  size_t samples_into_step{0};
+};
+
+static void advance_ducking(DuckingState &ducking, size_t samples) {
+  if (ducking.transition_samples_remaining == 0) {
+    return;
+  }
+
+  ducking.samples_into_step += samples;
+  while ((ducking.samples_into_step >= ducking.samples_per_step) &&
+         (ducking.current_db_reduction != ducking.target_db_reduction)) {
+    ducking.current_db_reduction += ducking.db_change_per_step;
+    ducking.samples_into_step -= ducking.samples_per_step;
+  }
+
+  ducking.transition_samples_remaining -= std::min(samples, ducking.transition_samples_remaining);
+  if (ducking.transition_samples_remaining == 0) {
+    ducking.current_db_reduction = ducking.target_db_reduction;
+  }
+}
+
+static uint64_t run_before(const std::vector<int16_t> &input, std::vector<int16_t> &output) {
+  DuckingState ducking;
+  ducking.target_db_reduction = DUCK_DB;
+  ducking.samples_per_step = RAMP_FRAMES * 2 / DUCK_DB;
+  ducking.transition_samples_remaining = RAMP_FRAMES * 2;
+
+  const int16_t gain = INT16_MAX;
+  const uint64_t start = harness::cycles();
+  for (size_t sample = 0; sample < input.size(); sample += BLOCK_FRAMES * 2) {
+    const size_t samples = std::min(BLOCK_FRAMES * 2, input.size() - sample);
+    const int16_t scale = static_cast<int16_t>(
+        (static_cast<int32_t>(gain) * decibel_reduction_table[ducking.current_db_reduction]) >> 15);
+    dsps_mulc_s16(input.data() + sample, output.data() + sample, samples, scale, 1, 1);
+    advance_ducking(ducking, samples);
+  }
+  return harness::cycles() - start;
+}
+
+static uint64_t run_after(const std::vector<int16_t> &input, std::vector<int16_t> &output, bool ramping) {
+  GainRamp ramp;
+  if (ramping) {
+    ramp.set(INT16_MAX);
+    ramp.ramp_to(decibel_reduction_table[DUCK_DB], RAMP_FRAMES, GainRampShape::EXPONENTIAL);
+  } else {
+    ramp.set(decibel_reduction_table[DUCK_DB]);
+  }
+
+  const uint64_t start = harness::cycles();
+  for (size_t sample = 0; sample < input.size(); sample += BLOCK_FRAMES * 2) {
+    const size_t frames = std::min(BLOCK_FRAMES * 2, input.size() - sample) / 2;
+    ramp.apply(input.data() + sample, output.data() + sample, frames, 2);
+  }
+  return harness::cycles() - start;
+}
+
+template<typename F> static double fastest_cycles_per_sample(size_t samples, F run) {
+  uint64_t fastest = UINT64_MAX;
+  for (int i = 0; i < RUNS; ++i) {
+    fastest = std::min(fastest, run());
+  }
+  return static_cast<double>(fastest) / samples;
+}
+
+int main() {
+  std::vector<int16_t> input = harness::make_sine(RAMP_FRAMES, 2, 440.0 / SAMPLE_RATE, 20000);
+  std::vector<int16_t> output(input.size());
+
+  const double before = fastest_cycles_per_sample(input.size(), [&]() { return run_before(input, output); });
+  const double ramping = fastest_cycles_per_sample(input.size(), [&]() { return run_after(input, output, true); });
+  const double steady = fastest_cycles_per_sample(input.size(), [&]() { return run_after(input, output, false); });
+
+  printf("bench_gain_ramp: %d dB duck over %zu stereo frames in blocks of %zu, cycles per sample:\n", DUCK_DB,
+         RAMP_FRAMES, BLOCK_FRAMES);
+  printf("  before, table-stepped per block:   %6.2f\n", before);
+  printf("  after, GainRamp while ramping:     %6.2f (%.2fx)\n", ramping, ramping / before);
+  printf("  after, GainRamp at a steady gain:  %6.2f (%.2fx)\n", steady, steady / before);
+
+  CHECK(before > 0.0);
+  CHECK(ramping > 0.0);
+  CHECK(steady > 0.0);
+  return harness::finish("bench_gain_ramp");
+}
@@ -0,0 +1,128 @@
+// Idle wakeups per second and sound start latency of the mixer task, before and after it blocked on task notifications
+//  - "before" models the old idle loop: with nothing to play, the task delays 25 ms and checks its input again
+//  - "after" is the real AudioMixer, which sleeps on its task notification until a commit or a command wakes it
+//  - Latency is the time from a block's commit to its first sample reaching the speaker, over starts at spread out
+//    moments, since a polling task's latency depends on where in its delay the commit lands
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t FRAME_BYTES = 2 * sizeof(int16_t);
+static const uint32_t OLD_TASK_DELAY_MS = 25;
+static const uint32_t IDLE_MS = 2000;
+static const size_t STARTS = 40;
+static const size_t BLOCK_FRAMES = SAMPLE_RATE / 100;
+
+// The old mixer's loop with one input and nothing to mix: delay, then check again
+struct PollingMixer {
+  AudioRingBuffer *ring_buffer;
+  speaker::Speaker *speaker;
+};
+
+static void polling_mixer_task(void *params) {
+  PollingMixer *mixer = static_cast<PollingMixer *>(params);
+  while (true) {
+    uint8_t *data = nullptr;
+    size_t available = mixer->ring_buffer->peek(&data, FRAME_BYTES, 0);
+    available -= available % FRAME_BYTES;
+    if (available > 0) {
+      mixer->ring_buffer->release(mixer->speaker->play(data, available, pdMS_TO_TICKS(OLD_TASK_DELAY_MS)));
+    } else {
+      delay(OLD_TASK_DELAY_MS);
+    }
+  }
+}
+
+struct Result {
+  double wakeups_per_second;
+  double mean_latency_ms;
+  double max_latency_ms;
+};
+
+static Result measure(TaskHandle_t task, AudioRingBuffer *ring_buffer, harness::CaptureSpeaker &speaker) {
+  Result result;
+
+  const uint32_t wakeups_before = harness::task_wakeups(task);
+  std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+  result.wakeups_per_second = (harness::task_wakeups(task) - wakeups_before) * 1000.0 / IDLE_MS;
+
+  const std::vector<int16_t> block = harness::make_sine(BLOCK_FRAMES, 2, 440.0 / SAMPLE_RATE, 10000);
+  double total_ms = 0.0;
+  result.max_latency_ms = 0.0;
+  for (size_t start = 0; start < STARTS; ++start) {
+    // Lands the commits at different points of a polling task's delay
+    std::this_thread::sleep_for(std::chrono::microseconds((start * 7919) % (OLD_TASK_DELAY_MS * 1000)));
+
+    speaker.reset();
+    CHECK_EQ(ring_buffer->write(block.data(), block.size() * sizeof(int16_t), 0), block.size() * sizeof(int16_t));
+    double latency_ms;
+    while ((latency_ms = speaker.first_sound_ms()) < 0.0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    total_ms += latency_ms;
+    result.max_latency_ms = std::max(result.max_latency_ms, latency_ms);
+
+    while (speaker.samples().size() < block.size()) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  result.mean_latency_ms = total_ms / STARTS;
+  return result;
+}
+
+int main() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2);
+
+  // Before
+  auto ring_buffer = AudioRingBuffer::create(SAMPLE_RATE / 4 * FRAME_BYTES);
+  PollingMixer polling_mixer{ring_buffer.get(), &speaker};
+  TaskHandle_t polling_task = nullptr;
+  xTaskCreate(polling_mixer_task, "polling_mixer", 3072, &polling_mixer, 10, &polling_task);
+  CHECK(polling_task != nullptr);
+  const Result before = measure(polling_task, ring_buffer.get(), speaker);
+  vTaskDelete(polling_task);
+
+  // After
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  MixerInputSettings settings;
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+  TaskHandle_t mixer_task = harness::find_task("mixer");
+  CHECK(mixer_task != nullptr);
+  Result after = {};
+  if (mixer_task != nullptr) {
+    after = measure(mixer_task, mixer.get_input_ring_buffer(input), speaker);
+  }
+
+  printf("bench_mixer_wakeups: idle wakeups per second, and latency from commit to the speaker over %zu starts:\n",
+         STARTS);
+  printf("  before, %u ms polling:    %6.1f wakeups/s, %5.2f ms mean, %5.2f ms max\n", OLD_TASK_DELAY_MS,
+         before.wakeups_per_second, before.mean_latency_ms, before.max_latency_ms);
+  printf("  after, task notification: %6.1f wakeups/s, %5.2f ms mean, %5.2f ms max\n", after.wakeups_per_second,
+         after.mean_latency_ms, after.max_latency_ms);
+
+  CHECK(after.wakeups_per_second < 1.0);
+  CHECK(after.mean_latency_ms < before.mean_latency_ms);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+
+  return harness::finish("bench_mixer_wakeups");
+}
@@ -0,0 +1,111 @@
+// Time per block of the output processor with every equalizer band and the compressor in use, against its budget
+//  - Blocks are OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES frames at OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE, i.e., the 10 ms
+//    blocks the budget is stated for, of a loud bass tone plus a voice band tone and noise, so the compressor works
+//  - Each figure is the fastest of several runs over the same samples; the check is that the fastest block fits
+//    OUTPUT_PROCESSOR_BUDGET_BLOCK_US. The host is much faster than an ESP32-S3, so the margin is what to watch.
+
+#include "harness.h"
+
+#include "output_processor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace esphome::nabu;
+
+static const size_t SECONDS = 2;
+static const int RUNS = 20;
+
+static OutputProcessorSettings full_settings() {
+  OutputProcessorSettings settings;
+  settings.bands[0] = {EqualizerFilterType::HIGH_PASS, 80.0f, 0.0f, 0.707f};
+  settings.bands[1] = {EqualizerFilterType::LOW_SHELF, 200.0f, 4.0f, 0.707f};
+  settings.bands[2] = {EqualizerFilterType::PEAKING, 1000.0f, -3.0f, 1.0f};
+  settings.bands[3] = {EqualizerFilterType::PEAKING, 3500.0f, 2.0f, 2.0f};
+  settings.bands[4] = {EqualizerFilterType::HIGH_SHELF, 8000.0f, -2.0f, 0.707f};
+  settings.bands[5] = {EqualizerFilterType::LOW_PASS, 18000.0f, 0.0f, 0.707f};
+  settings.band_count = MAX_EQUALIZER_BANDS;
+  settings.use_compressor = true;
+  settings.compressor = {150.0f, -18.0f, 4.0f, 5.0f, 100.0f};
+  return settings;
+}
+
+static std::vector<int16_t> make_input(size_t frames, uint8_t channels) {
+  std::vector<int16_t> input(frames * channels);
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> noise(-1000.0, 1000.0);
+  const double bass = 2.0 * M_PI * 60.0 / OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE;
+  const double voice = 2.0 * M_PI * 700.0 / OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE;
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const double sample = 16000.0 * std::sin(bass * frame) + 6000.0 * std::sin(voice * frame);
+    for (uint8_t channel = 0; channel < channels; ++channel) {
+      input[frame * channels + channel] = static_cast<int16_t>(sample + noise(random));
+    }
+  }
+  return input;
+}
+
+struct Result {
+  double cycles_per_frame;
+  double fastest_block_us;
+  double mean_block_us;
+};
+
+static Result measure(uint8_t channels) {
+  const size_t frames = OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE * SECONDS;
+  const size_t blocks = frames / OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES;
+  const std::vector<int16_t> input = make_input(frames, channels);
+  std::vector<int16_t> samples(input.size());
+
+  OutputProcessor processor;
+  processor.configure(full_settings(), OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE, channels);
+  CHECK(processor.is_active());
+
+  Result result = {1e30, 1e30, 1e30};
+  for (int run = 0; run < RUNS; ++run) {
+    samples = input;
+    processor.reset();
+    double total_us = 0.0;
+    const uint64_t start_cycles = harness::cycles();
+    for (size_t block = 0; block < blocks; ++block) {
+      int16_t *block_samples = samples.data() + block * OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES * channels;
+      const auto start = std::chrono::steady_clock::now();
+      processor.process(block_samples, OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES);
+      const double block_us =
+          std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      result.fastest_block_us = std::min(result.fastest_block_us, block_us);
+      total_us += block_us;
+    }
+    const uint64_t run_cycles = harness::cycles() - start_cycles;
+    result.cycles_per_frame = std::min(result.cycles_per_frame, static_cast<double>(run_cycles) / frames);
+    result.mean_block_us = std::min(result.mean_block_us, total_us / blocks);
+  }
+
+  // The compressor turned the loud bass down, so the processor really ran
+  int16_t input_peak = 0, output_peak = 0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    input_peak = std::max<int16_t>(input_peak, std::abs(input[i]));
+    output_peak = std::max<int16_t>(output_peak, std::abs(samples[i]));
+  }
+  CHECK(output_peak < input_peak);
+
+  return result;
+}
+
+int main() {
+  printf("bench_output_processor: %zu bands and the compressor, %zu frame blocks at %u Hz, budget %u us per block:\n",
+         MAX_EQUALIZER_BANDS, OUTPUT_PROCESSOR_BUDGET_BLOCK_FRAMES, OUTPUT_PROCESSOR_BUDGET_SAMPLE_RATE,
+         OUTPUT_PROCESSOR_BUDGET_BLOCK_US);
+  for (uint8_t channels : {1, 2}) {
+    const Result result = measure(channels);
+    printf("  %-6s %7.1f cycles per frame, %6.1f us per block (mean of the fastest run), %6.1f us fastest block, "
+           "%4.1f%% of the budget\n",
+           (channels == 1) ? "mono" : "stereo", result.cycles_per_frame, result.mean_block_us,
+           result.fastest_block_us, result.mean_block_us * 100.0 / OUTPUT_PROCESSOR_BUDGET_BLOCK_US);
+    CHECK(result.mean_block_us < OUTPUT_PROCESSOR_BUDGET_BLOCK_US);
+  }
+
+  return harness::finish("bench_output_processor");
+}
@@ -0,0 +1,69 @@
+// Cycles per output sample of converting a stereo stream, before and after PolyphaseResampler
+//  - "before" is the floating point path every stream used to take (harness/float_resampler.h): int16 to float, the
+//    biquads, ``resampleProcessInterleaved``, and back to int16
+//  - "after" is PolyphaseResampler, converting straight between int16 buffers
+//  - Both run the BALANCED profile's settings on a second of audio; each figure is the fastest of several runs
+//  - The floating point resampler is the host stand-in, not esp-audio-libs' own, so the ratio between the two is only
+//    a guide to the device
+
+#include "harness.h"
+#include "float_resampler.h"
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+
+using namespace esphome::nabu;
+
+static const int RUNS = 10;
+
+struct Ratio {
+  uint32_t input_sample_rate;
+  uint32_t output_sample_rate;
+};
+
+static const Ratio RATIOS[] = {{16000, 48000}, {24000, 48000}, {22050, 48000}, {44100, 48000}, {48000, 16000}};
+
+template<typename F> static double fastest_cycles_per_sample(F run) {
+  uint64_t fastest = UINT64_MAX;
+  size_t samples = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    const uint64_t start = harness::cycles();
+    samples = run();
+    fastest = std::min(fastest, harness::cycles() - start);
+  }
+  return static_cast<double>(fastest) / std::max<size_t>(samples, 1);
+}
+
+int main() {
+  printf("bench_polyphase_resampler: one second of stereo audio, cycles per output sample:\n");
+  for (const Ratio &ratio : RATIOS) {
+    const std::vector<int16_t> input =
+        harness::make_sine(ratio.input_sample_rate, 2, 1000.0 / ratio.input_sample_rate, 16384);
+    const size_t input_frames = input.size() / 2;
+    std::vector<int16_t> output;
+    output.reserve(input.size() * ratio.output_sample_rate / ratio.input_sample_rate + 256);
+
+    const double before = fastest_cycles_per_sample([&]() {
+      harness::FloatResampler resampler(ratio.input_sample_rate, ratio.output_sample_rate, 2, 2);
+      output.clear();
+      resampler.process(input.data(), input_frames, output);
+      return output.size();
+    });
+
+    const double after = fastest_cycles_per_sample([&]() {
+      PolyphaseResampler resampler;
+      resampler.start(ratio.input_sample_rate, ratio.output_sample_rate, 2, 2);
+      output.resize(output.capacity());
+      size_t frames_used = 0;
+      return 2 * resampler.process(input.data(), input_frames, output.data(), output.size() / 2, frames_used);
+    });
+
+    printf("  %5u -> %5u Hz: before, floating point %7.2f; after, polyphase %7.2f (%.2fx)\n", ratio.input_sample_rate,
+           ratio.output_sample_rate, before, after, after / before);
+    CHECK(before > 0.0);
+    CHECK(after > 0.0);
+  }
+
+  return harness::finish("bench_polyphase_resampler");
+}
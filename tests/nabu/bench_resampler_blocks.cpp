@@ -0,0 +1,69 @@
+// Cycles per output sample of AudioResampler's floating point path, before and after it ran in small cached blocks
+//  - "before" runs each stage over a whole call's worth, through float buffers the size of the media pipeline's old
+//    ones (BUFFER_SIZE_SAMPLES floats each); "after" runs them over RESAMPLER_FLOAT_BLOCK_FRAMES at a time
+//  - Both are harness::FloatResampler converting a second of stereo audio; each figure is the fastest of several runs
+//  - A host's caches hold even the old buffers, so the difference is smaller here than on the device, where they were
+//    in PSRAM behind a 32 KB cache. The working set printed with each figure is what decides it there.
+
+#include "harness.h"
+#include "float_resampler.h"
+
+#include "audio_resampler.h"
+
+#include <algorithm>
+
+using namespace esphome::nabu;
+
+// The media pipeline's resampler buffer, which sized the old float buffers
+static const size_t BUFFER_SIZE_SAMPLES = 32768;
+static const uint8_t CHANNELS = 2;
+static const int RUNS = 10;
+
+struct Ratio {
+  uint32_t input_sample_rate;
+  uint32_t output_sample_rate;
+};
+
+// Ratios the polyphase resampler doesn't take, so they still use the floating point path
+static const Ratio RATIOS[] = {{11025, 48000}, {11025, 16000}, {48000, 11025}};
+
+static double fastest_cycles_per_sample(const Ratio &ratio, const std::vector<int16_t> &input, size_t block_frames) {
+  std::vector<int16_t> output;
+  output.reserve(input.size() * ratio.output_sample_rate / ratio.input_sample_rate + 1024);
+  uint64_t fastest = UINT64_MAX;
+  for (int i = 0; i < RUNS; ++i) {
+    harness::FloatResampler resampler(ratio.input_sample_rate, ratio.output_sample_rate, CHANNELS, CHANNELS,
+                                      block_frames);
+    output.clear();
+    const uint64_t start = harness::cycles();
+    resampler.process(input.data(), input.size() / CHANNELS, output);
+    fastest = std::min(fastest, harness::cycles() - start);
+  }
+  return static_cast<double>(fastest) / std::max<size_t>(output.size(), 1);
+}
+
+int main() {
+  const size_t before_block_frames = BUFFER_SIZE_SAMPLES / CHANNELS;
+  // Input and output buffers of floats
+  const size_t before_bytes = 2 * BUFFER_SIZE_SAMPLES * sizeof(float);
+  const size_t after_bytes = 2 * RESAMPLER_FLOAT_BLOCK_FRAMES * CHANNELS * sizeof(float);
+
+  printf("bench_resampler_blocks: one second of stereo audio, cycles per output sample; float buffers of %zu KB "
+         "before, %zu KB after:\n",
+         before_bytes / 1024, after_bytes / 1024);
+  for (const Ratio &ratio : RATIOS) {
+    const std::vector<int16_t> input =
+        harness::make_sine(ratio.input_sample_rate, CHANNELS, 1000.0 / ratio.input_sample_rate, 16384);
+
+    const double before = fastest_cycles_per_sample(ratio, input, before_block_frames);
+    const double after = fastest_cycles_per_sample(ratio, input, RESAMPLER_FLOAT_BLOCK_FRAMES);
+
+    printf("  %5u -> %5u Hz: before, %5zu frame blocks %7.2f; after, %3zu frame blocks %7.2f (%.2fx)\n",
+           ratio.input_sample_rate, ratio.output_sample_rate, before_block_frames, before,
+           RESAMPLER_FLOAT_BLOCK_FRAMES, after, after / before);
+    CHECK(before > 0.0);
+    CHECK(after > 0.0);
+  }
+
+  return harness::finish("bench_resampler_blocks");
+}
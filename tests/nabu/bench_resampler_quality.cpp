@@ -0,0 +1,154 @@
+// Cost and passband of each ResamplerQuality profile, on the fixed point path and on the floating point fallback
+//  - Both paths convert 44.1 kHz to 48 kHz, which is media's usual conversion; the fallback takes it when drift
+//    compensation is on, and takes every ratio the polyphase resampler doesn't support
+//  - Cost is cycles per output sample of converting a second of stereo audio, the fastest of several runs
+//  - The passband is measured with tones at fractions of the lower Nyquist frequency: the ripple up to half of it,
+//    the highest fraction still within 0.1 dB, and the fraction where the gain falls to -3 dB
+//  - The floating point resampler is the host stand-in (harness/float_resampler.h), not esp-audio-libs' own, so its
+//    cost relative to the fixed point path is only a guide to the device
+
+#include "harness.h"
+#include "float_resampler.h"
+
+#include "audio_resampler.h"
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace esphome::nabu;
+
+static const uint32_t INPUT_SAMPLE_RATE = 44100;
+static const uint32_t OUTPUT_SAMPLE_RATE = 48000;
+static const int RUNS = 20;
+
+static const double AMPLITUDE = 16384.0;  // -6 dBFS
+// Output frames left out of each fit at either end, where the filters are filling or the input ran out
+static const size_t EDGE_FRAMES = 1000;
+static const double RIPPLE_FRACTION = 0.5;
+static const double FRACTION_STEP = 0.01;
+
+struct Quality {
+  const char *name;
+  ResamplerQuality quality;
+};
+
+static const Quality QUALITIES[] = {
+    {"voice", ResamplerQuality::VOICE},
+    {"balanced", ResamplerQuality::BALANCED},
+    {"hifi", ResamplerQuality::HIFI},
+};
+
+static std::vector<int16_t> run_polyphase(ResamplerQuality quality, const std::vector<int16_t> &input,
+                                          uint8_t channels) {
+  const ResamplerProfile &profile = get_resampler_profile(quality);
+  PolyphaseResampler resampler;
+  CHECK_EQ(resampler.start(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE, channels, channels,
+                           profile.polyphase_taps_per_phase, profile.polyphase_cutoff_fraction),
+           ESP_OK);
+  const size_t input_frames = input.size() / channels;
+  std::vector<int16_t> output((input_frames * OUTPUT_SAMPLE_RATE / INPUT_SAMPLE_RATE + 16) * channels);
+  size_t frames_used = 0;
+  const size_t frames = resampler.process(input.data(), input_frames, output.data(), output.size() / channels,
+                                          frames_used);
+  output.resize(frames * channels);
+  return output;
+}
+
+static std::vector<int16_t> run_float(ResamplerQuality quality, const std::vector<int16_t> &input,
+                                      uint8_t channels) {
+  harness::FloatResampler resampler(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE, channels, channels,
+                                    RESAMPLER_FLOAT_BLOCK_FRAMES, quality);
+  std::vector<int16_t> output;
+  output.reserve(input.size() * OUTPUT_SAMPLE_RATE / INPUT_SAMPLE_RATE + 1024);
+  resampler.process(input.data(), input.size() / channels, output);
+  return output;
+}
+
+template<typename Run> static double fastest_cycles_per_sample(ResamplerQuality quality, Run run) {
+  const std::vector<int16_t> input = harness::make_sine(INPUT_SAMPLE_RATE, 2, 1000.0 / INPUT_SAMPLE_RATE, AMPLITUDE);
+  uint64_t fastest = UINT64_MAX;
+  size_t samples = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    const uint64_t start = harness::cycles();
+    samples = run(quality, input, 2).size();
+    fastest = std::min(fastest, harness::cycles() - start);
+  }
+  return static_cast<double>(fastest) / std::max<size_t>(samples, 1);
+}
+
+/// @return the amplitude of the least squares fit of a sine of a known frequency plus DC to the middle of the samples
+static double fit_amplitude(const std::vector<int16_t> &samples, double frequency_ratio) {
+  double ss = 0.0, sc = 0.0, s1 = 0.0, cc = 0.0, c1 = 0.0, n = 0.0, ys = 0.0, yc = 0.0, y1 = 0.0;
+  for (size_t i = EDGE_FRAMES; i < samples.size() - EDGE_FRAMES; ++i) {
+    const double s = std::sin(2 * M_PI * frequency_ratio * i);
+    const double c = std::cos(2 * M_PI * frequency_ratio * i);
+    ss += s * s;
+    sc += s * c;
+    s1 += s;
+    cc += c * c;
+    c1 += c;
+    n += 1.0;
+    ys += samples[i] * s;
+    yc += samples[i] * c;
+    y1 += samples[i];
+  }
+  // Cramer's rule on the normal equations for the sin, cos, and DC terms
+  const double det = ss * (cc * n - c1 * c1) - sc * (sc * n - c1 * s1) + s1 * (sc * c1 - cc * s1);
+  const double a = (ys * (cc * n - c1 * c1) - sc * (yc * n - c1 * y1) + s1 * (yc * c1 - cc * y1)) / det;
+  const double b = (ss * (yc * n - y1 * c1) - ys * (sc * n - c1 * s1) + s1 * (sc * y1 - yc * s1)) / det;
+  return std::hypot(a, b);
+}
+
+struct Passband {
+  double ripple_db;
+  double flat_fraction;  // Highest fraction of the lower Nyquist frequency within 0.1 dB
+  double cutoff_fraction;  // Where the gain falls to -3 dB
+};
+
+template<typename Run> static Passband measure_passband(ResamplerQuality quality, Run run) {
+  Passband passband{0.0, 0.0, 1.0};
+  double lowest = 0.0, highest = -1000.0;
+  bool flat = true;
+  const double nyquist = std::min(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE) / 2.0;
+  for (double fraction = FRACTION_STEP; fraction < 1.0; fraction += FRACTION_STEP) {
+    const double frequency = fraction * nyquist;
+    const std::vector<int16_t> input =
+        harness::make_sine(INPUT_SAMPLE_RATE, 1, frequency / INPUT_SAMPLE_RATE, AMPLITUDE, 0.0);
+    const double gain_db =
+        20.0 * std::log10(fit_amplitude(run(quality, input, 1), frequency / OUTPUT_SAMPLE_RATE) / AMPLITUDE);
+    if (fraction <= RIPPLE_FRACTION + FRACTION_STEP / 2) {
+      lowest = std::min(lowest, gain_db);
+      highest = std::max(highest, gain_db);
+      passband.ripple_db = highest - std::min(lowest, highest);
+    }
+    if (flat && (std::abs(gain_db) <= 0.1)) {
+      passband.flat_fraction = fraction;
+    } else {
+      flat = false;
+    }
+    if (gain_db <= -3.0) {
+      passband.cutoff_fraction = fraction;
+      break;
+    }
+  }
+  return passband;
+}
+
+template<typename Run> static void report(const char *path, const Quality &quality, Run run) {
+  const double cycles = fastest_cycles_per_sample(quality.quality, run);
+  const Passband passband = measure_passband(quality.quality, run);
+  printf("bench_resampler_quality: %-8s %-11s %6.1f cycles per output sample; ripple %.3f dB to %.1f of Nyquist, "
+         "flat to 0.1 dB up to %.2f, -3 dB at %.2f\n",
+         quality.name, path, cycles, passband.ripple_db, RIPPLE_FRACTION, passband.flat_fraction,
+         passband.cutoff_fraction);
+}
+
+int main() {
+  printf("bench_resampler_quality: %u -> %u Hz\n", INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+  for (const Quality &quality : QUALITIES) {
+    report("polyphase", quality, run_polyphase);
+    report("float", quality, run_float);
+  }
+  return harness::finish("bench_resampler_quality");
+}
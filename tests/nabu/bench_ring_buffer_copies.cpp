@@ -0,0 +1,285 @@
+// Bytes copied per second of audio between the reader and the speaker, before and after the reserve/commit ring buffer
+//  - "after" runs the real AudioReader, AudioDecoder, and AudioResampler, with the single input mixer's zero copy
+//    path (peek, write to a SpeakerOutputSink, release) consuming the mixer input ring buffer
+//  - "before" models the copy-in/copy-out pipeline: each stage reads its input ring buffer into a buffer of its own,
+//    works on that, and writes its output from another buffer, the way the stages did before reserve/commit
+//  - Every memcpy and memmove in the program is counted (the Makefile links it with --wrap), so guard area copies at
+//    the wrap point and the FLAC staging buffer's memmoves are included. Copies into the speaker are not, as both
+//    versions hand the speaker the same bytes.
+//  - Only copies are compared; host cycle counts would mostly measure the FreeRTOS stand-in's locking
+
+#include "harness.h"
+
+#include "audio_decoder.h"
+#include "audio_output_sink.h"
+#include "audio_reader.h"
+#include "audio_resampler.h"
+#include "audio_ring_buffer.h"
+
+#include <flac_decoder.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static uint64_t copied_bytes = 0;
+
+extern "C" {
+void *__real_memcpy(void *destination, const void *source, size_t bytes);
+void *__real_memmove(void *destination, const void *source, size_t bytes);
+
+void *__wrap_memcpy(void *destination, const void *source, size_t bytes) {
+  copied_bytes += bytes;
+  return __real_memcpy(destination, source, bytes);
+}
+
+void *__wrap_memmove(void *destination, const void *source, size_t bytes) {
+  copied_bytes += bytes;
+  return __real_memmove(destination, source, bytes);
+}
+}
+
+// Sizes the pipeline uses for a media stream
+static const size_t FILE_BUFFER_SIZE = 32 * 1024;
+static const size_t FILE_RING_BUFFER_SIZE = 64 * 1024;
+static const size_t FILE_RING_BUFFER_GUARD_SIZE = 4 * 1024;
+static const size_t DECODED_RING_BUFFER_SIZE = 96 * 1024;
+static const size_t DECODED_RING_BUFFER_GUARD_SIZE = 4608 * 2 * sizeof(int16_t);
+static const size_t RESAMPLER_BUFFER_SAMPLES = 32768;
+static const size_t MIXER_INPUT_RING_BUFFER_FRAMES = 12000;
+static const size_t MIXER_INPUT_RING_BUFFER_GUARD_SIZE = 2048;
+static const size_t MIXER_BLOCK_FRAMES = 512;
+static const size_t SPEAKER_STAGING_BYTES = 4096;
+
+// Accepts everything without copying it
+class NullSpeaker : public speaker::Speaker {
+ public:
+  size_t play(const uint8_t */*data*/, size_t length, TickType_t /*ticks_to_wait*/) override { return length; }
+};
+
+struct Result {
+  uint64_t copied_bytes;
+  size_t output_bytes;
+};
+
+static Result run_after(const std::vector<uint8_t> &file, media_player::MediaFileType file_type) {
+  auto raw_ring = AudioRingBuffer::create(FILE_RING_BUFFER_SIZE, FILE_RING_BUFFER_GUARD_SIZE);
+  auto decoded_ring = AudioRingBuffer::create(DECODED_RING_BUFFER_SIZE, DECODED_RING_BUFFER_GUARD_SIZE);
+  std::unique_ptr<AudioRingBuffer> mixer_ring;
+
+  media_player::MediaFile media_file{file.data(), file.size(), file_type};
+  AudioReader reader(raw_ring.get(), FILE_BUFFER_SIZE);
+  AudioDecoder decoder(raw_ring.get(), decoded_ring.get(), FILE_BUFFER_SIZE);
+  std::unique_ptr<AudioResampler> resampler;
+  reader.set_ticks_to_wait(0);
+  decoder.set_ticks_to_wait(0);
+
+  NullSpeaker speaker;
+  auto sink = SpeakerOutputSink::create(&speaker, SPEAKER_STAGING_BYTES);
+
+  media_player::MediaFileType type;
+  reader.start(&media_file, type);
+  decoder.start(type);
+
+  const uint64_t start_copied = copied_bytes;
+  size_t output_bytes = 0;
+  bool reader_finished = false;
+  size_t frame_bytes = 0;
+
+  while (true) {
+    if (!reader_finished) {
+      reader_finished = (reader.read() != AudioReaderState::READING);
+    }
+    AudioDecoderState decoder_state = decoder.decode(reader_finished);
+
+    if ((resampler == nullptr) && decoder.get_audio_stream_info().has_value()) {
+      audio::AudioStreamInfo stream_info = decoder.get_audio_stream_info().value();
+      frame_bytes = stream_info.channels * sizeof(int16_t);
+      mixer_ring = AudioRingBuffer::create(MIXER_INPUT_RING_BUFFER_FRAMES * frame_bytes,
+                                           MIXER_INPUT_RING_BUFFER_GUARD_SIZE);
+      resampler = make_unique<AudioResampler>(decoded_ring.get(), mixer_ring.get(), RESAMPLER_BUFFER_SAMPLES);
+      resampler->set_ticks_to_wait(0);
+      ResampleInfo resample_info;
+      resampler->start(stream_info, stream_info.sample_rate, stream_info.channels, resample_info);
+    }
+    if (resampler == nullptr) {
+      continue;
+    }
+
+    AudioResamplerState resampler_state = resampler->resample(decoder_state == AudioDecoderState::FINISHED);
+
+    // The mixer's zero copy path for a single input
+    uint8_t *block;
+    size_t block_bytes = mixer_ring->peek(&block, 0, 0);
+    block_bytes = std::min(block_bytes, MIXER_BLOCK_FRAMES * frame_bytes);
+    block_bytes -= block_bytes % frame_bytes;
+    if (block_bytes > 0) {
+      size_t bytes_written = sink->write(reinterpret_cast<const int16_t *>(block), block_bytes, 0);
+      mixer_ring->release(bytes_written);
+      output_bytes += bytes_written;
+    } else if ((resampler_state == AudioResamplerState::FINISHED) || (resampler_state == AudioResamplerState::FAILED)) {
+      break;
+    }
+  }
+
+  return {copied_bytes - start_copied, output_bytes};
+}
+
+// The copy-in/copy-out pipeline. Ring buffers are only accessed through ``write`` and ``read``, which copy into and out
+// of them like the FreeRTOS byte ring buffers did.
+static Result run_before(const std::vector<uint8_t> &file, media_player::MediaFileType file_type) {
+  auto raw_ring = AudioRingBuffer::create(FILE_RING_BUFFER_SIZE);
+  auto decoded_ring = AudioRingBuffer::create(DECODED_RING_BUFFER_SIZE);
+  std::unique_ptr<AudioRingBuffer> mixer_ring;
+
+  std::vector<uint8_t> decoder_input(FILE_BUFFER_SIZE);
+  std::vector<uint8_t> decoder_output(std::max(DECODED_RING_BUFFER_GUARD_SIZE, FILE_BUFFER_SIZE));
+  std::vector<uint8_t> resampler_buffer(RESAMPLER_BUFFER_SAMPLES * sizeof(int16_t));
+  std::vector<uint8_t> mixer_input_buffer(MIXER_BLOCK_FRAMES * 2 * sizeof(int16_t));
+  std::vector<uint8_t> combination_buffer(MIXER_BLOCK_FRAMES * 2 * sizeof(int16_t));
+
+  flac::FLACDecoder flac_decoder(decoder_input.data());
+  bool header_read = false;
+  size_t frame_bytes = 0;
+
+  const uint64_t start_copied = copied_bytes;
+  size_t output_bytes = 0;
+
+  size_t file_position = 0;
+  size_t input_length = 0;
+  uint8_t *input_current = decoder_input.data();
+  size_t output_length = 0;
+  uint8_t *output_current = decoder_output.data();
+  size_t resampler_length = 0;
+  uint8_t *resampler_current = resampler_buffer.data();
+  bool decoder_finished = false;
+
+  while (true) {
+    // Reader: the file is written into the ring buffer straight from flash
+    if (file_position < file.size()) {
+      file_position += raw_ring->write(file.data() + file_position,
+                                       std::min(file.size() - file_position, FILE_BUFFER_SIZE), 0);
+    }
+
+    // Decoder: output buffer to ring buffer, then input ring buffer to input buffer, then decode
+    if (output_length > 0) {
+      size_t bytes_written = decoded_ring->write(output_current, output_length, 0);
+      output_current += bytes_written;
+      output_length -= bytes_written;
+    }
+    if ((output_length == 0) && !decoder_finished) {
+      if (input_length > 0) {
+        std::memmove(decoder_input.data(), input_current, input_length);
+      }
+      input_current = decoder_input.data();
+      input_length += raw_ring->read(decoder_input.data() + input_length, decoder_input.size() - input_length, 0);
+      output_current = decoder_output.data();
+
+      if (file_type == media_player::MediaFileType::WAV) {
+        if (!header_read && (input_length > 44)) {
+          // The canonical header from harness::make_wav
+          frame_bytes = input_current[22] * sizeof(int16_t);
+          input_current += 44;
+          input_length -= 44;
+          header_read = true;
+        }
+        if (header_read) {
+          size_t bytes_to_copy = std::min(input_length, decoder_output.size());
+          std::memcpy(output_current, input_current, bytes_to_copy);
+          input_current += bytes_to_copy;
+          input_length -= bytes_to_copy;
+          output_length = bytes_to_copy;
+        }
+      } else {
+        if (!header_read && (flac_decoder.read_header(input_length) == flac::FLAC_DECODER_SUCCESS)) {
+          frame_bytes = flac_decoder.get_num_channels() * sizeof(int16_t);
+          input_current += flac_decoder.get_bytes_index();
+          input_length = flac_decoder.get_bytes_left();
+          header_read = true;
+        } else if (header_read) {
+          // The FLAC decoder always reads from the start of the input buffer
+          std::memmove(decoder_input.data(), input_current, input_length);
+          input_current = decoder_input.data();
+          uint32_t samples = 0;
+          if (flac_decoder.decode_frame(input_length, reinterpret_cast<int16_t *>(output_current), &samples) ==
+              flac::FLAC_DECODER_SUCCESS) {
+            input_current += flac_decoder.get_bytes_index();
+            input_length = flac_decoder.get_bytes_left();
+            output_length = samples * sizeof(int16_t);
+          }
+        }
+      }
+      decoder_finished = (file_position == file.size()) && (raw_ring->available() == 0) && (output_length == 0) &&
+                         (header_read && ((file_type == media_player::MediaFileType::WAV) || (input_length == 0)));
+    }
+    if (!header_read) {
+      continue;
+    }
+    if (mixer_ring == nullptr) {
+      mixer_ring = AudioRingBuffer::create(MIXER_INPUT_RING_BUFFER_FRAMES * frame_bytes);
+    }
+
+    // Resampler at matching rates: input ring buffer to its buffer, then to the output ring buffer
+    if (resampler_length > 0) {
+      size_t bytes_written = mixer_ring->write(resampler_current, resampler_length, 0);
+      resampler_current += bytes_written;
+      resampler_length -= bytes_written;
+    }
+    if (resampler_length == 0) {
+      resampler_current = resampler_buffer.data();
+      size_t bytes_to_read = decoded_ring->available();
+      bytes_to_read -= bytes_to_read % frame_bytes;
+      resampler_length = decoded_ring->read(resampler_buffer.data(), std::min(bytes_to_read, resampler_buffer.size()),
+                                            0);
+    }
+
+    // Mixer with one active stream: ring buffer to its input buffer, then into the combination buffer
+    size_t bytes_to_read = std::min(mixer_ring->available(), MIXER_BLOCK_FRAMES * frame_bytes);
+    bytes_to_read -= bytes_to_read % frame_bytes;
+    if (bytes_to_read > 0) {
+      size_t bytes_read = mixer_ring->read(mixer_input_buffer.data(), bytes_to_read, 0);
+      std::memcpy(combination_buffer.data(), mixer_input_buffer.data(), bytes_read);
+      output_bytes += bytes_read;
+    } else if (decoder_finished && (output_length == 0) && (decoded_ring->available() < frame_bytes) &&
+               (resampler_length == 0)) {
+      break;
+    }
+  }
+
+  return {copied_bytes - start_copied, output_bytes};
+}
+
+static void report(const char *name, const std::vector<uint8_t> &file, media_player::MediaFileType type,
+                   uint32_t sample_rate, uint8_t channels) {
+  Result before = run_before(file, type);
+  Result after = run_after(file, type);
+
+  CHECK(before.output_bytes > 0);
+  CHECK_EQ(after.output_bytes, before.output_bytes);
+
+  const double seconds = static_cast<double>(after.output_bytes) / (sample_rate * channels * sizeof(int16_t));
+  const double pcm_bytes_per_second = sample_rate * channels * sizeof(int16_t);
+  printf("%-20s before %8.0f B/s (%4.2f per byte) | after %8.0f B/s (%4.2f per byte)\n", name,
+         before.copied_bytes / seconds, before.copied_bytes / seconds / pcm_bytes_per_second,
+         after.copied_bytes / seconds, after.copied_bytes / seconds / pcm_bytes_per_second);
+
+  // At least half of the copies are gone
+  CHECK(after.copied_bytes * 2 <= before.copied_bytes);
+}
+
+int main() {
+  printf("bench_ring_buffer_copies: bytes copied per second of audio, and per byte of PCM output\n");
+
+  std::vector<int16_t> samples = harness::make_sine(48000 * 20, 2, 440.0 / 48000, 12000);
+  report("wav 48 kHz stereo", harness::make_wav(samples, 48000, 2), media_player::MediaFileType::WAV, 48000, 2);
+
+  std::vector<uint8_t> flac = harness::read_file("../../sounds/timer_finished.flac");
+  CHECK(!flac.empty());
+  if (!flac.empty()) {
+    report("flac 48 kHz mono", flac, media_player::MediaFileType::FLAC, 48000, 1);
+  }
+
+  return harness::finish("bench_ring_buffer_copies");
+}
@@ -0,0 +1,54 @@
+// RBJ cookbook biquads with a Q of 1/sqrt(2), in the layout of esp-audio-libs' biquad.h
+
+#include <biquad.h>
+
+#include <cmath>
+
+void biquad_init(Biquad *f, const BiquadCoefficients *coeffs, float gain) {
+  f->coeffs = *coeffs;
+  f->gain = gain;
+  f->in_d1 = f->in_d2 = f->out_d1 = f->out_d2 = 0.0f;
+}
+
+static void biquad_normalize(BiquadCoefficients *filter, double b0, double b1, double b2, double a0, double a1,
+                             double a2) {
+  filter->b0 = b0 / a0;
+  filter->b1 = b1 / a0;
+  filter->b2 = b2 / a0;
+  filter->a1 = a1 / a0;
+  filter->a2 = a2 / a0;
+}
+
+void biquad_lowpass(BiquadCoefficients *filter, double frequency) {
+  double omega = 2.0 * M_PI * frequency;
+  double alpha = std::sin(omega) / (2.0 * M_SQRT1_2);
+  double cos_omega = std::cos(omega);
+  biquad_normalize(filter, (1.0 - cos_omega) / 2.0, 1.0 - cos_omega, (1.0 - cos_omega) / 2.0, 1.0 + alpha,
+                   -2.0 * cos_omega, 1.0 - alpha);
+}
+
+void biquad_highpass(BiquadCoefficients *filter, double frequency) {
+  double omega = 2.0 * M_PI * frequency;
+  double alpha = std::sin(omega) / (2.0 * M_SQRT1_2);
+  double cos_omega = std::cos(omega);
+  biquad_normalize(filter, (1.0 + cos_omega) / 2.0, -(1.0 + cos_omega), (1.0 + cos_omega) / 2.0, 1.0 + alpha,
+                   -2.0 * cos_omega, 1.0 - alpha);
+}
+
+void biquad_apply_sample(Biquad *f, float *input, float *output, int /*stride*/) {
+  float in = *input * f->gain;
+  float out = f->coeffs.b0 * in + f->coeffs.b1 * f->in_d1 + f->coeffs.b2 * f->in_d2 - f->coeffs.a1 * f->out_d1 -
+              f->coeffs.a2 * f->out_d2;
+  f->in_d2 = f->in_d1;
+  f->in_d1 = in;
+  f->out_d2 = f->out_d1;
+  f->out_d1 = out;
+  *output = out;
+}
+
+void biquad_apply_buffer(Biquad *f, float *buffer, int num_samples, int stride) {
+  for (int i = 0; i < num_samples; ++i) {
+    biquad_apply_sample(f, buffer, buffer, stride);
+    buffer += stride;
+  }
+}
@@ -0,0 +1,95 @@
+#include "capture_speaker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+namespace harness {
+
+CaptureSpeaker::CaptureSpeaker(uint32_t sample_rate, uint8_t channels, uint32_t buffer_ms)
+    : sample_rate_(sample_rate), channels_(channels), buffer_frames_(sample_rate * buffer_ms / 1000) {
+  this->reset();
+}
+
+void CaptureSpeaker::reset() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->samples_.clear();
+  this->underruns_.clear();
+  this->first_sound_ms_ = -1.0;
+  this->buffered_frames_ = 0.0;
+  this->reset_at_ = Clock::now();
+  this->drained_at_ = this->reset_at_;
+}
+
+std::vector<int16_t> CaptureSpeaker::samples() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->samples_;
+}
+
+std::vector<CaptureSpeaker::Underrun> CaptureSpeaker::underruns() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->underruns_;
+}
+
+double CaptureSpeaker::first_sound_ms() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->first_sound_ms_;
+}
+
+size_t CaptureSpeaker::free_frames_(Clock::time_point now) {
+  if (this->buffer_frames_ == 0) {
+    return SIZE_MAX / 4;
+  }
+  double drained = std::chrono::duration<double>(now - this->drained_at_).count() * this->sample_rate_;
+  if ((drained > this->buffered_frames_) && !this->samples_.empty()) {
+    const size_t frame = this->samples_.size() / this->channels_;
+    if (!this->underruns_.empty() && (this->underruns_.back().frame == frame)) {
+      this->underruns_.back().frames += drained - this->buffered_frames_;
+    } else {
+      this->underruns_.push_back({frame, drained - this->buffered_frames_});
+    }
+  }
+  this->buffered_frames_ = std::max(0.0, this->buffered_frames_ - drained);
+  this->drained_at_ = now;
+  return this->buffer_frames_ - static_cast<size_t>(std::ceil(this->buffered_frames_));
+}
+
+size_t CaptureSpeaker::play(const uint8_t *data, size_t length, TickType_t ticks_to_wait) {
+  const size_t frame_bytes = this->channels_ * sizeof(int16_t);
+  const auto deadline = Clock::now() + std::chrono::milliseconds(ticks_to_wait);
+
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  size_t frames = 0;
+  while (true) {
+    auto now = Clock::now();
+    frames = std::min(length / frame_bytes, this->free_frames_(now));
+    if ((frames > 0) || (now >= deadline)) {
+      break;
+    }
+    // Not a FreeRTOS delay, so the calling task's counters only show its own waits
+    lock.unlock();
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    lock.lock();
+  }
+
+  if (frames > 0) {
+    const int16_t *samples = reinterpret_cast<const int16_t *>(data);
+    const size_t sample_count = frames * this->channels_;
+    if (this->first_sound_ms_ < 0) {
+      for (size_t i = 0; i < sample_count; ++i) {
+        if (samples[i] != 0) {
+          this->first_sound_ms_ = std::chrono::duration<double, std::milli>(Clock::now() - this->reset_at_).count();
+          break;
+        }
+      }
+    }
+    this->samples_.insert(this->samples_.end(), samples, samples + sample_count);
+    this->buffered_frames_ += frames;
+  }
+
+  return frames * frame_bytes;
+}
+
+}  // namespace harness
@@ -0,0 +1,64 @@
+#pragma once
+
+// A speaker for host tests that records everything it plays
+//  - With a buffer length, it behaves like I2S DMA buffers: it accepts audio while the buffer has room, and the buffer
+//    drains at the sample rate in real time. Without one, it accepts everything immediately.
+//  - Records when the first audible sample was accepted, measured from ``reset``, and every time the buffer ran dry
+//    after the first audio, which a real speaker would have played as silence
+
+#include "esphome/components/speaker/speaker.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace harness {
+
+class CaptureSpeaker : public esphome::speaker::Speaker {
+ public:
+  /// @param sample_rate frames per second the buffer drains at
+  /// @param channels interleaved channels of the audio played
+  /// @param buffer_ms length of the buffer; 0 accepts everything immediately
+  CaptureSpeaker(uint32_t sample_rate, uint8_t channels, uint32_t buffer_ms = 0);
+
+  size_t play(const uint8_t *data, size_t length, TickType_t ticks_to_wait) override;
+
+  /// @brief Clears the recording and restarts the clock for ``first_sound_ms``
+  void reset();
+
+  /// @brief Copy of every sample played since ``reset``
+  std::vector<int16_t> samples();
+
+  /// @brief Milliseconds from ``reset`` until the first nonzero sample was accepted
+  /// @return the time, or -1 if every sample so far is silent
+  double first_sound_ms();
+
+  struct Underrun {
+    size_t frame;   // Frames played before the buffer ran dry
+    double frames;  // Frames of silence until the next audio
+  };
+  /// @brief Every time the buffer ran dry since the first audio; only for speakers with a buffer
+  std::vector<Underrun> underruns();
+
+ protected:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief Frames of free space in the buffer; drains it up to now first
+  size_t free_frames_(Clock::time_point now);
+
+  std::mutex mutex_;
+  const uint32_t sample_rate_;
+  const uint8_t channels_;
+  const size_t buffer_frames_;
+
+  double buffered_frames_{0.0};
+  Clock::time_point drained_at_;
+
+  Clock::time_point reset_at_;
+  double first_sound_ms_{-1.0};
+  std::vector<int16_t> samples_;
+  std::vector<Underrun> underruns_;
+};
+
+}  // namespace harness
@@ -0,0 +1,19 @@
+#include <dsp.h>
+
+esp_err_t dsps_mulc_s16(const int16_t *input, int16_t *output, int len, int16_t C, int step_in, int step_out) {
+  for (int i = 0; i < len; ++i) {
+    int32_t acc = static_cast<int32_t>(input[i * step_in]) * C;
+    output[i * step_out] = static_cast<int16_t>(acc >> 15);
+  }
+  return ESP_OK;
+}
+
+esp_err_t dsps_biquad_f32(const float *input, float *output, int len, float *coef, float *w) {
+  for (int i = 0; i < len; ++i) {
+    float d0 = input[i] - coef[3] * w[0] - coef[4] * w[1];
+    output[i] = coef[0] * d0 + coef[1] * w[0] + coef[2] * w[1];
+    w[1] = w[0];
+    w[0] = d0;
+  }
+  return ESP_OK;
+}
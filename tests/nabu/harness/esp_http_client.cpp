@@ -0,0 +1,230 @@
+// Plain HTTP/1.1 client with the interface of ESP-IDF's. Supports http://host[:port]/path URLs, extra request headers,
+// and Content-Length bodies; redirects and chunked encoding aren't needed by the tests.
+
+#include <esp_http_client.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+struct esp_http_client {
+  std::string url;
+  std::string host;
+  std::string port;
+  std::string path;
+  int timeout_ms;
+  std::map<std::string, std::string> headers;
+
+  int socket{-1};
+  int status_code{0};
+  int64_t content_length{-1};
+  int64_t data_received{0};
+  // Body bytes received along with the headers
+  std::string pending;
+};
+
+static bool parse_url(esp_http_client *client) {
+  const std::string prefix = "http://";
+  if (client->url.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  size_t host_start = prefix.size();
+  size_t path_start = client->url.find('/', host_start);
+  std::string authority = client->url.substr(host_start, path_start - host_start);
+  client->path = (path_start == std::string::npos) ? "/" : client->url.substr(path_start);
+
+  size_t colon = authority.find(':');
+  if (colon == std::string::npos) {
+    client->host = authority;
+    client->port = "80";
+  } else {
+    client->host = authority.substr(0, colon);
+    client->port = authority.substr(colon + 1);
+  }
+  return !client->host.empty();
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+  esp_http_client *client = new esp_http_client();
+  client->url = config->url;
+  client->timeout_ms = (config->timeout_ms > 0) ? config->timeout_ms : 5000;
+  if (!parse_url(client)) {
+    delete client;
+    return nullptr;
+  }
+  return client;
+}
+
+static bool send_all(int socket, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t result = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (result <= 0) {
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int /*write_len*/) {
+  esp_http_client_close(client);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *address = nullptr;
+  if (getaddrinfo(client->host.c_str(), client->port.c_str(), &hints, &address) != 0) {
+    return ESP_FAIL;
+  }
+
+  client->socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  bool connected = (client->socket >= 0) && (connect(client->socket, address->ai_addr, address->ai_addrlen) == 0);
+  freeaddrinfo(address);
+  if (!connected) {
+    esp_http_client_close(client);
+    return ESP_FAIL;
+  }
+
+  timeval timeout = {client->timeout_ms / 1000, (client->timeout_ms % 1000) * 1000};
+  setsockopt(client->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::string request = "GET " + client->path + " HTTP/1.1\r\nHost: " + client->host + "\r\n";
+  for (const auto &header : client->headers) {
+    request += header.first + ": " + header.second + "\r\n";
+  }
+  request += "\r\n";
+  if (!send_all(client->socket, request)) {
+    esp_http_client_close(client);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+  std::string response;
+  size_t headers_end;
+  while ((headers_end = response.find("\r\n\r\n")) == std::string::npos) {
+    char buffer[512];
+    ssize_t received = recv(client->socket, buffer, sizeof(buffer), 0);
+    if (received <= 0) {
+      return ESP_FAIL;
+    }
+    response.append(buffer, received);
+  }
+
+  client->pending = response.substr(headers_end + 4);
+  response.resize(headers_end);
+
+  int major, minor;
+  if (sscanf(response.c_str(), "HTTP/%d.%d %d", &major, &minor, &client->status_code) != 3) {
+    return ESP_FAIL;
+  }
+
+  client->content_length = -1;
+  size_t line_start = response.find("\r\n");
+  while (line_start != std::string::npos) {
+    line_start += 2;
+    size_t line_end = response.find("\r\n", line_start);
+    std::string line = response.substr(line_start, line_end - line_start);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      std::string name = line.substr(0, colon);
+      for (char &c : name) {
+        c = tolower(c);
+      }
+      if (name == "content-length") {
+        client->content_length = strtoll(line.c_str() + colon + 1, nullptr, 10);
+      }
+    }
+    line_start = line_end;
+  }
+
+  client->data_received = 0;
+  return client->content_length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+  if (client->socket < 0) {
+    return -1;
+  }
+
+  int total = 0;
+  if (!client->pending.empty()) {
+    total = std::min<int>(len, client->pending.size());
+    std::memcpy(buffer, client->pending.data(), total);
+    client->pending.erase(0, total);
+  }
+
+  // Like ESP-IDF, keep reading until the buffer is full, the body ends, or the connection closes or times out
+  while (total < len) {
+    if ((client->content_length >= 0) && (client->data_received + total >= client->content_length)) {
+      break;
+    }
+    ssize_t received = recv(client->socket, buffer + total, len - total, 0);
+    if (received > 0) {
+      total += received;
+    } else if (received == 0) {
+      break;
+    } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      break;
+    } else if (total == 0) {
+      // Connection reset
+      return -1;
+    } else {
+      break;
+    }
+  }
+
+  client->data_received += total;
+  return total;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+  return (client->content_length >= 0) && (client->data_received >= client->content_length);
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) { return client->status_code; }
+
+esp_err_t esp_http_client_get_url(esp_http_client_handle_t client, char *url, const int len) {
+  if (static_cast<int>(client->url.size()) >= len) {
+    return ESP_FAIL;
+  }
+  std::strcpy(url, client->url.c_str());
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+  client->headers[key] = value;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key) {
+  client->headers.erase(key);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+  if (client->socket >= 0) {
+    close(client->socket);
+    client->socket = -1;
+  }
+  client->pending.clear();
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+  esp_http_client_close(client);
+  delete client;
+  return ESP_OK;
+}
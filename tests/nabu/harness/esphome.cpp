@@ -0,0 +1,28 @@
+// The ESPHome helpers the nabu audio code links against; the HAL timing functions are in freertos.cpp
+
+#include "esphome/components/media_player/media_player.h"
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+
+bool str_endswith(const std::string &str, const std::string &end) {
+  return (str.size() >= end.size()) && (str.compare(str.size() - end.size(), end.size(), end) == 0);
+}
+
+namespace media_player {
+
+const char *media_player_file_type_to_string(MediaFileType file_type) {
+  switch (file_type) {
+    case MediaFileType::FLAC:
+      return "FLAC";
+    case MediaFileType::MP3:
+      return "MP3";
+    case MediaFileType::WAV:
+      return "WAV";
+    default:
+      return "unknown";
+  }
+}
+
+}  // namespace media_player
+}  // namespace esphome
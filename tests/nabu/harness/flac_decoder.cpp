@@ -0,0 +1,455 @@
+// FLAC decoder with the interface of esp-audio-libs' decoder. Decodes CONSTANT, VERBATIM, FIXED, and LPC subframes
+// with any channel decorrelation, and checks each frame's header and frame CRCs.
+
+#include <flac_decoder.h>
+
+#include <cstring>
+
+namespace flac {
+
+static const uint32_t MAGIC_NUMBER_BYTES = 4;
+static const uint32_t BLOCK_HEADER_BYTES = 4;
+static const uint32_t STREAMINFO_BYTES = 34;
+
+static uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; ++i) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < length; ++i) {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x8005) : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+FLACDecoderResult FLACDecoder::read_header(size_t buffer_length) {
+  if (buffer_length < MAGIC_NUMBER_BYTES) {
+    return FLAC_DECODER_HEADER_OUT_OF_DATA;
+  }
+  if (std::memcmp(this->buffer_, "fLaC", MAGIC_NUMBER_BYTES) != 0) {
+    return FLAC_DECODER_ERROR_BAD_MAGIC_NUMBER;
+  }
+
+  size_t position = MAGIC_NUMBER_BYTES;
+  bool last_block = false;
+  while (!last_block) {
+    if (position + BLOCK_HEADER_BYTES > buffer_length) {
+      return FLAC_DECODER_HEADER_OUT_OF_DATA;
+    }
+    const uint8_t *header = this->buffer_ + position;
+    last_block = header[0] & 0x80;
+    uint8_t block_type = header[0] & 0x7F;
+    size_t block_length = (header[1] << 16) | (header[2] << 8) | header[3];
+    position += BLOCK_HEADER_BYTES;
+
+    if (position + block_length > buffer_length) {
+      return FLAC_DECODER_HEADER_OUT_OF_DATA;
+    }
+
+    if (block_type == 0) {
+      if (block_length < STREAMINFO_BYTES) {
+        return FLAC_DECODER_ERROR_BAD_HEADER;
+      }
+      const uint8_t *info = this->buffer_ + position;
+      this->min_block_size_ = (info[0] << 8) | info[1];
+      this->max_block_size_ = (info[2] << 8) | info[3];
+      this->sample_rate_ = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+      this->num_channels_ = ((info[12] >> 1) & 0x07) + 1;
+      this->sample_depth_ = (((info[12] & 0x01) << 4) | (info[13] >> 4)) + 1;
+    }
+
+    position += block_length;
+  }
+
+  if ((this->max_block_size_ == 0) || (this->sample_rate_ == 0)) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+
+  this->block_samples_.resize(this->max_block_size_ * this->num_channels_);
+  this->bytes_index_ = position;
+  this->bytes_left_ = buffer_length - position;
+  return FLAC_DECODER_SUCCESS;
+}
+
+void FLACDecoder::free_buffers() {
+  this->block_samples_.clear();
+  this->block_samples_.shrink_to_fit();
+}
+
+bool FLACDecoder::read_bits_(uint32_t count, uint32_t &value) {
+  if (this->bit_position_ + count > this->buffer_length_ * 8) {
+    return false;
+  }
+  value = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    size_t byte = this->bit_position_ >> 3;
+    uint32_t bit = (this->buffer_[byte] >> (7 - (this->bit_position_ & 7))) & 1;
+    value = (value << 1) | bit;
+    ++this->bit_position_;
+  }
+  return true;
+}
+
+bool FLACDecoder::read_signed_bits_(uint32_t count, int32_t &value) {
+  uint32_t raw;
+  if (!this->read_bits_(count, raw)) {
+    return false;
+  }
+  if ((count > 0) && (count < 32) && (raw & (1u << (count - 1)))) {
+    raw |= ~0u << count;
+  }
+  value = static_cast<int32_t>(raw);
+  return true;
+}
+
+bool FLACDecoder::read_rice_signed_(uint32_t parameter, int32_t &value) {
+  uint32_t quotient = 0;
+  uint32_t bit;
+  while (true) {
+    if (!this->read_bits_(1, bit)) {
+      return false;
+    }
+    if (bit) {
+      break;
+    }
+    ++quotient;
+  }
+  uint32_t remainder = 0;
+  if (!this->read_bits_(parameter, remainder)) {
+    return false;
+  }
+  uint32_t folded = (quotient << parameter) | remainder;
+  value = static_cast<int32_t>(folded >> 1) ^ -static_cast<int32_t>(folded & 1);
+  return true;
+}
+
+bool FLACDecoder::read_utf8_number_(uint64_t &value) {
+  uint32_t first;
+  if (!this->read_bits_(8, first)) {
+    return false;
+  }
+  uint32_t continuation_bytes = 0;
+  while ((continuation_bytes < 7) && (first & (0x80 >> continuation_bytes))) {
+    ++continuation_bytes;
+  }
+  if (continuation_bytes == 0) {
+    value = first;
+    return true;
+  }
+  value = first & (0x7F >> continuation_bytes);
+  for (uint32_t i = 1; i < continuation_bytes; ++i) {
+    uint32_t next;
+    if (!this->read_bits_(8, next)) {
+      return false;
+    }
+    value = (value << 6) | (next & 0x3F);
+  }
+  return true;
+}
+
+FLACDecoderResult FLACDecoder::decode_residuals_(uint32_t block_size, uint32_t order, int32_t *residuals) {
+  uint32_t method;
+  uint32_t partition_order;
+  if (!this->read_bits_(2, method) || !this->read_bits_(4, partition_order)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if (method > 1) {
+    return FLAC_DECODER_ERROR_RESERVED_RESIDUAL_CODING_METHOD;
+  }
+  const uint32_t parameter_bits = (method == 0) ? 4 : 5;
+  const uint32_t escape = (method == 0) ? 15 : 31;
+
+  const uint32_t partitions = 1u << partition_order;
+  if ((block_size % partitions) != 0) {
+    return FLAC_DECODER_ERROR_BLOCK_SIZE_NOT_DIVISIBLE_RICE;
+  }
+  const uint32_t partition_samples = block_size >> partition_order;
+  if (partition_samples < order) {
+    return FLAC_DECODER_ERROR_BLOCK_SIZE_NOT_DIVISIBLE_RICE;
+  }
+
+  uint32_t sample = 0;
+  for (uint32_t partition = 0; partition < partitions; ++partition) {
+    uint32_t count = (partition == 0) ? partition_samples - order : partition_samples;
+    uint32_t parameter;
+    if (!this->read_bits_(parameter_bits, parameter)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+    if (parameter == escape) {
+      uint32_t raw_bits;
+      if (!this->read_bits_(5, raw_bits)) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        if (!this->read_signed_bits_(raw_bits, residuals[sample++])) {
+          return FLAC_DECODER_ERROR_OUT_OF_DATA;
+        }
+      }
+    } else {
+      for (uint32_t i = 0; i < count; ++i) {
+        if (!this->read_rice_signed_(parameter, residuals[sample++])) {
+          return FLAC_DECODER_ERROR_OUT_OF_DATA;
+        }
+      }
+    }
+  }
+  return FLAC_DECODER_SUCCESS;
+}
+
+FLACDecoderResult FLACDecoder::decode_subframe_(uint32_t block_size, uint32_t sample_depth, int32_t *samples) {
+  uint32_t padding;
+  uint32_t type;
+  uint32_t has_wasted_bits;
+  if (!this->read_bits_(1, padding) || !this->read_bits_(6, type) || !this->read_bits_(1, has_wasted_bits)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if (padding != 0) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+
+  uint32_t wasted_bits = 0;
+  if (has_wasted_bits) {
+    uint32_t bit = 0;
+    do {
+      if (!this->read_bits_(1, bit)) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+      ++wasted_bits;
+    } while (bit == 0);
+    sample_depth -= wasted_bits;
+  }
+
+  if (type == 0) {
+    int32_t value;
+    if (!this->read_signed_bits_(sample_depth, value)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+    for (uint32_t i = 0; i < block_size; ++i) {
+      samples[i] = value;
+    }
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < block_size; ++i) {
+      if (!this->read_signed_bits_(sample_depth, samples[i])) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+    }
+  } else if ((type >= 8) && (type <= 12)) {
+    uint32_t order = type & 0x07;
+    if (order > 4) {
+      return FLAC_DECODER_ERROR_BAD_FIXED_PREDICTION_ORDER;
+    }
+    for (uint32_t i = 0; i < order; ++i) {
+      if (!this->read_signed_bits_(sample_depth, samples[i])) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+    }
+    FLACDecoderResult result = this->decode_residuals_(block_size, order, samples + order);
+    if (result != FLAC_DECODER_SUCCESS) {
+      return result;
+    }
+    static const int32_t FIXED_COEFFICIENTS[5][4] = {{0}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+    for (uint32_t i = order; i < block_size; ++i) {
+      int64_t prediction = 0;
+      for (uint32_t j = 0; j < order; ++j) {
+        prediction += static_cast<int64_t>(FIXED_COEFFICIENTS[order][j]) * samples[i - 1 - j];
+      }
+      samples[i] += static_cast<int32_t>(prediction);
+    }
+  } else if (type >= 32) {
+    uint32_t order = (type & 0x1F) + 1;
+    for (uint32_t i = 0; i < order; ++i) {
+      if (!this->read_signed_bits_(sample_depth, samples[i])) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+    }
+    uint32_t precision;
+    int32_t shift;
+    if (!this->read_bits_(4, precision) || !this->read_signed_bits_(5, shift)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+    if ((precision == 15) || (shift < 0)) {
+      return FLAC_DECODER_ERROR_BAD_HEADER;
+    }
+    ++precision;
+    int32_t coefficients[32];
+    for (uint32_t i = 0; i < order; ++i) {
+      if (!this->read_signed_bits_(precision, coefficients[i])) {
+        return FLAC_DECODER_ERROR_OUT_OF_DATA;
+      }
+    }
+    FLACDecoderResult result = this->decode_residuals_(block_size, order, samples + order);
+    if (result != FLAC_DECODER_SUCCESS) {
+      return result;
+    }
+    for (uint32_t i = order; i < block_size; ++i) {
+      int64_t prediction = 0;
+      for (uint32_t j = 0; j < order; ++j) {
+        prediction += static_cast<int64_t>(coefficients[j]) * samples[i - 1 - j];
+      }
+      samples[i] += static_cast<int32_t>(prediction >> shift);
+    }
+  } else {
+    return FLAC_DECODER_ERROR_RESERVED_SUBFRAME_TYPE;
+  }
+
+  if (wasted_bits > 0) {
+    for (uint32_t i = 0; i < block_size; ++i) {
+      samples[i] <<= wasted_bits;
+    }
+  }
+  return FLAC_DECODER_SUCCESS;
+}
+
+FLACDecoderResult FLACDecoder::decode_frame(size_t buffer_length, int16_t *output_buffer, uint32_t *num_samples) {
+  *num_samples = 0;
+  this->buffer_length_ = buffer_length;
+  this->bit_position_ = 0;
+  this->bytes_index_ = 0;
+  this->bytes_left_ = buffer_length;
+
+  if (buffer_length == 0) {
+    return FLAC_DECODER_NO_MORE_FRAMES;
+  }
+
+  uint32_t sync;
+  if (!this->read_bits_(15, sync)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if (sync != (0xFFF8 >> 1)) {
+    return FLAC_DECODER_ERROR_SYNC_NOT_FOUND;
+  }
+
+  uint32_t blocking_strategy, block_size_code, sample_rate_code, channel_assignment, sample_size_code, reserved;
+  if (!this->read_bits_(1, blocking_strategy) || !this->read_bits_(4, block_size_code) ||
+      !this->read_bits_(4, sample_rate_code) || !this->read_bits_(4, channel_assignment) ||
+      !this->read_bits_(3, sample_size_code) || !this->read_bits_(1, reserved)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if ((reserved != 0) || (sample_rate_code == 15) || (sample_size_code == 3)) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+  if (channel_assignment > 10) {
+    return FLAC_DECODER_ERROR_RESERVED_CHANNEL_ASSIGNMENT;
+  }
+
+  uint64_t frame_number;
+  if (!this->read_utf8_number_(frame_number)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+
+  uint32_t block_size;
+  if (block_size_code == 0) {
+    return FLAC_DECODER_ERROR_BAD_BLOCK_SIZE_CODE;
+  } else if (block_size_code == 1) {
+    block_size = 192;
+  } else if (block_size_code <= 5) {
+    block_size = 576 << (block_size_code - 2);
+  } else if (block_size_code == 6) {
+    if (!this->read_bits_(8, block_size)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+    ++block_size;
+  } else if (block_size_code == 7) {
+    if (!this->read_bits_(16, block_size)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+    ++block_size;
+  } else {
+    block_size = 256 << (block_size_code - 8);
+  }
+
+  uint32_t unused;
+  if (sample_rate_code == 12) {
+    if (!this->read_bits_(8, unused)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+  } else if ((sample_rate_code == 13) || (sample_rate_code == 14)) {
+    if (!this->read_bits_(16, unused)) {
+      return FLAC_DECODER_ERROR_OUT_OF_DATA;
+    }
+  }
+
+  const size_t header_bytes = this->bit_position_ / 8;
+  uint32_t header_crc;
+  if (!this->read_bits_(8, header_crc)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if (header_crc != crc8(this->buffer_, header_bytes)) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+
+  if (block_size > this->max_block_size_) {
+    return FLAC_DECODER_ERROR_BLOCK_SIZE_OUT_OF_RANGE;
+  }
+
+  static const uint32_t SAMPLE_SIZES[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  const uint32_t sample_depth = (sample_size_code == 0) ? this->sample_depth_ : SAMPLE_SIZES[sample_size_code];
+  const uint32_t channels = (channel_assignment < 8) ? channel_assignment + 1 : 2;
+  if (channels != this->num_channels_) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+
+  int32_t *channel_samples[8];
+  for (uint32_t channel = 0; channel < channels; ++channel) {
+    channel_samples[channel] = this->block_samples_.data() + channel * this->max_block_size_;
+    // The side channel of a decorrelated pair has one more bit
+    bool side = ((channel_assignment == 8) && (channel == 1)) || ((channel_assignment == 9) && (channel == 0)) ||
+                ((channel_assignment == 10) && (channel == 1));
+    FLACDecoderResult result =
+        this->decode_subframe_(block_size, sample_depth + (side ? 1 : 0), channel_samples[channel]);
+    if (result != FLAC_DECODER_SUCCESS) {
+      return result;
+    }
+  }
+
+  // Zero padding to the byte boundary, then the frame CRC
+  this->bit_position_ = (this->bit_position_ + 7) & ~static_cast<size_t>(7);
+  const size_t frame_bytes = this->bit_position_ / 8;
+  uint32_t frame_crc;
+  if (!this->read_bits_(16, frame_crc)) {
+    return FLAC_DECODER_ERROR_OUT_OF_DATA;
+  }
+  if (frame_crc != crc16(this->buffer_, frame_bytes)) {
+    return FLAC_DECODER_ERROR_BAD_HEADER;
+  }
+
+  int32_t *left = channel_samples[0];
+  int32_t *right = channel_samples[1];
+  for (uint32_t i = 0; i < block_size; ++i) {
+    if (channel_assignment == 8) {
+      right[i] = left[i] - right[i];
+    } else if (channel_assignment == 9) {
+      left[i] += right[i];
+    } else if (channel_assignment == 10) {
+      int32_t mid = (left[i] << 1) | (right[i] & 1);
+      int32_t side = right[i];
+      left[i] = (mid + side) >> 1;
+      right[i] = (mid - side) >> 1;
+    }
+  }
+
+  const uint32_t shift = (sample_depth > 16) ? sample_depth - 16 : 0;
+  for (uint32_t i = 0; i < block_size; ++i) {
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      *output_buffer++ = static_cast<int16_t>(channel_samples[channel][i] >> shift);
+    }
+  }
+
+  *num_samples = block_size * channels;
+  this->bytes_index_ = this->bit_position_ / 8;
+  this->bytes_left_ = buffer_length - this->bytes_index_;
+  return FLAC_DECODER_SUCCESS;
+}
+
+}  // namespace flac
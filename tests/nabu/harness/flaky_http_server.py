@@ -0,0 +1,129 @@
+"""HTTP server for the reader tests that drops connections partway through the body.
+
+Serves one file at every path and honours ``Range: bytes=N-`` requests. Each response
+is cut off after a random number of body bytes, either by closing the connection
+(FIN) or by resetting it (RST), until the end of the file is reached. The listening
+port is printed as the first line of stdout. ``GET /quit`` prints a summary line and
+stops the server.
+"""
+
+import argparse
+import http.server
+import random
+import socket
+import struct
+import sys
+import threading
+
+
+class FlakyHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):  # pylint: disable=redefined-builtin
+        pass
+
+    def do_GET(self):
+        server = self.server
+        self.close_connection = True
+
+        if self.path == "/quit":
+            self.send_response(200)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            print(
+                f"requests {server.requests} ranges {server.ranges} "
+                f"closes {server.closes} resets {server.resets}",
+                flush=True,
+            )
+            threading.Thread(target=server.shutdown, daemon=True).start()
+            return
+
+        data = server.data
+        start = 0
+        range_header = self.headers.get("Range")
+        if range_header is not None and server.ranges_supported:
+            start = int(range_header.split("=", 1)[1].split("-", 1)[0])
+            if start >= len(data):
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{len(data)}")
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+
+        with server.lock:
+            server.requests += 1
+            if start > 0:
+                server.ranges += 1
+            cut = start + server.random.randint(1, 2 * server.mean_bytes)
+            reset = server.random.random() < 0.5
+
+        body = data[start:]
+        if start > 0:
+            self.send_response(206)
+            self.send_header(
+                "Content-Range", f"bytes {start}-{len(data) - 1}/{len(data)}"
+            )
+        else:
+            self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+
+        if cut >= len(data):
+            self.wfile.write(body)
+            return
+
+        self.wfile.write(data[start:cut])
+        self.wfile.flush()
+        with server.lock:
+            if reset:
+                server.resets += 1
+            else:
+                server.closes += 1
+        if reset:
+            # A zero linger time makes close send RST instead of FIN
+            self.connection.setsockopt(
+                socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0)
+            )
+            self.connection.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("file", help="file served at every path")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument(
+        "--mean-bytes",
+        type=int,
+        default=32 * 1024,
+        help="average number of body bytes sent before a connection is dropped",
+    )
+    parser.add_argument(
+        "--no-ranges",
+        action="store_true",
+        help="ignore Range headers and always send the whole file",
+    )
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as file:
+        data = file.read()
+
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), FlakyHandler)
+    server.daemon_threads = True
+    server.data = data
+    server.mean_bytes = args.mean_bytes
+    server.ranges_supported = not args.no_ranges
+    server.random = random.Random(args.seed)
+    server.lock = threading.Lock()
+    server.requests = 0
+    server.ranges = 0
+    server.closes = 0
+    server.resets = 0
+
+    print(server.server_address[1], flush=True)
+    server.serve_forever()
+    server.server_close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
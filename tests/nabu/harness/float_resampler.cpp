@@ -0,0 +1,102 @@
+#include "float_resampler.h"
+
+#include <algorithm>
+
+namespace harness {
+
+FloatResampler::FloatResampler(uint32_t input_sample_rate, uint32_t output_sample_rate, uint8_t input_channels,
+                               uint8_t output_channels, size_t block_frames, esphome::nabu::ResamplerQuality quality)
+    : input_channels_(input_channels),
+      output_channels_(output_channels),
+      channels_(std::min(input_channels, output_channels)),
+      block_frames_(block_frames),
+      input_block_(block_frames * 2),
+      output_block_(block_frames * 2) {
+  // The filter setup of AudioResampler::start
+  const esphome::nabu::ResamplerProfile &profile = esphome::nabu::get_resampler_profile(quality);
+  const float sample_ratio = static_cast<float>(output_sample_rate) / static_cast<float>(input_sample_rate);
+  this->ratio_ = sample_ratio;
+  float lowpass_ratio = 1.0f;
+  if (sample_ratio < 1.0) {
+    lowpass_ratio -= (10.24 / 16);
+    lowpass_ratio = std::max(lowpass_ratio, 0.84f);
+    lowpass_ratio = std::max(lowpass_ratio, sample_ratio);
+  }
+  if (lowpass_ratio * sample_ratio < 0.98 && profile.use_pre_post_filter) {
+    biquad_lowpass(&this->lowpass_coeff_, lowpass_ratio * sample_ratio / 2.0);
+    this->pre_filter_ = true;
+  }
+  if (lowpass_ratio / sample_ratio < 0.98 && profile.use_pre_post_filter && !this->pre_filter_) {
+    biquad_lowpass(&this->lowpass_coeff_, lowpass_ratio / sample_ratio / 2.0);
+    this->post_filter_ = true;
+  }
+  if (this->pre_filter_ || this->post_filter_) {
+    for (int i = 0; i < this->channels_; ++i) {
+      biquad_init(&this->lowpass_[i][0], &this->lowpass_coeff_, 1.0);
+      biquad_init(&this->lowpass_[i][1], &this->lowpass_coeff_, 1.0);
+    }
+  }
+
+  if (sample_ratio < 1.0) {
+    this->resampler_ = resampleInit(this->channels_, profile.num_taps, profile.num_filters,
+                                    sample_ratio * lowpass_ratio, INCLUDE_LOWPASS);
+  } else if (lowpass_ratio < 1.0) {
+    this->resampler_ =
+        resampleInit(this->channels_, profile.num_taps, profile.num_filters, lowpass_ratio, INCLUDE_LOWPASS);
+  } else {
+    this->resampler_ = resampleInit(this->channels_, profile.num_taps, profile.num_filters, 1.0, 0);
+  }
+  resampleAdvancePosition(this->resampler_, profile.num_taps / 2.0);
+}
+
+FloatResampler::~FloatResampler() { resampleFree(this->resampler_); }
+
+void FloatResampler::process(const int16_t *input, size_t input_frames, std::vector<int16_t> &output) {
+  float *input_block = this->input_block_.data();
+  float *output_block = this->output_block_.data();
+
+  // The input that fits a block's output, as AudioResampler::resample limits it
+  const size_t block_input_limit =
+      std::min(this->block_frames_, static_cast<size_t>((this->block_frames_ - 1.0) / this->ratio_ - 1.0));
+  size_t frames_used = 0;
+  while (frames_used < input_frames) {
+    const size_t block_input_frames = std::min(input_frames - frames_used, block_input_limit);
+    const int16_t *block_input = input + frames_used * this->input_channels_;
+    if (this->input_channels_ > this->channels_) {
+      for (size_t i = 0; i < block_input_frames; ++i) {
+        input_block[i] =
+            (static_cast<float>(block_input[2 * i]) + static_cast<float>(block_input[2 * i + 1])) / 65536.0f;
+      }
+    } else {
+      for (size_t i = 0; i < block_input_frames * this->channels_; ++i) {
+        input_block[i] = static_cast<float>(block_input[i]) / 32768.0f;
+      }
+    }
+    if (this->pre_filter_) {
+      for (int i = 0; i < this->channels_; ++i) {
+        biquad_apply_buffer(&this->lowpass_[i][0], input_block + i, block_input_frames, this->channels_);
+        biquad_apply_buffer(&this->lowpass_[i][1], input_block + i, block_input_frames, this->channels_);
+      }
+    }
+
+    ResampleResult result = resampleProcessInterleaved(this->resampler_, input_block, block_input_frames,
+                                                       output_block, this->block_frames_, this->ratio_);
+
+    if (this->post_filter_) {
+      for (int i = 0; i < this->channels_; ++i) {
+        biquad_apply_buffer(&this->lowpass_[i][0], output_block + i, result.output_generated, this->channels_);
+        biquad_apply_buffer(&this->lowpass_[i][1], output_block + i, result.output_generated, this->channels_);
+      }
+    }
+    for (size_t i = 0; i < result.output_generated * this->channels_; ++i) {
+      const int16_t sample = static_cast<int16_t>(output_block[i] * 32767);
+      output.push_back(sample);
+      if (this->output_channels_ > this->channels_) {
+        output.push_back(sample);
+      }
+    }
+    frames_used += result.input_used;
+  }
+}
+
+}  // namespace harness
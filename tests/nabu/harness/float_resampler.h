@@ -0,0 +1,57 @@
+#pragma once
+
+// AudioResampler's floating point path on its own, for comparing the fixed point PolyphaseResampler against it
+//  - Every stream went through this path before PolyphaseResampler existed, and ratios it doesn't support still do.
+//    AudioResampler only takes it for those ratios (or with drift compensation, which moves the ratio), so the tests
+//    run this copy of it on plain buffers instead.
+//  - The same filters as AudioResampler with the given profile: int16 to float, the biquad pre or post filter,
+//    ``resampleProcessInterleaved``, then back to int16 by truncation. Stereo is downmixed before it is resampled for a
+//    mono output, and a mono result is duplicated for a stereo output.
+//  - Each stage runs over a block of output frames before the next starts. AudioResampler uses blocks of
+//    RESAMPLER_FLOAT_BLOCK_FRAMES; before it did, each stage ran over a whole call's worth, up to the resampler's
+//    internal_buffer_samples, through float buffers that size.
+
+#include "audio_resampler.h"
+
+#include <resampler.h>
+#include <biquad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace harness {
+
+class FloatResampler {
+ public:
+  /// @param input_channels channels in each input frame; 1 or 2
+  /// @param output_channels channels in each output frame; 1 or 2
+  /// @param block_frames most output frames each stage runs over at a time
+  /// @param quality the profile whose taps, filters, and biquads are used
+  FloatResampler(uint32_t input_sample_rate, uint32_t output_sample_rate, uint8_t input_channels,
+                 uint8_t output_channels, size_t block_frames = esphome::nabu::RESAMPLER_FLOAT_BLOCK_FRAMES,
+                 esphome::nabu::ResamplerQuality quality = esphome::nabu::ResamplerQuality::BALANCED);
+  ~FloatResampler();
+
+  /// @brief Converts the next part of the stream
+  /// @param input interleaved frames
+  /// @param input_frames number of frames
+  /// @param output (output) the converted frames are appended
+  void process(const int16_t *input, size_t input_frames, std::vector<int16_t> &output);
+
+ protected:
+  Resample *resampler_{nullptr};
+  Biquad lowpass_[2][2];
+  BiquadCoefficients lowpass_coeff_;
+  double ratio_;
+  uint8_t input_channels_;
+  uint8_t output_channels_;
+  uint8_t channels_;  // Channels that are filtered and resampled
+  size_t block_frames_;
+  std::vector<float> input_block_;
+  std::vector<float> output_block_;
+  bool pre_filter_{false};
+  bool post_filter_{false};
+};
+
+}  // namespace harness
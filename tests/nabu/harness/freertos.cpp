@@ -0,0 +1,458 @@
+// Host stand-in for FreeRTOS. Every task is a thread, and ticks are milliseconds of the steady clock.
+//  - Blocking calls wait on a condition variable in short slices, so vTaskDelete and vTaskSuspend take effect at the
+//    target task's next blocking call. A deleted task unwinds its thread with an exception.
+//  - Each task counts its wakeups (blocking calls that returned) and its vTaskDelay calls; see harness.h
+
+#include "harness.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "esphome/core/hal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Longest a blocked call sleeps before checking whether its task was deleted or suspended
+static const auto WAIT_SLICE = std::chrono::milliseconds(2);
+
+static const Clock::time_point START_TIME = Clock::now();
+
+struct HostTask {
+  std::string name;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notification_value{0};
+  bool notification_pending{false};
+  std::atomic<bool> deleted{false};
+  std::atomic<bool> suspended{false};
+  std::atomic<uint32_t> wakeups{0};
+  std::atomic<uint32_t> delays{0};
+};
+
+struct HostEventGroup {
+  std::mutex mutex;
+  std::condition_variable cv;
+  EventBits_t bits{0};
+};
+
+struct HostQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t length;
+  size_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+// Thrown in a deleted task to unwind its thread
+struct TaskDeleted {};
+
+static thread_local HostTask *current_task = nullptr;
+
+// Tasks created by the harness, so tests can look them up by name
+static std::mutex tasks_mutex;
+static std::vector<HostTask *> tasks;
+
+static HostTask *get_current_task() {
+  if (current_task == nullptr) {
+    // A thread the harness didn't create, e.g., the test's main thread; it is never deleted
+    current_task = new HostTask();
+    current_task->name = "main";
+  }
+  return current_task;
+}
+
+// Blocks until the predicate holds or the ticks elapse, in slices so the task notices when it is deleted or suspended
+template<typename Predicate>
+static bool wait_for(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, TickType_t ticks_to_wait,
+                     Predicate predicate) {
+  HostTask *task = get_current_task();
+  const auto deadline = Clock::now() + std::chrono::milliseconds(ticks_to_wait);
+  bool blocked = false;
+  while (true) {
+    if (task->deleted.load()) {
+      throw TaskDeleted();
+    }
+    if (predicate() && !task->suspended.load()) {
+      break;
+    }
+    const auto now = Clock::now();
+    if ((ticks_to_wait != portMAX_DELAY) && (now >= deadline) && !task->suspended.load()) {
+      break;
+    }
+    blocked = true;
+    auto until = now + WAIT_SLICE;
+    if ((ticks_to_wait != portMAX_DELAY) && (deadline < until)) {
+      until = deadline;
+    }
+    cv.wait_until(lock, until);
+  }
+  if (blocked) {
+    ++task->wakeups;
+  }
+  return predicate();
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+      return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+      return "ESP_ERR_TIMEOUT";
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
+
+// Tasks
+
+static void run_task(HostTask *task, TaskFunction_t function, void *params) {
+  current_task = task;
+  try {
+    function(params);
+  } catch (const TaskDeleted &) {
+  }
+}
+
+static HostTask *create_task(TaskFunction_t function, const char *name, void *params) {
+  HostTask *task = new HostTask();
+  task->name = name;
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.push_back(task);
+  }
+  task->thread = std::thread(run_task, task, function, params);
+  return task;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task, const char *name, uint32_t /*stack_depth*/,
+                                           void *params, UBaseType_t /*priority*/, StackType_t * /*stack*/,
+                                           StaticTask_t * /*task_buffer*/, BaseType_t /*core*/) {
+  return create_task(task, name, params);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char *name, uint32_t /*stack_depth*/, void *params,
+                               UBaseType_t /*priority*/, StackType_t * /*stack*/, StaticTask_t * /*task_buffer*/) {
+  return create_task(task, name, params);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t /*stack_depth*/, void *params,
+                                   UBaseType_t /*priority*/, TaskHandle_t *handle, BaseType_t /*core*/) {
+  TaskHandle_t created = create_task(task, name, params);
+  if (handle != nullptr) {
+    *handle = created;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *params,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(task, name, stack_depth, params, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if ((task == nullptr) || (task == current_task)) {
+    // The thread object stays with the handle; its memory is reclaimed when the process exits
+    get_current_task()->deleted.store(true);
+    throw TaskDeleted();
+  }
+  task->deleted.store(true);
+  task->suspended.store(false);
+  if (task->thread.joinable()) {
+    task->thread.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+  }
+  delete task;
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+  if (task == nullptr) {
+    task = get_current_task();
+  }
+  task->suspended.store(true);
+  if (task == current_task) {
+    vTaskDelay(0);
+  }
+}
+
+void vTaskResume(TaskHandle_t task) { task->suspended.store(false); }
+
+void vTaskDelay(TickType_t ticks) {
+  HostTask *task = get_current_task();
+  ++task->delays;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::unique_lock<std::mutex> lock(mutex);
+  const auto deadline = Clock::now() + std::chrono::milliseconds(ticks);
+  wait_for(lock, cv, ticks, [deadline]() { return Clock::now() >= deadline; });
+}
+
+void vTaskPrioritySet(TaskHandle_t /*task*/, UBaseType_t /*priority*/) {}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t /*task*/) { return 0; }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return get_current_task(); }
+
+TickType_t xTaskGetTickCount() {
+  return static_cast<TickType_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - START_TIME).count());
+}
+
+// Task notifications
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return xTaskNotify(task, 0, eIncrement); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  HostTask *task = get_current_task();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  wait_for(lock, task->cv, ticks_to_wait, [task]() { return task->notification_value > 0; });
+  uint32_t value = task->notification_value;
+  if (value > 0) {
+    task->notification_value = clear_on_exit ? 0 : value - 1;
+  }
+  task->notification_pending = false;
+  return value;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    switch (action) {
+      case eNoAction:
+        break;
+      case eSetBits:
+        task->notification_value |= value;
+        break;
+      case eIncrement:
+        ++task->notification_value;
+        break;
+      case eSetValueWithOverwrite:
+        task->notification_value = value;
+        break;
+      case eSetValueWithoutOverwrite:
+        if (task->notification_pending) {
+          return pdFAIL;
+        }
+        task->notification_value = value;
+        break;
+    }
+    task->notification_pending = true;
+  }
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t *value,
+                           TickType_t ticks_to_wait) {
+  HostTask *task = get_current_task();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (!task->notification_pending) {
+    task->notification_value &= ~bits_to_clear_on_entry;
+  }
+  bool notified = wait_for(lock, task->cv, ticks_to_wait, [task]() { return task->notification_pending; });
+  if (value != nullptr) {
+    *value = task->notification_value;
+  }
+  if (notified) {
+    task->notification_value &= ~bits_to_clear_on_exit;
+    task->notification_pending = false;
+  }
+  return notified ? pdTRUE : pdFALSE;
+}
+
+// Event groups
+
+EventGroupHandle_t xEventGroupCreate() { return new HostEventGroup(); }
+
+void vEventGroupDelete(EventGroupHandle_t group) { delete group; }
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  EventBits_t result;
+  {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    result = group->bits;
+  }
+  group->cv.notify_all();
+  return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  std::lock_guard<std::mutex> lock(group->mutex);
+  EventBits_t previous = group->bits;
+  group->bits &= ~bits;
+  return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  std::lock_guard<std::mutex> lock(group->mutex);
+  return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+  std::unique_lock<std::mutex> lock(group->mutex);
+  auto satisfied = [group, bits, wait_for_all]() {
+    return wait_for_all ? ((group->bits & bits) == bits) : ((group->bits & bits) != 0);
+  };
+  bool met = wait_for(lock, group->cv, ticks_to_wait, satisfied);
+  EventBits_t result = group->bits;
+  if (met && clear_on_exit) {
+    group->bits &= ~bits;
+  }
+  return result;
+}
+
+// Queues
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  HostQueue *queue = new HostQueue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait, bool front) {
+  {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!wait_for(lock, queue->cv, ticks_to_wait, [queue]() { return queue->items.size() < queue->length; })) {
+      return pdFAIL;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    std::vector<uint8_t> copy(bytes, bytes + queue->item_size);
+    if (front) {
+      queue->items.push_front(std::move(copy));
+    } else {
+      queue->items.push_back(std::move(copy));
+    }
+  }
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+  return queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+  return queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+  return queue_send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->items.clear();
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+  }
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait, bool remove) {
+  {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!wait_for(lock, queue->cv, ticks_to_wait, [queue]() { return !queue->items.empty(); })) {
+      return pdFAIL;
+    }
+    std::memcpy(item, queue->items.front().data(), queue->item_size);
+    if (remove) {
+      queue->items.pop_front();
+    }
+  }
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+  return queue_receive(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+  return queue_receive(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->items.clear();
+  }
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+// ESPHome HAL
+
+namespace esphome {
+
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+uint32_t millis() { return xTaskGetTickCount(); }
+
+uint32_t micros() {
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - START_TIME).count());
+}
+
+}  // namespace esphome
+
+// Harness counters
+
+namespace harness {
+
+uint32_t task_wakeups(TaskHandle_t task) { return task->wakeups.load(); }
+
+uint32_t task_delays(TaskHandle_t task) { return task->delays.load(); }
+
+TaskHandle_t find_task(const char *name) {
+  std::lock_guard<std::mutex> lock(tasks_mutex);
+  for (HostTask *task : tasks) {
+    if (!task->deleted.load() && (task->name == name)) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace harness
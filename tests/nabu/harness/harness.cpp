@@ -0,0 +1,72 @@
+#include "harness.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace harness {
+
+int failures = 0;
+
+int finish(const char *name) {
+  if (failures > 0) {
+    printf("%s: %d check(s) failed\n", name, failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+static void append_le(std::vector<uint8_t> &data, uint32_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    data.push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+std::vector<uint8_t> make_wav(const std::vector<int16_t> &samples, uint32_t sample_rate, uint8_t channels) {
+  const uint32_t data_bytes = samples.size() * sizeof(int16_t);
+  std::vector<uint8_t> wav;
+  wav.reserve(44 + data_bytes);
+
+  const char *riff = "RIFF";
+  wav.insert(wav.end(), riff, riff + 4);
+  append_le(wav, 36 + data_bytes, 4);
+  const char *wave_fmt = "WAVEfmt ";
+  wav.insert(wav.end(), wave_fmt, wave_fmt + 8);
+  append_le(wav, 16, 4);
+  append_le(wav, 1, 2);  // PCM
+  append_le(wav, channels, 2);
+  append_le(wav, sample_rate, 4);
+  append_le(wav, sample_rate * channels * sizeof(int16_t), 4);
+  append_le(wav, channels * sizeof(int16_t), 2);
+  append_le(wav, 16, 2);
+  const char *data = "data";
+  wav.insert(wav.end(), data, data + 4);
+  append_le(wav, data_bytes, 4);
+
+  const uint8_t *sample_bytes = reinterpret_cast<const uint8_t *>(samples.data());
+  wav.insert(wav.end(), sample_bytes, sample_bytes + data_bytes);
+  return wav;
+}
+
+std::vector<uint8_t> read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+std::vector<int16_t> make_sine(size_t frames, uint8_t channels, double frequency_ratio, double amplitude,
+                               double phase) {
+  std::vector<int16_t> samples(frames * channels);
+  for (size_t i = 0; i < frames; ++i) {
+    int16_t sample = static_cast<int16_t>(std::lround(amplitude * std::sin(2 * M_PI * frequency_ratio * i + phase)));
+    for (uint8_t channel = 0; channel < channels; ++channel) {
+      samples[i * channels + channel] = sample;
+    }
+  }
+  return samples;
+}
+
+}  // namespace harness
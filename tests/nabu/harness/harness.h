@@ -0,0 +1,95 @@
+#pragma once
+
+// Helpers shared by the nabu host tests and benchmarks
+//  - CHECK macros record failures and keep going; ``harness::finish`` prints the result and gives the exit code
+//  - Task counters from the FreeRTOS stand-in, e.g., to count a task's wakeups
+//  - A cycle counter for benchmarks and helpers that build media files in memory
+
+#include <freertos/FreeRTOS.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace harness {
+
+extern int failures;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      ++harness::failures; \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) \
+  do { \
+    auto actual_value = (actual); \
+    auto expected_value = (expected); \
+    if (!(static_cast<long long>(actual_value) == static_cast<long long>(expected_value))) { \
+      ++harness::failures; \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+              (long long) actual_value, (long long) expected_value); \
+    } \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+  do { \
+    double actual_value = (actual); \
+    double expected_value = (expected); \
+    if (!(std::fabs(actual_value - expected_value) <= (tolerance))) { \
+      ++harness::failures; \
+      fprintf(stderr, "%s:%d: CHECK_NEAR failed: %s is %g, expected %g +- %g\n", __FILE__, __LINE__, #actual, \
+              actual_value, expected_value, (double) (tolerance)); \
+    } \
+  } while (0)
+
+/// @brief Prints the test's result
+/// @return the process exit code; 0 if every check passed
+int finish(const char *name);
+
+/// @brief Number of times the task returned from a call that blocked it, including vTaskDelay
+uint32_t task_wakeups(TaskHandle_t task);
+/// @brief Number of vTaskDelay (and esphome::delay) calls the task made
+uint32_t task_delays(TaskHandle_t task);
+/// @brief Finds a live task created with the given name
+/// @return the task, or nullptr if there is none
+TaskHandle_t find_task(const char *name);
+
+/// @brief Timestamp counter for benchmarks; CPU reference cycles on x86, nanoseconds elsewhere
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/// @brief Builds a canonical 16 bit PCM WAV file
+std::vector<uint8_t> make_wav(const std::vector<int16_t> &samples, uint32_t sample_rate, uint8_t channels);
+
+/// @brief Reads a whole file
+/// @return its bytes; empty if it couldn't be read
+std::vector<uint8_t> read_file(const std::string &path);
+
+/// @brief A sine wave that never starts or ends in silence, so a dropped or inserted sample is easy to spot
+/// @param frames number of frames
+/// @param channels interleaved channels, each with the same samples
+/// @param frequency_ratio frequency as a fraction of the sample rate
+/// @param amplitude peak amplitude
+/// @param phase starting phase in radians
+std::vector<int16_t> make_sine(size_t frames, uint8_t channels, double frequency_ratio, double amplitude,
+                               double phase = 0.5);
+
+}  // namespace harness
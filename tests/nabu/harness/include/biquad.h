@@ -0,0 +1,19 @@
+#pragma once
+
+// The biquad interface of esp-audio-libs' resampler (from ART); frequencies are fractions of the sample rate
+
+typedef struct {
+  float b0, b1, b2, a1, a2;
+} BiquadCoefficients;
+
+typedef struct {
+  BiquadCoefficients coeffs;
+  float gain;
+  float in_d1, in_d2, out_d1, out_d2;
+} Biquad;
+
+void biquad_init(Biquad *f, const BiquadCoefficients *coeffs, float gain);
+void biquad_lowpass(BiquadCoefficients *filter, double frequency);
+void biquad_highpass(BiquadCoefficients *filter, double frequency);
+void biquad_apply_sample(Biquad *f, float *input, float *output, int stride);
+void biquad_apply_buffer(Biquad *f, float *buffer, int num_samples, int stride);
@@ -0,0 +1,13 @@
+#pragma once
+
+// The esp-dsp functions the nabu audio code uses, as plain C ports of esp-dsp's reference (ANSI) implementations
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+/// @brief output[i * step_out] = (input[i * step_in] * C) >> 15
+esp_err_t dsps_mulc_s16(const int16_t *input, int16_t *output, int len, int16_t C, int step_in, int step_out);
+
+/// @brief Direct form II biquad; coef is {b0, b1, b2, a1, a2} and w is the two element delay line
+esp_err_t dsps_biquad_f32(const float *input, float *output, int len, float *coef, float *w);
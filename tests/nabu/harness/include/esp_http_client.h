@@ -0,0 +1,32 @@
+#pragma once
+
+// The parts of ESP-IDF's HTTP client the nabu reader uses. The host version in esp_http_client.cpp speaks plain
+// HTTP/1.1 over a blocking socket; a read returns 0 when the server closes the connection early, as ESP-IDF does, and
+// a negative value when the connection is reset.
+
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef struct {
+  const char *url;
+  const char *cert_pem;
+  bool disable_auto_redirect;
+  int max_redirection_count;
+  int buffer_size;
+  bool keep_alive_enable;
+  int timeout_ms;
+  esp_err_t (*crt_bundle_attach)(void *conf);
+} esp_http_client_config_t;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+esp_err_t esp_http_client_get_url(esp_http_client_handle_t client, char *url, const int len);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace audio {
+
+struct AudioStreamInfo {
+  uint8_t bits_per_sample;
+  uint8_t channels;
+  uint32_t sample_rate;
+};
+
+}  // namespace audio
+}  // namespace esphome
@@ -0,0 +1,28 @@
+#pragma once
+
+// Only the media file types of esphome/components/media_player/media_player.h; the entity isn't needed
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+namespace media_player {
+
+enum class MediaFileType : uint8_t {
+  NONE = 0,
+  WAV,
+  MP3,
+  FLAC,
+};
+const char *media_player_file_type_to_string(MediaFileType file_type);
+
+struct MediaFile {
+  const uint8_t *data;
+  size_t length;
+  MediaFileType file_type;
+};
+
+}  // namespace media_player
+}  // namespace esphome
@@ -0,0 +1,22 @@
+#pragma once
+
+// Only the playback interface of ESPHome's speaker component; tests implement ``play``
+
+#include <freertos/FreeRTOS.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace speaker {
+
+class Speaker {
+ public:
+  virtual ~Speaker() = default;
+
+  virtual size_t play(const uint8_t *data, size_t length, TickType_t ticks_to_wait) = 0;
+  virtual size_t play(const uint8_t *data, size_t length) { return this->play(data, length, 0); }
+};
+
+}  // namespace speaker
+}  // namespace esphome
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+
+/// @brief Sleeps the calling task; counted like vTaskDelay
+void delay(uint32_t ms);
+uint32_t millis();
+uint32_t micros();
+
+}  // namespace esphome
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+
+// Only errors and warnings are printed, so test output stays readable
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "[E][%s] " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "[W][%s] " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ((void) (tag))
+#define ESP_LOGD(tag, format, ...) ((void) (tag))
+#define ESP_LOGV(tag, format, ...) ((void) (tag))
+#define ESP_LOGCONFIG(tag, format, ...) ((void) (tag))
@@ -0,0 +1,76 @@
+#pragma once
+
+// The interface of esp-audio-libs' FLAC decoder. The host version in flac_decoder.cpp decodes every subframe type of
+// 8 and 16 bit streams; the input always starts at the buffer given to the constructor.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flac {
+
+enum FLACDecoderResult {
+  FLAC_DECODER_SUCCESS = 0,
+  FLAC_DECODER_NO_MORE_FRAMES,
+  FLAC_DECODER_HEADER_OUT_OF_DATA,
+  FLAC_DECODER_ERROR_OUT_OF_DATA,
+  FLAC_DECODER_ERROR_BAD_MAGIC_NUMBER,
+  FLAC_DECODER_ERROR_SYNC_NOT_FOUND,
+  FLAC_DECODER_ERROR_BAD_BLOCK_SIZE_CODE,
+  FLAC_DECODER_ERROR_BAD_HEADER,
+  FLAC_DECODER_ERROR_RESERVED_CHANNEL_ASSIGNMENT,
+  FLAC_DECODER_ERROR_RESERVED_SUBFRAME_TYPE,
+  FLAC_DECODER_ERROR_BAD_FIXED_PREDICTION_ORDER,
+  FLAC_DECODER_ERROR_RESERVED_RESIDUAL_CODING_METHOD,
+  FLAC_DECODER_ERROR_BLOCK_SIZE_NOT_DIVISIBLE_RICE,
+  FLAC_DECODER_ERROR_MEMORY_ALLOCATION_ERROR,
+  FLAC_DECODER_ERROR_BLOCK_SIZE_OUT_OF_RANGE,
+};
+
+class FLACDecoder {
+ public:
+  FLACDecoder(uint8_t *buffer) : buffer_(buffer) {}
+
+  /// @brief Reads the "fLaC" marker and every metadata block
+  FLACDecoderResult read_header(size_t buffer_length);
+
+  /// @brief Decodes the frame at the start of the buffer into interleaved 16 bit samples
+  /// @param num_samples (output) samples written, counting every channel
+  FLACDecoderResult decode_frame(size_t buffer_length, int16_t *output_buffer, uint32_t *num_samples);
+
+  void free_buffers();
+
+  uint32_t get_sample_rate() const { return this->sample_rate_; }
+  uint32_t get_sample_depth() const { return this->sample_depth_; }
+  uint32_t get_num_channels() const { return this->num_channels_; }
+  uint32_t get_max_block_size() const { return this->max_block_size_; }
+  /// @brief Samples (of every channel) the output buffer must fit
+  uint32_t get_output_buffer_size() const { return this->max_block_size_ * this->num_channels_; }
+  size_t get_bytes_index() const { return this->bytes_index_; }
+  size_t get_bytes_left() const { return this->bytes_left_; }
+
+ protected:
+  bool read_bits_(uint32_t count, uint32_t &value);
+  bool read_signed_bits_(uint32_t count, int32_t &value);
+  bool read_rice_signed_(uint32_t parameter, int32_t &value);
+  bool read_utf8_number_(uint64_t &value);
+  FLACDecoderResult decode_subframe_(uint32_t block_size, uint32_t sample_depth, int32_t *samples);
+  FLACDecoderResult decode_residuals_(uint32_t block_size, uint32_t order, int32_t *residuals);
+
+  uint8_t *buffer_;
+  size_t buffer_length_{0};
+  size_t bit_position_{0};
+
+  size_t bytes_index_{0};
+  size_t bytes_left_{0};
+
+  uint32_t sample_rate_{0};
+  uint32_t sample_depth_{0};
+  uint32_t num_channels_{0};
+  uint32_t min_block_size_{0};
+  uint32_t max_block_size_{0};
+
+  std::vector<int32_t> block_samples_;
+};
+
+}  // namespace flac
@@ -0,0 +1,38 @@
+#pragma once
+
+// Host stand-in for the parts of FreeRTOS the nabu audio code uses. Tasks are threads, ticks are milliseconds, and
+// every blocking call can be interrupted by vTaskDelete; see freertos.cpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "esp_err.h"
+
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+typedef uint8_t StackType_t;
+
+struct StaticTask_t {
+  int unused;
+};
+
+typedef struct HostTask *TaskHandle_t;
+typedef struct HostEventGroup *EventGroupHandle_t;
+typedef struct HostQueue *QueueHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY 0xffffffffUL
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+#define tskNO_AFFINITY 0x7fffffff
+
+#include "task.h"
@@ -0,0 +1,35 @@
+#pragma once
+
+// The interface of esp-audio-libs' MP3 decoder (Helix). There is no host MP3 decoder: MP3FindSyncWord never finds a
+// frame, so MP3 streams fail to decode in host tests.
+
+#include <cstdint>
+
+typedef void *HMP3Decoder;
+
+enum {
+  ERR_MP3_NONE = 0,
+  ERR_MP3_INDATA_UNDERFLOW = -1,
+  ERR_MP3_MAINDATA_UNDERFLOW = -2,
+  ERR_MP3_FREE_BITRATE_SYNC = -3,
+  ERR_MP3_OUT_OF_MEMORY = -4,
+  ERR_MP3_NULL_POINTER = -5,
+  ERR_MP3_INVALID_FRAMEHEADER = -6,
+};
+
+typedef struct {
+  int bitrate;
+  int nChans;
+  int samprate;
+  int bitsPerSample;
+  int outputSamps;
+  int layer;
+  int version;
+} MP3FrameInfo;
+
+HMP3Decoder MP3InitDecoder();
+void MP3FreeDecoder(HMP3Decoder decoder);
+int MP3FindSyncWord(unsigned char *buffer, int bytes_left);
+int MP3GetNextFrameInfo(HMP3Decoder decoder, MP3FrameInfo *frame_info, unsigned char *buffer);
+int MP3Decode(HMP3Decoder decoder, unsigned char **input, int *bytes_left, short *output, int use_size);
+void MP3GetLastFrameInfo(HMP3Decoder decoder, MP3FrameInfo *frame_info);
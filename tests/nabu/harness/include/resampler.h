@@ -0,0 +1,22 @@
+#pragma once
+
+// The interface of esp-audio-libs' floating point resampler (from ART). The host version in resampler.cpp is a
+// windowed sinc interpolator with the same buffering and position semantics.
+
+#define SUBSAMPLE_INTERPOLATE 0x1
+#define BLACKMAN_HARRIS 0x2
+#define INCLUDE_LOWPASS 0x4
+
+typedef struct {
+  unsigned int input_used, output_generated;
+} ResampleResult;
+
+typedef struct Resample Resample;
+
+Resample *resampleInit(int numChannels, int numTaps, int numFilters, double lowpassRatio, int flags);
+ResampleResult resampleProcessInterleaved(Resample *cxt, const float *input, int numInputFrames, float *output,
+                                          int numOutputFrames, double ratio);
+unsigned int resampleGetRequiredSamples(Resample *cxt, int numOutputFrames, double ratio);
+void resampleAdvancePosition(Resample *cxt, double delta);
+void resampleReset(Resample *cxt);
+void resampleFree(Resample *cxt);
@@ -0,0 +1,53 @@
+#pragma once
+
+// The interface of esp-audio-libs' WAV header parser. ``next`` parses the ``bytes_needed`` bytes at ``*buffer``; the
+// caller then advances past them and skips ``bytes_to_skip`` more.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wav_decoder {
+
+enum WAVDecoderState : uint8_t {
+  WAV_DECODER_BEFORE_RIFF = 0,
+  WAV_DECODER_BEFORE_WAVE,
+  WAV_DECODER_BEFORE_FMT,
+  WAV_DECODER_IN_FMT,
+  WAV_DECODER_BEFORE_DATA,
+  WAV_DECODER_IN_DATA,
+};
+
+enum WAVDecoderResult : uint8_t {
+  WAV_DECODER_SUCCESS_NEXT = 0,
+  WAV_DECODER_SUCCESS_IN_DATA,
+  WAV_DECODER_ERROR_NO_RIFF,
+  WAV_DECODER_ERROR_NO_WAVE,
+};
+
+class WAVDecoder {
+ public:
+  WAVDecoder(uint8_t **buffer) : buffer_(buffer) {}
+
+  WAVDecoderState state() const { return this->state_; }
+  size_t bytes_to_skip() const { return this->bytes_to_skip_; }
+  size_t bytes_needed() const { return this->bytes_needed_; }
+  size_t chunk_bytes_left() const { return this->chunk_bytes_left_; }
+  uint32_t sample_rate() const { return this->sample_rate_; }
+  uint16_t num_channels() const { return this->num_channels_; }
+  uint16_t bits_per_sample() const { return this->bits_per_sample_; }
+
+  WAVDecoderResult next();
+  void reset();
+
+ protected:
+  uint8_t **buffer_;
+  WAVDecoderState state_{WAV_DECODER_BEFORE_RIFF};
+  size_t bytes_needed_{8};
+  size_t bytes_to_skip_{0};
+  size_t chunk_bytes_left_{0};
+  uint32_t sample_rate_{0};
+  uint16_t num_channels_{0};
+  uint16_t bits_per_sample_{0};
+};
+
+}  // namespace wav_decoder
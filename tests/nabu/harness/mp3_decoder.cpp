@@ -0,0 +1,26 @@
+// No MP3 decoder on the host; see mp3_decoder.h
+
+#include <mp3_decoder.h>
+
+#include <cstring>
+
+static int dummy_decoder;
+
+HMP3Decoder MP3InitDecoder() { return &dummy_decoder; }
+
+void MP3FreeDecoder(HMP3Decoder /*decoder*/) {}
+
+int MP3FindSyncWord(unsigned char * /*buffer*/, int /*bytes_left*/) { return -1; }
+
+int MP3GetNextFrameInfo(HMP3Decoder /*decoder*/, MP3FrameInfo * /*frame_info*/, unsigned char * /*buffer*/) {
+  return ERR_MP3_INVALID_FRAMEHEADER;
+}
+
+int MP3Decode(HMP3Decoder /*decoder*/, unsigned char ** /*input*/, int * /*bytes_left*/, short * /*output*/,
+              int /*use_size*/) {
+  return ERR_MP3_INVALID_FRAMEHEADER;
+}
+
+void MP3GetLastFrameInfo(HMP3Decoder /*decoder*/, MP3FrameInfo *frame_info) {
+  std::memset(frame_info, 0, sizeof(*frame_info));
+}
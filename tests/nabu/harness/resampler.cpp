@@ -0,0 +1,158 @@
+// Windowed sinc resampler with the interface and buffering of esp-audio-libs' floating point resampler (from ART)
+//  - The filter bank has num_filters + 1 phases of num_taps Blackman-Harris windowed sinc taps; each output either
+//    uses the nearest phase or, with SUBSAMPLE_INTERPOLATE, blends the outputs of the two phases around it
+//  - The history holds the last num_taps input frames, starting as silence. The next output is centered ``offset``
+//    frames after the frame num_taps / 2 - 1 back from the newest, so ``resampleAdvancePosition(num_taps / 2)`` lines
+//    the first output up with the first input frame.
+
+#include <resampler.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+struct Resample {
+  int num_channels;
+  int num_taps;
+  int num_filters;
+  int flags;
+  std::vector<float> filters;  // (num_filters + 1) phases of num_taps taps
+
+  // Frames [write_frame - num_taps, write_frame) are the history; the buffer holds twice that, so shifting it down is
+  // only needed once per num_taps input frames
+  std::vector<float> history;
+  int write_frame;
+
+  // Input frames still to push before the next output can be computed
+  double offset;
+};
+
+static double blackman_harris(double x, double width) {
+  // x is in [-width / 2, width / 2]
+  double phase = 2.0 * M_PI * x / width;
+  return 0.35875 + 0.48829 * std::cos(phase) + 0.14128 * std::cos(2 * phase) + 0.01168 * std::cos(3 * phase);
+}
+
+Resample *resampleInit(int numChannels, int numTaps, int numFilters, double lowpassRatio, int flags) {
+  if ((numChannels < 1) || (numTaps < 4) || (numTaps & 3) || (numFilters < 2)) {
+    return nullptr;
+  }
+
+  Resample *cxt = new Resample();
+  cxt->num_channels = numChannels;
+  cxt->num_taps = numTaps;
+  cxt->num_filters = numFilters;
+  cxt->flags = flags;
+  cxt->filters.resize((numFilters + 1) * numTaps);
+
+  const double cutoff = (flags & INCLUDE_LOWPASS) ? lowpassRatio : 1.0;
+  for (int phase_index = 0; phase_index <= numFilters; ++phase_index) {
+    const double phase = static_cast<double>(phase_index) / numFilters;
+    float *taps = &cxt->filters[phase_index * numTaps];
+    double sum = 0.0;
+    for (int k = 0; k < numTaps; ++k) {
+      // Distance of tap k from the output position, num_taps / 2 + phase
+      double x = k - numTaps / 2 - phase;
+      double sinc = (x == 0.0) ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+      double value = sinc * blackman_harris(x, numTaps);
+      taps[k] = value;
+      sum += value;
+    }
+    for (int k = 0; k < numTaps; ++k) {
+      taps[k] /= sum;
+    }
+  }
+
+  cxt->history.assign(2 * numTaps * numChannels, 0.0f);
+  cxt->write_frame = numTaps;
+  cxt->offset = 0.0;
+  return cxt;
+}
+
+static void push_frame(Resample *cxt, const float *frame) {
+  const int channels = cxt->num_channels;
+  if (cxt->write_frame == 2 * cxt->num_taps) {
+    std::memmove(cxt->history.data(), cxt->history.data() + cxt->num_taps * channels,
+                 cxt->num_taps * channels * sizeof(float));
+    cxt->write_frame = cxt->num_taps;
+  }
+  std::memcpy(&cxt->history[cxt->write_frame * channels], frame, channels * sizeof(float));
+  ++cxt->write_frame;
+}
+
+static void apply_filter(const Resample *cxt, const float *taps, float *output) {
+  const int channels = cxt->num_channels;
+  const float *window = &cxt->history[(cxt->write_frame - cxt->num_taps) * channels];
+  for (int channel = 0; channel < channels; ++channel) {
+    float sum = 0.0f;
+    for (int k = 0; k < cxt->num_taps; ++k) {
+      sum += taps[k] * window[k * channels + channel];
+    }
+    output[channel] = sum;
+  }
+}
+
+static void compute_output(const Resample *cxt, float *output) {
+  const double phase = cxt->offset * cxt->num_filters;
+  if (cxt->flags & SUBSAMPLE_INTERPOLATE) {
+    int lower = static_cast<int>(phase);
+    if (lower >= cxt->num_filters) {
+      lower = cxt->num_filters - 1;
+    }
+    const float fraction = phase - lower;
+    float lower_output[2];
+    float upper_output[2];
+    apply_filter(cxt, &cxt->filters[lower * cxt->num_taps], lower_output);
+    apply_filter(cxt, &cxt->filters[(lower + 1) * cxt->num_taps], upper_output);
+    for (int channel = 0; channel < cxt->num_channels; ++channel) {
+      output[channel] = lower_output[channel] + (upper_output[channel] - lower_output[channel]) * fraction;
+    }
+  } else {
+    int nearest = static_cast<int>(std::lround(phase));
+    apply_filter(cxt, &cxt->filters[nearest * cxt->num_taps], output);
+  }
+}
+
+ResampleResult resampleProcessInterleaved(Resample *cxt, const float *input, int numInputFrames, float *output,
+                                          int numOutputFrames, double ratio) {
+  ResampleResult result = {0, 0};
+  const double step = 1.0 / ratio;
+
+  while (true) {
+    if (cxt->offset >= 1.0) {
+      if (static_cast<int>(result.input_used) == numInputFrames) {
+        break;
+      }
+      push_frame(cxt, input + result.input_used * cxt->num_channels);
+      ++result.input_used;
+      cxt->offset -= 1.0;
+    } else {
+      if (static_cast<int>(result.output_generated) == numOutputFrames) {
+        break;
+      }
+      compute_output(cxt, output + result.output_generated * cxt->num_channels);
+      ++result.output_generated;
+      cxt->offset += step;
+    }
+  }
+
+  return result;
+}
+
+unsigned int resampleGetRequiredSamples(Resample *cxt, int numOutputFrames, double ratio) {
+  if (numOutputFrames <= 0) {
+    return 0;
+  }
+  double last_output = cxt->offset + (numOutputFrames - 1) / ratio;
+  return (last_output < 1.0) ? 0 : static_cast<unsigned int>(std::floor(last_output));
+}
+
+void resampleAdvancePosition(Resample *cxt, double delta) { cxt->offset += delta; }
+
+void resampleReset(Resample *cxt) {
+  std::fill(cxt->history.begin(), cxt->history.end(), 0.0f);
+  cxt->write_frame = cxt->num_taps;
+  cxt->offset = 0.0;
+}
+
+void resampleFree(Resample *cxt) { delete cxt; }
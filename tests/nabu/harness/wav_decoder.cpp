@@ -0,0 +1,77 @@
+#include <wav_decoder.h>
+
+#include <cstring>
+
+namespace wav_decoder {
+
+static uint32_t read_le(const uint8_t *data, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint32_t>(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+void WAVDecoder::reset() {
+  this->state_ = WAV_DECODER_BEFORE_RIFF;
+  this->bytes_needed_ = 8;  // "RIFF" and the file size
+  this->bytes_to_skip_ = 0;
+  this->chunk_bytes_left_ = 0;
+}
+
+WAVDecoderResult WAVDecoder::next() {
+  const uint8_t *data = *this->buffer_;
+  this->bytes_to_skip_ = 0;
+
+  switch (this->state_) {
+    case WAV_DECODER_BEFORE_RIFF:
+      if (std::memcmp(data, "RIFF", 4) != 0) {
+        return WAV_DECODER_ERROR_NO_RIFF;
+      }
+      this->state_ = WAV_DECODER_BEFORE_WAVE;
+      this->bytes_needed_ = 4;
+      return WAV_DECODER_SUCCESS_NEXT;
+
+    case WAV_DECODER_BEFORE_WAVE:
+      if (std::memcmp(data, "WAVE", 4) != 0) {
+        return WAV_DECODER_ERROR_NO_WAVE;
+      }
+      this->state_ = WAV_DECODER_BEFORE_FMT;
+      this->bytes_needed_ = 8;  // Chunk id and size
+      return WAV_DECODER_SUCCESS_NEXT;
+
+    case WAV_DECODER_BEFORE_FMT:
+    case WAV_DECODER_BEFORE_DATA: {
+      uint32_t chunk_size = read_le(data + 4, 4);
+      if ((this->state_ == WAV_DECODER_BEFORE_FMT) && (std::memcmp(data, "fmt ", 4) == 0)) {
+        this->state_ = WAV_DECODER_IN_FMT;
+        this->bytes_needed_ = chunk_size;
+      } else if ((this->state_ == WAV_DECODER_BEFORE_DATA) && (std::memcmp(data, "data", 4) == 0)) {
+        this->state_ = WAV_DECODER_IN_DATA;
+        this->bytes_needed_ = 0;
+        this->chunk_bytes_left_ = chunk_size;
+        return WAV_DECODER_SUCCESS_IN_DATA;
+      } else {
+        // Chunks are padded to an even length
+        this->bytes_to_skip_ = chunk_size + (chunk_size & 1);
+        this->bytes_needed_ = 8;
+      }
+      return WAV_DECODER_SUCCESS_NEXT;
+    }
+
+    case WAV_DECODER_IN_FMT:
+      this->num_channels_ = read_le(data + 2, 2);
+      this->sample_rate_ = read_le(data + 4, 4);
+      this->bits_per_sample_ = read_le(data + 14, 2);
+      this->state_ = WAV_DECODER_BEFORE_DATA;
+      this->bytes_needed_ = 8;
+      return WAV_DECODER_SUCCESS_NEXT;
+
+    case WAV_DECODER_IN_DATA:
+      return WAV_DECODER_SUCCESS_IN_DATA;
+  }
+
+  return WAV_DECODER_ERROR_NO_RIFF;
+}
+
+}  // namespace wav_decoder
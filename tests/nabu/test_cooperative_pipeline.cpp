@@ -0,0 +1,84 @@
+// Plays an announcement through a cooperative pipeline and a mixer into a real time speaker, and checks that the
+// pipeline task only sleeps on the mixer's releases: it never falls back to polling while the mixer input is full, and
+// the first audio reaches the speaker right away.
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_pipeline.h"
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t SPEAKER_BUFFER_MS = 100;
+static const uint32_t SOURCE_SAMPLE_RATE = 16000;
+static const size_t SOURCE_FRAMES = SOURCE_SAMPLE_RATE * 3 / 2;
+
+// Generous for a host; the first block is ready within a couple of milliseconds
+static const double MAX_FIRST_SOUND_MS = 50.0;
+
+static bool wait_for_playback(AudioPipeline &pipeline, harness::CaptureSpeaker &speaker, size_t samples) {
+  for (int i = 0; i < 1000; ++i) {
+    pipeline.get_state();
+    if (speaker.samples().size() >= samples) {
+      return true;
+    }
+    delay(10);
+  }
+  return false;
+}
+
+int main() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2, SPEAKER_BUFFER_MS);
+
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  MixerInputSettings settings;
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+
+  std::vector<uint8_t> wav = harness::make_wav(
+      harness::make_sine(SOURCE_FRAMES, 1, 440.0 / SOURCE_SAMPLE_RATE, 10000), SOURCE_SAMPLE_RATE, 1);
+  media_player::MediaFile file{wav.data(), wav.size(), media_player::MediaFileType::WAV};
+
+  AudioPipeline pipeline(&mixer, input, true);
+  pipeline.set_low_latency(true);
+
+  speaker.reset();
+  CHECK_EQ(pipeline.start(&file, SAMPLE_RATE, "ann"), ESP_OK);
+
+  // The task is created by start
+  TaskHandle_t task = harness::find_task("ann_pipeline");
+  CHECK(task != nullptr);
+  const uint32_t delays_before = (task != nullptr) ? harness::task_delays(task) : 0;
+  const uint32_t wakeups_before = (task != nullptr) ? harness::task_wakeups(task) : 0;
+
+  // Most of the stream is resampled before the speaker has played much, so the task spends nearly all of it waiting
+  // for room in the mixer input
+  const size_t expected_samples = SOURCE_FRAMES * (SAMPLE_RATE / SOURCE_SAMPLE_RATE) * 2;
+  CHECK(wait_for_playback(pipeline, speaker, expected_samples * 99 / 100));
+
+  const uint32_t delays = (task != nullptr) ? harness::task_delays(task) - delays_before : 0;
+  const uint32_t wakeups = (task != nullptr) ? harness::task_wakeups(task) - wakeups_before : 0;
+  const double first_sound_ms = speaker.first_sound_ms();
+  printf("test_cooperative_pipeline: first sound after %.1f ms, %u idle delays, %u wakeups for %.1f s of audio\n",
+         first_sound_ms, delays, wakeups, static_cast<double>(SOURCE_FRAMES) / SOURCE_SAMPLE_RATE);
+
+  CHECK(first_sound_ms >= 0.0);
+  CHECK(first_sound_ms < MAX_FIRST_SOUND_MS);
+  // A file source never runs dry, so the only waits are for the mixer's releases
+  CHECK_EQ(delays, 0);
+
+  CHECK_EQ(pipeline.stop(), ESP_OK);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+
+  return harness::finish("test_cooperative_pipeline");
+}
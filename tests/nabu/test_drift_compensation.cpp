@@ -0,0 +1,212 @@
+// Simulates a live stream whose clock drifts from the output's, through the media pipeline's buffers, and checks that
+// drift compensation settles on the clocks' offset
+//  - A 128 kbps MP3 stream of 44.1 kHz mono audio, produced at the source's clock offset by a set ppm. It arrives in
+//    TCP segments, starts with a burst of already buffered audio like Icecast servers send, and a Wi-Fi stall holds
+//    it back for a second every few minutes.
+//  - The buffers are sized like the media pipeline's: about 4 s of encoded data (the raw file ring buffer), 500 ms of
+//    decoded audio, and AudioMixer's 250 ms input ring buffer. The decoder is a stand-in that turns each 418 byte
+//    frame into 1152 decoded frames; AudioResampler is the real one, converting to 48 kHz with drift compensation.
+//  - The mixer reads 10 ms at exactly 48 kHz, once playback starts
+//  - Time advances in steps of the mixer's reads. The ratio the resampler actually applied is measured from the frames
+//    it took and made over the last part of the stream, and must undo the source's offset.
+//  - A download, which the reader pulls faster than real time, must play at the nominal ratio
+
+#include "harness.h"
+
+#include "audio_resampler.h"
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SOURCE_SAMPLE_RATE = 44100;
+static const uint32_t OUTPUT_SAMPLE_RATE = 48000;
+static const uint32_t BITRATE = 128000;
+static const size_t MP3_FRAME_SAMPLES = 1152;
+static const double MP3_FRAME_BYTES = static_cast<double>(BITRATE) / 8 * MP3_FRAME_SAMPLES / SOURCE_SAMPLE_RATE;
+
+// The media pipeline's buffers, sized for this stream (see AudioPipeline::size_buffers_for_stream_)
+static const size_t RAW_RING_BUFFER_BYTES = 64 * 1024;
+static const size_t RAW_RING_BUFFER_GUARD_BYTES = 4 * 1024;
+static const size_t DECODED_RING_BUFFER_BYTES = 44 * 1024;
+static const size_t DECODED_RING_BUFFER_GUARD_BYTES = 4608 * 2 * sizeof(int16_t);
+static const size_t RESAMPLER_BUFFER_SAMPLES = 32768;
+// AudioMixer's input ring buffer
+static const size_t MIXER_INPUT_FRAMES = 12000;
+static const size_t MIXER_INPUT_GUARD_BYTES = 2048;
+static const uint32_t MIXER_READ_MS = 10;
+static const size_t MIXER_READ_FRAMES = OUTPUT_SAMPLE_RATE / 1000 * MIXER_READ_MS;
+static const size_t MIXER_START_FRAMES = OUTPUT_SAMPLE_RATE / 10;
+
+static const size_t TCP_SEGMENT_BYTES = 1460;
+static const uint32_t BURST_MS = 2000;
+static const uint32_t STALL_INTERVAL_MS = 5 * 60 * 1000;
+static const uint32_t STALL_MS = 1000;
+
+static const uint32_t LIVE_MINUTES = 40;
+static const uint32_t DOWNLOAD_MINUTES = 10;
+// The ratio and fill are measured after this long
+static const uint32_t SETTLE_MINUTES = 25;
+
+// The limits
+static const double MAX_RATIO_ERROR_PPM = 10.0;
+static const double MAX_DOWNLOAD_CORRECTION_PPM = 5.0;
+// Of the total capacity, around the half the compensator targets
+static const double MAX_FILL_ERROR = 0.1;
+
+struct Result {
+  double correction_ppm;  // The ratio applied over the measured part, relative to the nominal ratio
+  double fill_fraction;   // Average total fill over the measured part, relative to the capacity
+  double min_fill_fraction;
+  double max_fill_fraction;
+  uint32_t underruns;
+};
+
+/// @param offset_ppm how much faster the source's clock runs than the output's
+/// @param live true for a live stream, false for a download the reader pulls as fast as the buffers allow
+static Result simulate(double offset_ppm, bool live, uint32_t minutes) {
+  auto raw_ring_buffer = AudioRingBuffer::create(RAW_RING_BUFFER_BYTES, RAW_RING_BUFFER_GUARD_BYTES);
+  auto decoded_ring_buffer = AudioRingBuffer::create(DECODED_RING_BUFFER_BYTES, DECODED_RING_BUFFER_GUARD_BYTES);
+  auto mixer_input_ring_buffer =
+      AudioRingBuffer::create(MIXER_INPUT_FRAMES * sizeof(int16_t), MIXER_INPUT_GUARD_BYTES);
+
+  AudioResampler resampler(decoded_ring_buffer.get(), mixer_input_ring_buffer.get(), RESAMPLER_BUFFER_SAMPLES);
+  resampler.set_ticks_to_wait(0);
+  // The filters don't change how much is buffered, so the cheapest profile keeps the simulation short
+  resampler.set_quality(ResamplerQuality::VOICE);
+  resampler.set_drift_compensation(true);
+  resampler.set_upstream_buffer(raw_ring_buffer.get(), BITRATE);
+  audio::AudioStreamInfo stream_info{16, 1, SOURCE_SAMPLE_RATE};
+  ResampleInfo resample_info;
+  CHECK_EQ(resampler.start(stream_info, OUTPUT_SAMPLE_RATE, 1, resample_info), ESP_OK);
+
+  const double output_frames_per_byte = 8.0 * OUTPUT_SAMPLE_RATE / BITRATE;
+  const double capacity_frames = RAW_RING_BUFFER_BYTES * output_frames_per_byte +
+                                 DECODED_RING_BUFFER_BYTES / sizeof(int16_t) * OUTPUT_SAMPLE_RATE / SOURCE_SAMPLE_RATE +
+                                 MIXER_INPUT_FRAMES;
+
+  const std::vector<int16_t> mp3_frame = harness::make_sine(MP3_FRAME_SAMPLES, 1, 1000.0 / SOURCE_SAMPLE_RATE, 8000);
+  std::vector<int16_t> mixer_block(MIXER_READ_FRAMES);
+
+  // Encoded bytes the source has produced but the reader hasn't taken: queued at the server or in flight
+  double source_bytes = live ? static_cast<double>(BITRATE) / 8 * BURST_MS / 1000 : 0.0;
+  double delivered_bytes = 0.0;            // Bytes that reached the device but the reader hasn't written yet
+  double decoder_bytes = MP3_FRAME_BYTES;  // Encoded bytes of the current MP3 frame still to read
+  const double source_bytes_per_step =
+      static_cast<double>(BITRATE) / 8 / 1000 * MIXER_READ_MS * (1.0 + offset_ppm * 1e-6);
+
+  bool playing = false;
+  Result result{};
+  const uint32_t settle_ms = std::min(SETTLE_MINUTES, minutes / 2) * 60 * 1000;
+  const uint32_t end_ms = minutes * 60 * 1000;
+  uint64_t measured_input_frames = 0, measured_output_frames = 0;
+  double fill_sum = 0.0;
+  uint32_t fill_count = 0;
+  result.min_fill_fraction = 1.0;
+
+  for (uint32_t ms = 0; ms < end_ms; ms += MIXER_READ_MS) {
+    // The network: the source keeps producing, and segments reach the device unless Wi-Fi is stalled
+    if (live) {
+      source_bytes += source_bytes_per_step;
+      if ((ms % STALL_INTERVAL_MS) < STALL_INTERVAL_MS - STALL_MS) {
+        while (source_bytes >= TCP_SEGMENT_BYTES) {
+          source_bytes -= TCP_SEGMENT_BYTES;
+          delivered_bytes += TCP_SEGMENT_BYTES;
+        }
+      }
+    } else {
+      delivered_bytes = raw_ring_buffer->free();
+    }
+
+    // The reader. The encoded bytes' contents don't matter to the stand-in decoder.
+    uint8_t *raw_data;
+    size_t raw_bytes = raw_ring_buffer->reserve(&raw_data, 0, 0);
+    raw_bytes = std::min(raw_bytes, static_cast<size_t>(delivered_bytes));
+    raw_ring_buffer->commit(raw_bytes);
+    delivered_bytes -= raw_bytes;
+
+    // The decoder: once a frame's encoded bytes are read, its decoded audio is written when there is room. Frames are
+    // a fraction of a byte longer or shorter than MP3_FRAME_BYTES on average, and the fraction carries over.
+    while (true) {
+      if (decoder_bytes > 0.0) {
+        const size_t bytes = std::min<size_t>(std::ceil(decoder_bytes), raw_ring_buffer->available());
+        raw_ring_buffer->release(bytes);
+        decoder_bytes -= bytes;
+        if (decoder_bytes > 0.0) {
+          break;
+        }
+      }
+      if (decoded_ring_buffer->free() < mp3_frame.size() * sizeof(int16_t)) {
+        break;
+      }
+      decoded_ring_buffer->write(mp3_frame.data(), mp3_frame.size() * sizeof(int16_t), 0);
+      decoder_bytes += MP3_FRAME_BYTES;
+    }
+
+    // The resampler
+    const bool measuring = ms >= settle_ms;
+    do {
+      const size_t decoded_bytes = decoded_ring_buffer->available();
+      const size_t output_bytes = mixer_input_ring_buffer->available();
+      resampler.resample(false);
+      if (measuring) {
+        measured_input_frames += (decoded_bytes - decoded_ring_buffer->available()) / sizeof(int16_t);
+        measured_output_frames += (mixer_input_ring_buffer->available() - output_bytes) / sizeof(int16_t);
+      }
+    } while (resampler.get_bytes_moved() > 0);
+
+    // The mixer
+    if (!playing && (mixer_input_ring_buffer->available() >= MIXER_START_FRAMES * sizeof(int16_t))) {
+      playing = true;
+    }
+    if (playing) {
+      const size_t read = mixer_input_ring_buffer->read(mixer_block.data(), MIXER_READ_FRAMES * sizeof(int16_t), 0);
+      if (read < MIXER_READ_FRAMES * sizeof(int16_t)) {
+        ++result.underruns;
+      }
+    }
+
+    if (measuring) {
+      const double fill = raw_ring_buffer->available() * output_frames_per_byte +
+                          decoded_ring_buffer->available() / sizeof(int16_t) * OUTPUT_SAMPLE_RATE / SOURCE_SAMPLE_RATE +
+                          mixer_input_ring_buffer->available() / sizeof(int16_t);
+      const double fraction = fill / capacity_frames;
+      fill_sum += fraction;
+      ++fill_count;
+      result.min_fill_fraction = std::min(result.min_fill_fraction, fraction);
+      result.max_fill_fraction = std::max(result.max_fill_fraction, fraction);
+    }
+  }
+
+  const double nominal_ratio = static_cast<double>(OUTPUT_SAMPLE_RATE) / SOURCE_SAMPLE_RATE;
+  const double ratio = static_cast<double>(measured_output_frames) / std::max<uint64_t>(measured_input_frames, 1);
+  result.correction_ppm = (ratio / nominal_ratio - 1.0) * 1e6;
+  result.fill_fraction = fill_sum / std::max<uint32_t>(fill_count, 1);
+  return result;
+}
+
+int main() {
+  for (double offset_ppm : {-300.0, -50.0, 0.0, 50.0, 300.0}) {
+    const Result result = simulate(offset_ppm, true, LIVE_MINUTES);
+    // A source that is faster by offset_ppm needs that many fewer output frames per input frame
+    const double expected_ppm = -offset_ppm / (1.0 + offset_ppm * 1e-6);
+    printf("test_drift_compensation: live source %+6.0f ppm: ratio corrected by %+7.1f ppm, total fill %.2f of the "
+           "capacity (%.2f to %.2f), %u underruns\n",
+           offset_ppm, result.correction_ppm, result.fill_fraction, result.min_fill_fraction, result.max_fill_fraction,
+           result.underruns);
+    CHECK_NEAR(result.correction_ppm, expected_ppm, MAX_RATIO_ERROR_PPM);
+    CHECK_NEAR(result.fill_fraction, 0.5, MAX_FILL_ERROR);
+    CHECK_EQ(result.underruns, 0);
+  }
+
+  const Result download = simulate(0.0, false, DOWNLOAD_MINUTES);
+  printf("test_drift_compensation: download: ratio corrected by %+.1f ppm, total fill %.2f of the capacity\n",
+         download.correction_ppm, download.fill_fraction);
+  CHECK(std::fabs(download.correction_ppm) <= MAX_DOWNLOAD_CORRECTION_PPM);
+  CHECK_EQ(download.underruns, 0);
+
+  return harness::finish("test_drift_compensation");
+}
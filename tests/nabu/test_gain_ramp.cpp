@@ -0,0 +1,186 @@
+// Checks GainRamp's per frame gains for both shapes
+//  - Applying a ramp in blocks of any size gives exactly the samples of applying it in one go, so block boundaries
+//    never show up as steps
+//  - Linear ramps move by equal amplitude steps and exponential ramps by equal dB steps, and both end exactly on their
+//    target after the requested number of frames
+//  - Retargeting in the middle of a ramp continues from the current gain without a jump
+//  - ``advance`` leaves the ramp where stepping it frame by frame would
+
+#include "harness.h"
+
+#include "gain_ramp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace esphome::nabu;
+
+static const size_t RAMP_FRAMES = 48000;
+static const int16_t UNITY = INT16_MAX;
+// -20 dB in Q15
+static const int16_t DUCKED = 3277;
+static const size_t BLOCK_SIZES[] = {1, 7, 128, 333, 4096};
+// Full scale input, so the output samples are the gains themselves
+static const int16_t FULL_SCALE = INT16_MAX;
+
+static const char *shape_name(GainRampShape shape) {
+  return (shape == GainRampShape::LINEAR) ? "linear" : "exponential";
+}
+
+/// @brief Applies a ramp to full scale stereo input in blocks of ``block_frames``
+/// @return the left channel of the output
+static std::vector<int16_t> apply_in_blocks(GainRamp ramp, size_t frames, size_t block_frames) {
+  std::vector<int16_t> input(frames * 2, FULL_SCALE);
+  std::vector<int16_t> output(frames * 2);
+  for (size_t frame = 0; frame < frames; frame += block_frames) {
+    size_t block = std::min(block_frames, frames - frame);
+    ramp.apply(input.data() + frame * 2, output.data() + frame * 2, block, 2);
+  }
+  std::vector<int16_t> left(frames);
+  for (size_t i = 0; i < frames; ++i) {
+    left[i] = output[2 * i];
+    if (output[2 * i + 1] != output[2 * i]) {
+      CHECK_EQ(output[2 * i + 1], output[2 * i]);
+      break;
+    }
+  }
+  return left;
+}
+
+/// @brief The largest change between two consecutive gains
+static int max_step(const std::vector<int32_t> &gains) {
+  int step = 0;
+  for (size_t i = 1; i < gains.size(); ++i) {
+    step = std::max(step, std::abs(gains[i] - gains[i - 1]));
+  }
+  return step;
+}
+
+static std::vector<int32_t> next_gains(GainRamp &ramp, size_t frames) {
+  std::vector<int32_t> gains(frames);
+  for (auto &gain : gains) {
+    gain = ramp.next_gain();
+  }
+  return gains;
+}
+
+static void check_blocks(GainRampShape shape, int16_t from, int16_t to) {
+  GainRamp ramp;
+  ramp.set(from);
+  ramp.ramp_to(to, RAMP_FRAMES, shape);
+
+  // Past the end of the ramp, so the switch to the steady gain is covered too
+  const size_t frames = RAMP_FRAMES + 1000;
+  std::vector<int16_t> reference = apply_in_blocks(ramp, frames, frames);
+  for (size_t block_frames : BLOCK_SIZES) {
+    std::vector<int16_t> output = apply_in_blocks(ramp, frames, block_frames);
+    size_t difference = 0;
+    while ((difference < frames) && (output[difference] == reference[difference])) {
+      ++difference;
+    }
+    if (difference < frames) {
+      fprintf(stderr, "%s %d -> %d in blocks of %zu: first difference at frame %zu\n", shape_name(shape), from, to,
+              block_frames, difference);
+    }
+    CHECK_EQ(difference, frames);
+  }
+
+  // Full scale input times a Q15 gain, shifted by 15, is the gain itself less at most one step of rounding
+  CHECK(std::abs(reference.front() - from) <= 1);
+  CHECK(std::abs(reference[RAMP_FRAMES] - to) <= 1);
+  CHECK(std::abs(reference.back() - to) <= 1);
+
+  std::vector<int32_t> gains = next_gains(ramp, RAMP_FRAMES + 1);
+  CHECK_EQ(gains.front(), from);
+  CHECK_EQ(gains.back(), to);
+  CHECK(!ramp.is_ramping());
+
+  // Monotonic, and the largest step is close to the average step of the steepest part of the ramp
+  bool monotonic = true;
+  for (size_t i = 1; i < gains.size(); ++i) {
+    monotonic = monotonic && ((to < from) ? (gains[i] <= gains[i - 1]) : (gains[i] >= gains[i - 1]));
+  }
+  CHECK(monotonic);
+  const double low = std::min(from, to), high = std::max(from, to);
+  double steepest = (high - low) / RAMP_FRAMES;
+  if (shape == GainRampShape::EXPONENTIAL) {
+    steepest = high * (1.0 - std::pow(low / high, 1.0 / RAMP_FRAMES));
+  }
+  const int step = max_step(gains);
+  CHECK(step <= std::ceil(steepest) + 1);
+
+  // The shape: halfway through, linear ramps are at the mean and exponential ramps at the geometric mean
+  const double halfway = gains[RAMP_FRAMES / 2];
+  const double expected =
+      (shape == GainRampShape::LINEAR) ? (from + to) / 2.0 : std::sqrt(static_cast<double>(from) * to);
+  CHECK_NEAR(halfway, expected, expected * 0.005 + 1);
+
+  printf("test_gain_ramp: %s %d -> %d over %zu frames: halfway at %.0f (expected %.0f), largest step %d\n",
+         shape_name(shape), from, to, RAMP_FRAMES, halfway, expected, step);
+}
+
+static void check_retarget(GainRampShape shape) {
+  const size_t retarget_frame = RAMP_FRAMES / 3;
+  const size_t second_frames = RAMP_FRAMES / 2;
+
+  GainRamp ramp;
+  ramp.set(UNITY);
+  ramp.ramp_to(DUCKED, RAMP_FRAMES, shape);
+  std::vector<int32_t> gains = next_gains(ramp, retarget_frame);
+
+  // Back up to unity before the first ramp is done, like a duck released early
+  const int32_t gain_at_retarget = ramp.get_gain();
+  ramp.ramp_to(UNITY, second_frames, shape);
+  CHECK_EQ(ramp.get_gain(), gain_at_retarget);
+  std::vector<int32_t> second = next_gains(ramp, second_frames + 1);
+  gains.insert(gains.end(), second.begin(), second.end());
+
+  CHECK_EQ(gains.back(), UNITY);
+  CHECK(!ramp.is_ramping());
+  // The turn is no larger a step than the steeper of the two ramps takes anyway
+  const int step = max_step(gains);
+  const int turn = std::abs(gains[retarget_frame] - gains[retarget_frame - 1]);
+  CHECK(turn <= std::max(max_step(std::vector<int32_t>(gains.begin(), gains.begin() + retarget_frame)),
+                         max_step(second)));
+  CHECK(step <= static_cast<int>(std::ceil(static_cast<double>(UNITY - DUCKED) / second_frames * 10)));
+
+  printf("test_gain_ramp: %s retarget at frame %zu (gain %d): step at the turn %d, largest step %d\n",
+         shape_name(shape), retarget_frame, gain_at_retarget, turn, step);
+}
+
+static void check_advance(GainRampShape shape) {
+  for (size_t frames : {size_t(1), size_t(100), RAMP_FRAMES / 2, RAMP_FRAMES + 5}) {
+    GainRamp stepped, advanced;
+    stepped.set(UNITY);
+    advanced.set(UNITY);
+    stepped.ramp_to(DUCKED, RAMP_FRAMES, shape);
+    advanced.ramp_to(DUCKED, RAMP_FRAMES, shape);
+
+    next_gains(stepped, frames);
+    advanced.advance(frames);
+    CHECK_EQ(advanced.get_gain(), stepped.get_gain());
+    CHECK_EQ(advanced.is_ramping(), stepped.is_ramping());
+    // And they stay together for the rest of the ramp
+    CHECK(next_gains(advanced, RAMP_FRAMES) == next_gains(stepped, RAMP_FRAMES));
+  }
+}
+
+int main() {
+  for (GainRampShape shape : {GainRampShape::LINEAR, GainRampShape::EXPONENTIAL}) {
+    check_blocks(shape, UNITY, DUCKED);
+    check_blocks(shape, DUCKED, UNITY);
+    check_retarget(shape);
+    check_advance(shape);
+  }
+
+  // Exponential ramps can't reach silence, so fading out falls back to a linear ramp
+  GainRamp ramp;
+  ramp.set(UNITY);
+  ramp.ramp_to(0, RAMP_FRAMES, GainRampShape::EXPONENTIAL);
+  std::vector<int32_t> gains = next_gains(ramp, RAMP_FRAMES + 1);
+  CHECK_NEAR(gains[RAMP_FRAMES / 2], UNITY / 2.0, 2);
+  CHECK_EQ(gains.back(), 0);
+
+  return harness::finish("test_gain_ramp");
+}
@@ -0,0 +1,181 @@
+// Plays two tracks back to back through a threaded pipeline, the second queued with ``enqueue``, and checks that the
+// decoder and resampler switch tracks without a gap: the speaker receives exactly the samples of both tracks, with none
+// dropped, inserted, or zeroed at the boundary, and its buffer never runs dry in between. Runs once with WAV files and
+// once with FLAC files.
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_pipeline.h"
+
+#include <flac_decoder.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t SPEAKER_BUFFER_MS = 200;
+static const size_t START_THRESHOLD_MS = 100;
+
+// The mixer's unity gain is 32767 in Q15, so full scale samples may come out one step lower
+static const int MAX_SAMPLE_ERROR = 1;
+// Reported around the first mismatch
+static const size_t CONTEXT_FRAMES = 4;
+
+/// @brief Decodes a whole FLAC file with the stand-in decoder and duplicates mono samples to stereo
+static std::vector<int16_t> decode_flac_stereo(std::vector<uint8_t> file) {
+  std::vector<int16_t> samples;
+  flac::FLACDecoder decoder(file.data());
+  if (decoder.read_header(file.size()) != flac::FLAC_DECODER_SUCCESS) {
+    return samples;
+  }
+  const uint32_t channels = decoder.get_num_channels();
+  std::vector<int16_t> block(decoder.get_output_buffer_size());
+  size_t offset = decoder.get_bytes_index();
+  while (offset < file.size()) {
+    // The decoder always reads from the start of its buffer
+    std::memmove(file.data(), file.data() + offset, file.size() - offset);
+    file.resize(file.size() - offset);
+    uint32_t block_samples = 0;
+    if (decoder.decode_frame(file.size(), block.data(), &block_samples) != flac::FLAC_DECODER_SUCCESS) {
+      break;
+    }
+    for (uint32_t i = 0; i < block_samples; ++i) {
+      samples.push_back(block[i]);
+      if (channels == 1) {
+        samples.push_back(block[i]);
+      }
+    }
+    offset = decoder.get_bytes_index();
+  }
+  decoder.free_buffers();
+  return samples;
+}
+
+static bool wait_for_playback(AudioPipeline &pipeline, harness::CaptureSpeaker &speaker, size_t samples) {
+  for (int i = 0; i < 2000; ++i) {
+    if (pipeline.get_state() != AudioPipelineState::PLAYING) {
+      // Give the mixer time to pass on what is still in its input
+      delay(SPEAKER_BUFFER_MS);
+      return speaker.samples().size() >= samples;
+    }
+    if (speaker.samples().size() >= samples) {
+      return true;
+    }
+    delay(10);
+  }
+  return false;
+}
+
+/// @brief Plays ``first`` and then ``second`` and compares the speaker's samples with ``expected``
+static void check_gapless(const char *name, AudioMixer &mixer, uint8_t input, harness::CaptureSpeaker &speaker,
+                          media_player::MediaFile *first, media_player::MediaFile *second,
+                          const std::vector<int16_t> &expected, size_t boundary_frame) {
+  AudioPipeline pipeline(&mixer, input);
+
+  speaker.reset();
+  CHECK_EQ(pipeline.start(first, SAMPLE_RATE, "media"), ESP_OK);
+  CHECK_EQ(pipeline.enqueue(second), ESP_OK);
+  CHECK(wait_for_playback(pipeline, speaker, expected.size()));
+  CHECK_EQ(pipeline.stop(), ESP_OK);
+
+  const std::vector<int16_t> samples = speaker.samples();
+  CHECK_EQ(samples.size(), expected.size());
+
+  size_t mismatches = 0;
+  size_t first_mismatch = SIZE_MAX;
+  size_t silent_samples = 0;
+  for (size_t i = 0; i < std::min(samples.size(), expected.size()); ++i) {
+    if (std::abs(samples[i] - expected[i]) > MAX_SAMPLE_ERROR) {
+      ++mismatches;
+      first_mismatch = std::min(first_mismatch, i);
+      if (samples[i] == 0) {
+        ++silent_samples;
+      }
+    }
+  }
+  if (first_mismatch != SIZE_MAX) {
+    const size_t frame = first_mismatch / 2;
+    fprintf(stderr, "%s: first mismatch at frame %zu (boundary at %zu):\n", name, frame, boundary_frame);
+    for (size_t i = (frame > CONTEXT_FRAMES ? frame - CONTEXT_FRAMES : 0) * 2;
+         i < std::min({samples.size(), expected.size(), (frame + CONTEXT_FRAMES) * 2}); i += 2) {
+      fprintf(stderr, "  frame %zu: got %d %d, expected %d %d\n", i / 2, samples[i], samples[i + 1], expected[i],
+              expected[i + 1]);
+    }
+  }
+
+  const std::vector<harness::CaptureSpeaker::Underrun> underruns = speaker.underruns();
+  for (const auto &underrun : underruns) {
+    fprintf(stderr, "%s: speaker ran dry for %.0f frames after frame %zu (boundary at %zu)\n", name, underrun.frames,
+            underrun.frame, boundary_frame);
+  }
+
+  printf("test_gapless_playback: %s, %zu frames, track boundary at frame %zu: %zu mismatched samples, %zu silent, "
+         "%zu speaker underruns\n",
+         name, expected.size() / 2, boundary_frame, mismatches, silent_samples, underruns.size());
+  CHECK_EQ(mismatches, 0);
+  CHECK_EQ(silent_samples, 0);
+  CHECK_EQ(underruns.size(), 0);
+}
+
+int main() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2, SPEAKER_BUFFER_MS);
+
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  MixerInputSettings settings;
+  settings.start_threshold = SAMPLE_RATE * START_THRESHOLD_MS / 1000 * 2 * sizeof(int16_t);
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+
+  // WAV: sines around a DC offset, so no sample of either track is zero and a zeroed sample can't go unnoticed
+  std::vector<int16_t> first_samples = harness::make_sine(SAMPLE_RATE * 3 / 4, 2, 440.0 / SAMPLE_RATE, 4000);
+  std::vector<int16_t> second_samples = harness::make_sine(SAMPLE_RATE / 2, 2, 660.0 / SAMPLE_RATE, 4000, 2.0);
+  for (auto *track : {&first_samples, &second_samples}) {
+    for (auto &sample : *track) {
+      sample += 8000;
+    }
+  }
+  std::vector<uint8_t> first_wav = harness::make_wav(first_samples, SAMPLE_RATE, 2);
+  std::vector<uint8_t> second_wav = harness::make_wav(second_samples, SAMPLE_RATE, 2);
+  media_player::MediaFile first_wav_file{first_wav.data(), first_wav.size(), media_player::MediaFileType::WAV};
+  media_player::MediaFile second_wav_file{second_wav.data(), second_wav.size(), media_player::MediaFileType::WAV};
+
+  std::vector<int16_t> expected = first_samples;
+  expected.insert(expected.end(), second_samples.begin(), second_samples.end());
+  check_gapless("wav", mixer, input, speaker, &first_wav_file, &second_wav_file, expected, first_samples.size() / 2);
+
+  // FLAC: two of the device's sounds, mono at 48 kHz; the mixer plays them on both channels. The first is larger than
+  // the raw file ring buffer, so the reader is still reading it when the second is queued.
+  std::vector<uint8_t> first_flac = harness::read_file("../../sounds/timer_finished.flac");
+  std::vector<uint8_t> second_flac = harness::read_file("../../sounds/wake_word_triggered.flac");
+  CHECK(!first_flac.empty());
+  CHECK(!second_flac.empty());
+  if (!first_flac.empty() && !second_flac.empty()) {
+    media_player::MediaFile first_flac_file{first_flac.data(), first_flac.size(), media_player::MediaFileType::FLAC};
+    media_player::MediaFile second_flac_file{second_flac.data(), second_flac.size(),
+                                             media_player::MediaFileType::FLAC};
+
+    std::vector<int16_t> first_pcm = decode_flac_stereo(first_flac);
+    std::vector<int16_t> second_pcm = decode_flac_stereo(second_flac);
+    CHECK(!first_pcm.empty());
+    CHECK(!second_pcm.empty());
+    expected = first_pcm;
+    expected.insert(expected.end(), second_pcm.begin(), second_pcm.end());
+    check_gapless("flac", mixer, input, speaker, &first_flac_file, &second_flac_file, expected, first_pcm.size() / 2);
+  }
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+
+  return harness::finish("test_gapless_playback");
+}
@@ -0,0 +1,173 @@
+// Checks that a stereo mixer input carries each stream in its own channels
+//  - A threaded pipeline plays a mono track with a stereo one queued after it. The input switches to one channel and,
+//    at the track change, back to two; the speaker must receive the mono track on both channels and then the stereo
+//    one, with nothing of the mono track's end dropped by the switch.
+//  - An input faded out, like the incoming input before a crossfade, stays faded out when it switches channels
+//  - An input can't switch to more channels than its settings give it
+//  - A switch the mixer task doesn't get to in time is canceled, so the input keeps its channels once the task runs
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_pipeline.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t SPEAKER_BUFFER_MS = 200;
+static const size_t START_THRESHOLD_MS = 100;
+static const uint32_t MONO_TRACK_SECONDS = 3;
+
+// The mixer's unity gain is 32767 in Q15, so full scale samples may come out one step lower
+static const int MAX_SAMPLE_ERROR = 1;
+
+/// @brief Waits until the pipeline has finished its tracks
+/// @param mono_seen (output) set if the input carried a single channel meanwhile
+static bool wait_for_pipeline(AudioPipeline &pipeline, AudioMixer &mixer, uint8_t input, bool &mono_seen) {
+  for (int i = 0; i < 2000; ++i) {
+    mono_seen |= mixer.get_input_channels(input) == 1;
+    if (pipeline.get_state() != AudioPipelineState::PLAYING) {
+      return true;
+    }
+    delay(10);
+  }
+  return false;
+}
+
+/// @brief Sines around a DC offset, so a dropped or zeroed sample can't go unnoticed
+static std::vector<int16_t> make_track(size_t frames, uint8_t channels, double frequency) {
+  std::vector<int16_t> samples = harness::make_sine(frames, channels, frequency / SAMPLE_RATE, 4000, 2.0);
+  for (auto &sample : samples) {
+    sample += 8000;
+  }
+  return samples;
+}
+
+static void check_stream_channels(AudioMixer &mixer, uint8_t input, harness::CaptureSpeaker &speaker) {
+  // Longer than the pipeline buffers, so the reader is still on it when the stereo track is queued
+  const std::vector<int16_t> mono_samples = make_track(MONO_TRACK_SECONDS * SAMPLE_RATE, 1, 440.0);
+  const std::vector<int16_t> stereo_samples = make_track(SAMPLE_RATE / 2, 2, 660.0);
+  std::vector<uint8_t> mono_wav = harness::make_wav(mono_samples, SAMPLE_RATE, 1);
+  std::vector<uint8_t> stereo_wav = harness::make_wav(stereo_samples, SAMPLE_RATE, 2);
+  media_player::MediaFile mono_file{mono_wav.data(), mono_wav.size(), media_player::MediaFileType::WAV};
+  media_player::MediaFile stereo_file{stereo_wav.data(), stereo_wav.size(), media_player::MediaFileType::WAV};
+
+  std::vector<int16_t> expected;
+  for (int16_t sample : mono_samples) {
+    expected.push_back(sample);
+    expected.push_back(sample);
+  }
+  expected.insert(expected.end(), stereo_samples.begin(), stereo_samples.end());
+
+  AudioPipeline pipeline(&mixer, input);
+  speaker.reset();
+
+  bool mono_seen = false;
+  CHECK_EQ(pipeline.start(&mono_file, SAMPLE_RATE, "media"), ESP_OK);
+  CHECK_EQ(pipeline.enqueue(&stereo_file), ESP_OK);
+  CHECK(wait_for_pipeline(pipeline, mixer, input, mono_seen));
+  const uint8_t stereo_channels = mixer.get_input_channels(input);
+  // Give the mixer time to pass on what is still on its way to the speaker
+  delay(SPEAKER_BUFFER_MS);
+  CHECK_EQ(pipeline.stop(), ESP_OK);
+
+  const std::vector<int16_t> samples = speaker.samples();
+  size_t mismatches = 0;
+  for (size_t i = 0; i < std::min(samples.size(), expected.size()); ++i) {
+    if (std::abs(samples[i] - expected[i]) > MAX_SAMPLE_ERROR) {
+      ++mismatches;
+    }
+  }
+
+  printf("test_mixer_input_channels: mono then stereo track: input carried %s then %u channels, %zu of %zu samples, "
+         "%zu mismatched\n",
+         mono_seen ? "1" : "2", stereo_channels, samples.size(), expected.size(), mismatches);
+  CHECK(mono_seen);
+  CHECK_EQ(stereo_channels, 2);
+  CHECK_EQ(samples.size(), expected.size());
+  CHECK_EQ(mismatches, 0);
+}
+
+static void check_fade_kept(AudioMixer &mixer, uint8_t input, harness::CaptureSpeaker &speaker) {
+  CHECK_EQ(mixer.set_input_channels(input, 2), ESP_OK);
+
+  CommandEvent command;
+  command.command = CommandEventType::FADE;
+  command.input = input;
+  command.gain = 0;
+  mixer.send_command(&command);
+
+  CHECK_EQ(mixer.set_input_channels(input, 1), ESP_OK);
+  CHECK_EQ(mixer.get_input_channels(input), 1);
+
+  speaker.reset();
+  const std::vector<int16_t> pcm = make_track(SAMPLE_RATE / 4, 1, 440.0);
+  CHECK_EQ(mixer.play_pcm(input, pcm.data(), pcm.size() * sizeof(int16_t)), pdTRUE);
+  for (int i = 0; (i < 200) && mixer.is_playing_pcm(input); ++i) {
+    delay(10);
+  }
+  // The last block may still be on its way to the speaker
+  delay(SPEAKER_BUFFER_MS);
+
+  const std::vector<int16_t> samples = speaker.samples();
+  int loudest = 0;
+  for (int16_t sample : samples) {
+    loudest = std::max(loudest, std::abs(sample));
+  }
+  printf("test_mixer_input_channels: faded out input switched to mono: %zu samples played, loudest %d\n",
+         samples.size(), loudest);
+  CHECK_EQ(samples.size(), 2 * pcm.size());
+  CHECK_EQ(loudest, 0);
+
+  command.gain = INT16_MAX;
+  mixer.send_command(&command);
+}
+
+static void check_timeout_cancels(AudioMixer &mixer, uint8_t input) {
+  const uint8_t channels = mixer.get_input_channels(input);
+  mixer.suspend_task();
+  const esp_err_t err = mixer.set_input_channels(input, 3 - channels);
+  mixer.resume_task();
+  // The task now handles the queued command
+  delay(50);
+  printf("test_mixer_input_channels: switch while the task is suspended: %s, input carries %u channels after\n",
+         esp_err_to_name(err), mixer.get_input_channels(input));
+  CHECK_EQ(err, ESP_ERR_TIMEOUT);
+  CHECK_EQ(mixer.get_input_channels(input), channels);
+}
+
+int main() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2, SPEAKER_BUFFER_MS);
+
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  MixerInputSettings settings;
+  settings.start_threshold = SAMPLE_RATE * START_THRESHOLD_MS / 1000 * 2 * sizeof(int16_t);
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  MixerInputSettings mono_settings;
+  mono_settings.channels = 1;
+  uint8_t mono_input;
+  CHECK_EQ(mixer.add_input(mono_settings, mono_input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+
+  check_stream_channels(mixer, input, speaker);
+  check_fade_kept(mixer, input, speaker);
+  check_timeout_cancels(mixer, input);
+
+  CHECK_EQ(mixer.set_input_channels(mono_input, 2), ESP_ERR_INVALID_ARG);
+  CHECK_EQ(mixer.get_input_channels(mono_input), 1);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+
+  return harness::finish("test_mixer_input_channels");
+}
@@ -0,0 +1,84 @@
+// Checks the mixer's volume, which software volume control uses
+//  - The volume set before the task starts scales an input's audio from its first sample
+//  - A SET_VOLUME command ramps the output to the new level instead of stepping, and the output ends on that level
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t SPEAKER_BUFFER_MS = 200;
+static const uint32_t RAMP_MS = 50;
+// A constant level, so every change in the output comes from the volume
+static const int16_t LEVEL = 16000;
+static const int16_t HALF_VOLUME = INT16_MAX / 2;
+// Largest change between frames of a 50 ms ramp from half to full volume is about 1 / 2400 of the level
+static const int MAX_STEP = 8;
+static const int MAX_LEVEL_ERROR = 2;
+
+int main() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2, SPEAKER_BUFFER_MS);
+
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  mixer.set_volume(HALF_VOLUME);
+  MixerInputSettings settings;
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+
+  const std::vector<int16_t> pcm(SAMPLE_RATE / 2 * 2, LEVEL);
+  CHECK_EQ(mixer.play_pcm(input, pcm.data(), pcm.size() * sizeof(int16_t)), pdTRUE);
+  delay(100);
+
+  CommandEvent command;
+  command.command = CommandEventType::SET_VOLUME;
+  command.gain = INT16_MAX;
+  command.transition_samples = SAMPLE_RATE * RAMP_MS / 1000 * 2;
+  mixer.send_command(&command);
+
+  for (int i = 0; (i < 200) && mixer.is_playing_pcm(input); ++i) {
+    delay(10);
+  }
+  // The last block may still be on its way to the speaker
+  delay(SPEAKER_BUFFER_MS);
+
+  const std::vector<int16_t> samples = speaker.samples();
+  CHECK_EQ(samples.size(), pcm.size());
+  if (samples.size() != pcm.size()) {
+    return harness::finish("test_mixer_volume");
+  }
+
+  const int half_level = (LEVEL * HALF_VOLUME) >> 15;
+  int largest_step = 0;
+  size_t ramp_frames = 0;
+  for (size_t i = 2; i < samples.size(); i += 2) {
+    const int step = std::abs(samples[i] - samples[i - 2]);
+    largest_step = std::max(largest_step, step);
+    if (step > 0) {
+      ++ramp_frames;
+    }
+  }
+
+  printf("test_mixer_volume: first sample %d (expected %d), last %d (expected %d), largest step %d over %zu changing "
+         "frames\n",
+         samples.front(), half_level, samples.back(), LEVEL, largest_step, ramp_frames);
+  CHECK(std::abs(samples.front() - half_level) <= MAX_LEVEL_ERROR);
+  CHECK(std::abs(samples.back() - LEVEL) <= MAX_LEVEL_ERROR);
+  CHECK(largest_step <= MAX_STEP);
+  CHECK(ramp_frames > SAMPLE_RATE * RAMP_MS / 1000 / 2);
+
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+
+  return harness::finish("test_mixer_volume");
+}
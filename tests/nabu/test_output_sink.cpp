@@ -0,0 +1,302 @@
+// Checks that writing mixes straight into an output sink gives the speaker the same samples the old combination buffer
+// did
+//  - SpeakerOutputSink on its own: random acquire, commit, write, and flush calls against a speaker that accepts a
+//    random number of bytes each time, with and without mono duplication. The speaker has to receive every committed
+//    and written byte exactly once and in order, with duplicated audio expanded in place.
+//  - The mixer end to end: two inputs mixed through the limiter, the limiter's tail drained, and one input with a
+//    gain sent alone. Sent to a speaker that takes partial writes (SpeakerOutputSink), to a RingBufferOutputSink, and
+//    to a model of the old path, which mixed into its own combination buffer and played that until the speaker took
+//    it all. All three streams must be sample identical, for a stereo mix and for a mono mix duplicated to stereo.
+
+#include "harness.h"
+
+#include "audio_mixer.h"
+#include "audio_output_sink.h"
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t STAGING_BYTES = 4096;
+static const size_t SINK_OPERATIONS = 5000;
+// Longer than the limiter's delay and several mixer blocks, yet both inputs fit their ring buffers before the start
+static const size_t LONG_INPUT_FRAMES = 11000;
+static const size_t SHORT_INPUT_FRAMES = 6000;
+
+// Accepts a random number of bytes per play call, including none, and keeps everything it accepted
+class PartialSpeaker : public speaker::Speaker {
+ public:
+  explicit PartialSpeaker(uint32_t seed) : random_(seed) {}
+
+  size_t play(const uint8_t *data, size_t length, TickType_t /*ticks_to_wait*/) override {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    size_t bytes = std::min<size_t>(length, this->random_() % 700);
+    this->bytes_.insert(this->bytes_.end(), data, data + bytes);
+    return bytes;
+  }
+
+  std::vector<int16_t> samples() {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    std::vector<int16_t> samples(this->bytes_.size() / sizeof(int16_t));
+    std::memcpy(samples.data(), this->bytes_.data(), samples.size() * sizeof(int16_t));
+    return samples;
+  }
+
+ protected:
+  std::mutex mutex_;
+  std::mt19937 random_;
+  std::vector<uint8_t> bytes_;
+};
+
+// The old output path: the mixer filled its own combination buffer and played it until the speaker took all of it
+class CombinationBufferSink : public AudioOutputSink {
+ public:
+  explicit CombinationBufferSink(size_t bytes) : combination_buffer_(bytes / sizeof(int16_t)) {}
+
+  size_t acquire(int16_t **region, size_t /*min_bytes*/, TickType_t /*ticks_to_wait*/) override {
+    *region = this->combination_buffer_.data();
+    return this->combination_buffer_.size() * sizeof(int16_t);
+  }
+
+  void commit(size_t bytes) override { this->play_all_(this->combination_buffer_.data(), bytes); }
+
+  size_t write(const int16_t *data, size_t bytes, TickType_t /*ticks_to_wait*/) override {
+    this->play_all_(data, bytes);
+    return bytes;
+  }
+
+  std::vector<int16_t> samples() {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    return this->samples_;
+  }
+
+ protected:
+  void play_all_(const int16_t *data, size_t bytes) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->samples_.insert(this->samples_.end(), data, data + bytes / sizeof(int16_t));
+  }
+
+  std::vector<int16_t> combination_buffer_;
+  std::mutex mutex_;
+  std::vector<int16_t> samples_;
+};
+
+/// @brief Drives a SpeakerOutputSink with random calls and checks what reached the speaker
+static void check_speaker_sink(bool duplicate, uint32_t seed) {
+  PartialSpeaker speaker(seed);
+  auto sink = SpeakerOutputSink::create(&speaker, STAGING_BYTES);
+  CHECK(sink != nullptr);
+  if (sink == nullptr) {
+    return;
+  }
+  sink->set_duplicate_channels(duplicate);
+
+  std::mt19937 random(seed);
+  std::vector<int16_t> sent;
+  int16_t next_sample = 1;
+  size_t acquire_timeouts = 0, partial_writes = 0;
+
+  auto make_samples = [&](size_t count) {
+    std::vector<int16_t> samples(count);
+    for (auto &sample : samples) {
+      sample = next_sample++;
+    }
+    return samples;
+  };
+
+  for (size_t operation = 0; operation < SINK_OPERATIONS; ++operation) {
+    const uint32_t choice = random() % 4;
+    if (choice < 2) {
+      // A mix: fill part of an acquired region in place
+      int16_t *region = nullptr;
+      const size_t min_bytes = (random() % 256 + 1) * sizeof(int16_t);
+      size_t region_bytes = sink->acquire(&region, min_bytes, 0);
+      if (region_bytes == 0) {
+        ++acquire_timeouts;
+        continue;
+      }
+      CHECK(region_bytes >= min_bytes);
+      const size_t count = (random() % (region_bytes / sizeof(int16_t))) + 1;
+      std::vector<int16_t> samples = make_samples(count);
+      std::memcpy(region, samples.data(), count * sizeof(int16_t));
+      sink->commit(count * sizeof(int16_t));
+      sent.insert(sent.end(), samples.begin(), samples.end());
+    } else if (choice == 2) {
+      // A single input's ring buffer: copied in, and like the mixer, the rest is sent from wherever the speaker
+      // stopped taking it, which may be in the middle of a sample
+      std::vector<int16_t> samples = make_samples(random() % 1500 + 1);
+      const uint8_t *data = reinterpret_cast<const uint8_t *>(samples.data());
+      size_t bytes_left = samples.size() * sizeof(int16_t);
+      while (bytes_left > 0) {
+        size_t bytes = sink->write(reinterpret_cast<const int16_t *>(data), bytes_left, 0);
+        if (bytes < bytes_left) {
+          ++partial_writes;
+        }
+        data += bytes;
+        bytes_left -= bytes;
+      }
+      sent.insert(sent.end(), samples.begin(), samples.end());
+    } else {
+      sink->flush(0);
+    }
+  }
+  while (!sink->flush(0)) {
+  }
+
+  std::vector<int16_t> expected;
+  if (duplicate) {
+    for (int16_t sample : sent) {
+      expected.push_back(sample);
+      expected.push_back(sample);
+    }
+  } else {
+    expected = sent;
+  }
+
+  const std::vector<int16_t> received = speaker.samples();
+  CHECK_EQ(received.size(), expected.size());
+  CHECK(received == expected);
+  CHECK(acquire_timeouts > 0);
+  CHECK(partial_writes > 0);
+  printf("test_output_sink: speaker sink%s: %zu samples sent, %zu acquire timeouts, %zu partial writes: %s\n",
+         duplicate ? " duplicating mono" : "", sent.size(), acquire_timeouts, partial_writes,
+         (received == expected) ? "identical" : "DIFFERENT");
+}
+
+struct MixerRun {
+  uint8_t channels;
+  bool stereo_output;
+};
+
+/// @brief Plays the scenario through a fresh mixer into a sink or a speaker
+/// @param get_samples returns what has been output so far
+/// @param expected_samples number of samples the whole scenario outputs
+template<typename Start, typename GetSamples>
+static std::vector<int16_t> run_mixer(const MixerRun &run, Start start, GetSamples get_samples,
+                                      size_t expected_samples) {
+  std::unique_ptr<AudioMixer> mixer(new AudioMixer());
+  mixer->set_sample_rate(SAMPLE_RATE);
+  mixer->set_channels(run.channels);
+  mixer->set_stereo_output(run.stereo_output);
+
+  // Loud enough together that the limiter works on the mix; the long input has a gain, so its part alone is scaled
+  MixerInputSettings long_settings;
+  long_settings.gain = 24000;
+  MixerInputSettings short_settings;
+  uint8_t long_input, short_input;
+  CHECK_EQ(mixer->add_input(long_settings, long_input), ESP_OK);
+  CHECK_EQ(mixer->add_input(short_settings, short_input), ESP_OK);
+
+  std::vector<int16_t> long_samples =
+      harness::make_sine(LONG_INPUT_FRAMES, run.channels, 440.0 / SAMPLE_RATE, 26000);
+  std::vector<int16_t> short_samples =
+      harness::make_sine(SHORT_INPUT_FRAMES, run.channels, 1000.0 / SAMPLE_RATE, 20000, 1.0);
+  // Both are buffered before the task starts, so the mix doesn't depend on timing
+  size_t bytes = long_samples.size() * sizeof(int16_t);
+  CHECK_EQ(mixer->get_input_ring_buffer(long_input)->write(long_samples.data(), bytes, 0), bytes);
+  bytes = short_samples.size() * sizeof(int16_t);
+  CHECK_EQ(mixer->get_input_ring_buffer(short_input)->write(short_samples.data(), bytes, 0), bytes);
+
+  CHECK_EQ(start(*mixer), ESP_OK);
+  for (int i = 0; (i < 500) && (get_samples().size() < expected_samples); ++i) {
+    delay(10);
+  }
+  // Anything extra would show up now
+  delay(50);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer->send_command(&command);
+  delay(50);
+  mixer->stop();
+
+  return get_samples();
+}
+
+static void check_mixer(const MixerRun &run) {
+  const uint8_t output_channels = run.stereo_output ? 2 : run.channels;
+  const size_t expected_samples = LONG_INPUT_FRAMES * output_channels;
+  const char *name = (run.channels == 1) ? "mono mix duplicated to stereo" : "stereo mix";
+
+  // The old path, which had no mono duplication, so its mono output is duplicated here
+  CombinationBufferSink combination_sink(STAGING_BYTES);
+  std::vector<int16_t> reference = run_mixer(
+      {run.channels, false}, [&](AudioMixer &mixer) { return mixer.start(&combination_sink, "mixer"); },
+      [&]() { return combination_sink.samples(); }, LONG_INPUT_FRAMES * run.channels);
+  if (output_channels > run.channels) {
+    std::vector<int16_t> duplicated;
+    for (int16_t sample : reference) {
+      duplicated.push_back(sample);
+      duplicated.push_back(sample);
+    }
+    reference = duplicated;
+  }
+  CHECK_EQ(reference.size(), expected_samples);
+
+  PartialSpeaker speaker(run.channels);
+  std::vector<int16_t> speaker_samples = run_mixer(
+      run, [&](AudioMixer &mixer) { return mixer.start(&speaker, "mixer"); }, [&]() { return speaker.samples(); },
+      expected_samples);
+  CHECK_EQ(speaker_samples.size(), expected_samples);
+  CHECK(speaker_samples == reference);
+
+  // A ring buffer sink can't duplicate, so it gets the mixer's channels
+  auto ring_buffer = AudioRingBuffer::create(64 * 1024, 2048);
+  RingBufferOutputSink ring_sink(ring_buffer.get());
+  std::mutex ring_mutex;
+  std::vector<int16_t> ring_samples;
+  std::atomic<bool> stop_consumer{false};
+  std::thread consumer([&]() {
+    std::vector<int16_t> buffer(1024);
+    while (!stop_consumer.load()) {
+      size_t bytes = ring_buffer->read(buffer.data(), buffer.size() * sizeof(int16_t), 0);
+      if (bytes == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_samples.insert(ring_samples.end(), buffer.begin(), buffer.begin() + bytes / sizeof(int16_t));
+    }
+  });
+  std::vector<int16_t> ring_output = run_mixer(
+      run, [&](AudioMixer &mixer) { return mixer.start(&ring_sink, "mixer"); },
+      [&]() {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        return ring_samples;
+      },
+      LONG_INPUT_FRAMES * run.channels);
+  stop_consumer.store(true);
+  consumer.join();
+  std::vector<int16_t> expected_ring = reference;
+  if (output_channels > run.channels) {
+    expected_ring.clear();
+    for (size_t i = 0; i < reference.size(); i += 2) {
+      expected_ring.push_back(reference[i]);
+    }
+  }
+  CHECK(ring_output == expected_ring);
+
+  printf("test_output_sink: mixer, %s: %zu samples; speaker sink with partial writes %s, ring buffer sink %s\n",
+         name, reference.size(), (speaker_samples == reference) ? "identical" : "DIFFERENT",
+         (ring_output == expected_ring) ? "identical" : "DIFFERENT");
+}
+
+int main() {
+  check_speaker_sink(false, 1);
+  check_speaker_sink(true, 2);
+
+  check_mixer({2, false});
+  check_mixer({1, true});
+
+  return harness::finish("test_output_sink");
+}
@@ -0,0 +1,168 @@
+// Checks the USE_AUDIO_PIPELINE_STATS counters and reports what keeping them costs
+//  - Plays a 44.1 kHz file through a threaded pipeline and a 48 kHz mixer into a real time speaker. Every byte each
+//    stage passes on must be counted: the reader's the whole file, the decoder's the file's samples, the resampler's
+//    the resampled frames, and the mixer's everything the speaker got. No stage can wait longer than the stream took,
+//    and every peek of the decoded audio must land in the fill histogram.
+//  - Times a ring buffer passing blocks the size the pipeline uses, as every block goes through commit and peek. The
+//    same source is built without the stats as test_pipeline_stats_baseline, which only prints that timing; the
+//    difference between the two is the counters' overhead per block.
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_pipeline.h"
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t SOURCE_SAMPLE_RATE = 44100;
+static const size_t SOURCE_FRAMES = SOURCE_SAMPLE_RATE * 3 / 2;
+static const uint32_t SPEAKER_BUFFER_MS = 100;
+// The resampler's filter delay and the rounding at the end of the stream
+static const size_t MAX_RESAMPLED_FRAMES_ERROR = 64;
+
+static const size_t RING_BUFFER_SIZE = 16 * 1024;
+static const size_t BLOCK_BYTES = 1024;
+static const size_t BLOCKS = 100000;
+static const int RUNS = 10;
+
+/// @brief Fastest of several runs of committing and then peeking and releasing blocks through one ring buffer
+/// @return timestamp counts per block; see harness::cycles
+static double ring_buffer_cycles_per_block() {
+  std::unique_ptr<AudioRingBuffer> ring_buffer = AudioRingBuffer::create(RING_BUFFER_SIZE);
+  uint64_t fastest = UINT64_MAX;
+  for (int run = 0; run < RUNS; ++run) {
+    const uint64_t start = harness::cycles();
+    for (size_t i = 0; i < BLOCKS; ++i) {
+      uint8_t *data;
+      ring_buffer->reserve(&data, BLOCK_BYTES, 0);
+      ring_buffer->commit(BLOCK_BYTES);
+      ring_buffer->peek(&data, BLOCK_BYTES, 0);
+      ring_buffer->release(BLOCK_BYTES);
+    }
+    fastest = std::min(fastest, harness::cycles() - start);
+  }
+  return static_cast<double>(fastest) / BLOCKS;
+}
+
+#ifdef USE_AUDIO_PIPELINE_STATS
+static bool wait_for_playback(AudioPipeline &pipeline, harness::CaptureSpeaker &speaker, size_t samples) {
+  for (int i = 0; i < 1000; ++i) {
+    if (pipeline.get_state() != AudioPipelineState::PLAYING) {
+      // Give the mixer time to pass on what is still in its input
+      delay(SPEAKER_BUFFER_MS * 2);
+      return speaker.samples().size() >= samples;
+    }
+    delay(10);
+  }
+  return false;
+}
+
+static void check_stage(const char *name, const AudioStageStats &stats, uint32_t elapsed_us) {
+  printf("test_pipeline_stats: %s: %u bytes, waited %u us for input and %u us for output, %u underruns\n", name,
+         stats.bytes_processed, stats.input_wait_us, stats.output_wait_us, stats.underruns);
+  CHECK(stats.input_wait_us <= elapsed_us);
+  CHECK(stats.output_wait_us <= elapsed_us);
+}
+
+static void check_counters() {
+  harness::CaptureSpeaker speaker(SAMPLE_RATE, 2, SPEAKER_BUFFER_MS);
+
+  AudioMixer mixer;
+  mixer.set_sample_rate(SAMPLE_RATE);
+  MixerInputSettings settings;
+  uint8_t input;
+  CHECK_EQ(mixer.add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer.start(&speaker, "mixer"), ESP_OK);
+
+  std::vector<uint8_t> wav = harness::make_wav(
+      harness::make_sine(SOURCE_FRAMES, 2, 440.0 / SOURCE_SAMPLE_RATE, 10000), SOURCE_SAMPLE_RATE, 2);
+  media_player::MediaFile file{wav.data(), wav.size(), media_player::MediaFileType::WAV};
+
+  AudioPipeline pipeline(&mixer, input);
+  const size_t resampled_frames = static_cast<size_t>(static_cast<uint64_t>(SOURCE_FRAMES) * SAMPLE_RATE /
+                                                      SOURCE_SAMPLE_RATE);
+
+  const uint32_t start_us = micros();
+  CHECK_EQ(pipeline.start(&file, SAMPLE_RATE, "media"), ESP_OK);
+  CHECK(wait_for_playback(pipeline, speaker, (resampled_frames - MAX_RESAMPLED_FRAMES_ERROR) * 2));
+  const uint32_t elapsed_us = micros() - start_us;
+
+  AudioPipelineStats stats;
+  pipeline.get_stats(stats);
+  AudioStageStats mixer_stats;
+  mixer.get_stats(mixer_stats);
+  const size_t speaker_bytes = speaker.samples().size() * sizeof(int16_t);
+
+  check_stage("reader", stats.reader, elapsed_us);
+  check_stage("decoder", stats.decoder, elapsed_us);
+  check_stage("resampler", stats.resampler, elapsed_us);
+  check_stage("mixer", mixer_stats, elapsed_us);
+
+  uint32_t peeks = 0;
+  for (size_t i = 0; i < FILL_HISTOGRAM_BUCKETS; ++i) {
+    peeks += stats.decoded_fill_histogram[i];
+  }
+  const size_t resampled_bytes_error = MAX_RESAMPLED_FRAMES_ERROR * 2 * sizeof(int16_t);
+  printf("test_pipeline_stats: %zu bytes played in %.2f s, %u peeks of the decoded audio\n", speaker_bytes,
+         elapsed_us / 1e6, peeks);
+
+  CHECK_EQ(stats.reader.bytes_processed, wav.size());
+  CHECK_EQ(stats.decoder.bytes_processed, SOURCE_FRAMES * 2 * sizeof(int16_t));
+  CHECK(stats.resampler.bytes_processed + resampled_bytes_error >= resampled_frames * 2 * sizeof(int16_t));
+  CHECK(stats.resampler.bytes_processed <= resampled_frames * 2 * sizeof(int16_t) + resampled_bytes_error);
+  CHECK_EQ(mixer_stats.bytes_processed, speaker_bytes);
+  CHECK(peeks > 0);
+
+  CHECK_EQ(pipeline.stop(), ESP_OK);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer.send_command(&command);
+  delay(50);
+  mixer.stop();
+}
+
+/// @brief Runs the build without the stats
+/// @return its timestamp counts per block, or a negative number if it couldn't be run
+static double baseline_cycles_per_block(const char *program) {
+  const std::string command = std::string("exec ") + program + "_baseline";
+  FILE *baseline = popen(command.c_str(), "r");
+  if (baseline == nullptr) {
+    return -1.0;
+  }
+  double cycles = -1.0;
+  if (fscanf(baseline, "%lf", &cycles) != 1) {
+    cycles = -1.0;
+  }
+  pclose(baseline);
+  return cycles;
+}
+#endif
+
+int main(int /*argc*/, char **argv) {
+#ifdef USE_AUDIO_PIPELINE_STATS
+  check_counters();
+
+  const double with_stats = ring_buffer_cycles_per_block();
+  const double without_stats = baseline_cycles_per_block(argv[0]);
+  // Fastest runs of two processes, so expect a few counts of noise either way
+  printf("test_pipeline_stats: a %zu byte block through a ring buffer takes %.1f timestamp counts with the stats and "
+         "%.1f without, an overhead of %+.1f\n",
+         BLOCK_BYTES, with_stats, without_stats, with_stats - without_stats);
+  CHECK(without_stats > 0.0);
+
+  return harness::finish("test_pipeline_stats");
+#else
+  (void) argv;
+  printf("%.3f\n", ring_buffer_cycles_per_block());
+  return 0;
+#endif
+}
@@ -0,0 +1,186 @@
+// Checks the fixed point PolyphaseResampler's accuracy against the floating point path it replaced, for the ratios it
+// takes over
+//  - THD+N: a -6 dBFS 1 kHz tone is converted, a sine of the known frequency is fitted to the output, and everything
+//    the fit doesn't explain (harmonics, aliases, and noise) is measured against the tone
+//  - Passband: tones at fractions of the lower Nyquist frequency are converted, and the fitted amplitude gives the gain
+//  - Stopband, when decimating: a tone between the two Nyquist frequencies must be rejected instead of aliasing
+//  - Both run the BALANCED profile's settings: 32 taps per phase and a 0.9 cutoff for the polyphase resampler, and 32
+//    taps and filters with the biquads for the floating point path (harness/float_resampler.h)
+
+#include "harness.h"
+#include "float_resampler.h"
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace esphome::nabu;
+
+static const double AMPLITUDE = 16384.0;  // -6 dBFS
+static const double THDN_FREQUENCY = 1000.0;
+static const size_t INPUT_SECONDS = 1;
+// Output frames left out of each fit at either end, where the filters are filling or the input ran out
+static const size_t EDGE_FRAMES = 1000;
+
+// The limits the polyphase resampler must meet
+static const double MAX_THDN_DB = -75.0;
+// The Q15 coefficients put a floor near -90 dB under the THD+N, so where the floating point path is cleaner still, the
+// polyphase resampler may trail it by this much
+static const double THDN_MARGIN_DB = 6.0;
+static const double MAX_PASSBAND_DEVIATION_DB = 0.01;  // Up to PASSBAND_CHECKED_FRACTION
+static const double PASSBAND_CHECKED_FRACTION = 0.35;
+static const double MIN_STOPBAND_REJECTION_DB = 70.0;
+
+static const double PASSBAND_FRACTIONS[] = {0.05, 0.1, 0.2, 0.3, 0.35, 0.4};
+
+struct Ratio {
+  uint32_t input_sample_rate;
+  uint32_t output_sample_rate;
+};
+
+static const Ratio RATIOS[] = {
+    {16000, 48000}, {24000, 48000}, {22050, 48000}, {44100, 48000}, {32000, 48000},
+    {48000, 44100}, {48000, 32000}, {48000, 16000}, {44100, 16000},
+};
+
+struct SineFit {
+  double amplitude;
+  double residual_rms;
+};
+
+/// @brief Least squares fit of a sine of a known frequency plus DC to the middle of a mono signal
+static SineFit fit_sine(const std::vector<int16_t> &samples, double frequency_ratio) {
+  const size_t first = EDGE_FRAMES;
+  const size_t last = samples.size() - EDGE_FRAMES;
+  // Normal equations for the sin, cos, and DC terms
+  double a[3][3] = {}, b[3] = {};
+  for (size_t i = first; i < last; ++i) {
+    const double basis[3] = {std::sin(2 * M_PI * frequency_ratio * i), std::cos(2 * M_PI * frequency_ratio * i), 1.0};
+    for (int row = 0; row < 3; ++row) {
+      for (int column = 0; column < 3; ++column) {
+        a[row][column] += basis[row] * basis[column];
+      }
+      b[row] += basis[row] * samples[i];
+    }
+  }
+  // Gaussian elimination; the system is small and well conditioned
+  for (int pivot = 0; pivot < 3; ++pivot) {
+    for (int row = pivot + 1; row < 3; ++row) {
+      const double factor = a[row][pivot] / a[pivot][pivot];
+      for (int column = pivot; column < 3; ++column) {
+        a[row][column] -= factor * a[pivot][column];
+      }
+      b[row] -= factor * b[pivot];
+    }
+  }
+  double x[3];
+  for (int row = 2; row >= 0; --row) {
+    x[row] = b[row];
+    for (int column = row + 1; column < 3; ++column) {
+      x[row] -= a[row][column] * x[column];
+    }
+    x[row] /= a[row][row];
+  }
+
+  double residual = 0.0;
+  for (size_t i = first; i < last; ++i) {
+    const double fitted =
+        x[0] * std::sin(2 * M_PI * frequency_ratio * i) + x[1] * std::cos(2 * M_PI * frequency_ratio * i) + x[2];
+    residual += (samples[i] - fitted) * (samples[i] - fitted);
+  }
+  return {std::hypot(x[0], x[1]), std::sqrt(residual / (last - first))};
+}
+
+static std::vector<int16_t> run_polyphase(const Ratio &ratio, const std::vector<int16_t> &input) {
+  PolyphaseResampler resampler;
+  CHECK_EQ(resampler.start(ratio.input_sample_rate, ratio.output_sample_rate, 1, 1), ESP_OK);
+  std::vector<int16_t> output(input.size() * ratio.output_sample_rate / ratio.input_sample_rate + 16);
+  size_t frames_used = 0;
+  output.resize(resampler.process(input.data(), input.size(), output.data(), output.size(), frames_used));
+  CHECK_EQ(frames_used, input.size());
+  return output;
+}
+
+static std::vector<int16_t> run_float(const Ratio &ratio, const std::vector<int16_t> &input) {
+  harness::FloatResampler resampler(ratio.input_sample_rate, ratio.output_sample_rate, 1, 1);
+  std::vector<int16_t> output;
+  resampler.process(input.data(), input.size(), output);
+  return output;
+}
+
+static double to_db(double ratio) { return 20.0 * std::log10(ratio); }
+
+template<typename Run> static double thdn_db(const Ratio &ratio, Run run) {
+  const std::vector<int16_t> input = harness::make_sine(ratio.input_sample_rate * INPUT_SECONDS, 1,
+                                                        THDN_FREQUENCY / ratio.input_sample_rate, AMPLITUDE, 0.0);
+  const SineFit fit = fit_sine(run(ratio, input), THDN_FREQUENCY / ratio.output_sample_rate);
+  return to_db(fit.residual_rms / (fit.amplitude / std::sqrt(2.0)));
+}
+
+/// @return the gain in dB of a tone at a fraction of the lower Nyquist frequency
+template<typename Run> static double gain_db(const Ratio &ratio, double fraction, Run run) {
+  const double frequency = fraction * std::min(ratio.input_sample_rate, ratio.output_sample_rate) / 2.0;
+  const std::vector<int16_t> input = harness::make_sine(ratio.input_sample_rate * INPUT_SECONDS, 1,
+                                                        frequency / ratio.input_sample_rate, AMPLITUDE, 0.0);
+  return to_db(fit_sine(run(ratio, input), frequency / ratio.output_sample_rate).amplitude / AMPLITUDE);
+}
+
+/// @brief A tone above the output's Nyquist frequency: 1.3 times it, or halfway to the input's if that is closer
+static double stopband_frequency(const Ratio &ratio) {
+  return std::min(1.3 * ratio.output_sample_rate / 2.0, (ratio.output_sample_rate + ratio.input_sample_rate) / 4.0);
+}
+
+/// @return how far below the input a tone in the stopband ends up, in dB
+template<typename Run> static double rejection_db(const Ratio &ratio, Run run) {
+  const double frequency = stopband_frequency(ratio);
+  const std::vector<int16_t> input = harness::make_sine(ratio.input_sample_rate * INPUT_SECONDS, 1,
+                                                        frequency / ratio.input_sample_rate, AMPLITUDE, 0.0);
+  const std::vector<int16_t> output = run(ratio, input);
+  double power = 0.0;
+  for (size_t i = EDGE_FRAMES; i < output.size() - EDGE_FRAMES; ++i) {
+    power += static_cast<double>(output[i]) * output[i];
+  }
+  return -to_db(std::sqrt(power / (output.size() - 2 * EDGE_FRAMES)) / (AMPLITUDE / std::sqrt(2.0)));
+}
+
+int main() {
+  for (const Ratio &ratio : RATIOS) {
+    const double polyphase_thdn = thdn_db(ratio, run_polyphase);
+    const double float_thdn = thdn_db(ratio, run_float);
+
+    double polyphase_deviation = 0.0, float_deviation = 0.0;
+    char gains[256];
+    int length = 0;
+    for (double fraction : PASSBAND_FRACTIONS) {
+      const double polyphase_gain = gain_db(ratio, fraction, run_polyphase);
+      const double float_gain = gain_db(ratio, fraction, run_float);
+      if (fraction <= PASSBAND_CHECKED_FRACTION) {
+        polyphase_deviation = std::max(polyphase_deviation, std::abs(polyphase_gain));
+        float_deviation = std::max(float_deviation, std::abs(float_gain));
+      }
+      length += snprintf(gains + length, sizeof(gains) - length, " %.2f: %+.3f/%+.3f", fraction, polyphase_gain,
+                         float_gain);
+    }
+
+    printf("test_polyphase_resampler: %5u -> %5u Hz: THD+N %6.1f dB (float %6.1f dB); gain at fractions of Nyquist, "
+           "polyphase/float:%s\n",
+           ratio.input_sample_rate, ratio.output_sample_rate, polyphase_thdn, float_thdn, gains);
+
+    CHECK(polyphase_thdn <= MAX_THDN_DB);
+    CHECK(polyphase_thdn <= float_thdn + THDN_MARGIN_DB);
+    CHECK(polyphase_deviation <= MAX_PASSBAND_DEVIATION_DB);
+    CHECK(polyphase_deviation <= float_deviation + MAX_PASSBAND_DEVIATION_DB);
+
+    if (ratio.output_sample_rate < ratio.input_sample_rate) {
+      const double polyphase_rejection = rejection_db(ratio, run_polyphase);
+      const double float_rejection = rejection_db(ratio, run_float);
+      printf("test_polyphase_resampler: %5u -> %5u Hz: %.0f Hz tone rejected by %.1f dB (float %.1f dB)\n",
+             ratio.input_sample_rate, ratio.output_sample_rate, stopband_frequency(ratio), polyphase_rejection,
+             float_rejection);
+      CHECK(polyphase_rejection >= MIN_STOPBAND_REJECTION_DB);
+    }
+  }
+
+  return harness::finish("test_polyphase_resampler");
+}
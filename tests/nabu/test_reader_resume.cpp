@@ -0,0 +1,168 @@
+// Reads a file from an HTTP server that keeps dropping the connection partway through, by closing or by resetting it,
+// and checks that the reader resumes each time with a range request from the last byte it committed: the ring buffer
+// receives the file byte for byte. A server that ignores range requests must make the reader fail rather than repeat
+// the start of the file.
+
+#include "harness.h"
+
+#include "audio_reader.h"
+#include "audio_ring_buffer.h"
+
+#include <esp_http_client.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const char *SERVER_SCRIPT = "harness/flaky_http_server.py";
+static const size_t FILE_SIZE = 512 * 1024;
+static const size_t RING_BUFFER_SIZE = 64 * 1024;
+static const size_t TRANSFER_SIZE = 8 * 1024;
+// Average number of bytes the server sends before dropping a connection
+static const size_t MEAN_BYTES_PER_CONNECTION = 24 * 1024;
+static const int SEEDS[] = {1, 2, 3};
+
+struct Server {
+  FILE *output{nullptr};
+  int port{0};
+};
+
+static Server start_server(const std::string &path, int seed, bool no_ranges) {
+  Server server;
+  std::string command = "exec python3 " + std::string(SERVER_SCRIPT) + " " + path + " --seed " +
+                        std::to_string(seed) + " --mean-bytes " + std::to_string(MEAN_BYTES_PER_CONNECTION) +
+                        (no_ranges ? " --no-ranges" : "");
+  server.output = popen(command.c_str(), "r");
+  if ((server.output == nullptr) || (fscanf(server.output, "%d", &server.port) != 1)) {
+    server.port = 0;
+  }
+  return server;
+}
+
+/// @brief Stops the server
+/// @return its summary line
+static std::string stop_server(Server &server) {
+  if (server.port != 0) {
+    esp_http_client_config_t config = {};
+    std::string url = "http://127.0.0.1:" + std::to_string(server.port) + "/quit";
+    config.url = url.c_str();
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (esp_http_client_open(client, 0) == ESP_OK) {
+      esp_http_client_fetch_headers(client);
+    }
+    esp_http_client_cleanup(client);
+  }
+
+  std::string summary;
+  if (server.output != nullptr) {
+    char line[256];
+    while (fgets(line, sizeof(line), server.output) != nullptr) {
+      summary += line;
+    }
+    pclose(server.output);
+  }
+  while (!summary.empty() && ((summary.back() == '\n') || (summary.front() == '\n'))) {
+    summary.erase((summary.back() == '\n') ? summary.size() - 1 : 0, 1);
+  }
+  return summary;
+}
+
+/// @brief Reads the server's file through an AudioReader, draining its ring buffer as it goes
+/// @param received (output) the bytes that reached the ring buffer
+/// @return the reader's final state
+static AudioReaderState read_all(int port, std::vector<uint8_t> &received) {
+  auto ring_buffer = AudioRingBuffer::create(RING_BUFFER_SIZE);
+  AudioReader reader(ring_buffer.get(), TRANSFER_SIZE);
+
+  media_player::MediaFileType file_type;
+  std::string url = "http://127.0.0.1:" + std::to_string(port) + "/track.flac";
+  if (reader.start(url, file_type) != ESP_OK) {
+    return AudioReaderState::FAILED;
+  }
+
+  std::vector<uint8_t> buffer(RING_BUFFER_SIZE);
+  AudioReaderState state = AudioReaderState::READING;
+  while (state == AudioReaderState::READING) {
+    state = reader.read();
+    size_t bytes_read = ring_buffer->read(buffer.data(), buffer.size(), 0);
+    received.insert(received.end(), buffer.begin(), buffer.begin() + bytes_read);
+  }
+  size_t bytes_read;
+  while ((bytes_read = ring_buffer->read(buffer.data(), buffer.size(), 0)) > 0) {
+    received.insert(received.end(), buffer.begin(), buffer.begin() + bytes_read);
+  }
+  return state;
+}
+
+static size_t first_difference(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  size_t i = 0;
+  while ((i < a.size()) && (i < b.size()) && (a[i] == b[i])) {
+    ++i;
+  }
+  return i;
+}
+
+int main() {
+  // Random bytes, so a repeated or skipped range can't match by chance
+  std::vector<uint8_t> file(FILE_SIZE);
+  std::mt19937 random(0);
+  for (auto &byte : file) {
+    byte = random() & 0xFF;
+  }
+  char path[] = "/tmp/nabu_reader_resume_XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  FILE *source = fdopen(fd, "wb");
+  fwrite(file.data(), 1, file.size(), source);
+  fclose(source);
+
+  for (int seed : SEEDS) {
+    Server server = start_server(path, seed, false);
+    CHECK(server.port != 0);
+    if (server.port == 0) {
+      stop_server(server);
+      continue;
+    }
+
+    std::vector<uint8_t> received;
+    AudioReaderState state = read_all(server.port, received);
+    std::string summary = stop_server(server);
+
+    printf("test_reader_resume: seed %d: %zu of %zu bytes, first difference at %zu; server %s\n", seed,
+           received.size(), file.size(), first_difference(received, file), summary.c_str());
+    CHECK(state == AudioReaderState::FINISHED);
+    CHECK_EQ(received.size(), file.size());
+    CHECK(received == file);
+
+    // Make sure the connection was actually dropped both ways
+    unsigned requests = 0, ranges = 0, closes = 0, resets = 0;
+    CHECK_EQ(sscanf(summary.c_str(), "requests %u ranges %u closes %u resets %u", &requests, &ranges, &closes, &resets),
+             4);
+    CHECK(ranges > 0);
+    CHECK(closes > 0);
+    CHECK(resets > 0);
+  }
+
+  // Without range support, resuming would repeat the start of the file, so the reader has to give up
+  Server server = start_server(path, SEEDS[0], true);
+  CHECK(server.port != 0);
+  if (server.port != 0) {
+    std::vector<uint8_t> received;
+    AudioReaderState state = read_all(server.port, received);
+    std::string summary = stop_server(server);
+    printf("test_reader_resume: no range support: %zu of %zu bytes, first difference at %zu; server %s\n",
+           received.size(), file.size(), first_difference(received, file), summary.c_str());
+    CHECK(state == AudioReaderState::FAILED);
+    CHECK(received.size() < file.size());
+    CHECK_EQ(first_difference(received, file), received.size());
+  } else {
+    stop_server(server);
+  }
+
+  remove(path);
+  return harness::finish("test_reader_resume");
+}
@@ -0,0 +1,276 @@
+// Checks that the reference tap's timestamps line its samples up with the output, which guards the ``reference_frame``
+// arithmetic in AudioReferenceTap::write
+//  - Pulses are placed at known output frames. Each is a short Hann pulse, narrow enough to locate to a fraction of a
+//    frame, yet band limited well below the reference's Nyquist frequency, so its centroid survives the decimation.
+//  - Every reference sample is mapped back to an output frame with the timestamp of the block it was written in. The
+//    alignment error is the distance between a pulse's centroid in the mapped reference and the frame it was placed at.
+//  - The tap on its own: written in random byte counts that split frames, at 16, 32, and 48 kHz, mono and stereo, with
+//    a consumer that stalls so whole blocks are dropped. Pulses whose samples straddle a drop are skipped.
+//  - The loopback stand-in: the mixer plays the pulses to a speaker that records them, and the recording takes the
+//    place of a microphone loopback. The pulses are found in the recording, not assumed, and the reference is mapped
+//    onto them.
+
+#include "harness.h"
+#include "capture_speaker.h"
+
+#include "audio_mixer.h"
+#include "audio_reference_tap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+static const size_t PULSE_FRAMES_PER_KHZ = 2;  // A 2 ms pulse, whose spectrum is well inside the 6.5 kHz passband
+static const int16_t PULSE_AMPLITUDE = 12000;
+static const uint32_t PULSE_SPACING_MS = 40;
+static const uint32_t SECONDS = 2;
+static const uint32_t REFERENCE_BUFFER_MS = 200;
+// A tenth of an output frame; a mistake in the timestamp arithmetic is off by at least a whole frame
+static const double MAX_ALIGNMENT_ERROR_FRAMES = 0.1;
+
+struct Pulses {
+  std::vector<int16_t> samples;
+  std::vector<size_t> centers;  // Output frame each pulse is centered on
+};
+
+/// @brief Pulses at jittered frames, so they land on every phase of the decimation; the right channel is half as loud
+static Pulses make_pulses(uint32_t sample_rate, uint8_t channels, size_t frames, uint32_t seed) {
+  Pulses pulses;
+  pulses.samples.assign(frames * channels, 0);
+  const size_t half_width = PULSE_FRAMES_PER_KHZ * sample_rate / 1000 / 2;
+  const size_t spacing = sample_rate / 1000 * PULSE_SPACING_MS;
+  std::mt19937 random(seed);
+  for (size_t center = spacing; center + spacing < frames; center += spacing + random() % 97) {
+    for (size_t i = 0; i <= 2 * half_width; ++i) {
+      const double window = 0.5 - 0.5 * std::cos(M_PI * i / half_width);
+      const size_t frame = center - half_width + i;
+      const int16_t sample = static_cast<int16_t>(std::lrint(PULSE_AMPLITUDE * window));
+      pulses.samples[frame * channels] = sample;
+      if (channels == 2) {
+        pulses.samples[frame * channels + 1] = sample / 2;
+      }
+    }
+    pulses.centers.push_back(center);
+  }
+  return pulses;
+}
+
+// Reference samples with the output frame each is centered on; a gap in the frames is where blocks were dropped
+struct MappedReference {
+  std::vector<int16_t> samples;
+  std::vector<double> frames;
+};
+
+/// @brief Maps a reference sample to an output frame with a timestamp from the block it was written in
+static double map_to_frame(const ReferenceTimestamp &timestamp, uint64_t sample, uint32_t decimation) {
+  return static_cast<double>(timestamp.reference_frame) +
+         static_cast<double>(static_cast<int64_t>(sample - timestamp.reference_sample)) * decimation;
+}
+
+struct Alignment {
+  size_t found{0};
+  size_t skipped{0};
+  double max_error{0.0};
+};
+
+/// @brief Finds each pulse's centroid in the mapped reference and measures its distance from where it was placed
+static Alignment measure_alignment(const MappedReference &reference, const std::vector<double> &centers,
+                                   uint32_t sample_rate, uint32_t decimation) {
+  Alignment alignment;
+  // Covers the pulse and the spread of the tap's filter
+  const double reach = PULSE_FRAMES_PER_KHZ * sample_rate / 1000 / 2 + 16.0 * decimation;
+  size_t first = 0;
+  for (double center : centers) {
+    while ((first < reference.frames.size()) && (reference.frames[first] < center - reach)) {
+      ++first;
+    }
+    size_t last = first;
+    bool contiguous = true;
+    double weighted = 0.0, total = 0.0;
+    while ((last < reference.frames.size()) && (reference.frames[last] <= center + reach)) {
+      if ((last > first) && (reference.frames[last] - reference.frames[last - 1] != decimation)) {
+        contiguous = false;
+      }
+      weighted += reference.frames[last] * reference.samples[last];
+      total += reference.samples[last];
+      ++last;
+    }
+    // The whole pulse has to be there, with no drop in the middle of it or at either end
+    const bool complete = (last > first) && (first > 0) &&
+                          (reference.frames[first] - reference.frames[first - 1] == decimation) &&
+                          (last < reference.frames.size()) &&
+                          (reference.frames[last] - reference.frames[last - 1] == decimation) && contiguous;
+    if (!complete || (total <= 0.0)) {
+      ++alignment.skipped;
+      continue;
+    }
+    ++alignment.found;
+    alignment.max_error = std::max(alignment.max_error, std::abs(weighted / total - center));
+  }
+  return alignment;
+}
+
+static void check_tap(uint32_t sample_rate, uint8_t channels, bool stall, uint32_t seed) {
+  std::unique_ptr<AudioReferenceTap> tap = AudioReferenceTap::create(sample_rate, channels, REFERENCE_BUFFER_MS);
+  CHECK(tap != nullptr);
+  if (tap == nullptr) {
+    return;
+  }
+  const uint32_t decimation = tap->get_decimation();
+  const size_t frames = sample_rate * SECONDS;
+  const Pulses pulses = make_pulses(sample_rate, channels, frames, seed);
+
+  std::mt19937 random(seed);
+  MappedReference reference;
+  std::vector<int16_t> chunk(REFERENCE_BUFFER_MS * REFERENCE_SAMPLE_RATE / 1000);
+  // Timestamps of the blocks whose samples haven't all been read yet
+  std::vector<ReferenceTimestamp> timestamps;
+  uint64_t read_samples = 0;
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(pulses.samples.data());
+  const size_t bytes = pulses.samples.size() * sizeof(int16_t);
+  for (size_t offset = 0; offset < bytes;) {
+    // Odd counts split samples as well as frames
+    const size_t length = std::min<size_t>(1 + random() % 3000, bytes - offset);
+    tap->write(reinterpret_cast<const int16_t *>(data + offset), length);
+    offset += length;
+
+    ReferenceTimestamp timestamp;
+    if (tap->get_timestamp(timestamp) &&
+        (timestamps.empty() || (timestamp.reference_sample != timestamps.back().reference_sample))) {
+      timestamps.push_back(timestamp);
+    }
+
+    // The consumer stalls for the second quarter of the output, long enough to overflow the ring buffer
+    if (stall && (offset > bytes / 4) && (offset < bytes / 2)) {
+      continue;
+    }
+    const size_t read = tap->get_ring_buffer()->read(chunk.data(), chunk.size() * sizeof(int16_t), 0);
+    for (size_t i = 0; i < read / sizeof(int16_t); ++i, ++read_samples) {
+      while ((timestamps.size() > 1) && (timestamps[1].reference_sample <= read_samples)) {
+        timestamps.erase(timestamps.begin());
+      }
+      reference.samples.push_back(chunk[i]);
+      reference.frames.push_back(map_to_frame(timestamps.front(), read_samples, decimation));
+    }
+  }
+
+  const std::vector<double> centers(pulses.centers.begin(), pulses.centers.end());
+  const Alignment alignment = measure_alignment(reference, centers, sample_rate, decimation);
+  printf("test_reference_tap: %u Hz %s%s: %zu of %zu pulses found, %u samples dropped, largest error %.3f frames\n",
+         sample_rate, (channels == 1) ? "mono" : "stereo", stall ? " with a stalled consumer" : "", alignment.found,
+         centers.size(), tap->get_dropped_samples(), alignment.max_error);
+
+  CHECK_EQ(tap->get_dropped_samples() > 0, stall);
+  // Only the pulses in and around the stall may be missing
+  CHECK(alignment.found + (stall ? centers.size() / 4 + 2 : 1) >= centers.size());
+  CHECK(alignment.max_error <= MAX_ALIGNMENT_ERROR_FRAMES);
+}
+
+/// @brief Centroids of the pulses in what the speaker played, with the same reach as the reference's
+static std::vector<double> find_played_pulses(const std::vector<int16_t> &samples, uint8_t channels) {
+  std::vector<double> centers;
+  const size_t frames = samples.size() / channels;
+  size_t frame = 0;
+  while (frame < frames) {
+    if (samples[frame * channels] == 0) {
+      ++frame;
+      continue;
+    }
+    double weighted = 0.0, total = 0.0;
+    for (; (frame < frames) && (samples[frame * channels] != 0); ++frame) {
+      double mono = samples[frame * channels];
+      if (channels == 2) {
+        mono = (mono + samples[frame * channels + 1]) / 2.0;
+      }
+      weighted += frame * mono;
+      total += mono;
+    }
+    centers.push_back(weighted / total);
+  }
+  return centers;
+}
+
+static void check_loopback(uint32_t sample_rate, uint8_t channels) {
+  const size_t frames = sample_rate * SECONDS;
+  const Pulses pulses = make_pulses(sample_rate, channels, frames, sample_rate + channels);
+
+  // Holds the whole run, so nothing is dropped and the last timestamp maps every sample
+  std::unique_ptr<AudioReferenceTap> tap =
+      AudioReferenceTap::create(sample_rate, channels, SECONDS * 1000 + REFERENCE_BUFFER_MS);
+  CHECK(tap != nullptr);
+  if (tap == nullptr) {
+    return;
+  }
+
+  // A mono mix is duplicated to stereo for the speaker, while the tap gets it before the duplication
+  harness::CaptureSpeaker speaker(sample_rate, 2);
+  std::unique_ptr<AudioMixer> mixer(new AudioMixer());
+  mixer->set_sample_rate(sample_rate);
+  mixer->set_channels(channels);
+  mixer->set_stereo_output(true);
+  mixer->set_reference_tap(tap.get());
+  MixerInputSettings settings;
+  uint8_t input;
+  CHECK_EQ(mixer->add_input(settings, input), ESP_OK);
+  CHECK_EQ(mixer->start(&speaker, "mixer"), ESP_OK);
+
+  // Fed in small pieces while the mixer runs, so the output is made of many blocks of different sizes
+  AudioRingBuffer *ring_buffer = mixer->get_input_ring_buffer(input);
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(pulses.samples.data());
+  const size_t bytes = pulses.samples.size() * sizeof(int16_t);
+  std::mt19937 random(sample_rate);
+  for (size_t offset = 0; offset < bytes;) {
+    const size_t length = std::min<size_t>((1 + random() % 600) * channels * sizeof(int16_t), bytes - offset);
+    offset += ring_buffer->write(data + offset, length, pdMS_TO_TICKS(1000));
+  }
+  for (int i = 0; (i < 500) && (speaker.samples().size() < frames * 2); ++i) {
+    delay(10);
+  }
+  delay(50);
+
+  CommandEvent command;
+  command.command = CommandEventType::STOP;
+  mixer->send_command(&command);
+  delay(50);
+  mixer->stop();
+
+  const std::vector<double> played = find_played_pulses(speaker.samples(), 2);
+  CHECK_EQ(played.size(), pulses.centers.size());
+
+  ReferenceTimestamp timestamp;
+  CHECK(tap->get_timestamp(timestamp));
+  CHECK_EQ(tap->get_dropped_samples(), 0u);
+  MappedReference reference;
+  reference.samples.resize(tap->get_ring_buffer()->available() / sizeof(int16_t));
+  tap->get_ring_buffer()->read(reference.samples.data(), reference.samples.size() * sizeof(int16_t), 0);
+  for (size_t i = 0; i < reference.samples.size(); ++i) {
+    reference.frames.push_back(map_to_frame(timestamp, i, tap->get_decimation()));
+  }
+
+  const Alignment alignment = measure_alignment(reference, played, sample_rate, tap->get_decimation());
+  printf("test_reference_tap: loopback through the mixer at %u Hz %s: %zu of %zu pulses found, largest error %.3f "
+         "frames (%.2f us)\n",
+         sample_rate, (channels == 1) ? "mono" : "stereo", alignment.found, played.size(), alignment.max_error,
+         alignment.max_error * 1e6 / sample_rate);
+  CHECK_EQ(alignment.found, played.size());
+  CHECK(alignment.max_error <= MAX_ALIGNMENT_ERROR_FRAMES);
+}
+
+int main() {
+  uint32_t seed = 1;
+  for (uint32_t sample_rate : {16000u, 32000u, 48000u}) {
+    for (uint8_t channels : {1, 2}) {
+      check_tap(sample_rate, channels, false, seed++);
+      check_tap(sample_rate, channels, true, seed++);
+    }
+  }
+
+  check_loopback(48000, 2);
+  check_loopback(16000, 1);
+
+  return harness::finish("test_reference_tap");
+}
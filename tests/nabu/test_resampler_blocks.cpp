@@ -0,0 +1,142 @@
+// Checks that AudioResampler's floating point path, which converts, filters, and resamples in small cached blocks,
+// gives the output the old stage by stage passes over whole calls did
+//  - The old path is harness::FloatResampler with blocks the size of the media pipeline's old float buffers
+//    (BUFFER_SIZE_SAMPLES); the new one is AudioResampler itself, between ring buffers
+//  - The input is written and the output read in random amounts between calls, so AudioResampler's calls, and the
+//    blocks within them, start and end at arbitrary frames
+//  - Ratios the fixed point PolyphaseResampler doesn't support, so the floating point path runs, with every channel
+//    conversion
+
+#include "harness.h"
+#include "float_resampler.h"
+
+#include "audio_resampler.h"
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+using namespace esphome;
+using namespace esphome::nabu;
+
+// The media pipeline's resampler buffer, which sized the old float buffers
+static const size_t BUFFER_SIZE_SAMPLES = 32768;
+static const size_t INPUT_RING_BUFFER_BYTES = 16 * 1024;
+static const size_t OUTPUT_RING_BUFFER_BYTES = 32 * 1024;
+// The mixer input rings AudioResampler writes to have a guard, so a reserve near the wrap still returns a usable region
+static const size_t OUTPUT_RING_BUFFER_GUARD_BYTES = 2048;
+static const uint32_t INPUT_SECONDS = 2;
+// Both paths do the same float operations in the same order per sample, so they match exactly; the tolerance only
+// allows for a compiler evaluating an expression differently in the two copies
+static const int MAX_DIFFERENCE = 1;
+
+struct Conversion {
+  uint32_t input_sample_rate;
+  uint32_t output_sample_rate;
+  uint8_t input_channels;
+  uint8_t output_channels;
+};
+
+static const Conversion CONVERSIONS[] = {
+    {11025, 48000, 1, 1}, {11025, 48000, 1, 2}, {11025, 48000, 2, 2},
+    {11025, 48000, 2, 1}, {48000, 11025, 2, 2}, {48000, 11025, 2, 1},
+};
+
+/// @brief Two tones and noise, different in each channel
+static std::vector<int16_t> make_input(const Conversion &conversion) {
+  const size_t frames = conversion.input_sample_rate * INPUT_SECONDS;
+  std::vector<int16_t> input(frames * conversion.input_channels);
+  std::mt19937 random(conversion.input_sample_rate);
+  std::uniform_real_distribution<double> noise(-2000.0, 2000.0);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    for (uint8_t channel = 0; channel < conversion.input_channels; ++channel) {
+      const double t = static_cast<double>(frame) / conversion.input_sample_rate;
+      const double sample = 12000.0 * std::sin(2 * M_PI * (440.0 + 220.0 * channel) * t) +
+                            6000.0 * std::sin(2 * M_PI * 3000.0 * t) + noise(random);
+      input[frame * conversion.input_channels + channel] = static_cast<int16_t>(sample);
+    }
+  }
+  return input;
+}
+
+static std::vector<int16_t> run_audio_resampler(const Conversion &conversion, const std::vector<int16_t> &input) {
+  auto input_ring_buffer = AudioRingBuffer::create(INPUT_RING_BUFFER_BYTES);
+  auto output_ring_buffer = AudioRingBuffer::create(OUTPUT_RING_BUFFER_BYTES, OUTPUT_RING_BUFFER_GUARD_BYTES);
+  AudioResampler resampler(input_ring_buffer.get(), output_ring_buffer.get(), BUFFER_SIZE_SAMPLES);
+  resampler.set_ticks_to_wait(0);
+
+  audio::AudioStreamInfo stream_info{16, conversion.input_channels, conversion.input_sample_rate};
+  ResampleInfo resample_info;
+  CHECK_EQ(resampler.start(stream_info, conversion.output_sample_rate, conversion.output_channels, resample_info),
+           ESP_OK);
+  CHECK(resample_info.resample);
+
+  std::mt19937 random(conversion.output_sample_rate + conversion.output_channels);
+  std::vector<int16_t> output;
+  std::vector<int16_t> chunk(OUTPUT_RING_BUFFER_BYTES / sizeof(int16_t));
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(input.data());
+  const size_t bytes = input.size() * sizeof(int16_t);
+  size_t written = 0;
+  while (true) {
+    // Whole frames, like the decoder writes
+    const size_t frame_bytes = conversion.input_channels * sizeof(int16_t);
+    size_t length = std::min<size_t>((1 + random() % 2000) * frame_bytes, bytes - written);
+    length = std::min(length, input_ring_buffer->free() / frame_bytes * frame_bytes);
+    written += input_ring_buffer->write(data + written, length, 0);
+
+    resampler.resample(false);
+
+    // Whole frames, like the mixer reads
+    const size_t output_frame_bytes = conversion.output_channels * sizeof(int16_t);
+    const size_t read = output_ring_buffer->read(
+        chunk.data(), std::min<size_t>(random() % 5000, chunk.size() / conversion.output_channels) * output_frame_bytes,
+        0);
+    output.insert(output.end(), chunk.begin(), chunk.begin() + read / sizeof(int16_t));
+
+    if ((written == bytes) && (input_ring_buffer->available() == 0) && (resampler.get_bytes_moved() == 0)) {
+      break;
+    }
+  }
+  // Whatever is left
+  while (output_ring_buffer->available() > 0) {
+    const size_t read = output_ring_buffer->read(chunk.data(), chunk.size() * sizeof(int16_t), 0);
+    output.insert(output.end(), chunk.begin(), chunk.begin() + read / sizeof(int16_t));
+  }
+  return output;
+}
+
+int main() {
+  for (const Conversion &conversion : CONVERSIONS) {
+    const std::vector<int16_t> input = make_input(conversion);
+
+    const uint8_t resample_channels = std::min(conversion.input_channels, conversion.output_channels);
+    harness::FloatResampler old_path(conversion.input_sample_rate, conversion.output_sample_rate,
+                                     conversion.input_channels, conversion.output_channels,
+                                     BUFFER_SIZE_SAMPLES / resample_channels);
+    std::vector<int16_t> expected;
+    old_path.process(input.data(), input.size() / conversion.input_channels, expected);
+
+    const std::vector<int16_t> output = run_audio_resampler(conversion, input);
+
+    int largest = 0;
+    size_t different = 0;
+    const size_t samples = std::min(output.size(), expected.size());
+    for (size_t i = 0; i < samples; ++i) {
+      const int difference = std::abs(output[i] - expected[i]);
+      largest = std::max(largest, difference);
+      different += (difference > 0) ? 1 : 0;
+    }
+
+    printf("test_resampler_blocks: %5u Hz %u ch -> %5u Hz %u ch: %zu samples (old path %zu), %zu differ, largest "
+           "difference %d\n",
+           conversion.input_sample_rate, conversion.input_channels, conversion.output_sample_rate,
+           conversion.output_channels, output.size(), expected.size(), different, largest);
+
+    CHECK_EQ(output.size(), expected.size());
+    CHECK(largest <= MAX_DIFFERENCE);
+  }
+
+  return harness::finish("test_resampler_blocks");
+}